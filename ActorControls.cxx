@@ -0,0 +1,155 @@
+/*
+ * Keyboard-driven actors
+ */
+
+#include "ActorControls.h"
+
+#include <algorithm>
+
+const double ActorControls::TURN_RATE = 45;
+const double ActorControls::SPEED     = 10;
+
+namespace
+{
+struct KeyBinding
+{
+    const char            *keySym;
+    ActorControls::Action  action;
+};
+
+const KeyBinding BINDINGS[] = {
+    { "Left",  ActorControls::TURN_LEFT },
+    { "Right", ActorControls::TURN_RIGHT },
+    { "Up",    ActorControls::FORWARD },
+    { "Down",  ActorControls::BACKWARD },
+    { "Prior", ActorControls::ASCEND },
+    { "Next",  ActorControls::DESCEND }
+};
+}
+
+ActorControls::ActorControls()
+    : time(-1), applied(0), journal(NULL), focus(0)
+{
+}
+
+int ActorControls::AddActor(vtkActor *actor)
+{
+    Driven driven;
+    driven.actor = actor;
+    driven.held  = 0;
+    actors.push_back(driven);
+    return (int)actors.size() - 1;
+}
+
+void ActorControls::Submit(const Command &command)
+{
+    queue.Push(command);
+}
+
+bool ActorControls::HandleKey(const std::string &keySym, bool pressed, double when)
+{
+    if (actors.empty())
+        return false;
+    if (keySym == "Tab")
+    {
+        if (pressed)
+            focus = (focus + 1) % (int)actors.size();
+        return true;
+    }
+
+    const KeyBinding *binding = NULL;
+    for (size_t b = 0; b < sizeof(BINDINGS) / sizeof(BINDINGS[0]) && !binding; b++)
+        if (keySym == BINDINGS[b].keySym)
+            binding = &BINDINGS[b];
+    if (!binding)
+        return false;
+
+    /* Auto-repeat presses a held key again; it is already down */
+    std::map<std::string, int>::iterator key = pressedKeys.find(keySym);
+    Command command;
+    command.time    = when;
+    command.action  = binding->action;
+    command.pressed = pressed;
+    if (pressed)
+    {
+        if (key != pressedKeys.end())
+            return true;
+        command.actor = focus;
+        pressedKeys[keySym] = focus;
+    }
+    else
+    {
+        if (key == pressedKeys.end())
+            return true;
+        command.actor = key->second;
+        pressedKeys.erase(key);
+    }
+    Submit(command);
+    return true;
+}
+
+void ActorControls::Integrate(double dt)
+{
+    if (dt <= 0)
+        return;
+    double degrees  = TURN_RATE * dt;
+    double distance = SPEED * dt;
+    for (size_t i = 0; i < actors.size(); i++)
+    {
+        unsigned int held = actors[i].held;
+        if (!held)
+            continue;
+        vtkActor *actor = actors[i].actor;
+        if (held & (1u << TURN_LEFT))
+            actor->RotateY(degrees);
+        if (held & (1u << TURN_RIGHT))
+            actor->RotateY(-degrees);
+        if (held & (1u << ASCEND))
+            actor->AddPosition(0, distance, 0);
+        if (held & (1u << DESCEND))
+            actor->AddPosition(0, -distance, 0);
+        if (held & (1u << FORWARD))
+            actor->AddPosition(distance, 0, 0);
+        if (held & (1u << BACKWARD))
+            actor->AddPosition(-distance, 0, 0);
+    }
+}
+
+/* Turning and moving are independent, so each stretch between commands
+ * integrates exactly in one go */
+bool ActorControls::Update(double now)
+{
+    if (time < 0)
+        time = now;
+    while (const Command *command = queue.Front())
+    {
+        if (command->time > now)
+            break;
+        double at = std::max(command->time, time);
+        Integrate(at - time);
+        time = at;
+        if (command->actor >= 0 && command->actor < (int)actors.size() && command->action >= 0
+            && command->action < NUMBER_OF_ACTIONS)
+        {
+            unsigned int bit = 1u << command->action;
+            if (command->pressed)
+                actors[command->actor].held |= bit;
+            else
+                actors[command->actor].held &= ~bit;
+        }
+        if (journal)
+            journal->push_back(*command);
+        queue.Pop();
+        applied++;
+    }
+    if (now > time)
+    {
+        Integrate(now - time);
+        time = now;
+    }
+
+    for (size_t i = 0; i < actors.size(); i++)
+        if (actors[i].held)
+            return true;
+    return false;
+}
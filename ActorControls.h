@@ -0,0 +1,112 @@
+/*
+ * Keyboard-driven actors
+ *
+ * Key presses and releases become timestamped commands on a lock-free
+ * SpscQueue, pushed from the interactor's callbacks and applied by
+ * Update(), which runs with the rest of the scene's per-frame step. Each
+ * actor keeps the set of moves currently held; Update() replays the
+ * commands in order and integrates the held moves over the exact time
+ * between them, so an actor turns and travels at the same rate whatever
+ * the frame rate or key repeat, and a press and release inside one frame
+ * still move it for as long as the key was down. Commands stamped after
+ * the update's time stay queued for the next one.
+ *
+ * Any number of actors can be driven: the arrow keys and Page Up/Down
+ * steer the focused one, Tab moves the focus on, and a key released after
+ * the focus moved still lets go of the actor it pressed.
+ */
+
+#ifndef FISHTANK_ACTORCONTROLS_H
+#define FISHTANK_ACTORCONTROLS_H
+
+#include "SpscQueue.h"
+
+#include <vtkActor.h>
+#include <vtkSmartPointer.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+class ActorControls
+{
+    public:
+        enum Action
+        {
+            TURN_LEFT,
+            TURN_RIGHT,
+            ASCEND,
+            DESCEND,
+            FORWARD,
+            BACKWARD,
+            NUMBER_OF_ACTIONS
+        };
+
+        struct Command
+        {
+            double time;      /* FrameClock seconds */
+            int    actor;
+            int    action;
+            bool   pressed;
+        };
+
+        /* Degrees a second about the actor's y, and world units a second */
+        static const double TURN_RATE;
+        static const double SPEED;
+
+        ActorControls();
+
+        /* Returns the index commands use for it; the first added has the focus */
+        int AddActor(vtkActor *actor);
+        int GetNumberOfActors() const { return (int)actors.size(); }
+
+        /* Producer: queue a command; never blocks or drops it */
+        void Submit(const Command &command);
+
+        /* Producer: queue anything held back while the queue was full;
+         * Submit() does this too, so it is only needed when input stops */
+        void Flush() { queue.Flush(); }
+
+        /* Producer: turn a key event into commands for the focused actor;
+         * returns false for keys that aren't bound */
+        bool HandleKey(const std::string &keySym, bool pressed, double time);
+
+        /* Consumer: apply the commands up to now and move every actor by
+         * what it held since the last call; returns true while any move
+         * is still held */
+        bool Update(double now);
+
+        /* Consumer: append every command to journal as it is applied, for
+         * a recording; null stops */
+        void SetJournal(std::vector<Command> *commands) { journal = commands; }
+
+        /* Commands applied so far */
+        long long GetNumberOfCommands() const { return applied; }
+
+    private:
+        ActorControls(const ActorControls &);
+        ActorControls &operator=(const ActorControls &);
+
+        /* Move every actor by its held moves for dt seconds */
+        void Integrate(double dt);
+
+        struct Driven
+        {
+            vtkSmartPointer<vtkActor> actor;
+            unsigned int              held;   /* one bit per Action */
+        };
+
+        SpscQueue<Command> queue;
+
+        /* Consumer side */
+        std::vector<Driven>   actors;
+        double                time;     /* negative until the first Update() */
+        long long             applied;
+        std::vector<Command> *journal;
+
+        /* Producer side: the focused actor, and the actor each held key pressed */
+        int                        focus;
+        std::map<std::string, int> pressedKeys;
+};
+
+#endif
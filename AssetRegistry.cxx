@@ -0,0 +1,104 @@
+/*
+ * Shared meshes and materials
+ */
+
+#include "AssetRegistry.h"
+
+#include "MeshCache.h"
+#include "Profiler.h"
+
+#include <sstream>
+
+AssetRegistry::AssetRegistry(MeshLoader &meshLoader)
+    : loader(meshLoader)
+{
+}
+
+MeshLoader::MeshFuture AssetRegistry::GetMesh(const std::string &fileName)
+{
+    std::map<std::string, MeshLoader::MeshFuture>::iterator it = meshes.find(fileName);
+    if (it != meshes.end())
+        return it->second;
+    MeshLoader::MeshFuture mesh = loader.Load(fileName);
+    meshes[fileName] = mesh;
+    return mesh;
+}
+
+MeshLoader::MeshFuture AssetRegistry::Reload(const std::string &fileName)
+{
+    if (meshes.find(fileName) == meshes.end())
+        return MeshLoader::MeshFuture();
+    return loader.Reload(fileName);
+}
+
+void AssetRegistry::ReplaceMesh(const std::string &fileName, const MeshLoader::MeshFuture &mesh)
+{
+    meshes[fileName] = mesh;
+}
+
+void AssetRegistry::ApplyMaterial(const MaterialDescription &material, vtkProperty *prop)
+{
+    prop->SetDiffuseColor(material.diffuse[0], material.diffuse[1], material.diffuse[2]);
+
+    /* VTK clamps the ambient coefficient to 1 but not its colour, so
+     * the glow goes in the colour */
+    if (material.emissive > 0)
+    {
+        prop->SetAmbient(1.0);
+        prop->SetAmbientColor(material.diffuse[0] * material.emissive, material.diffuse[1] * material.emissive,
+                              material.diffuse[2] * material.emissive);
+    }
+    else
+    {
+        prop->SetAmbient(0.0);
+        prop->SetAmbientColor(1, 1, 1);
+    }
+}
+
+vtkProperty *AssetRegistry::GetMaterial(const MaterialDescription &material)
+{
+    vtkSmartPointer<vtkProperty> &prop = materials[material.name];
+    if (!prop)
+    {
+        prop = vtkSmartPointer<vtkProperty>::New();
+        ApplyMaterial(material, prop);
+    }
+    return prop;
+}
+
+bool AssetRegistry::UpdateMaterial(const MaterialDescription &material)
+{
+    std::map<std::string, vtkSmartPointer<vtkProperty> >::iterator it = materials.find(material.name);
+    if (it == materials.end())
+        return false;
+    ApplyMaterial(material, it->second);
+    return true;
+}
+
+std::shared_ptr<const CausticsAtlas> AssetRegistry::MakeCaustics(const CausticsAtlas::Parameters &parameters,
+                                                                 const std::string &cacheDirectory)
+{
+    ScopedTimer timer("caustics:build");
+    return MeshCache::ReadOrBuild<CausticsAtlas>(cacheDirectory, "caustics", "ftca",
+                                                 CausticsAtlas::ComputeKey(parameters),
+        [&](CausticsAtlas &atlas) { atlas.Build(parameters); },
+        [](const CausticsAtlas &atlas) {
+            std::ostringstream description;
+            description << atlas.GetNumberOfFrames() << " frames of " << atlas.GetSize() << "x" << atlas.GetSize();
+            return description.str();
+        });
+}
+
+AssetRegistry::CausticsFuture AssetRegistry::GetCaustics(const CausticsAtlas::Parameters &parameters)
+{
+    uint64_t key = CausticsAtlas::ComputeKey(parameters);
+    std::map<uint64_t, CausticsFuture>::iterator it = caustics.find(key);
+    if (it != caustics.end())
+        return it->second;
+    std::string cacheDirectory = loader.GetCacheDirectory();
+    CausticsFuture atlas = std::async(std::launch::async, [=]() {
+        return MakeCaustics(parameters, cacheDirectory);
+    }).share();
+    caustics[key] = atlas;
+    return atlas;
+}
@@ -0,0 +1,79 @@
+/*
+ * Shared meshes and materials
+ *
+ * Every mesh file is loaded once and every material becomes one
+ * vtkProperty, no matter how many instances use them; instances share the
+ * same vtkPolyData and vtkProperty objects.
+ *
+ * For hot reloading, a changed mesh file can be parsed afresh while the
+ * old mesh is still drawn, and a material edited in place, which every
+ * actor sharing its property picks up.
+ *
+ * Caustics atlases are shared the same way, one per set of parameters,
+ * each built on a thread of its own, or read back from the cache
+ * directory, from its first request.
+ */
+
+#ifndef FISHTANK_ASSETREGISTRY_H
+#define FISHTANK_ASSETREGISTRY_H
+
+#include "CausticsAtlas.h"
+#include "MeshLoader.h"
+#include "SceneDescription.h"
+
+#include <vtkProperty.h>
+#include <vtkSmartPointer.h>
+
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+
+class AssetRegistry
+{
+    public:
+        explicit AssetRegistry(MeshLoader &loader);
+
+        typedef std::shared_future<std::shared_ptr<const CausticsAtlas> > CausticsFuture;
+
+        /* Future for a mesh file, queueing the load on first request */
+        MeshLoader::MeshFuture GetMesh(const std::string &fileName);
+
+        /* The property for a material, created on first request */
+        vtkProperty *GetMaterial(const MaterialDescription &material);
+
+        /* Queue a fresh parse of a mesh file already requested; an invalid
+         * future for any other. GetMesh() keeps returning the old mesh
+         * until the new one is handed to ReplaceMesh(). */
+        MeshLoader::MeshFuture Reload(const std::string &fileName);
+        void ReplaceMesh(const std::string &fileName, const MeshLoader::MeshFuture &mesh);
+
+        /* Future for a caustics atlas, starting it on first request */
+        CausticsFuture GetCaustics(const CausticsAtlas::Parameters &parameters);
+
+        /* Set an existing material's property to the description; returns
+         * false when no material of that name has been requested */
+        bool UpdateMaterial(const MaterialDescription &material);
+
+        /* Where derived data such as distance fields may be kept; empty
+         * when the mesh cache is disabled */
+        std::string GetCacheDirectory() const { return loader.GetCacheDirectory(); }
+
+        size_t GetNumberOfMeshes() const { return meshes.size(); }
+        size_t GetNumberOfMaterials() const { return materials.size(); }
+
+    private:
+        static void ApplyMaterial(const MaterialDescription &material, vtkProperty *prop);
+
+        /* Runs on its own thread; reads the atlas from the cache or builds
+         * and caches it */
+        static std::shared_ptr<const CausticsAtlas> MakeCaustics(const CausticsAtlas::Parameters &parameters,
+                                                                 const std::string &cacheDirectory);
+
+        MeshLoader                                          &loader;
+        std::map<std::string, MeshLoader::MeshFuture>        meshes;
+        std::map<std::string, vtkSmartPointer<vtkProperty> > materials;
+        std::map<uint64_t, CausticsFuture>                   caustics;   /* by atlas key */
+};
+
+#endif
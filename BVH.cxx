@@ -0,0 +1,139 @@
+/*
+ * Bounding volume hierarchy
+ */
+
+#include "BVH.h"
+
+#include <algorithm>
+
+namespace
+{
+/* Orders items by their box centre along one axis */
+struct CentreLess
+{
+    const std::vector<double> *bounds;
+    int                        axis;
+
+    bool operator()(int a, int b) const
+    {
+        const std::vector<double> &box = *bounds;
+        return box[6 * a + 2 * axis] + box[6 * a + 2 * axis + 1] <
+               box[6 * b + 2 * axis] + box[6 * b + 2 * axis + 1];
+    }
+};
+}
+
+void BVH::Build(const std::vector<double> &itemBounds)
+{
+    int count = (int)(itemBounds.size() / 6);
+    nodes.clear();
+    leafOfItem.assign(count, -1);
+    if (count == 0)
+        return;
+
+    nodes.reserve(2 * count - 1);
+    std::vector<int> items(count);
+    for (int i = 0; i < count; i++)
+        items[i] = i;
+    BuildRange(items, 0, count, -1, itemBounds);
+}
+
+int BVH::BuildRange(std::vector<int> &items, int begin, int end, int parent,
+                    const std::vector<double> &itemBounds)
+{
+    int index = (int)nodes.size();
+    nodes.push_back(Node());
+    nodes[index].parent = parent;
+    nodes[index].count  = end - begin;
+
+    if (end - begin == 1)
+    {
+        int item = items[begin];
+        std::copy(&itemBounds[6 * item], &itemBounds[6 * item] + 6, nodes[index].bounds);
+        nodes[index].left = nodes[index].right = -1;
+        nodes[index].item = item;
+        leafOfItem[item]  = index;
+        return index;
+    }
+
+    /* Split at the median centre along the axis the centres spread most on */
+    double low[3], high[3];
+    for (int c = 0; c < 3; c++)
+    {
+        low[c]  = 1e300;
+        high[c] = -1e300;
+    }
+    for (int i = begin; i < end; i++)
+        for (int c = 0; c < 3; c++)
+        {
+            double centre = itemBounds[6 * items[i] + 2 * c] + itemBounds[6 * items[i] + 2 * c + 1];
+            low[c]  = std::min(low[c], centre);
+            high[c] = std::max(high[c], centre);
+        }
+    CentreLess less;
+    less.bounds = &itemBounds;
+    less.axis   = 0;
+    for (int c = 1; c < 3; c++)
+        if (high[c] - low[c] > high[less.axis] - low[less.axis])
+            less.axis = c;
+    int middle = begin + (end - begin) / 2;
+    std::nth_element(items.begin() + begin, items.begin() + middle, items.begin() + end, less);
+
+    int left  = BuildRange(items, begin, middle, index, itemBounds);
+    int right = BuildRange(items, middle, end, index, itemBounds);
+    nodes[index].left  = left;
+    nodes[index].right = right;
+    nodes[index].item  = -1;
+    Enclose(index);
+    return index;
+}
+
+bool BVH::Enclose(int index)
+{
+    Node &node = nodes[index];
+    const double *a = nodes[node.left].bounds;
+    const double *b = nodes[node.right].bounds;
+    double box[6];
+    for (int c = 0; c < 3; c++)
+    {
+        box[2 * c]     = std::min(a[2 * c], b[2 * c]);
+        box[2 * c + 1] = std::max(a[2 * c + 1], b[2 * c + 1]);
+    }
+    if (std::equal(box, box + 6, node.bounds))
+        return false;
+    std::copy(box, box + 6, node.bounds);
+    return true;
+}
+
+void BVH::Refit(int item, const double bounds[6])
+{
+    int index = leafOfItem[item];
+    std::copy(bounds, bounds + 6, nodes[index].bounds);
+    for (index = nodes[index].parent; index >= 0 && Enclose(index); index = nodes[index].parent)
+        ;
+}
+
+BVH::Containment BVH::TestFrustum(const double bounds[6], const double planes[24], int &planeMask)
+{
+    for (int i = 0; i < 6; i++)
+    {
+        if (!(planeMask & (1 << i)))
+            continue;
+        const double *plane = planes + 4 * i;
+
+        /* The corners furthest along and against the plane's normal */
+        double ahead = plane[3], behind = plane[3];
+        for (int c = 0; c < 3; c++)
+        {
+            double lo = plane[c] * bounds[2 * c];
+            double hi = plane[c] * bounds[2 * c + 1];
+            ahead  += std::max(lo, hi);
+            behind += std::min(lo, hi);
+        }
+        if (ahead < 0)
+            return OUTSIDE;
+        if (behind >= 0)
+            planeMask &= ~(1 << i);
+    }
+    return planeMask ? INTERSECTS : INSIDE;
+}
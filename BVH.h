@@ -0,0 +1,65 @@
+/*
+ * Bounding volume hierarchy
+ *
+ * A binary tree of axis-aligned boxes over a set of items, one item per
+ * leaf, built top-down by splitting at the median centroid along the
+ * widest axis. Moving items are handled by refitting: a leaf takes the
+ * item's new box and its ancestors grow or shrink to match, without
+ * changing the tree's shape. That stays cheap for objects that drift,
+ * though the tree gets looser the further they go; Build() again when
+ * items are added or removed.
+ *
+ * Bounds use VTK's order: xmin, xmax, ymin, ymax, zmin, zmax.
+ */
+
+#ifndef FISHTANK_BVH_H
+#define FISHTANK_BVH_H
+
+#include <vector>
+
+class BVH
+{
+    public:
+        struct Node
+        {
+            double bounds[6];
+            int    parent;   /* -1 at the root */
+            int    left;     /* -1 in a leaf */
+            int    right;
+            int    item;     /* -1 in an inner node */
+            int    count;    /* items beneath */
+        };
+
+        /* Results of TestFrustum() */
+        enum Containment { OUTSIDE, INTERSECTS, INSIDE };
+
+        /* One leaf per item, item i having bounds[6 * i .. 6 * i + 5] */
+        void Build(const std::vector<double> &itemBounds);
+
+        /* Give an item new bounds and refit the boxes above it */
+        void Refit(int item, const double bounds[6]);
+
+        int         GetRoot() const { return nodes.empty() ? -1 : 0; }
+        const Node &GetNode(int index) const { return nodes[index]; }
+        int         GetNumberOfNodes() const { return (int)nodes.size(); }
+        int         GetNumberOfItems() const { return (int)leafOfItem.size(); }
+        int         GetLeaf(int item) const { return leafOfItem[item]; }
+
+        /* Box against frustum planes a*x + b*y + c*z + d >= 0 inside, as
+         * vtkCamera::GetFrustumPlanes() gives them. planeMask has bit i set
+         * for each plane i still to be tested; planes the box lies wholly
+         * inside are cleared from it, so a box's children can skip them. */
+        static Containment TestFrustum(const double bounds[6], const double planes[24], int &planeMask);
+
+    private:
+        int BuildRange(std::vector<int> &items, int begin, int end, int parent,
+                       const std::vector<double> &itemBounds);
+
+        /* Recompute a node's box from its children; false when unchanged */
+        bool Enclose(int node);
+
+        std::vector<Node> nodes;
+        std::vector<int>  leafOfItem;
+};
+
+#endif
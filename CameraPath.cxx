@@ -0,0 +1,118 @@
+/*
+ * Scripted camera paths
+ */
+
+#include "CameraPath.h"
+
+#include "JSON.h"
+
+#include <sstream>
+
+namespace
+{
+bool ReadPoint(const JSONValue &value, double out[3])
+{
+    if (!value.IsArray() || value.Size() != 3)
+        return false;
+    for (int i = 0; i < 3; i++)
+    {
+        if (!value[i].IsNumber())
+            return false;
+        out[i] = value[i].AsNumber();
+    }
+    return true;
+}
+
+/* Uniform Catmull-Rom between b and c */
+double CatmullRom(double a, double b, double c, double d, double t)
+{
+    double t2 = t * t;
+    double t3 = t2 * t;
+    return 0.5 * (2 * b + (c - a) * t + (2 * a - 5 * b + 4 * c - d) * t2 + (3 * b - a - 3 * c + d) * t3);
+}
+}
+
+bool CameraPath::Load(const std::string &fileName, std::string &error)
+{
+    JSONValue root;
+    if (!JSONValue::ParseFile(fileName, root, error))
+        return false;
+
+    const JSONValue &list = root.Get("keys");
+    if (!list.IsArray() || list.Size() == 0)
+    {
+        error = fileName + ": 'keys' must be a non-empty list";
+        return false;
+    }
+
+    keys.clear();
+    for (size_t i = 0; i < list.Size(); i++)
+    {
+        const JSONValue &value = list[i];
+        std::ostringstream where;
+        where << fileName << ": key " << i;
+
+        Key key;
+        key.viewUp[0] = key.viewUp[2] = 0;
+        key.viewUp[1] = 1;
+        if (!value.Get("time").IsNumber())
+        {
+            error = where.str() + ": 'time' must be a number";
+            return false;
+        }
+        key.time = value.Get("time").AsNumber();
+        if (!keys.empty() && key.time <= keys.back().time)
+        {
+            error = where.str() + ": keys must be in increasing time order";
+            return false;
+        }
+        if (!ReadPoint(value.Get("position"), key.position) || !ReadPoint(value.Get("focalPoint"), key.focalPoint))
+        {
+            error = where.str() + ": 'position' and 'focalPoint' must be lists of three numbers";
+            return false;
+        }
+        if (value.Has("viewUp") && !ReadPoint(value.Get("viewUp"), key.viewUp))
+        {
+            error = where.str() + ": 'viewUp' must be a list of three numbers";
+            return false;
+        }
+        keys.push_back(key);
+    }
+    return true;
+}
+
+void CameraPath::Apply(double time, vtkCamera *camera) const
+{
+    if (keys.empty())
+        return;
+
+    /* The segment [k, k + 1] that holds time, with the end keys repeated */
+    size_t last = keys.size() - 1;
+    size_t k = 0;
+    while (k < last && keys[k + 1].time <= time)
+        k++;
+    if (k == last)
+    {
+        camera->SetPosition(keys[last].position);
+        camera->SetFocalPoint(keys[last].focalPoint);
+        camera->SetViewUp(keys[last].viewUp);
+        return;
+    }
+    const Key &a = keys[k > 0 ? k - 1 : 0];
+    const Key &b = keys[k];
+    const Key &c = keys[k + 1];
+    const Key &d = keys[k + 2 <= last ? k + 2 : last];
+    double t = time <= b.time ? 0 : (time - b.time) / (c.time - b.time);
+
+    double position[3], focalPoint[3], viewUp[3];
+    for (int i = 0; i < 3; i++)
+    {
+        position[i]   = CatmullRom(a.position[i], b.position[i], c.position[i], d.position[i], t);
+        focalPoint[i] = CatmullRom(a.focalPoint[i], b.focalPoint[i], c.focalPoint[i], d.focalPoint[i], t);
+        viewUp[i]     = b.viewUp[i] + (c.viewUp[i] - b.viewUp[i]) * t;
+    }
+    camera->SetPosition(position);
+    camera->SetFocalPoint(focalPoint);
+    camera->SetViewUp(viewUp);
+    camera->OrthogonalizeViewUp();
+}
@@ -0,0 +1,48 @@
+/*
+ * Scripted camera paths
+ *
+ * A camera path is a JSON document listing keyframes in time order:
+ *
+ *   { "keys": [ { "time": seconds, "position": [x, y, z],
+ *                 "focalPoint": [x, y, z],
+ *                 "viewUp": [x, y, z] } ] }      (optional, default +y)
+ *
+ * Between keys the camera position and focal point follow Catmull-Rom
+ * splines through the neighbouring keys, so the camera passes through
+ * every key without a jolt; before the first and after the last key it
+ * holds still.
+ */
+
+#ifndef FISHTANK_CAMERAPATH_H
+#define FISHTANK_CAMERAPATH_H
+
+#include <vtkCamera.h>
+
+#include <string>
+#include <vector>
+
+class CameraPath
+{
+    public:
+        struct Key
+        {
+            double time;
+            double position[3];
+            double focalPoint[3];
+            double viewUp[3];
+        };
+
+        /* Read a path file; on failure returns false and fills error */
+        bool Load(const std::string &fileName, std::string &error);
+
+        /* Time of the last key */
+        double GetDuration() const { return keys.empty() ? 0 : keys.back().time; }
+
+        /* Pose the camera as the path has it at the given time */
+        void Apply(double time, vtkCamera *camera) const;
+
+    private:
+        std::vector<Key> keys;
+};
+
+#endif
@@ -0,0 +1,224 @@
+/*
+ * Caustics atlas
+ */
+
+#include "CausticsAtlas.h"
+
+#include "MeshCache.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <future>
+
+const float CausticsAtlas::INTENSITY_SCALE = 4.0f;
+
+namespace
+{
+const char     ATLAS_MAGIC[4] = { 'F', 'T', 'C', 'A' };
+const uint32_t ATLAS_VERSION  = 1;
+
+const float TWO_PI = 6.2831853f;
+
+/* Rays per texel along each axis */
+const int OVERSAMPLE = 2;
+
+/* On-disk layout: this header, then the frames' bytes in order */
+struct AtlasHeader
+{
+    char     magic[4];
+    uint32_t version;
+    uint64_t key;
+    int32_t  size;
+    int32_t  frames;
+};
+
+/* One wave of the surface: whole cycles across the tile and over the loop */
+struct Wave
+{
+    float kx;
+    float ky;
+    float cycles;
+    float phase;
+    float amplitude;
+};
+
+/* xorshift, so the waves depend on the seed alone */
+unsigned int NextRandom(unsigned int &state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+/* Wavelengths of a third to a sixth of the tile, travelling every way,
+ * each as steep as the others. Rays move by the slope times scale, which
+ * is set so that at a focus of 1 the surface's mean curvature just brings
+ * neighbouring rays together; beyond it they cross into bright lines. */
+std::vector<Wave> MakeWaves(const CausticsAtlas::Parameters &parameters, float &scale)
+{
+    unsigned int state = parameters.seed * 2654435761u + 1;
+    std::vector<Wave> waves;
+    float curvature = 0;
+    for (int i = 0; i < parameters.waves; i++)
+    {
+        Wave wave;
+        do
+        {
+            wave.kx = (float)((int)(NextRandom(state) % 13) - 6);
+            wave.ky = (float)((int)(NextRandom(state) % 13) - 6);
+        }
+        while (wave.kx * wave.kx + wave.ky * wave.ky < 9 || wave.kx * wave.kx + wave.ky * wave.ky > 36);
+        wave.cycles = (float)(1 + NextRandom(state) % 2) * (NextRandom(state) % 2 ? 1.0f : -1.0f);
+        wave.phase  = TWO_PI * (float)(NextRandom(state) % 65536) / 65536.0f;
+        float k = TWO_PI * std::sqrt(wave.kx * wave.kx + wave.ky * wave.ky);
+        wave.amplitude = 1.0f / (k * (float)parameters.waves);
+        curvature += wave.amplitude * k * k;
+        waves.push_back(wave);
+    }
+    scale = parameters.focus / curvature;
+    return waves;
+}
+
+/* Light of one frame, averaging one, splatted bilinearly with wrapping
+ * and softened by a [1 2 1] blur each way */
+void BuildFrame(const std::vector<Wave> &waves, float scale, int size, float time, unsigned char *out)
+{
+    ScopedTimer timer("caustics:frame");
+    std::vector<float> light((size_t)size * size, 0.0f);
+    int rays = size * OVERSAMPLE;
+    float weight = 1.0f / (OVERSAMPLE * OVERSAMPLE);
+
+    for (int y = 0; y < rays; y++)
+    {
+        float py = ((float)y + 0.5f) / (float)rays;
+        for (int x = 0; x < rays; x++)
+        {
+            float px = ((float)x + 0.5f) / (float)rays;
+            float dx = 0, dy = 0;
+            for (size_t w = 0; w < waves.size(); w++)
+            {
+                const Wave &wave = waves[w];
+                float slope = wave.amplitude * TWO_PI
+                            * std::cos(TWO_PI * (wave.kx * px + wave.ky * py + wave.cycles * time) + wave.phase);
+                dx += slope * wave.kx;
+                dy += slope * wave.ky;
+            }
+            float tx = (px + scale * dx) * (float)size - 0.5f;
+            float ty = (py + scale * dy) * (float)size - 0.5f;
+            float fx = std::floor(tx), fy = std::floor(ty);
+            float ax = tx - fx, ay = ty - fy;
+            int x0 = ((int)fx % size + size) % size, y0 = ((int)fy % size + size) % size;
+            int x1 = (x0 + 1) % size, y1 = (y0 + 1) % size;
+            light[(size_t)y0 * size + x0] += weight * (1 - ax) * (1 - ay);
+            light[(size_t)y0 * size + x1] += weight * ax * (1 - ay);
+            light[(size_t)y1 * size + x0] += weight * (1 - ax) * ay;
+            light[(size_t)y1 * size + x1] += weight * ax * ay;
+        }
+    }
+
+    std::vector<float> across(light.size());
+    for (int y = 0; y < size; y++)
+        for (int x = 0; x < size; x++)
+        {
+            const float *row = &light[(size_t)y * size];
+            across[(size_t)y * size + x] =
+                0.25f * row[(x + size - 1) % size] + 0.5f * row[x] + 0.25f * row[(x + 1) % size];
+        }
+    for (int y = 0; y < size; y++)
+        for (int x = 0; x < size; x++)
+        {
+            float value = 0.25f * across[(size_t)((y + size - 1) % size) * size + x]
+                        + 0.5f * across[(size_t)y * size + x]
+                        + 0.25f * across[(size_t)((y + 1) % size) * size + x];
+            out[(size_t)y * size + x] =
+                (unsigned char)std::min(255.0f, value / CausticsAtlas::INTENSITY_SCALE * 255.0f + 0.5f);
+        }
+}
+}
+
+CausticsAtlas::Parameters CausticsAtlas::GetDefaultParameters()
+{
+    Parameters parameters;
+    parameters.size   = 256;
+    parameters.frames = 32;
+    parameters.waves  = 8;
+    parameters.focus  = 1.8f;
+    parameters.seed   = 1;
+    return parameters;
+}
+
+bool CausticsAtlas::Build(const Parameters &parameters)
+{
+    if (parameters.size < 16 || parameters.size > 1024 || parameters.frames < 1 || parameters.frames > 256
+        || parameters.waves < 1 || parameters.waves > 32 || !(parameters.focus >= 0))
+        return false;
+
+    float scale;
+    std::vector<Wave> waves = MakeWaves(parameters, scale);
+    size      = parameters.size;
+    frames    = parameters.frames;
+    texels.assign((size_t)frames * size * size, 0);
+
+    ThreadPool pool;
+    std::vector<std::future<void> > jobs;
+    for (int f = 0; f < frames; f++)
+    {
+        float time = (float)f / (float)frames;
+        unsigned char *out = &texels[(size_t)f * size * size];
+        int tile = size;
+        jobs.push_back(pool.Submit([&waves, scale, tile, time, out]() {
+            BuildFrame(waves, scale, tile, time, out);
+        }));
+    }
+    for (size_t j = 0; j < jobs.size(); j++)
+        jobs[j].get();
+    return true;
+}
+
+uint64_t CausticsAtlas::ComputeKey(const Parameters &parameters)
+{
+    uint64_t hash = MeshCache::HashBytes(&ATLAS_VERSION, sizeof(ATLAS_VERSION));
+    hash = MeshCache::HashBytes(&parameters.size, sizeof(parameters.size), hash);
+    hash = MeshCache::HashBytes(&parameters.frames, sizeof(parameters.frames), hash);
+    hash = MeshCache::HashBytes(&parameters.waves, sizeof(parameters.waves), hash);
+    hash = MeshCache::HashBytes(&parameters.focus, sizeof(parameters.focus), hash);
+    hash = MeshCache::HashBytes(&parameters.seed, sizeof(parameters.seed), hash);
+    return hash;
+}
+
+bool CausticsAtlas::Read(const std::string &fileName, uint64_t key)
+{
+    std::ifstream in(fileName.c_str(), std::ios::binary);
+    AtlasHeader header;
+    if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)))
+        return false;
+    if (memcmp(header.magic, ATLAS_MAGIC, sizeof(ATLAS_MAGIC)) != 0 || header.version != ATLAS_VERSION
+        || header.key != key || header.size < 16 || header.size > 1024 || header.frames < 1
+        || header.frames > 256)
+        return false;
+
+    std::vector<unsigned char> values((size_t)header.frames * header.size * header.size);
+    if (!in.read(reinterpret_cast<char *>(&values[0]), (std::streamsize)values.size()))
+        return false;
+    size   = header.size;
+    frames = header.frames;
+    texels.swap(values);
+    return true;
+}
+
+bool CausticsAtlas::Write(const std::string &fileName, uint64_t key) const
+{
+    AtlasHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ATLAS_MAGIC, sizeof(ATLAS_MAGIC));
+    header.version = ATLAS_VERSION;
+    header.key     = key;
+    header.size    = size;
+    header.frames  = frames;
+    return MeshCache::WriteFile(fileName, &header, sizeof(header), texels.empty() ? NULL : &texels[0], texels.size());
+}
@@ -0,0 +1,69 @@
+/*
+ * Caustics atlas
+ *
+ * The dancing web of light a rippling water surface focuses onto what is
+ * below it, precomputed as a loop of greyscale frames, each a square tile
+ * that repeats seamlessly, so that drawing caustics costs a texture fetch
+ * whatever the scene and the window.
+ *
+ * The surface is a sum of waves whose wave vectors are whole numbers of
+ * cycles across the tile, and whose phases turn a whole number of times
+ * over the loop, so both space and time wrap. For each frame, a grid of
+ * light rays is bent by the surface's slope and splatted where it lands,
+ * wrapping around the tile; where rays crowd together the light is
+ * bright, where they spread it is dim. The light averages one.
+ *
+ * Frames are built in parallel, one job per frame on one thread per core.
+ * The parameters alone decide the atlas, so its cache key hashes nothing
+ * else and every scene with the same water shares one file.
+ */
+
+#ifndef FISHTANK_CAUSTICSATLAS_H
+#define FISHTANK_CAUSTICSATLAS_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class CausticsAtlas
+{
+    public:
+        /* A stored texel of 255 is this much light */
+        static const float INTENSITY_SCALE;
+
+        struct Parameters
+        {
+            int          size;     /* texels across a tile, 16 to 1024 */
+            int          frames;   /* in one loop, 1 to 256 */
+            int          waves;    /* summed into the surface, 1 to 32 */
+            float        focus;    /* how far rays travel; lines form past 1 */
+            unsigned int seed;
+        };
+
+        static Parameters GetDefaultParameters();
+
+        /* False, leaving the atlas as it was, when a parameter is out of range */
+        bool Build(const Parameters &parameters);
+
+        int GetSize() const { return size; }
+        int GetNumberOfFrames() const { return frames; }
+
+        /* size * size texels, rows along x */
+        const unsigned char *GetFrame(int frame) const { return &texels[(size_t)frame * size * size]; }
+
+        /* Identifies the atlas Build() would make from these parameters */
+        static uint64_t ComputeKey(const Parameters &parameters);
+
+        /* An atlas written with the same key; false if missing or stale */
+        bool Read(const std::string &fileName, uint64_t key);
+        bool Write(const std::string &fileName, uint64_t key) const;
+
+        CausticsAtlas() : size(0), frames(0) {}
+
+    private:
+        int                        size;
+        int                        frames;
+        std::vector<unsigned char> texels;
+};
+
+#endif
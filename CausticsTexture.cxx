@@ -0,0 +1,81 @@
+/*
+ * Caustics atlas texture shared between mappers
+ */
+
+#include "CausticsTexture.h"
+
+#include <map>
+#include <mutex>
+#include <utility>
+
+namespace
+{
+typedef std::pair<vtkRenderWindow *, const CausticsAtlas *> Key;
+
+std::mutex                       tableLock;
+std::map<Key, CausticsTexture *> table;
+size_t                           totalBytes = 0;
+}
+
+CausticsTexture *CausticsTexture::Acquire(vtkRenderWindow *context, const std::shared_ptr<const CausticsAtlas> &atlas)
+{
+    std::lock_guard<std::mutex> lock(tableLock);
+    CausticsTexture *&texture = table[Key(context, atlas.get())];
+    if (!texture)
+        texture = new CausticsTexture(context, atlas);
+    texture->users++;
+    return texture;
+}
+
+void CausticsTexture::Release()
+{
+    std::lock_guard<std::mutex> lock(tableLock);
+    if (--users > 0)
+        return;
+    table.erase(Key(context, atlas.get()));
+    delete this;
+}
+
+/* Called with the table locked. Rows of a single byte need the unpack
+ * alignment at one whatever the size; it is put back afterwards. */
+CausticsTexture::CausticsTexture(vtkRenderWindow *window, const std::shared_ptr<const CausticsAtlas> &source)
+    : context(window), atlas(source), texture(0), frames(source->GetNumberOfFrames()), bytes(0), users(0)
+{
+    int size = atlas->GetSize();
+    GLint alignment;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8, size, size, frames, 0, GL_RED, GL_UNSIGNED_BYTE,
+                 atlas->GetFrame(0));
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+
+    /* A full mip chain adds a third */
+    bytes = (size_t)size * size * frames * 4 / 3;
+    totalBytes += bytes;
+}
+
+CausticsTexture::~CausticsTexture()
+{
+    totalBytes -= bytes;
+    glDeleteTextures(1, &texture);
+}
+
+void CausticsTexture::Bind(GLenum unit) const
+{
+    glActiveTexture(unit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+}
+
+size_t CausticsTexture::GetTotalBytes()
+{
+    std::lock_guard<std::mutex> lock(tableLock);
+    return totalBytes;
+}
@@ -0,0 +1,57 @@
+/*
+ * Caustics atlas texture shared between mappers
+ *
+ * A CausticsAtlas uploaded once per OpenGL context as a 2D array texture,
+ * one layer per frame, single channel, repeating and mipmapped so that
+ * caustics far away or at grazing angles average out rather than shimmer.
+ * Every mapper that lights its surfaces with the same atlas in a window,
+ * whichever tank it belongs to, samples the same texture.
+ *
+ * Textures are keyed by the window whose context holds them and the atlas,
+ * which they keep alive. Users Acquire() them with that context current
+ * and Release() them in their ReleaseGraphicsResources(); the last
+ * release frees them. The table is locked, as MeshBuffers' is.
+ */
+
+#ifndef FISHTANK_CAUSTICSTEXTURE_H
+#define FISHTANK_CAUSTICSTEXTURE_H
+
+#include "CausticsAtlas.h"
+
+#include <vtk_glew.h>
+
+#include <vtkRenderWindow.h>
+
+#include <memory>
+#include <stddef.h>
+
+class CausticsTexture
+{
+    public:
+        static CausticsTexture *Acquire(vtkRenderWindow *context, const std::shared_ptr<const CausticsAtlas> &atlas);
+        void Release();
+
+        /* Bind the texture to a texture unit, GL_TEXTURE0 and up */
+        void Bind(GLenum unit) const;
+
+        const CausticsAtlas *GetAtlas() const { return atlas.get(); }
+        int                  GetNumberOfFrames() const { return frames; }
+
+        /* Bytes of every caustics texture alive, mipmaps included */
+        static size_t GetTotalBytes();
+
+    private:
+        CausticsTexture(vtkRenderWindow *context, const std::shared_ptr<const CausticsAtlas> &atlas);
+        ~CausticsTexture();
+        CausticsTexture(const CausticsTexture &);
+        void operator=(const CausticsTexture &);
+
+        vtkRenderWindow                     *context;
+        std::shared_ptr<const CausticsAtlas> atlas;   /* held, so its address stays its key */
+        GLuint                               texture;
+        int                                  frames;
+        size_t                               bytes;
+        int                                  users;
+};
+
+#endif
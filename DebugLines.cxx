@@ -0,0 +1,142 @@
+/*
+ * Batched debug lines
+ */
+
+#include "DebugLines.h"
+
+#include "GLUtilities.h"
+
+#include <iostream>
+#include <string>
+
+namespace
+{
+enum
+{
+    POSITION_LOCATION = 0,
+    COLOR_LOCATION    = 1
+};
+
+const char *VERTEX_SHADER =
+    "#version 150\n"
+    "in vec3 position;\n"
+    "in vec3 color;\n"
+    "uniform mat4 modelToClip;\n"
+    "out vec3 lineColor;\n"
+    "void main()\n"
+    "{\n"
+    "    gl_Position = modelToClip * vec4(position, 1.0);\n"
+    "    lineColor   = color;\n"
+    "}\n";
+
+const char *FRAGMENT_SHADER =
+    "#version 150\n"
+    "in vec3 lineColor;\n"
+    "out vec4 fragOutput0;\n"
+    "void main()\n"
+    "{\n"
+    "    fragOutput0 = vec4(lineColor, 1.0);\n"
+    "}\n";
+}
+
+DebugLines::DebugLines()
+    : modified(false), program(0), vertexArray(0), vertexBuffer(0), modelToClipLocation(-1),
+      programFailed(false)
+{
+}
+
+void DebugLines::Clear()
+{
+    vertices.clear();
+    modified = true;
+}
+
+void DebugLines::AddLine(const float from[3], const float to[3], const unsigned char color[3])
+{
+    const float *ends[2] = { from, to };
+    for (int e = 0; e < 2; e++)
+    {
+        for (int c = 0; c < 3; c++)
+            vertices.push_back(ends[e][c]);
+        for (int c = 0; c < 3; c++)
+            vertices.push_back(color[c] / 255.0f);
+    }
+    modified = true;
+}
+
+void DebugLines::Draw(vtkRenderer *ren, vtkMatrix4x4 *model)
+{
+    if (vertices.empty() || programFailed)
+        return;
+
+    if (!program)
+    {
+        GLUtilities::AttributeBindings attributes;
+        attributes.push_back(std::make_pair((GLuint)POSITION_LOCATION, "position"));
+        attributes.push_back(std::make_pair((GLuint)COLOR_LOCATION, "color"));
+        std::string log;
+        program = GLUtilities::BuildProgram(VERTEX_SHADER, FRAGMENT_SHADER, attributes, log);
+        if (!program)
+        {
+            std::cerr << "DebugLines: " << log << std::endl;
+            programFailed = true;
+            return;
+        }
+        modelToClipLocation = glGetUniformLocation(program, "modelToClip");
+
+        glGenVertexArrays(1, &vertexArray);
+        glGenBuffers(1, &vertexBuffer);
+        glBindVertexArray(vertexArray);
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        glEnableVertexAttribArray(POSITION_LOCATION);
+        glVertexAttribPointer(POSITION_LOCATION, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)0);
+        glEnableVertexAttribArray(COLOR_LOCATION);
+        glVertexAttribPointer(COLOR_LOCATION, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float),
+                              (void *)(3 * sizeof(float)));
+        glBindVertexArray(0);
+        modified = true;
+    }
+    if (modified)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
+        modified = false;
+    }
+
+    /* World to clip times the model matrix, both column-major */
+    float worldToClip[16], modelMatrix[16], modelToClip[16];
+    GLUtilities::GetWorldToClip(ren, worldToClip);
+    if (model)
+    {
+        GLUtilities::ToColumnMajor(model, modelMatrix);
+        for (int column = 0; column < 4; column++)
+            for (int row = 0; row < 4; row++)
+            {
+                float sum = 0;
+                for (int k = 0; k < 4; k++)
+                    sum += worldToClip[k * 4 + row] * modelMatrix[column * 4 + k];
+                modelToClip[column * 4 + row] = sum;
+            }
+    }
+
+    glUseProgram(program);
+    glUniformMatrix4fv(modelToClipLocation, 1, GL_FALSE, model ? modelToClip : worldToClip);
+    glBindVertexArray(vertexArray);
+    glDrawArrays(GL_LINES, 0, (GLsizei)(vertices.size() / 6));
+    glBindVertexArray(0);
+
+    GLUtilities::ReleaseVTKShader(ren);
+}
+
+void DebugLines::ReleaseGraphicsResources()
+{
+    if (program)
+    {
+        glDeleteProgram(program);
+        glDeleteVertexArrays(1, &vertexArray);
+        glDeleteBuffers(1, &vertexBuffer);
+    }
+    program      = 0;
+    vertexArray  = 0;
+    vertexBuffer = 0;
+}
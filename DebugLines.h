@@ -0,0 +1,49 @@
+/*
+ * Batched debug lines
+ *
+ * Coloured line segments, such as axes, kept in one vertex buffer that is
+ * uploaded when the segments change and drawn with a single call after
+ * that. Replaces glBegin/glEnd, which core profiles do not have.
+ */
+
+#ifndef FISHTANK_DEBUGLINES_H
+#define FISHTANK_DEBUGLINES_H
+
+#include <vtk_glew.h>
+
+#include <vtkMatrix4x4.h>
+#include <vtkRenderer.h>
+
+#include <vector>
+
+class DebugLines
+{
+    public:
+        DebugLines();
+
+        void Clear();
+        void AddLine(const float from[3], const float to[3], const unsigned char color[3]);
+        bool IsEmpty() const { return vertices.empty(); }
+
+        /* Draw the segments, given in model coordinates, under a model
+         * matrix; null means world coordinates */
+        void Draw(vtkRenderer *ren, vtkMatrix4x4 *model);
+
+        /* Free the GL objects; the context must be current */
+        void ReleaseGraphicsResources();
+
+    private:
+        DebugLines(const DebugLines &);
+        void operator=(const DebugLines &);
+
+        std::vector<float> vertices;    /* x, y, z, r, g, b per end */
+        bool               modified;
+
+        GLuint program;
+        GLuint vertexArray;
+        GLuint vertexBuffer;
+        GLint  modelToClipLocation;
+        bool   programFailed;
+};
+
+#endif
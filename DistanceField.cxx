@@ -0,0 +1,532 @@
+/*
+ * Signed distance field
+ */
+
+#include "DistanceField.h"
+
+#include "MeshCache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <fstream>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DISTANCEFIELD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+const char     FIELD_MAGIC[4] = { 'F', 'T', 'D', 'F' };
+const uint32_t FIELD_VERSION  = 2;   /* 2: band nodes signed by side */
+
+/* Nodes with no surface in reach, which only happens without triangles */
+const float FAR_AWAY = 1e6f;
+
+/* On-disk layout: this header, then the distances as float32, x fastest */
+struct FieldHeader
+{
+    char     magic[4];
+    uint32_t version;
+    uint64_t key;
+    int32_t  dimensions[3];
+    float    origin[3];
+    float    cellSize;
+};
+
+float Dot(const float a[3], const float b[3])
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+/* Positive on one side of triangle abc's plane, negative on the other;
+ * which is which depends on the winding, so only compare two points' */
+float PlaneSide(const float p[3], const float a[3], const float b[3], const float c[3])
+{
+    float ab[3], ac[3], ap[3];
+    for (int k = 0; k < 3; k++)
+    {
+        ab[k] = b[k] - a[k];
+        ac[k] = c[k] - a[k];
+        ap[k] = p[k] - a[k];
+    }
+    float normal[3] = { ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2], ab[0] * ac[1] - ab[1] * ac[0] };
+    return Dot(normal, ap);
+}
+
+/* Closest point to p on triangle abc, by the Voronoi region p falls in
+ * (Ericson, Real-Time Collision Detection, 5.1.5) */
+void ClosestPointOnTriangle(const float p[3], const float a[3], const float b[3], const float c[3],
+                            float out[3])
+{
+    float ab[3], ac[3], ap[3];
+    for (int k = 0; k < 3; k++)
+    {
+        ab[k] = b[k] - a[k];
+        ac[k] = c[k] - a[k];
+        ap[k] = p[k] - a[k];
+    }
+    float d1 = Dot(ab, ap), d2 = Dot(ac, ap);
+    if (d1 <= 0 && d2 <= 0)
+    {
+        memcpy(out, a, 3 * sizeof(float));
+        return;
+    }
+
+    float bp[3];
+    for (int k = 0; k < 3; k++)
+        bp[k] = p[k] - b[k];
+    float d3 = Dot(ab, bp), d4 = Dot(ac, bp);
+    if (d3 >= 0 && d4 <= d3)
+    {
+        memcpy(out, b, 3 * sizeof(float));
+        return;
+    }
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0)
+    {
+        float v = d1 / (d1 - d3);
+        for (int k = 0; k < 3; k++)
+            out[k] = a[k] + v * ab[k];
+        return;
+    }
+
+    float cp[3];
+    for (int k = 0; k < 3; k++)
+        cp[k] = p[k] - c[k];
+    float d5 = Dot(ab, cp), d6 = Dot(ac, cp);
+    if (d6 >= 0 && d5 <= d6)
+    {
+        memcpy(out, c, 3 * sizeof(float));
+        return;
+    }
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0)
+    {
+        float w = d2 / (d2 - d6);
+        for (int k = 0; k < 3; k++)
+            out[k] = a[k] + w * ac[k];
+        return;
+    }
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0)
+    {
+        float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+        for (int k = 0; k < 3; k++)
+            out[k] = b[k] + w * (c[k] - b[k]);
+        return;
+    }
+
+    /* Inside the face; a degenerate triangle lands here with a zero sum */
+    float sum = va + vb + vc;
+    float denominator = sum != 0 ? 1.0f / sum : 0.0f;
+    float v = vb * denominator, w = vc * denominator;
+    for (int k = 0; k < 3; k++)
+        out[k] = a[k] + ab[k] * v + ac[k] * w;
+}
+
+/* The grid a batch samples from */
+struct Grid
+{
+    const float *distances;
+    int          dimensions[3];
+    float        origin[3];
+    float        inverseCell;
+};
+
+typedef void (*Sampler)(const Grid &grid, const float *x, const float *y, const float *z, int count,
+                        float *distance, float *gradientX, float *gradientY, float *gradientZ);
+
+/* Trilinear in the cell holding the point; the gradient is the exact
+ * derivative of the same interpolant */
+void SampleScalar(const Grid &grid, const float *x, const float *y, const float *z, int count,
+                  float *distance, float *gradientX, float *gradientY, float *gradientZ)
+{
+    const int nx = grid.dimensions[0], nxy = nx * grid.dimensions[1];
+    for (int i = 0; i < count; i++)
+    {
+        float position[3] = { x[i], y[i], z[i] };
+        int   cell[3];
+        float t[3];
+        for (int c = 0; c < 3; c++)
+        {
+            float f = (position[c] - grid.origin[c]) * grid.inverseCell;
+            f = std::min(std::max(f, 0.0f), (float)(grid.dimensions[c] - 1));
+            cell[c] = std::min((int)f, grid.dimensions[c] - 2);
+            t[c]    = f - cell[c];
+        }
+        const float *d = grid.distances + (cell[2] * grid.dimensions[1] + cell[1]) * nx + cell[0];
+        float d000 = d[0],       d100 = d[1];
+        float d010 = d[nx],      d110 = d[nx + 1];
+        float d001 = d[nxy],     d101 = d[nxy + 1];
+        float d011 = d[nxy + nx], d111 = d[nxy + nx + 1];
+
+        float c00 = d000 + (d100 - d000) * t[0];
+        float c10 = d010 + (d110 - d010) * t[0];
+        float c01 = d001 + (d101 - d001) * t[0];
+        float c11 = d011 + (d111 - d011) * t[0];
+        float c0  = c00 + (c10 - c00) * t[1];
+        float c1  = c01 + (c11 - c01) * t[1];
+        distance[i] = c0 + (c1 - c0) * t[2];
+
+        float e0 = (d100 - d000) + ((d110 - d010) - (d100 - d000)) * t[1];
+        float e1 = (d101 - d001) + ((d111 - d011) - (d101 - d001)) * t[1];
+        gradientX[i] = (e0 + (e1 - e0) * t[2]) * grid.inverseCell;
+        gradientY[i] = ((c10 - c00) + ((c11 - c01) - (c10 - c00)) * t[2]) * grid.inverseCell;
+        gradientZ[i] = (c1 - c0) * grid.inverseCell;
+    }
+}
+
+#ifdef DISTANCEFIELD_X86
+__attribute__((target("avx2,fma")))
+inline __m256 Lerp(__m256 a, __m256 b, __m256 t)
+{
+    return _mm256_fmadd_ps(_mm256_sub_ps(b, a), t, a);
+}
+
+/* As the scalar sampler, eight points at a time, the eight corners of
+ * their cells gathered. The last few points go through the scalar code. */
+__attribute__((target("avx2,fma")))
+void SampleAVX2(const Grid &grid, const float *x, const float *y, const float *z, int count,
+                float *distance, float *gradientX, float *gradientY, float *gradientZ)
+{
+    const int    nx = grid.dimensions[0], nxy = nx * grid.dimensions[1];
+    const __m256 scale = _mm256_set1_ps(grid.inverseCell);
+    const __m256 zero  = _mm256_setzero_ps();
+    const __m256 origin[3] = { _mm256_set1_ps(grid.origin[0]), _mm256_set1_ps(grid.origin[1]),
+                               _mm256_set1_ps(grid.origin[2]) };
+    const __m256 top[3]    = { _mm256_set1_ps((float)(grid.dimensions[0] - 1)),
+                               _mm256_set1_ps((float)(grid.dimensions[1] - 1)),
+                               _mm256_set1_ps((float)(grid.dimensions[2] - 1)) };
+    const __m256i last[3]  = { _mm256_set1_epi32(grid.dimensions[0] - 2), _mm256_set1_epi32(grid.dimensions[1] - 2),
+                               _mm256_set1_epi32(grid.dimensions[2] - 2) };
+    const __m256i strideY  = _mm256_set1_epi32(nx);
+    const __m256i strideZ  = _mm256_set1_epi32(nxy);
+    const __m256i one      = _mm256_set1_epi32(1);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const float *positions[3] = { x + i, y + i, z + i };
+        __m256i cell[3];
+        __m256  t[3];
+        for (int c = 0; c < 3; c++)
+        {
+            __m256 f = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(positions[c]), origin[c]), scale);
+            f = _mm256_min_ps(_mm256_max_ps(f, zero), top[c]);
+            cell[c] = _mm256_min_epi32(_mm256_cvttps_epi32(f), last[c]);
+            t[c]    = _mm256_sub_ps(f, _mm256_cvtepi32_ps(cell[c]));
+        }
+        __m256i base = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(cell[2], strideZ),
+                                                         _mm256_mullo_epi32(cell[1], strideY)), cell[0]);
+        __m256i baseY  = _mm256_add_epi32(base, strideY);
+        __m256i baseZ  = _mm256_add_epi32(base, strideZ);
+        __m256i baseYZ = _mm256_add_epi32(baseZ, strideY);
+        __m256 d000 = _mm256_i32gather_ps(grid.distances, base, 4);
+        __m256 d100 = _mm256_i32gather_ps(grid.distances, _mm256_add_epi32(base, one), 4);
+        __m256 d010 = _mm256_i32gather_ps(grid.distances, baseY, 4);
+        __m256 d110 = _mm256_i32gather_ps(grid.distances, _mm256_add_epi32(baseY, one), 4);
+        __m256 d001 = _mm256_i32gather_ps(grid.distances, baseZ, 4);
+        __m256 d101 = _mm256_i32gather_ps(grid.distances, _mm256_add_epi32(baseZ, one), 4);
+        __m256 d011 = _mm256_i32gather_ps(grid.distances, baseYZ, 4);
+        __m256 d111 = _mm256_i32gather_ps(grid.distances, _mm256_add_epi32(baseYZ, one), 4);
+
+        __m256 c00 = Lerp(d000, d100, t[0]);
+        __m256 c10 = Lerp(d010, d110, t[0]);
+        __m256 c01 = Lerp(d001, d101, t[0]);
+        __m256 c11 = Lerp(d011, d111, t[0]);
+        __m256 c0  = Lerp(c00, c10, t[1]);
+        __m256 c1  = Lerp(c01, c11, t[1]);
+        _mm256_storeu_ps(distance + i, Lerp(c0, c1, t[2]));
+
+        __m256 e0 = Lerp(_mm256_sub_ps(d100, d000), _mm256_sub_ps(d110, d010), t[1]);
+        __m256 e1 = Lerp(_mm256_sub_ps(d101, d001), _mm256_sub_ps(d111, d011), t[1]);
+        __m256 gy = Lerp(_mm256_sub_ps(c10, c00), _mm256_sub_ps(c11, c01), t[2]);
+        _mm256_storeu_ps(gradientX + i, _mm256_mul_ps(Lerp(e0, e1, t[2]), scale));
+        _mm256_storeu_ps(gradientY + i, _mm256_mul_ps(gy, scale));
+        _mm256_storeu_ps(gradientZ + i, _mm256_mul_ps(_mm256_sub_ps(c1, c0), scale));
+    }
+    SampleScalar(grid, x + i, y + i, z + i, count - i, distance + i, gradientX + i, gradientY + i, gradientZ + i);
+}
+#endif
+
+Sampler GetSampler()
+{
+#ifdef DISTANCEFIELD_X86
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return SampleAVX2;
+#endif
+    return SampleScalar;
+}
+}
+
+DistanceField::DistanceField()
+    : cellSize(1)
+{
+    for (int c = 0; c < 3; c++)
+    {
+        dimensions[c] = 0;
+        origin[c]     = 0;
+    }
+}
+
+const char *DistanceField::GetKernelName()
+{
+    return GetSampler() == SampleScalar ? "scalar" : "avx2";
+}
+
+uint64_t DistanceField::ComputeKey(const std::vector<float> &triangles, const float boundsMin[3],
+                                   const float boundsMax[3], float size)
+{
+    uint64_t hash = MeshCache::HashBytes(&FIELD_VERSION, sizeof(FIELD_VERSION));
+    hash = MeshCache::HashBytes(boundsMin, 3 * sizeof(float), hash);
+    hash = MeshCache::HashBytes(boundsMax, 3 * sizeof(float), hash);
+    hash = MeshCache::HashBytes(&size, sizeof(size), hash);
+    if (!triangles.empty())
+        hash = MeshCache::HashBytes(&triangles[0], triangles.size() * sizeof(float), hash);
+    return hash;
+}
+
+void DistanceField::Build(const std::vector<float> &triangles, const float boundsMin[3],
+                          const float boundsMax[3], float size)
+{
+    cellSize = size;
+    for (int c = 0; c < 3; c++)
+    {
+        origin[c]     = boundsMin[c];
+        dimensions[c] = std::max(2, (int)std::ceil((boundsMax[c] - boundsMin[c]) / size) + 1);
+    }
+    const int nx = dimensions[0], ny = dimensions[1], nz = dimensions[2];
+    const size_t nodes = (size_t)nx * ny * nz;
+
+    /* Squared distance to, position of and triangle holding the nearest
+     * surface point found so far; a negative squared distance means none
+     * yet */
+    std::vector<float> nearest(3 * nodes);
+    std::vector<float> distance2(nodes, -1.0f);
+    std::vector<size_t> nearestTriangle(nodes, 0);
+
+    /* Exact distances for the nodes within two cells of each triangle */
+    const float band = 2 * size;
+    for (size_t t = 0; t + 9 <= triangles.size(); t += 9)
+    {
+        const float *a = &triangles[t], *b = a + 3, *c = a + 6;
+        int low[3], high[3];
+        for (int k = 0; k < 3; k++)
+        {
+            float lo = std::min(a[k], std::min(b[k], c[k])) - band;
+            float hi = std::max(a[k], std::max(b[k], c[k])) + band;
+            low[k]  = std::max(0, (int)std::ceil((lo - origin[k]) / size));
+            high[k] = std::min(dimensions[k] - 1, (int)std::floor((hi - origin[k]) / size));
+        }
+        for (int z = low[2]; z <= high[2]; z++)
+            for (int y = low[1]; y <= high[1]; y++)
+                for (int x = low[0]; x <= high[0]; x++)
+                {
+                    size_t n = ((size_t)z * ny + y) * nx + x;
+                    float p[3] = { origin[0] + x * size, origin[1] + y * size, origin[2] + z * size };
+                    float q[3];
+                    ClosestPointOnTriangle(p, a, b, c, q);
+                    float d2 = (p[0] - q[0]) * (p[0] - q[0]) + (p[1] - q[1]) * (p[1] - q[1])
+                             + (p[2] - q[2]) * (p[2] - q[2]);
+                    if (distance2[n] < 0 || d2 < distance2[n])
+                    {
+                        distance2[n] = d2;
+                        memcpy(&nearest[3 * n], q, 3 * sizeof(float));
+                        nearestTriangle[n] = t;
+                    }
+                }
+    }
+
+    /* Everywhere else, try the nearest points of the neighbours already
+     * visited: the thirteen before a node in scan order on the way forward,
+     * the thirteen after it on the way back */
+    int offsets[13][3];
+    int neighbours = 0;
+    for (int dz = -1; dz <= 0; dz++)
+        for (int dy = -1; dy <= 1; dy++)
+            for (int dx = -1; dx <= 1; dx++)
+            {
+                if (dz == 0 && (dy > 0 || (dy == 0 && dx >= 0)))
+                    continue;
+                offsets[neighbours][0] = dx;
+                offsets[neighbours][1] = dy;
+                offsets[neighbours][2] = dz;
+                neighbours++;
+            }
+    for (int round = 0; round < 2; round++)
+        for (int direction = 1; direction >= -1; direction -= 2)
+        {
+            bool backward = direction < 0;
+            for (int zi = 0; zi < nz; zi++)
+                for (int yi = 0; yi < ny; yi++)
+                    for (int xi = 0; xi < nx; xi++)
+                    {
+                        int x = backward ? nx - 1 - xi : xi;
+                        int y = backward ? ny - 1 - yi : yi;
+                        int z = backward ? nz - 1 - zi : zi;
+                        size_t n = ((size_t)z * ny + y) * nx + x;
+                        float p[3] = { origin[0] + x * size, origin[1] + y * size, origin[2] + z * size };
+                        for (int k = 0; k < neighbours; k++)
+                        {
+                            int mx = x + direction * offsets[k][0];
+                            int my = y + direction * offsets[k][1];
+                            int mz = z + direction * offsets[k][2];
+                            if (mx < 0 || my < 0 || mz < 0 || mx >= nx || my >= ny || mz >= nz)
+                                continue;
+                            size_t m = ((size_t)mz * ny + my) * nx + mx;
+                            if (distance2[m] < 0)
+                                continue;
+                            const float *q = &nearest[3 * m];
+                            float d2 = (p[0] - q[0]) * (p[0] - q[0]) + (p[1] - q[1]) * (p[1] - q[1])
+                                     + (p[2] - q[2]) * (p[2] - q[2]);
+                            if (distance2[n] < 0 || d2 < distance2[n])
+                            {
+                                distance2[n] = d2;
+                                memcpy(&nearest[3 * n], q, 3 * sizeof(float));
+                                nearestTriangle[n] = nearestTriangle[m];
+                            }
+                        }
+                    }
+        }
+
+    /* Flood the outside in from the grid's faces through nodes clear of
+     * every surface. A surface crossing the gap between two neighbouring
+     * nodes is within half a cell of one of them, so a closed mesh stops
+     * the flood. */
+    const float clear2 = 0.75f * size * size;
+    std::vector<unsigned char> outside(nodes, 0);
+    std::deque<size_t> queue;
+    for (int z = 0; z < nz; z++)
+        for (int y = 0; y < ny; y++)
+            for (int x = 0; x < nx; x++)
+            {
+                if (x > 0 && y > 0 && z > 0 && x < nx - 1 && y < ny - 1 && z < nz - 1)
+                    continue;
+                size_t n = ((size_t)z * ny + y) * nx + x;
+                if (distance2[n] < 0 || distance2[n] >= clear2)
+                {
+                    outside[n] = 1;
+                    queue.push_back(n);
+                }
+            }
+    const long long steps[6] = { 1, -1, (long long)nx, -(long long)nx, (long long)nx * ny, -(long long)nx * ny };
+    while (!queue.empty())
+    {
+        size_t n = queue.front();
+        queue.pop_front();
+        int x = (int)(n % nx), y = (int)(n / nx % ny), z = (int)(n / ((size_t)nx * ny));
+        const bool inside[6] = { x + 1 < nx, x > 0, y + 1 < ny, y > 0, z + 1 < nz, z > 0 };
+        for (int k = 0; k < 6; k++)
+        {
+            if (!inside[k])
+                continue;
+            size_t m = (size_t)((long long)n + steps[k]);
+            if (outside[m] || (distance2[m] >= 0 && distance2[m] < clear2))
+                continue;
+            outside[m] = 1;
+            queue.push_back(m);
+        }
+    }
+
+    /* Nodes near a surface are outside if a flooded neighbour is on their
+     * side of the nearest triangle's plane. Flood beyond a thin wall is on
+     * the far side, so nodes inside the wall stay inside; flood around a
+     * leaf reaches both sides, so it stays outside on both. */
+    distances.resize(nodes);
+    for (int z = 0; z < nz; z++)
+        for (int y = 0; y < ny; y++)
+            for (int x = 0; x < nx; x++)
+            {
+                size_t n = ((size_t)z * ny + y) * nx + x;
+                if (distance2[n] < 0)
+                {
+                    distances[n] = FAR_AWAY;
+                    continue;
+                }
+                bool out = outside[n] != 0;
+                if (!out && distance2[n] < clear2)
+                {
+                    const float *a = &triangles[nearestTriangle[n]], *b = a + 3, *c = a + 6;
+                    float p[3] = { origin[0] + x * size, origin[1] + y * size, origin[2] + z * size };
+                    float side = PlaneSide(p, a, b, c);
+                    const bool inside[6] = { x + 1 < nx, x > 0, y + 1 < ny, y > 0, z + 1 < nz, z > 0 };
+                    const int  moves[6][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 },
+                                               { 0, 0, -1 } };
+                    for (int k = 0; k < 6 && !out; k++)
+                    {
+                        if (!inside[k] || !outside[(size_t)((long long)n + steps[k])])
+                            continue;
+                        float m[3] = { p[0] + moves[k][0] * size, p[1] + moves[k][1] * size,
+                                       p[2] + moves[k][2] * size };
+                        float neighbourSide = PlaneSide(m, a, b, c);
+                        out = side == 0 || neighbourSide == 0 || (side > 0) == (neighbourSide > 0);
+                    }
+                }
+                float d = std::sqrt(distance2[n]);
+                distances[n] = out ? d : -d;
+            }
+}
+
+bool DistanceField::Read(const std::string &fileName, uint64_t key)
+{
+    std::ifstream in(fileName.c_str(), std::ios::binary);
+    FieldHeader header;
+    if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)))
+        return false;
+    if (memcmp(header.magic, FIELD_MAGIC, sizeof(FIELD_MAGIC)) != 0 || header.version != FIELD_VERSION
+        || header.key != key || header.cellSize <= 0)
+        return false;
+    for (int c = 0; c < 3; c++)
+        if (header.dimensions[c] < 2 || header.dimensions[c] > 4096)
+            return false;
+
+    std::vector<float> values((size_t)header.dimensions[0] * header.dimensions[1] * header.dimensions[2]);
+    if (!in.read(reinterpret_cast<char *>(&values[0]), (std::streamsize)(values.size() * sizeof(float))))
+        return false;
+    for (int c = 0; c < 3; c++)
+    {
+        dimensions[c] = header.dimensions[c];
+        origin[c]     = header.origin[c];
+    }
+    cellSize = header.cellSize;
+    distances.swap(values);
+    return true;
+}
+
+bool DistanceField::Write(const std::string &fileName, uint64_t key) const
+{
+    if (IsEmpty())
+        return false;
+    FieldHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FIELD_MAGIC, sizeof(FIELD_MAGIC));
+    header.version  = FIELD_VERSION;
+    header.key      = key;
+    header.cellSize = cellSize;
+    for (int c = 0; c < 3; c++)
+    {
+        header.dimensions[c] = dimensions[c];
+        header.origin[c]     = origin[c];
+    }
+    return MeshCache::WriteFile(fileName, &header, sizeof(header), &distances[0], distances.size() * sizeof(float));
+}
+
+void DistanceField::Sample(const float *x, const float *y, const float *z, int count,
+                           float *distance, float *gradientX, float *gradientY, float *gradientZ) const
+{
+    if (IsEmpty() || count <= 0)
+        return;
+    static const Sampler sample = GetSampler();
+    Grid grid;
+    grid.distances   = &distances[0];
+    grid.inverseCell = 1.0f / cellSize;
+    for (int c = 0; c < 3; c++)
+    {
+        grid.dimensions[c] = dimensions[c];
+        grid.origin[c]     = origin[c];
+    }
+    sample(grid, x, y, z, count, distance, gradientX, gradientY, gradientZ);
+}
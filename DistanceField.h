@@ -0,0 +1,75 @@
+/*
+ * Signed distance field
+ *
+ * Distances to a triangle soup, sampled at the nodes of a uniform grid, so
+ * that how far a point is from the nearest surface, and which way is away
+ * from it, costs one trilinear lookup instead of a test against every
+ * triangle. Positive is outside, negative inside a closed mesh.
+ *
+ * Building computes exact distances in a narrow band around each triangle,
+ * carries the nearest surface point outwards through the grid in forward
+ * and backward sweeps, and then signs the field by flooding the outside in
+ * from the grid's faces: nodes the flood can't reach without crossing a
+ * surface are inside. Nodes too near a surface for the flood to enter are
+ * outside when a flooded neighbour lies on their side of the nearest
+ * triangle's plane, so thin walls keep their insides. Open meshes such as
+ * leaves enclose nothing and stay positive on both sides. Where parts of
+ * a mesh are less than a cell apart the flood can't pass between them, so
+ * the few nodes there within a fraction of a cell of the surface may take
+ * the wrong sign.
+ *
+ * Fields are built once and kept on disk, keyed by a hash of their
+ * triangles and grid, so later runs just read them back.
+ *
+ * Sampling takes batches of points in structure-of-arrays form, eight at a
+ * time with AVX2 gathers where the CPU has them. Points outside the grid
+ * are clamped onto it.
+ */
+
+#ifndef FISHTANK_DISTANCEFIELD_H
+#define FISHTANK_DISTANCEFIELD_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class DistanceField
+{
+    public:
+        DistanceField();
+
+        /* Sample the distance to triangles, nine floats each, at nodes
+         * cellSize apart covering the bounds */
+        void Build(const std::vector<float> &triangles, const float boundsMin[3], const float boundsMax[3],
+                   float cellSize);
+
+        bool IsEmpty() const { return distances.empty(); }
+
+        const int   *GetDimensions() const { return dimensions; }
+        const float *GetOrigin() const { return origin; }
+        float        GetCellSize() const { return cellSize; }
+
+        /* Identifies the field Build() would make from these arguments */
+        static uint64_t ComputeKey(const std::vector<float> &triangles, const float boundsMin[3],
+                                   const float boundsMax[3], float cellSize);
+
+        /* A field written with the same key; false if missing or stale */
+        bool Read(const std::string &fileName, uint64_t key);
+        bool Write(const std::string &fileName, uint64_t key) const;
+
+        /* Distance and its gradient, which points away from the nearest
+         * surface and is about unit length, at count points */
+        void Sample(const float *x, const float *y, const float *z, int count,
+                    float *distance, float *gradientX, float *gradientY, float *gradientZ) const;
+
+        /* "avx2" or "scalar", whichever Sample() uses on this CPU */
+        static const char *GetKernelName();
+
+    private:
+        int                dimensions[3];
+        float              origin[3];
+        float              cellSize;
+        std::vector<float> distances;   /* x fastest, then y, then z */
+};
+
+#endif
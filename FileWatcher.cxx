@@ -0,0 +1,165 @@
+/*
+ * File change notification
+ */
+
+#include "FileWatcher.h"
+
+#include "Profiler.h"
+
+#if defined(__linux__)
+#define FILEWATCHER_INOTIFY
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <iostream>
+
+const int FileWatcher::SETTLE_MS;
+
+namespace
+{
+bool EarlierChange(const FileWatcher::Change &a, const FileWatcher::Change &b)
+{
+    return a.time < b.time;
+}
+}
+
+FileWatcher::FileWatcher()
+    : notifyFd(-1)
+{
+    stopPipe[0] = stopPipe[1] = -1;
+}
+
+FileWatcher::~FileWatcher()
+{
+#ifdef FILEWATCHER_INOTIFY
+    if (thread.joinable())
+    {
+        char stop = 1;
+        if (write(stopPipe[1], &stop, 1) != 1)
+            std::cerr << "FileWatcher: could not stop the watch thread" << std::endl;
+        thread.join();
+    }
+    if (notifyFd >= 0)
+        close(notifyFd);
+    if (stopPipe[0] >= 0)
+    {
+        close(stopPipe[0]);
+        close(stopPipe[1]);
+    }
+#endif
+}
+
+bool FileWatcher::Watch(const std::string &fileName)
+{
+#ifdef FILEWATCHER_INOTIFY
+    if (notifyFd < 0)
+    {
+        notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (notifyFd < 0)
+            return false;
+        if (pipe(stopPipe) != 0)
+        {
+            close(notifyFd);
+            notifyFd = -1;
+            return false;
+        }
+    }
+
+    size_t slash = fileName.rfind('/');
+    std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : fileName.substr(0, slash);
+    std::string name      = slash == std::string::npos ? fileName : fileName.substr(slash + 1);
+
+    /* Watching a directory twice hands back the same descriptor */
+    int watch = inotify_add_watch(notifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (watch < 0)
+        return false;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        watches[watch][name] = fileName;
+    }
+    if (!thread.joinable())
+        thread = std::thread(&FileWatcher::Run, this);
+    return true;
+#else
+    (void)fileName;
+    return false;
+#endif
+}
+
+std::vector<FileWatcher::Change> FileWatcher::TakeChanges()
+{
+    std::vector<Change> changes;
+    Clock::time_point now = Clock::now();
+    std::lock_guard<std::mutex> guard(lock);
+    for (std::map<std::string, Burst>::iterator it = bursts.begin(); it != bursts.end();)
+    {
+        if (now - it->second.last < std::chrono::milliseconds(SETTLE_MS))
+        {
+            ++it;
+            continue;
+        }
+        Change change;
+        change.fileName = it->first;
+        change.time     = it->second.first;
+        changes.push_back(change);
+        bursts.erase(it++);
+    }
+    std::sort(changes.begin(), changes.end(), EarlierChange);
+    return changes;
+}
+
+/* Sleeps in poll() until inotify or the stop pipe has something to say */
+void FileWatcher::Run()
+{
+#ifdef FILEWATCHER_INOTIFY
+    Profiler::Get().SetThreadName("watch");
+    /* Aligned for the events read into it, and room for at least one with
+     * the longest name */
+    alignas(struct inotify_event) char buffer[4096];
+    for (;;)
+    {
+        struct pollfd fds[2];
+        fds[0].fd     = notifyFd;
+        fds[0].events = POLLIN;
+        fds[1].fd     = stopPipe[0];
+        fds[1].events = POLLIN;
+        if (poll(fds, 2, -1) < 0)
+            continue;
+        if (fds[1].revents)
+            return;
+
+        ssize_t length;
+        while ((length = read(notifyFd, buffer, sizeof(buffer))) > 0)
+        {
+            Clock::time_point now = Clock::now();
+            std::lock_guard<std::mutex> guard(lock);
+            for (char *p = buffer; p < buffer + length;)
+            {
+                const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(p);
+                p += sizeof(struct inotify_event) + event->len;
+                if (event->len == 0)
+                    continue;
+                std::map<int, std::map<std::string, std::string> >::const_iterator directory =
+                    watches.find(event->wd);
+                if (directory == watches.end())
+                    continue;
+                std::map<std::string, std::string>::const_iterator file = directory->second.find(event->name);
+                if (file == directory->second.end())
+                    continue;
+
+                std::map<std::string, Burst>::iterator burst = bursts.find(file->second);
+                if (burst == bursts.end())
+                {
+                    Burst fresh = { now, now };
+                    bursts[file->second] = fresh;
+                }
+                else
+                    burst->second.last = now;
+            }
+        }
+    }
+#endif
+}
@@ -0,0 +1,76 @@
+/*
+ * File change notification
+ *
+ * Watches a set of files through inotify on a thread of its own. The
+ * directory holding each file is watched rather than the file, since most
+ * editors and exporters save by writing a new file and renaming it over
+ * the old one, which a watch on the file itself would not survive. A file
+ * counts as changed when it is closed after writing or renamed into place.
+ *
+ * Saves often come in bursts (a write, a rename, a touch), so a change is
+ * only reported once its file has been quiet for SETTLE_MS; its time is
+ * that of the first event of the burst, so latencies measured from it
+ * include the wait.
+ *
+ * Only Linux has inotify; elsewhere Watch() fails and nothing is reported.
+ */
+
+#ifndef FISHTANK_FILEWATCHER_H
+#define FISHTANK_FILEWATCHER_H
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class FileWatcher
+{
+    public:
+        static const int SETTLE_MS = 50;
+
+        struct Change
+        {
+            std::string                           fileName;   /* as passed to Watch() */
+            std::chrono::steady_clock::time_point time;
+        };
+
+        FileWatcher();
+        ~FileWatcher();
+
+        /* Report changes to fileName from now on; returns false when its
+         * directory can't be watched */
+        bool Watch(const std::string &fileName);
+
+        /* Files changed and settled since the last call, each once, in the
+         * order they changed; any thread */
+        std::vector<Change> TakeChanges();
+
+    private:
+        FileWatcher(const FileWatcher &);
+        FileWatcher &operator=(const FileWatcher &);
+
+        void Run();
+
+        typedef std::chrono::steady_clock Clock;
+
+        /* A burst of events on one file: its first and latest */
+        struct Burst
+        {
+            Clock::time_point first;
+            Clock::time_point last;
+        };
+
+        int         notifyFd;
+        int         stopPipe[2];
+        std::thread thread;
+
+        /* Watch descriptor to the names in its directory and the paths
+         * they were watched as */
+        std::mutex                                            lock;
+        std::map<int, std::map<std::string, std::string> >   watches;
+        std::map<std::string, Burst>                          bursts;
+};
+
+#endif
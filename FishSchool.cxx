@@ -0,0 +1,600 @@
+/*
+ * Fish schooling simulation
+ */
+
+#include "FishSchool.h"
+
+#include "DistanceField.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FISHSCHOOL_X86 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+/* The arrays a neighbour scan reads, already in grid order */
+struct Neighbours
+{
+    const float *x, *y, *z;
+    const float *vx, *vy, *vz;
+};
+
+/* What a scan adds up over the fish within reach: how many there are,
+ * their summed offsets and velocities, and the separation push */
+struct Sums
+{
+    float count;
+    float offset[3];
+    float velocity[3];
+    float separation[3];
+};
+
+typedef void (*Accumulator)(const Neighbours &n, const int *ranges, int rangeCount,
+                            const float position[3], float reach2, float separation2, Sums &sums);
+
+void AccumulateRange(const Neighbours &n, int begin, int end, const float position[3],
+                     float reach2, float separation2, Sums &sums)
+{
+    for (int j = begin; j < end; j++)
+    {
+        float dx = n.x[j] - position[0];
+        float dy = n.y[j] - position[1];
+        float dz = n.z[j] - position[2];
+        float d2 = dx * dx + dy * dy + dz * dz;
+        if (!(d2 < reach2 && d2 > 0))
+            continue;
+        sums.count++;
+        sums.offset[0]   += dx;
+        sums.offset[1]   += dy;
+        sums.offset[2]   += dz;
+        sums.velocity[0] += n.vx[j];
+        sums.velocity[1] += n.vy[j];
+        sums.velocity[2] += n.vz[j];
+        if (d2 < separation2)
+        {
+            float inverse = 1.0f / d2;
+            sums.separation[0] -= dx * inverse;
+            sums.separation[1] -= dy * inverse;
+            sums.separation[2] -= dz * inverse;
+        }
+    }
+}
+
+void AccumulateScalar(const Neighbours &n, const int *ranges, int rangeCount,
+                      const float position[3], float reach2, float separation2, Sums &sums)
+{
+    for (int r = 0; r < rangeCount; r++)
+        AccumulateRange(n, ranges[2 * r], ranges[2 * r + 1], position, reach2, separation2, sums);
+}
+
+#ifdef FISHSCHOOL_X86
+__attribute__((target("sse2")))
+float HorizontalSum(__m128 v)
+{
+    __m128 pairs = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+}
+
+/* Four neighbours per iteration; lanes out of reach are masked to zero */
+__attribute__((target("sse2")))
+void AccumulateSSE(const Neighbours &n, const int *ranges, int rangeCount,
+                   const float position[3], float reach2, float separation2, Sums &sums)
+{
+    const __m128 x     = _mm_set1_ps(position[0]);
+    const __m128 y     = _mm_set1_ps(position[1]);
+    const __m128 z     = _mm_set1_ps(position[2]);
+    const __m128 reach = _mm_set1_ps(reach2);
+    const __m128 apart = _mm_set1_ps(separation2);
+    const __m128 zero  = _mm_setzero_ps();
+    const __m128 one   = _mm_set1_ps(1.0f);
+
+    __m128 count = zero;
+    __m128 ox = zero, oy = zero, oz = zero;
+    __m128 vx = zero, vy = zero, vz = zero;
+    __m128 sx = zero, sy = zero, sz = zero;
+    for (int r = 0; r < rangeCount; r++)
+    {
+        int j   = ranges[2 * r];
+        int end = ranges[2 * r + 1];
+        for (; j + 4 <= end; j += 4)
+        {
+            __m128 dx = _mm_sub_ps(_mm_loadu_ps(n.x + j), x);
+            __m128 dy = _mm_sub_ps(_mm_loadu_ps(n.y + j), y);
+            __m128 dz = _mm_sub_ps(_mm_loadu_ps(n.z + j), z);
+            __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+            __m128 near = _mm_and_ps(_mm_cmplt_ps(d2, reach), _mm_cmpgt_ps(d2, zero));
+            count = _mm_add_ps(count, _mm_and_ps(near, one));
+            ox = _mm_add_ps(ox, _mm_and_ps(near, dx));
+            oy = _mm_add_ps(oy, _mm_and_ps(near, dy));
+            oz = _mm_add_ps(oz, _mm_and_ps(near, dz));
+            vx = _mm_add_ps(vx, _mm_and_ps(near, _mm_loadu_ps(n.vx + j)));
+            vy = _mm_add_ps(vy, _mm_and_ps(near, _mm_loadu_ps(n.vy + j)));
+            vz = _mm_add_ps(vz, _mm_and_ps(near, _mm_loadu_ps(n.vz + j)));
+            __m128 close   = _mm_and_ps(near, _mm_cmplt_ps(d2, apart));
+            __m128 inverse = _mm_div_ps(one, d2);
+            sx = _mm_sub_ps(sx, _mm_and_ps(close, _mm_mul_ps(dx, inverse)));
+            sy = _mm_sub_ps(sy, _mm_and_ps(close, _mm_mul_ps(dy, inverse)));
+            sz = _mm_sub_ps(sz, _mm_and_ps(close, _mm_mul_ps(dz, inverse)));
+        }
+        AccumulateRange(n, j, end, position, reach2, separation2, sums);
+    }
+    sums.count         += HorizontalSum(count);
+    sums.offset[0]     += HorizontalSum(ox);
+    sums.offset[1]     += HorizontalSum(oy);
+    sums.offset[2]     += HorizontalSum(oz);
+    sums.velocity[0]   += HorizontalSum(vx);
+    sums.velocity[1]   += HorizontalSum(vy);
+    sums.velocity[2]   += HorizontalSum(vz);
+    sums.separation[0] += HorizontalSum(sx);
+    sums.separation[1] += HorizontalSum(sy);
+    sums.separation[2] += HorizontalSum(sz);
+}
+
+__attribute__((target("avx2,fma")))
+float HorizontalSum(__m256 v)
+{
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    __m128 pairs = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+}
+
+/* As the SSE kernel, eight neighbours at a time. The last few of a run
+ * go through masked loads rather than the scalar loop, which would cost
+ * an AVX to SSE transition per run */
+__attribute__((target("avx2,fma")))
+void AccumulateAVX2(const Neighbours &n, const int *ranges, int rangeCount,
+                    const float position[3], float reach2, float separation2, Sums &sums)
+{
+    const __m256  x     = _mm256_set1_ps(position[0]);
+    const __m256  y     = _mm256_set1_ps(position[1]);
+    const __m256  z     = _mm256_set1_ps(position[2]);
+    const __m256  reach = _mm256_set1_ps(reach2);
+    const __m256  apart = _mm256_set1_ps(separation2);
+    const __m256  zero  = _mm256_setzero_ps();
+    const __m256  one   = _mm256_set1_ps(1.0f);
+    const __m256i lane  = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    __m256 count = zero;
+    __m256 ox = zero, oy = zero, oz = zero;
+    __m256 vx = zero, vy = zero, vz = zero;
+    __m256 sx = zero, sy = zero, sz = zero;
+    for (int r = 0; r < rangeCount; r++)
+    {
+        int end = ranges[2 * r + 1];
+        for (int j = ranges[2 * r]; j < end; j += 8)
+        {
+            __m256i load = _mm256_cmpgt_epi32(_mm256_set1_epi32(end - j), lane);
+            __m256 dx = _mm256_sub_ps(_mm256_maskload_ps(n.x + j, load), x);
+            __m256 dy = _mm256_sub_ps(_mm256_maskload_ps(n.y + j, load), y);
+            __m256 dz = _mm256_sub_ps(_mm256_maskload_ps(n.z + j, load), z);
+            __m256 d2 = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dz, dz)));
+            __m256 near = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(d2, reach, _CMP_LT_OQ),
+                                                      _mm256_cmp_ps(d2, zero, _CMP_GT_OQ)),
+                                        _mm256_castsi256_ps(load));
+            count = _mm256_add_ps(count, _mm256_and_ps(near, one));
+            ox = _mm256_add_ps(ox, _mm256_and_ps(near, dx));
+            oy = _mm256_add_ps(oy, _mm256_and_ps(near, dy));
+            oz = _mm256_add_ps(oz, _mm256_and_ps(near, dz));
+            vx = _mm256_add_ps(vx, _mm256_and_ps(near, _mm256_maskload_ps(n.vx + j, load)));
+            vy = _mm256_add_ps(vy, _mm256_and_ps(near, _mm256_maskload_ps(n.vy + j, load)));
+            vz = _mm256_add_ps(vz, _mm256_and_ps(near, _mm256_maskload_ps(n.vz + j, load)));
+            __m256 close   = _mm256_and_ps(near, _mm256_cmp_ps(d2, apart, _CMP_LT_OQ));
+            __m256 inverse = _mm256_div_ps(one, d2);
+            sx = _mm256_sub_ps(sx, _mm256_and_ps(close, _mm256_mul_ps(dx, inverse)));
+            sy = _mm256_sub_ps(sy, _mm256_and_ps(close, _mm256_mul_ps(dy, inverse)));
+            sz = _mm256_sub_ps(sz, _mm256_and_ps(close, _mm256_mul_ps(dz, inverse)));
+        }
+    }
+    sums.count         += HorizontalSum(count);
+    sums.offset[0]     += HorizontalSum(ox);
+    sums.offset[1]     += HorizontalSum(oy);
+    sums.offset[2]     += HorizontalSum(oz);
+    sums.velocity[0]   += HorizontalSum(vx);
+    sums.velocity[1]   += HorizontalSum(vy);
+    sums.velocity[2]   += HorizontalSum(vz);
+    sums.separation[0] += HorizontalSum(sx);
+    sums.separation[1] += HorizontalSum(sy);
+    sums.separation[2] += HorizontalSum(sz);
+}
+#endif
+
+}
+
+bool FishSchool::IsKernelSupported(Kernel kernel)
+{
+    switch (kernel)
+    {
+        case SCALAR:
+            return true;
+#ifdef FISHSCHOOL_X86
+        case SSE:
+            return __builtin_cpu_supports("sse2");
+        case AVX2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+        default:
+            return false;
+    }
+}
+
+namespace
+{
+Accumulator GetAccumulator(FishSchool::Kernel kernel)
+{
+#ifdef FISHSCHOOL_X86
+    if (kernel == FishSchool::AVX2)
+        return AccumulateAVX2;
+    if (kernel == FishSchool::SSE)
+        return AccumulateSSE;
+#endif
+    return AccumulateScalar;
+}
+
+/* Move the entries of values into grid order */
+template <typename T>
+void Reorder(std::vector<T> &values, const std::vector<int> &order, std::vector<T> &scratch)
+{
+    scratch.resize(values.size());
+    for (size_t k = 0; k < order.size(); k++)
+        scratch[k] = values[order[k]];
+    values.swap(scratch);
+}
+}
+
+FishSchool::FishSchool()
+    : parameters(GetDefaultParameters()), kernel(GetBestKernel()), obstacles(0)
+{
+    cells[0] = cells[1] = cells[2] = 1;
+}
+
+FishSchool::Parameters FishSchool::GetDefaultParameters()
+{
+    Parameters p;
+    p.neighbourRadius  = 3.0f;
+    p.separationRadius = 1.2f;
+    p.separationWeight = 3.0f;
+    p.alignmentWeight  = 1.0f;
+    p.cohesionWeight   = 0.5f;
+    p.wallWeight       = 8.0f;
+    p.wallMargin       = 3.0f;
+    p.minSpeed         = 1.5f;
+    p.maxSpeed         = 5.0f;
+    p.turnRate         = 6.0f;
+    p.obstacleWeight   = 12.0f;
+    p.obstacleMargin   = 2.5f;
+    p.bodyRadius       = 0.6f;
+    p.boundsMin[0] = -22; p.boundsMin[1] = -8; p.boundsMin[2] = -15;
+    p.boundsMax[0] =  22; p.boundsMax[1] =  8; p.boundsMax[2] =   8;
+    return p;
+}
+
+FishSchool::Kernel FishSchool::GetBestKernel()
+{
+    if (IsKernelSupported(AVX2))
+        return AVX2;
+    if (IsKernelSupported(SSE))
+        return SSE;
+    return SCALAR;
+}
+
+const char *FishSchool::GetKernelName(Kernel kernel)
+{
+    switch (kernel)
+    {
+        case AVX2: return "avx2";
+        case SSE:  return "sse";
+        default:   return "scalar";
+    }
+}
+
+void FishSchool::SetKernel(Kernel k)
+{
+    kernel = IsKernelSupported(k) ? k : GetBestKernel();
+}
+
+void FishSchool::Reset(int count, int speciesCount, unsigned int seed)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::normal_distribution<float>       gaussian(0.0f, 1.0f);
+
+    std::vector<float> *arrays[] = { &px, &py, &pz, &vx, &vy, &vz, &hx, &hy, &hz, &nvx, &nvy, &nvz };
+    for (size_t a = 0; a < sizeof(arrays) / sizeof(arrays[0]); a++)
+        arrays[a]->assign(count, 0.0f);
+    species.assign(count, 0);
+    ids.resize(count);
+
+    float speed = 0.5f * (parameters.minSpeed + parameters.maxSpeed);
+    for (int i = 0; i < count; i++)
+    {
+        float *position[3] = { &px[i], &py[i], &pz[i] };
+        for (int c = 0; c < 3; c++)
+            *position[c] = parameters.boundsMin[c] + unit(random) * (parameters.boundsMax[c] - parameters.boundsMin[c]);
+
+        float d[3] = { gaussian(random), 0.3f * gaussian(random), gaussian(random) };
+        float length = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+        if (length < 1e-6f)
+        {
+            d[0]   = 1;
+            length = 1;
+        }
+        hx[i] = d[0] / length;
+        hy[i] = d[1] / length;
+        hz[i] = d[2] / length;
+        vx[i] = hx[i] * speed;
+        vy[i] = hy[i] * speed;
+        vz[i] = hz[i] * speed;
+        species[i] = (unsigned char)(speciesCount > 0 ? i % speciesCount : 0);
+        ids[i]     = i;
+    }
+}
+
+void FishSchool::Step(float dt)
+{
+    if (px.empty())
+        return;
+    SortIntoGrid();
+    SampleObstacles();
+    Steer(dt);
+    Integrate(dt);
+    if (obstacles)
+    {
+        SampleObstacles();
+        Collide();
+    }
+}
+
+void FishSchool::SampleObstacles()
+{
+    if (!obstacles)
+        return;
+    int count = GetNumberOfFish();
+    clearance.resize(count);
+    awayX.resize(count);
+    awayY.resize(count);
+    awayZ.resize(count);
+    obstacles->Sample(&px[0], &py[0], &pz[0], count, &clearance[0], &awayX[0], &awayY[0], &awayZ[0]);
+}
+
+/* Put fish that got too close back at arm's length along the way out, and
+ * keep only the part of their velocity along the surface */
+void FishSchool::Collide()
+{
+    const Parameters &p = parameters;
+    int count = GetNumberOfFish();
+    for (int i = 0; i < count; i++)
+    {
+        if (clearance[i] >= p.bodyRadius)
+            continue;
+        float away[3] = { awayX[i], awayY[i], awayZ[i] };
+        float length  = std::sqrt(away[0] * away[0] + away[1] * away[1] + away[2] * away[2]);
+        if (length < 1e-6f)
+            continue;
+        for (int c = 0; c < 3; c++)
+            away[c] /= length;
+
+        float push = p.bodyRadius - clearance[i];
+        px[i] += away[0] * push;
+        py[i] += away[1] * push;
+        pz[i] += away[2] * push;
+        float inward = vx[i] * away[0] + vy[i] * away[1] + vz[i] * away[2];
+        if (inward < 0)
+        {
+            vx[i] -= inward * away[0];
+            vy[i] -= inward * away[1];
+            vz[i] -= inward * away[2];
+        }
+    }
+}
+
+/* Counting sort by cell, then reorder every per-fish array to match */
+void FishSchool::SortIntoGrid()
+{
+    const Parameters &p = parameters;
+    float inverseCell = 1.0f / p.neighbourRadius;
+    for (int c = 0; c < 3; c++)
+        cells[c] = std::max(1, (int)std::ceil((p.boundsMax[c] - p.boundsMin[c]) * inverseCell));
+    int cellCount = cells[0] * cells[1] * cells[2];
+
+    int count = GetNumberOfFish();
+    cellOf.resize(count);
+    cellStart.assign(cellCount + 1, 0);
+    for (int i = 0; i < count; i++)
+    {
+        int cx = std::min(cells[0] - 1, std::max(0, (int)((px[i] - p.boundsMin[0]) * inverseCell)));
+        int cy = std::min(cells[1] - 1, std::max(0, (int)((py[i] - p.boundsMin[1]) * inverseCell)));
+        int cz = std::min(cells[2] - 1, std::max(0, (int)((pz[i] - p.boundsMin[2]) * inverseCell)));
+        cellOf[i] = (cz * cells[1] + cy) * cells[0] + cx;
+        cellStart[cellOf[i] + 1]++;
+    }
+    for (int c = 0; c < cellCount; c++)
+        cellStart[c + 1] += cellStart[c];
+
+    /* Scatter with cellStart as the cursor, which leaves each entry at the
+     * start of the next cell; shifting by one restores the starts */
+    order.resize(count);
+    for (int i = 0; i < count; i++)
+        order[cellStart[cellOf[i]]++] = i;
+    for (int c = cellCount; c > 0; c--)
+        cellStart[c] = cellStart[c - 1];
+    cellStart[0] = 0;
+
+    std::vector<float> *arrays[] = { &px, &py, &pz, &vx, &vy, &vz, &hx, &hy, &hz };
+    for (size_t a = 0; a < sizeof(arrays) / sizeof(arrays[0]); a++)
+        Reorder(*arrays[a], order, scratch);
+    Reorder(species, order, scratchSpecies);
+    Reorder(ids, order, scratchIds);
+}
+
+void FishSchool::Steer(float dt)
+{
+    const Parameters &p = parameters;
+    Accumulator accumulate = GetAccumulator(kernel);
+    Neighbours  neighbours = { &px[0], &py[0], &pz[0], &vx[0], &vy[0], &vz[0] };
+    float inverseCell = 1.0f / p.neighbourRadius;
+    float reach2      = p.neighbourRadius * p.neighbourRadius;
+    float separation2 = p.separationRadius * p.separationRadius;
+    float minSpeed2   = p.minSpeed * p.minSpeed;
+    float maxSpeed2   = p.maxSpeed * p.maxSpeed;
+
+    int count = GetNumberOfFish();
+    for (int i = 0; i < count; i++)
+    {
+        float position[3] = { px[i], py[i], pz[i] };
+        int cell[3];
+        for (int c = 0; c < 3; c++)
+            cell[c] = std::min(cells[c] - 1, std::max(0, (int)((position[c] - p.boundsMin[c]) * inverseCell)));
+
+        /* Cells are numbered x fastest, so each row of three is one run */
+        int ranges[18];
+        int rangeCount = 0;
+        int x0 = std::max(cell[0] - 1, 0);
+        int x1 = std::min(cell[0] + 1, cells[0] - 1);
+        for (int z = std::max(cell[2] - 1, 0); z <= std::min(cell[2] + 1, cells[2] - 1); z++)
+            for (int y = std::max(cell[1] - 1, 0); y <= std::min(cell[1] + 1, cells[1] - 1); y++)
+            {
+                int row = (z * cells[1] + y) * cells[0];
+                ranges[2 * rangeCount]     = cellStart[row + x0];
+                ranges[2 * rangeCount + 1] = cellStart[row + x1 + 1];
+                rangeCount++;
+            }
+
+        Sums sums = { 0, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 } };
+        accumulate(neighbours, ranges, rangeCount, position, reach2, separation2, sums);
+
+        /* Scenery pushes harder the closer it is */
+        float avoid   = 0;
+        float away[3] = { 0, 0, 0 };
+        if (obstacles && clearance[i] < p.obstacleMargin)
+        {
+            avoid   = p.obstacleWeight * (p.obstacleMargin - clearance[i]) / p.obstacleMargin;
+            away[0] = awayX[i];
+            away[1] = awayY[i];
+            away[2] = awayZ[i];
+        }
+
+        float velocity[3] = { vx[i], vy[i], vz[i] };
+        float steer[3];
+        for (int c = 0; c < 3; c++)
+        {
+            steer[c] = p.separationWeight * sums.separation[c];
+            if (sums.count > 0)
+                steer[c] += p.alignmentWeight * (sums.velocity[c] / sums.count - velocity[c])
+                          + p.cohesionWeight * (sums.offset[c] / sums.count);
+            steer[c] += avoid * away[c];
+            float low  = p.boundsMin[c] + p.wallMargin;
+            float high = p.boundsMax[c] - p.wallMargin;
+            if (position[c] < low)
+                steer[c] += p.wallWeight * (low - position[c]) / p.wallMargin;
+            else if (position[c] > high)
+                steer[c] -= p.wallWeight * (position[c] - high) / p.wallMargin;
+            velocity[c] += steer[c] * dt;
+        }
+
+        float speed2 = velocity[0] * velocity[0] + velocity[1] * velocity[1] + velocity[2] * velocity[2];
+        if (speed2 > maxSpeed2 || (speed2 < minSpeed2 && speed2 > 0))
+        {
+            float scale = (speed2 > maxSpeed2 ? p.maxSpeed : p.minSpeed) / std::sqrt(speed2);
+            for (int c = 0; c < 3; c++)
+                velocity[c] *= scale;
+        }
+        nvx[i] = velocity[0];
+        nvy[i] = velocity[1];
+        nvz[i] = velocity[2];
+    }
+}
+
+void FishSchool::Integrate(float dt)
+{
+    const Parameters &p = parameters;
+    vx.swap(nvx);
+    vy.swap(nvy);
+    vz.swap(nvz);
+
+    float follow = std::min(1.0f, p.turnRate * dt);
+    int   count  = GetNumberOfFish();
+    for (int i = 0; i < count; i++)
+    {
+        px[i] += vx[i] * dt;
+        py[i] += vy[i] * dt;
+        pz[i] += vz[i] * dt;
+
+        /* Headings ease towards the direction of travel */
+        float speed = std::sqrt(vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i]);
+        if (speed > 0)
+        {
+            float inverse = 1.0f / speed;
+            hx[i] += (vx[i] * inverse - hx[i]) * follow;
+            hy[i] += (vy[i] * inverse - hy[i]) * follow;
+            hz[i] += (vz[i] * inverse - hz[i]) * follow;
+        }
+        float length = std::sqrt(hx[i] * hx[i] + hy[i] * hy[i] + hz[i] * hz[i]);
+        if (length > 0)
+        {
+            hx[i] /= length;
+            hy[i] /= length;
+            hz[i] /= length;
+        }
+    }
+
+    /* The walls only steer; anything that still got out is put back */
+    float *position[3] = { &px[0], &py[0], &pz[0] };
+    float *velocity[3] = { &vx[0], &vy[0], &vz[0] };
+    for (int c = 0; c < 3; c++)
+        for (int i = 0; i < count; i++)
+        {
+            if (position[c][i] < p.boundsMin[c])
+            {
+                position[c][i] = p.boundsMin[c];
+                velocity[c][i] = std::fabs(velocity[c][i]);
+            }
+            else if (position[c][i] > p.boundsMax[c])
+            {
+                position[c][i] = p.boundsMax[c];
+                velocity[c][i] = -std::fabs(velocity[c][i]);
+            }
+        }
+}
+
+void FishSchool::GetModelMatrix(int fish, float scale, float matrix[16]) const
+{
+    float position[3] = { px[fish], py[fish], pz[fish] };
+    float heading[3]  = { hx[fish], hy[fish], hz[fish] };
+    ComputeModelMatrix(position, heading, scale, matrix);
+}
+
+void FishSchool::ComputeModelMatrix(const float position[3], const float forward[3],
+                                    float scale, float matrix[16])
+{
+    /* right = worldUp x forward, up = forward x right */
+    float right[3] = { forward[2], 0, -forward[0] };
+    float length   = std::sqrt(right[0] * right[0] + right[2] * right[2]);
+    if (length < 1e-4f)
+    {
+        right[0] = 1;
+        right[2] = 0;
+    }
+    else
+    {
+        right[0] /= length;
+        right[2] /= length;
+    }
+    float up[3] = { forward[1] * right[2] - forward[2] * right[1],
+                    forward[2] * right[0] - forward[0] * right[2],
+                    forward[0] * right[1] - forward[1] * right[0] };
+
+    for (int r = 0; r < 3; r++)
+    {
+        matrix[r]      = right[r] * scale;
+        matrix[4 + r]  = up[r] * scale;
+        matrix[8 + r]  = forward[r] * scale;
+        matrix[12 + r] = position[r];
+    }
+    matrix[3] = matrix[7] = matrix[11] = 0;
+    matrix[15] = 1;
+}
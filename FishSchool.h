@@ -0,0 +1,132 @@
+/*
+ * Fish schooling simulation
+ *
+ * Boids in structure-of-arrays form: positions, velocities and headings
+ * live in separate float arrays, one entry per fish. Every step the fish
+ * are counting-sorted into a uniform grid over the tank bounds whose cells
+ * are one neighbour radius wide, and the arrays are reordered to match, so
+ * a fish's neighbours are found by scanning nine contiguous runs of the
+ * arrays (three rows of three cells along x). The scan, which accumulates
+ * separation, alignment and cohesion, runs on AVX2, SSE or scalar code,
+ * chosen at run time.
+ *
+ * Because of the reordering a fish's index changes between steps; its
+ * species and its id, the index it was created with, travel with it.
+ *
+ * Given a distance field of the scenery, fish steer away from anything
+ * within the obstacle margin, and any that still end a step closer than
+ * their body radius are pushed back out and lose the part of their
+ * velocity heading in. The field is sampled for every fish in one batch,
+ * before steering and again after moving.
+ */
+
+#ifndef FISHTANK_FISHSCHOOL_H
+#define FISHTANK_FISHSCHOOL_H
+
+#include <vector>
+
+class DistanceField;
+
+class FishSchool
+{
+    public:
+        struct Parameters
+        {
+            float neighbourRadius;    /* alignment and cohesion reach, also the cell size */
+            float separationRadius;   /* closer than this pushes apart */
+            float separationWeight;
+            float alignmentWeight;
+            float cohesionWeight;
+            float wallWeight;         /* push back from within wallMargin of the bounds */
+            float wallMargin;
+            float minSpeed;
+            float maxSpeed;
+            float turnRate;           /* how fast headings follow velocity, per second */
+            float obstacleWeight;     /* push away from scenery within obstacleMargin */
+            float obstacleMargin;
+            float bodyRadius;         /* closest a fish's centre gets to scenery */
+            float boundsMin[3];
+            float boundsMax[3];
+        };
+
+        enum Kernel { SCALAR, SSE, AVX2 };
+
+        FishSchool();
+
+        /* Defaults tuned for the tank's units */
+        static Parameters GetDefaultParameters();
+
+        void              SetParameters(const Parameters &p) { parameters = p; }
+        const Parameters &GetParameters() const { return parameters; }
+
+        /* Scenery to avoid, or null for none; not owned */
+        void                 SetObstacles(const DistanceField *field) { obstacles = field; }
+        const DistanceField *GetObstacles() const { return obstacles; }
+
+        /* Fastest kernel this CPU supports; the default */
+        static Kernel      GetBestKernel();
+        static bool        IsKernelSupported(Kernel kernel);
+        static const char *GetKernelName(Kernel kernel);
+
+        /* Falls back to the best supported kernel if this one isn't */
+        void   SetKernel(Kernel kernel);
+        Kernel GetKernel() const { return kernel; }
+
+        /* Scatter count fish uniformly through the bounds, species assigned
+         * round robin */
+        void Reset(int count, int speciesCount, unsigned int seed);
+
+        void Step(float dt);
+
+        int GetNumberOfFish() const { return (int)px.size(); }
+
+        const float         *GetPositionX() const { return px.empty() ? 0 : &px[0]; }
+        const float         *GetPositionY() const { return py.empty() ? 0 : &py[0]; }
+        const float         *GetPositionZ() const { return pz.empty() ? 0 : &pz[0]; }
+        const float         *GetHeadingX() const { return hx.empty() ? 0 : &hx[0]; }
+        const float         *GetHeadingY() const { return hy.empty() ? 0 : &hy[0]; }
+        const float         *GetHeadingZ() const { return hz.empty() ? 0 : &hz[0]; }
+        const unsigned char *GetSpecies() const { return species.empty() ? 0 : &species[0]; }
+        const int           *GetIds() const { return ids.empty() ? 0 : &ids[0]; }
+
+        /* Column-major model matrix placing a mesh whose nose points along +z
+         * at the fish, facing its heading, upright and uniformly scaled */
+        void GetModelMatrix(int fish, float scale, float matrix[16]) const;
+        static void ComputeModelMatrix(const float position[3], const float heading[3],
+                                       float scale, float matrix[16]);
+
+    private:
+        void SortIntoGrid();
+        void Steer(float dt);
+        void Integrate(float dt);
+        void Collide();
+
+        /* Distance to the scenery and the way out, for every fish */
+        void SampleObstacles();
+
+        Parameters           parameters;
+        Kernel               kernel;
+        const DistanceField *obstacles;
+
+        std::vector<float>         px, py, pz;
+        std::vector<float>         vx, vy, vz;
+        std::vector<float>         hx, hy, hz;
+        std::vector<unsigned char> species;
+        std::vector<int>           ids;
+
+        /* Velocities for the next step, written while the old ones are read */
+        std::vector<float> nvx, nvy, nvz;
+
+        std::vector<float> clearance, awayX, awayY, awayZ;
+
+        /* Uniform grid; cellStart[c]..cellStart[c + 1] are the fish in cell c */
+        int                cells[3];
+        std::vector<int>   cellOf;
+        std::vector<int>   cellStart;
+        std::vector<int>   order;
+        std::vector<float> scratch;
+        std::vector<unsigned char> scratchSpecies;
+        std::vector<int>           scratchIds;
+};
+
+#endif
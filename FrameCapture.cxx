@@ -0,0 +1,429 @@
+/*
+ * Frame capture
+ */
+
+#include "FrameCapture.h"
+
+#include "Profiler.h"
+
+#include <vtkCommand.h>
+#include <vtkImageData.h>
+#include <vtkPNGWriter.h>
+#include <vtkPointData.h>
+#include <vtkUnsignedCharArray.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+/* How long the render loop waits for a readback it needs its buffer back
+ * from before giving the frame up */
+const GLuint64 READBACK_TIMEOUT_NS = 1000000000;
+
+/* True when the pattern has exactly one integer conversion, such as %05d,
+ * and no other; %% is allowed */
+bool IsFramePattern(const std::string &pattern)
+{
+    int conversions = 0;
+    for (size_t i = 0; i < pattern.size(); i++)
+    {
+        if (pattern[i] != '%')
+            continue;
+        if (i + 1 < pattern.size() && pattern[i + 1] == '%')
+        {
+            i++;
+            continue;
+        }
+        size_t j = i + 1;
+        while (j < pattern.size() && isdigit((unsigned char)pattern[j]))
+            j++;
+        if (j >= pattern.size() || pattern[j] != 'd')
+            return false;
+        conversions++;
+        i = j;
+    }
+    return conversions == 1;
+}
+
+std::string ShellQuote(const std::string &text)
+{
+    std::string quoted = "'";
+    for (size_t i = 0; i < text.size(); i++)
+        quoted += text[i] == '\'' ? std::string("'\\''") : std::string(1, text[i]);
+    return quoted + "'";
+}
+}
+
+FrameCapture::FrameCapture()
+    : framesPerSecond(30), video(NULL), videoWidth(0), videoHeight(0), queueLength(8), policy(DROP),
+      window(NULL), renderer(NULL), observer(0), nextSlot(0), nextIndex(0), closing(false)
+{
+    for (int i = 0; i < RING_SIZE; i++)
+    {
+        slots[i].buffer = 0;
+        slots[i].fence  = 0;
+        slots[i].width  = slots[i].height = 0;
+        slots[i].index  = 0;
+    }
+    memset(&stats, 0, sizeof(stats));
+}
+
+FrameCapture::~FrameCapture()
+{
+    /* Without a context the GL objects can only be abandoned, but the
+     * encoders must not outlive the queue */
+    if (renderer)
+        renderer->RemoveObserver(observer);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing = true;
+    }
+    ready.notify_all();
+    for (size_t i = 0; i < encoders.size(); i++)
+        encoders[i].join();
+    if (video)
+        pclose(video);
+}
+
+void FrameCapture::SetQueueLength(size_t frames)
+{
+    queueLength = std::max<size_t>(frames, 1);
+}
+
+void FrameCapture::SetPolicy(Policy value)
+{
+    policy = value;
+}
+
+bool FrameCapture::OpenImages(const std::string &imagePattern, unsigned int threads, std::string &error)
+{
+    if (!IsFramePattern(imagePattern))
+    {
+        error = "'" + imagePattern + "' needs one frame number conversion, such as tank%05d.png";
+        return false;
+    }
+    pattern = imagePattern;
+    if (threads == 0)
+        threads = std::max(std::thread::hardware_concurrency() / 2, 1u);
+    StartEncoders(threads);
+    return true;
+}
+
+bool FrameCapture::OpenVideo(const std::string &fileName, double rate, std::string &error)
+{
+    if (system("ffmpeg -version >/dev/null 2>&1") != 0)
+    {
+        error = "recording " + fileName + " needs ffmpeg on the PATH";
+        return false;
+    }
+
+    /* A dead ffmpeg should fail the writes, not kill the app */
+    signal(SIGPIPE, SIG_IGN);
+    videoFile       = fileName;
+    framesPerSecond = rate > 0 ? rate : 30;
+    StartEncoders(1);
+    return true;
+}
+
+void FrameCapture::Attach(vtkRenderWindow *renderWindow, vtkRenderer *lastRenderer)
+{
+    window   = renderWindow;
+    renderer = lastRenderer;
+    callback = vtkSmartPointer<vtkCallbackCommand>::New();
+    callback->SetCallback(OnRendered);
+    callback->SetClientData(this);
+    observer = renderer->AddObserver(vtkCommand::EndEvent, callback);
+}
+
+FrameCapture::Stats FrameCapture::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void FrameCapture::OnRendered(vtkObject *, unsigned long, void *clientData, void *)
+{
+    static_cast<FrameCapture *>(clientData)->ReadBack();
+}
+
+/* Runs as the last renderer finishes, before the buffers swap */
+void FrameCapture::ReadBack()
+{
+    int *size  = window->GetSize();
+    int width  = size[0];
+    int height = size[1];
+    if (width < 1 || height < 1)
+        return;
+    ScopedTimer timer("capture:readback");
+
+    GLint packBuffer, packAlignment, readFramebuffer, drawFramebuffer, drawBuffer, readBuffer;
+    glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &packBuffer);
+    glGetIntegerv(GL_PACK_ALIGNMENT, &packAlignment);
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer);
+    glGetIntegerv(GL_DRAW_BUFFER, &drawBuffer);
+
+    /* Whatever has come back since, oldest first, so frames stay in order */
+    for (int i = 0; i < RING_SIZE; i++)
+    {
+        Slot &slot = slots[(nextSlot + i) % RING_SIZE];
+        if (slot.fence && !Collect(slot, false))
+            break;
+    }
+
+    Slot &slot = slots[nextSlot];
+    if (slot.fence)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stats.stalls++;
+        }
+        Collect(slot, true);
+    }
+
+    /* The frame just drawn, read from where it was drawn */
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, drawFramebuffer);
+    glGetIntegerv(GL_READ_BUFFER, &readBuffer);
+    glReadBuffer(drawBuffer);
+    if (!slot.buffer)
+        glGenBuffers(1, &slot.buffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    if (slot.width != width || slot.height != height)
+        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 3, NULL, GL_STREAM_READ);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, (void *)0);
+    slot.fence  = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.width  = width;
+    slot.height = height;
+    slot.index  = nextIndex++;
+    nextSlot    = (nextSlot + 1) % RING_SIZE;
+
+    glReadBuffer(readBuffer);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, packAlignment);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffer);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Profiler &profiler = Profiler::Get();
+    profiler.Count("capture:queued", (double)queue.size());
+    profiler.Count("capture:dropped", (double)stats.dropped);
+}
+
+bool FrameCapture::Collect(Slot &slot, bool wait)
+{
+    GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? READBACK_TIMEOUT_NS : 0);
+    if (status == GL_TIMEOUT_EXPIRED && !wait)
+        return false;
+    glDeleteSync(slot.fence);
+    slot.fence = 0;
+
+    Frame frame;
+    frame.width  = slot.width;
+    frame.height = slot.height;
+    frame.index  = slot.index;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.readBack++;
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        {
+            stats.failed++;
+            return true;
+        }
+        /* No point copying a frame that is going to be dropped */
+        if (policy == DROP && queue.size() >= queueLength)
+        {
+            stats.dropped++;
+            return true;
+        }
+        if (!spare.empty())
+        {
+            frame.pixels.swap(spare.back());
+            spare.pop_back();
+        }
+    }
+
+    size_t bytes = (size_t)frame.width * frame.height * 3;
+    frame.pixels.resize(bytes);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    const void *mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)bytes, GL_MAP_READ_BIT);
+    if (!mapped)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.failed++;
+        return true;
+    }
+    memcpy(&frame.pixels[0], mapped, bytes);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    Enqueue(frame);
+    return true;
+}
+
+void FrameCapture::Enqueue(Frame &frame)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    /* ffmpeg was told one size; a resized window's frames can't join it */
+    if (!videoFile.empty())
+    {
+        if (videoWidth == 0)
+        {
+            videoWidth  = frame.width;
+            videoHeight = frame.height;
+        }
+        else if (frame.width != videoWidth || frame.height != videoHeight)
+        {
+            stats.dropped++;
+            spare.push_back(std::move(frame.pixels));
+            return;
+        }
+    }
+
+    if (queue.size() >= queueLength)
+    {
+        if (policy == DROP)
+        {
+            stats.dropped++;
+            spare.push_back(std::move(frame.pixels));
+            return;
+        }
+        ScopedTimer timer("capture:wait");
+        FrameClock::Clock::time_point start = FrameClock::Clock::now();
+        space.wait(lock, [this]() { return queue.size() < queueLength; });
+        stats.waitMs += std::chrono::duration<double, std::milli>(FrameClock::Clock::now() - start).count();
+    }
+    queue.push_back(std::move(frame));
+    stats.maxQueued = std::max(stats.maxQueued, queue.size());
+    lock.unlock();
+    ready.notify_one();
+}
+
+void FrameCapture::StartEncoders(unsigned int count)
+{
+    for (unsigned int i = 0; i < count; i++)
+        encoders.push_back(std::thread(&FrameCapture::EncoderLoop, this));
+}
+
+void FrameCapture::EncoderLoop()
+{
+    Profiler::Get().SetThreadName("encoder");
+    for (;;)
+    {
+        Frame frame;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [this]() { return !queue.empty() || closing; });
+            if (queue.empty())
+                return;
+            frame = std::move(queue.front());
+            queue.pop_front();
+        }
+        space.notify_one();
+
+        bool written;
+        {
+            ScopedTimer timer("capture:encode");
+            written = videoFile.empty() ? WriteImage(frame) : WriteVideo(frame);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (written)
+            stats.written++;
+        else
+            stats.failed++;
+        spare.push_back(std::move(frame.pixels));
+    }
+}
+
+bool FrameCapture::WriteImage(const Frame &frame)
+{
+    char fileName[4096];
+    snprintf(fileName, sizeof(fileName), pattern.c_str(), (int)frame.index);
+
+    /* VTK images start at the bottom row too, so the rows go in as read */
+    vtkSmartPointer<vtkUnsignedCharArray> scalars = vtkSmartPointer<vtkUnsignedCharArray>::New();
+    scalars->SetNumberOfComponents(3);
+    scalars->SetArray(const_cast<unsigned char *>(&frame.pixels[0]), (vtkIdType)frame.pixels.size(), 1);
+    vtkSmartPointer<vtkImageData> image = vtkSmartPointer<vtkImageData>::New();
+    image->SetDimensions(frame.width, frame.height, 1);
+    image->GetPointData()->SetScalars(scalars);
+
+    vtkSmartPointer<vtkPNGWriter> writer = vtkSmartPointer<vtkPNGWriter>::New();
+    writer->SetFileName(fileName);
+    writer->SetInputData(image);
+    writer->Write();
+    return writer->GetErrorCode() == 0;
+}
+
+/* Only ever called from the one video encoder thread */
+bool FrameCapture::WriteVideo(const Frame &frame)
+{
+    if (!video)
+    {
+        /* Rows arrive bottom first, and most codecs want even sizes */
+        std::ostringstream command;
+        command << "ffmpeg -loglevel error -y -f rawvideo -pix_fmt rgb24 -s " << frame.width << "x"
+                << frame.height << " -r " << framesPerSecond << " -i -"
+                << " -vf 'vflip,scale=trunc(iw/2)*2:trunc(ih/2)*2' -pix_fmt yuv420p " << ShellQuote(videoFile);
+        video = popen(command.str().c_str(), "w");
+        if (!video)
+            return false;
+    }
+    return fwrite(&frame.pixels[0], 1, frame.pixels.size(), video) == frame.pixels.size();
+}
+
+void FrameCapture::ReleaseSlots()
+{
+    for (int i = 0; i < RING_SIZE; i++)
+    {
+        if (slots[i].fence)
+            glDeleteSync(slots[i].fence);
+        if (slots[i].buffer)
+            glDeleteBuffers(1, &slots[i].buffer);
+        slots[i].buffer = 0;
+        slots[i].fence  = 0;
+        slots[i].width  = slots[i].height = 0;
+    }
+}
+
+void FrameCapture::Finish()
+{
+    if (window)
+    {
+        renderer->RemoveObserver(observer);
+        GLint packBuffer;
+        glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &packBuffer);
+        for (int i = 0; i < RING_SIZE; i++)
+        {
+            Slot &slot = slots[(nextSlot + i) % RING_SIZE];
+            if (slot.fence)
+                Collect(slot, true);
+        }
+        ReleaseSlots();
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffer);
+        window   = NULL;
+        renderer = NULL;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing = true;
+    }
+    ready.notify_all();
+    for (size_t i = 0; i < encoders.size(); i++)
+        encoders[i].join();
+    encoders.clear();
+
+    if (video)
+    {
+        int status = pclose(video);
+        video = NULL;
+        if (status != 0)
+            std::cerr << "[capture] ffmpeg exited with status " << status << " writing " << videoFile << std::endl;
+    }
+}
@@ -0,0 +1,148 @@
+/*
+ * Frame capture
+ *
+ * Records every frame a render window draws, to a numbered PNG sequence or
+ * through a local ffmpeg process to a video file, without making the
+ * render loop wait on the GPU. When the window's last renderer finishes,
+ * its pixels are read into one of a small ring of pixel buffer objects;
+ * the copy completes on the GPU while later frames are drawn, and each
+ * buffer is mapped a frame or two afterwards, once its fence has passed.
+ * Mapped frames go into a bounded queue drained by encoder threads: any
+ * number for PNGs, one for video, which needs its frames in order.
+ *
+ * When the queue is full the capture either drops the frame, which keeps
+ * an interactive window responsive, or waits for an encoder, so that a
+ * recording has every frame at the cost of the frame rate. Either way the
+ * statistics say what happened.
+ */
+
+#ifndef FISHTANK_FRAMECAPTURE_H
+#define FISHTANK_FRAMECAPTURE_H
+
+#include <vtk_glew.h>
+
+#include <vtkCallbackCommand.h>
+#include <vtkRenderWindow.h>
+#include <vtkRenderer.h>
+#include <vtkSmartPointer.h>
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class FrameCapture
+{
+    public:
+        /* What to do with a frame when the queue is full */
+        enum Policy { DROP, WAIT };
+
+        struct Stats
+        {
+            long long readBack;   /* frames read out of the window */
+            long long written;
+            long long dropped;    /* queue full, or a video frame of the wrong size */
+            long long failed;     /* readback or encoder errors */
+            long long stalls;     /* readbacks the render loop had to wait for */
+            size_t    maxQueued;
+            double    waitMs;     /* render loop time spent waiting for encoders */
+        };
+
+        FrameCapture();
+
+        /* Finish() must have been called */
+        ~FrameCapture();
+
+        /* Frames waiting for an encoder at most; 8 by default */
+        void SetQueueLength(size_t frames);
+        void SetPolicy(Policy policy);
+
+        /* Write frame n to the file the printf pattern gives for n, e.g.
+         * "shots/tank%05d.png", with the given number of encoder threads */
+        bool OpenImages(const std::string &pattern, unsigned int threads, std::string &error);
+
+        /* Pipe raw frames to ffmpeg, which picks the codec from the file's
+         * extension; frames are taken to be evenly spaced */
+        bool OpenVideo(const std::string &fileName, double framesPerSecond, std::string &error);
+
+        /* Start reading back every frame once renderer, the last the
+         * window draws, has finished */
+        void Attach(vtkRenderWindow *window, vtkRenderer *renderer);
+
+        /* With the window's context current: collect the frames still on
+         * the GPU, let the encoders finish the queue and close the output */
+        void Finish();
+
+        Stats GetStats() const;
+
+    private:
+        FrameCapture(const FrameCapture &);
+        FrameCapture &operator=(const FrameCapture &);
+
+        struct Frame
+        {
+            std::vector<unsigned char> pixels;   /* RGB rows, bottom first */
+            int                        width;
+            int                        height;
+            long long                  index;
+        };
+
+        /* One pixel buffer object and the readback in flight in it */
+        struct Slot
+        {
+            GLuint    buffer;
+            GLsync    fence;
+            int       width;
+            int       height;
+            long long index;
+        };
+
+        static const int RING_SIZE = 3;
+
+        static void OnRendered(vtkObject *caller, unsigned long event, void *clientData, void *callData);
+
+        void ReadBack();
+
+        /* Map a slot's finished readback and queue it; returns false,
+         * leaving the slot pending, if it isn't done and wait is false */
+        bool Collect(Slot &slot, bool wait);
+
+        void Enqueue(Frame &frame);
+        void StartEncoders(unsigned int count);
+        void EncoderLoop();
+        bool WriteImage(const Frame &frame);
+        bool WriteVideo(const Frame &frame);
+        void ReleaseSlots();
+
+        std::string  pattern;
+        std::string  videoFile;
+        double       framesPerSecond;
+        FILE        *video;
+        int          videoWidth;
+        int          videoHeight;
+        size_t       queueLength;
+        Policy       policy;
+
+        vtkRenderWindow                     *window;
+        vtkRenderer                         *renderer;
+        vtkSmartPointer<vtkCallbackCommand>  callback;
+        unsigned long                        observer;
+
+        Slot      slots[RING_SIZE];
+        int       nextSlot;
+        long long nextIndex;
+
+        mutable std::mutex                        mutex;
+        std::condition_variable                   ready;   /* a frame was queued, or closing */
+        std::condition_variable                   space;   /* a frame was taken off the queue */
+        std::deque<Frame>                         queue;
+        std::vector<std::vector<unsigned char> >  spare;   /* pixel storage to reuse */
+        std::vector<std::thread>                  encoders;
+        bool                                      closing;
+        Stats                                     stats;
+};
+
+#endif
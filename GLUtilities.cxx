@@ -0,0 +1,113 @@
+/*
+ * Small helpers for the mappers and passes that talk to OpenGL directly
+ */
+
+#include "GLUtilities.h"
+
+#include <vtkCamera.h>
+#include <vtkOpenGLRenderWindow.h>
+#include <vtkOpenGLShaderCache.h>
+
+namespace
+{
+GLuint CompileShader(GLenum type, const char *source, std::string &log)
+{
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+
+    GLint ok = 0;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (ok)
+        return shader;
+
+    char info[2048];
+    glGetShaderInfoLog(shader, sizeof(info), NULL, info);
+    log = std::string(type == GL_VERTEX_SHADER ? "vertex shader: " : "fragment shader: ") + info;
+    glDeleteShader(shader);
+    return 0;
+}
+}
+
+GLuint GLUtilities::BuildProgram(const char *vertexSource, const char *fragmentSource,
+                                 const AttributeBindings &attributes, std::string &log)
+{
+    GLuint vertex = CompileShader(GL_VERTEX_SHADER, vertexSource, log);
+    if (!vertex)
+        return 0;
+    GLuint fragment = CompileShader(GL_FRAGMENT_SHADER, fragmentSource, log);
+    if (!fragment)
+    {
+        glDeleteShader(vertex);
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertex);
+    glAttachShader(program, fragment);
+    for (size_t i = 0; i < attributes.size(); i++)
+        glBindAttribLocation(program, attributes[i].first, attributes[i].second);
+    glBindFragDataLocation(program, 0, "fragOutput0");
+    glLinkProgram(program);
+    glDeleteShader(vertex);
+    glDeleteShader(fragment);
+
+    GLint ok = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &ok);
+    if (ok)
+        return program;
+
+    char info[2048];
+    glGetProgramInfoLog(program, sizeof(info), NULL, info);
+    log = std::string("link: ") + info;
+    glDeleteProgram(program);
+    return 0;
+}
+
+void GLUtilities::ToColumnMajor(const vtkMatrix4x4 *matrix, float out[16])
+{
+    for (int r = 0; r < 4; r++)
+        for (int c = 0; c < 4; c++)
+            out[c * 4 + r] = (float)matrix->Element[r][c];
+}
+
+void GLUtilities::ToColumnMajor(const double matrix[16], float out[16])
+{
+    for (int r = 0; r < 4; r++)
+        for (int c = 0; c < 4; c++)
+            out[c * 4 + r] = (float)matrix[r * 4 + c];
+}
+
+void GLUtilities::GetWorldToClip(vtkRenderer *renderer, float out[16])
+{
+    vtkMatrix4x4 *worldToClip = renderer->GetActiveCamera()->GetCompositeProjectionTransformMatrix(
+        renderer->GetTiledAspectRatio(), -1, 1);
+    ToColumnMajor(worldToClip, out);
+}
+
+bool GLUtilities::IsSupported(int major, int minor, const char *extension)
+{
+    GLint contextMajor = 0, contextMinor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &contextMajor);
+    glGetIntegerv(GL_MINOR_VERSION, &contextMinor);
+    if (contextMajor > major || (contextMajor == major && contextMinor >= minor))
+        return true;
+
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const char *name = (const char *)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+        if (name && std::string(name) == extension)
+            return true;
+    }
+    return false;
+}
+
+void GLUtilities::ReleaseVTKShader(vtkRenderer *renderer)
+{
+    vtkOpenGLRenderWindow *window = vtkOpenGLRenderWindow::SafeDownCast(renderer->GetRenderWindow());
+    if (window)
+        window->GetShaderCache()->ReleaseCurrentShader();
+    glUseProgram(0);
+}
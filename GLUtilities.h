@@ -0,0 +1,45 @@
+/*
+ * Small helpers for the mappers and passes that talk to OpenGL directly
+ *
+ * Everything here needs a current context; callers run inside VTK's
+ * render traversal, where the render window's context is current.
+ */
+
+#ifndef FISHTANK_GLUTILITIES_H
+#define FISHTANK_GLUTILITIES_H
+
+#include <vtk_glew.h>
+
+#include <vtkMatrix4x4.h>
+#include <vtkRenderer.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace GLUtilities
+{
+    typedef std::vector<std::pair<GLuint, const char *> > AttributeBindings;
+
+    /* Compile and link a program, binding attribute locations first.
+     * Returns 0 and fills log on failure. */
+    GLuint BuildProgram(const char *vertexSource, const char *fragmentSource,
+                        const AttributeBindings &attributes, std::string &log);
+
+    /* Copy a row-major VTK matrix into column-major floats for glUniformMatrix4fv */
+    void ToColumnMajor(const vtkMatrix4x4 *matrix, float out[16]);
+    void ToColumnMajor(const double matrix[16], float out[16]);
+
+    /* World to clip space for the renderer's active camera */
+    void GetWorldToClip(vtkRenderer *renderer, float out[16]);
+
+    /* True when the context is at least version major.minor or offers
+     * the extension, e.g. "GL_ARB_timer_query" */
+    bool IsSupported(int major, int minor, const char *extension);
+
+    /* Tell VTK's shader cache that its program is no longer bound, so the
+     * next VTK mapper rebinds instead of trusting stale state */
+    void ReleaseVTKShader(vtkRenderer *renderer);
+}
+
+#endif
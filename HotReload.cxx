@@ -0,0 +1,134 @@
+/*
+ * Hot reloading
+ */
+
+#include "HotReload.h"
+
+#include "Profiler.h"
+
+#include <iostream>
+#include <map>
+#include <sstream>
+
+namespace
+{
+double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+}
+
+HotReload::HotReload(const TankOptions &tankOptions, AssetRegistry &assets, TankScene &tank)
+    : options(tankOptions), registry(assets), scene(tank)
+{
+}
+
+bool HotReload::Start(const SceneDescription &description)
+{
+    std::vector<std::string> files(1, options.sceneFile);
+    for (std::map<std::string, std::string>::const_iterator it = description.meshFiles.begin();
+         it != description.meshFiles.end(); ++it)
+        files.push_back(it->second);
+
+    int watched = 0;
+    for (size_t f = 0; f < files.size(); f++)
+    {
+        if (watcher.Watch(files[f]))
+            watched++;
+        else
+            std::cerr << "[reload] can't watch " << files[f] << std::endl;
+    }
+    if (watched > 0)
+        std::cerr << "[reload] watching " << watched << " files" << std::endl;
+    return watched > 0;
+}
+
+/* A file saved again while it is parsing is parsed again; the latency
+ * still counts from the first save, the one that has waited longest */
+bool HotReload::Update()
+{
+    bool changed = false;
+    std::vector<FileWatcher::Change> changes = watcher.TakeChanges();
+    for (size_t c = 0; c < changes.size(); c++)
+    {
+        const FileWatcher::Change &change = changes[c];
+        if (change.fileName == options.sceneFile)
+        {
+            changed = ReloadScene(change.time) || changed;
+            continue;
+        }
+
+        PendingMesh reload;
+        reload.fileName = change.fileName;
+        reload.mesh     = registry.Reload(change.fileName);
+        reload.changed  = change.time;
+        if (!reload.mesh.valid())
+            continue;
+        for (size_t p = 0; p < pending.size(); p++)
+            if (pending[p].fileName == reload.fileName)
+            {
+                reload.changed = pending[p].changed;
+                pending.erase(pending.begin() + p);
+                break;
+            }
+        pending.push_back(reload);
+    }
+
+    std::vector<PendingMesh> stillPending;
+    for (size_t p = 0; p < pending.size(); p++)
+    {
+        if (MeshLoader::IsReady(pending[p].mesh))
+            changed = SwapMesh(pending[p]) || changed;
+        else
+            stillPending.push_back(pending[p]);
+    }
+    pending.swap(stillPending);
+
+    /* Rebuilding the obstacles, or attaching what was still loading */
+    if (!scene.IsComplete())
+        changed = scene.AttachReady() > 0 || changed;
+    return changed;
+}
+
+/* A file caught half written parses to nothing; the next save will do */
+bool HotReload::SwapMesh(const PendingMesh &reload)
+{
+    ScopedTimer timer("reload:mesh", reload.fileName);
+    const MeshLoader::MeshLevels &levels = reload.mesh.get();
+    if (levels.front()->GetNumberOfPoints() == 0)
+    {
+        std::cerr << "[reload] no geometry in " << reload.fileName << ", still drawing the old mesh" << std::endl;
+        return false;
+    }
+
+    registry.ReplaceMesh(reload.fileName, reload.mesh);
+    int actors = scene.ReplaceMesh(reload.fileName, reload.mesh);
+    std::ostringstream message;
+    message << "[reload] " << reload.fileName << " (" << levels.front()->GetNumberOfPolys() << " faces, "
+            << levels.size() << " levels) swapped into " << actors << " actors "
+            << MillisecondsSince(reload.changed) << " ms after it changed" << std::endl;
+    std::cerr << message.str();
+    return actors > 0;
+}
+
+bool HotReload::ReloadScene(Clock::time_point changed)
+{
+    ScopedTimer timer("reload:scene", options.sceneFile);
+    SceneDescription description;
+    std::string error;
+    if (!options.LoadDescription(description, error))
+    {
+        std::cerr << "[reload] " << error << "; the tank is left as it was" << std::endl;
+        return false;
+    }
+
+    TankScene::EditStats stats = scene.ApplyEdits(description);
+    std::ostringstream message;
+    message << "[reload] " << options.sceneFile << ": " << stats.materials << " materials and " << stats.instances
+            << " instances changed " << MillisecondsSince(changed) << " ms after it changed";
+    if (stats.ignored > 0)
+        message << "; " << stats.ignored << " other edits need a restart";
+    message << std::endl;
+    std::cerr << message.str();
+    return stats.materials > 0 || stats.instances > 0;
+}
@@ -0,0 +1,64 @@
+/*
+ * Hot reloading
+ *
+ * Watches the scene file and every mesh file it names, and applies what
+ * changes to the running tank without a restart. A changed mesh is parsed
+ * afresh on the loader's workers, bypassing the mesh cache, while the old
+ * one goes on being drawn, and swapped into the mappers that draw it once
+ * ready. A changed scene file is loaded again and its material, placement
+ * and swim edits applied to the objects they concern; anything else it
+ * changes waits for a restart.
+ *
+ * Update() does all the swapping, between frames on the render thread.
+ * Every reload is logged with its latency, from the first write to the
+ * file to the change being in place for the next frame.
+ */
+
+#ifndef FISHTANK_HOTRELOAD_H
+#define FISHTANK_HOTRELOAD_H
+
+#include "AssetRegistry.h"
+#include "FileWatcher.h"
+#include "MeshLoader.h"
+#include "SceneDescription.h"
+#include "TankScene.h"
+#include "TankSetup.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+class HotReload
+{
+    public:
+        HotReload(const TankOptions &options, AssetRegistry &registry, TankScene &scene);
+
+        /* Watch the scene file and the meshes it names; false when none
+         * of them can be watched */
+        bool Start(const SceneDescription &description);
+
+        /* Apply every change that is ready; true when the tank changed */
+        bool Update();
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        /* A mesh being parsed again, and when its file changed */
+        struct PendingMesh
+        {
+            std::string            fileName;
+            MeshLoader::MeshFuture mesh;
+            Clock::time_point      changed;
+        };
+
+        bool ReloadScene(Clock::time_point changed);
+        bool SwapMesh(const PendingMesh &reload);
+
+        const TankOptions       &options;
+        AssetRegistry           &registry;
+        TankScene               &scene;
+        FileWatcher              watcher;
+        std::vector<PendingMesh> pending;
+};
+
+#endif
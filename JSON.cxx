@@ -0,0 +1,293 @@
+/*
+ * Minimal JSON reader
+ */
+
+#include "JSON.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+class JSONParser
+{
+    public:
+        JSONParser(const std::string &doc) : document(doc), pos(0), line(1) {}
+
+        bool ParseDocument(JSONValue &result, std::string &error)
+        {
+            bool ok = ParseValue(result);
+            if (ok)
+            {
+                SkipSpace();
+                if (pos != document.size())
+                    ok = Fail("trailing characters");
+            }
+            if (!ok)
+            {
+                std::ostringstream msg;
+                msg << "line " << line << ": " << message;
+                error = msg.str();
+                return false;
+            }
+            return true;
+        }
+
+    private:
+        const std::string &document;
+        size_t             pos;
+        int                line;
+        std::string        message;
+
+        bool Fail(const char *what)
+        {
+            if (message.empty())
+                message = what;
+            return false;
+        }
+
+        void SkipSpace()
+        {
+            while (pos < document.size())
+            {
+                char c = document[pos];
+                if (c == '\n')
+                    line++;
+                else if (c != ' ' && c != '\t' && c != '\r')
+                    return;
+                pos++;
+            }
+        }
+
+        bool Literal(const char *word)
+        {
+            size_t len = std::string(word).size();
+            if (document.compare(pos, len, word) != 0)
+                return Fail("unexpected token");
+            pos += len;
+            return true;
+        }
+
+        bool ParseValue(JSONValue &value)
+        {
+            SkipSpace();
+            if (pos >= document.size())
+                return Fail("unexpected end of input");
+            char c = document[pos];
+            if (c == '{')
+                return ParseObject(value);
+            if (c == '[')
+                return ParseArray(value);
+            if (c == '"')
+            {
+                value.type = JSONValue::String;
+                return ParseString(value.text);
+            }
+            if (c == 't' || c == 'f')
+            {
+                value.type    = JSONValue::Boolean;
+                value.boolean = c == 't';
+                return Literal(value.boolean ? "true" : "false");
+            }
+            if (c == 'n')
+            {
+                value.type = JSONValue::Null;
+                return Literal("null");
+            }
+            return ParseNumber(value);
+        }
+
+        bool ParseNumber(JSONValue &value)
+        {
+            const char *start = document.c_str() + pos;
+            char *end;
+            value.number = strtod(start, &end);
+            if (end == start)
+                return Fail("expected a value");
+            value.type = JSONValue::Number;
+            pos += end - start;
+            return true;
+        }
+
+        bool ParseString(std::string &out)
+        {
+            pos++;
+            while (pos < document.size())
+            {
+                char c = document[pos++];
+                if (c == '"')
+                    return true;
+                if (c == '\n')
+                    return Fail("newline in string");
+                if (c != '\\')
+                {
+                    out += c;
+                    continue;
+                }
+                if (pos >= document.size())
+                    break;
+                char e = document[pos++];
+                switch (e)
+                {
+                    case 'n': out += '\n'; break;
+                    case 't': out += '\t'; break;
+                    case 'r': out += '\r'; break;
+                    case 'b': out += '\b'; break;
+                    case 'f': out += '\f'; break;
+                    case 'u':
+                    {
+                        /* Scene files are ASCII; keep the BMP code point as UTF-8 */
+                        if (pos + 4 > document.size())
+                            return Fail("bad \\u escape");
+                        unsigned long cp = strtoul(document.substr(pos, 4).c_str(), NULL, 16);
+                        pos += 4;
+                        if (cp < 0x80)
+                            out += (char)cp;
+                        else if (cp < 0x800)
+                        {
+                            out += (char)(0xC0 | (cp >> 6));
+                            out += (char)(0x80 | (cp & 0x3F));
+                        }
+                        else
+                        {
+                            out += (char)(0xE0 | (cp >> 12));
+                            out += (char)(0x80 | ((cp >> 6) & 0x3F));
+                            out += (char)(0x80 | (cp & 0x3F));
+                        }
+                        break;
+                    }
+                    default: out += e; break;
+                }
+            }
+            return Fail("unterminated string");
+        }
+
+        bool ParseArray(JSONValue &value)
+        {
+            value.type = JSONValue::Array;
+            pos++;
+            SkipSpace();
+            if (pos < document.size() && document[pos] == ']')
+            {
+                pos++;
+                return true;
+            }
+            for (;;)
+            {
+                value.items.push_back(JSONValue());
+                if (!ParseValue(value.items.back()))
+                    return false;
+                SkipSpace();
+                if (pos >= document.size())
+                    return Fail("unterminated array");
+                char c = document[pos++];
+                if (c == ']')
+                    return true;
+                if (c != ',')
+                    return Fail("expected ',' or ']'");
+            }
+        }
+
+        bool ParseObject(JSONValue &value)
+        {
+            value.type = JSONValue::Object;
+            pos++;
+            SkipSpace();
+            if (pos < document.size() && document[pos] == '}')
+            {
+                pos++;
+                return true;
+            }
+            for (;;)
+            {
+                SkipSpace();
+                if (pos >= document.size() || document[pos] != '"')
+                    return Fail("expected a key");
+                std::string key;
+                if (!ParseString(key))
+                    return false;
+                SkipSpace();
+                if (pos >= document.size() || document[pos] != ':')
+                    return Fail("expected ':'");
+                pos++;
+                value.members.push_back(std::make_pair(key, JSONValue()));
+                if (!ParseValue(value.members.back().second))
+                    return false;
+                SkipSpace();
+                if (pos >= document.size())
+                    return Fail("unterminated object");
+                char c = document[pos++];
+                if (c == '}')
+                    return true;
+                if (c != ',')
+                    return Fail("expected ',' or '}'");
+            }
+        }
+};
+
+const JSONValue &JSONValue::Get(const std::string &key) const
+{
+    static const JSONValue missing;
+    for (size_t i = 0; i < members.size(); i++)
+        if (members[i].first == key)
+            return members[i].second;
+    return missing;
+}
+
+bool JSONValue::Has(const std::string &key) const
+{
+    for (size_t i = 0; i < members.size(); i++)
+        if (members[i].first == key)
+            return true;
+    return false;
+}
+
+bool JSONValue::Parse(const std::string &document, JSONValue &result, std::string &error)
+{
+    result = JSONValue();
+    JSONParser parser(document);
+    return parser.ParseDocument(result, error);
+}
+
+bool JSONValue::ParseFile(const std::string &fileName, JSONValue &result, std::string &error)
+{
+    std::ifstream in(fileName.c_str());
+    if (!in)
+    {
+        error = "cannot open " + fileName;
+        return false;
+    }
+    std::ostringstream contents;
+    contents << in.rdbuf();
+    if (!Parse(contents.str(), result, error))
+    {
+        error = fileName + ": " + error;
+        return false;
+    }
+    return true;
+}
+
+std::string JSONValue::Quote(const std::string &text)
+{
+    std::string out = "\"";
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        char c = text[i];
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += c;
+        }
+        else if (c == '\n')
+            out += "\\n";
+        else if ((unsigned char)c < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        }
+        else
+            out += c;
+    }
+    return out + "\"";
+}
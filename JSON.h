@@ -0,0 +1,61 @@
+/*
+ * Minimal JSON reader
+ *
+ * Just enough JSON for scene files and tool configuration: objects keep
+ * their key order, numbers are doubles, and errors carry a line number.
+ */
+
+#ifndef FISHTANK_JSON_H
+#define FISHTANK_JSON_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+class JSONValue
+{
+    public:
+        enum Type { Null, Boolean, Number, String, Array, Object };
+
+        JSONValue() : type(Null), boolean(false), number(0) {}
+
+        Type GetType() const { return type; }
+        bool IsNull() const { return type == Null; }
+        bool IsBoolean() const { return type == Boolean; }
+        bool IsNumber() const { return type == Number; }
+        bool IsString() const { return type == String; }
+        bool IsArray() const { return type == Array; }
+        bool IsObject() const { return type == Object; }
+
+        bool               AsBoolean(bool fallback = false) const { return type == Boolean ? boolean : fallback; }
+        double             AsNumber(double fallback = 0) const { return type == Number ? number : fallback; }
+        const std::string &AsString() const { return text; }
+
+        /* Arrays */
+        size_t           Size() const { return items.size(); }
+        const JSONValue &operator[](size_t i) const { return items[i]; }
+
+        /* Objects; Get() returns a null value for missing keys */
+        const JSONValue &Get(const std::string &key) const;
+        bool             Has(const std::string &key) const;
+        const std::vector<std::pair<std::string, JSONValue> > &Members() const { return members; }
+
+        /* Parse a document; on failure returns false and fills error */
+        static bool Parse(const std::string &document, JSONValue &result, std::string &error);
+        static bool ParseFile(const std::string &fileName, JSONValue &result, std::string &error);
+
+        /* Quote and escape a string for writing JSON */
+        static std::string Quote(const std::string &text);
+
+    private:
+        friend class JSONParser;
+
+        Type                                            type;
+        bool                                            boolean;
+        double                                          number;
+        std::string                                     text;
+        std::vector<JSONValue>                          items;
+        std::vector<std::pair<std::string, JSONValue> > members;
+};
+
+#endif
@@ -0,0 +1,72 @@
+/*
+ * Level of detail selection
+ */
+
+#include "LevelOfDetail.h"
+
+#include <vtkCamera.h>
+#include <vtkMath.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+/* log2 of 1.25: how far past a boundary, in levels, before switching */
+const double HYSTERESIS = 0.32;
+}
+
+LevelOfDetail::ScreenProjection::ScreenProjection(vtkRenderer *renderer)
+{
+    vtkCamera *camera = renderer->GetActiveCamera();
+    camera->GetPosition(eye);
+    double height = std::max(renderer->GetSize()[1], 1);
+    parallel = camera->GetParallelProjection() != 0;
+    if (parallel)
+        pixelsPerUnit = height / (2 * camera->GetParallelScale());
+    else
+        pixelsPerUnit = height / (2 * std::tan(vtkMath::RadiansFromDegrees(camera->GetViewAngle()) / 2));
+}
+
+/* Distance from the eye rather than depth along the view, so turning the
+ * camera on the spot never changes a level */
+double LevelOfDetail::ScreenProjection::GetSize(const double center[3], double radius) const
+{
+    if (parallel)
+        return 2 * radius * pixelsPerUnit;
+    double distance = std::sqrt(vtkMath::Distance2BetweenPoints(eye, center));
+    if (distance <= radius)
+        return std::numeric_limits<double>::max();
+    return 2 * radius * pixelsPerUnit / distance;
+}
+
+double LevelOfDetail::ScreenProjection::GetSize(const double bounds[6]) const
+{
+    double center[3], radius2 = 0;
+    for (int c = 0; c < 3; c++)
+    {
+        center[c] = (bounds[2 * c] + bounds[2 * c + 1]) / 2;
+        double half = (bounds[2 * c + 1] - bounds[2 * c]) / 2;
+        radius2 += half * half;
+    }
+    return GetSize(center, std::sqrt(radius2));
+}
+
+int LevelOfDetail::SelectLevel(int current, int levelCount, double pixels)
+{
+    if (levelCount <= 1)
+        return 0;
+
+    /* Level k suits sizes from FULL_DETAIL_PIXELS / 2^k down to half that */
+    double ideal = pixels > 0 ? std::log2(FULL_DETAIL_PIXELS / pixels) : levelCount;
+    int level = (int)std::floor(std::min(std::max(ideal, 0.0), (double)levelCount - 1));
+    if (current < 0 || current >= levelCount)
+        return level;
+
+    if (level > current && ideal < current + 1 + HYSTERESIS)
+        return current;
+    if (level < current && ideal > current - HYSTERESIS)
+        return current;
+    return level;
+}
@@ -0,0 +1,45 @@
+/*
+ * Level of detail selection
+ *
+ * Picks which of a mesh's levels of detail to draw from how large the
+ * object appears on screen. Full detail is kept while an object's bounding
+ * sphere spans FULL_DETAIL_PIXELS or more; each level below that covers
+ * half the size of the one before, matching the halving of triangles from
+ * level to level. To stop objects near a boundary from flickering between
+ * levels, a switch only happens once the size is a quarter past it.
+ */
+
+#ifndef FISHTANK_LEVELOFDETAIL_H
+#define FISHTANK_LEVELOFDETAIL_H
+
+#include <vtkRenderer.h>
+
+namespace LevelOfDetail
+{
+    const double FULL_DETAIL_PIXELS = 200;
+
+    /* The active camera's view, set up once per frame, for sizing many
+     * objects */
+    class ScreenProjection
+    {
+        public:
+            explicit ScreenProjection(vtkRenderer *renderer);
+
+            /* Diameter in pixels of a world space sphere */
+            double GetSize(const double center[3], double radius) const;
+
+            /* Same, for a sphere around world space bounds */
+            double GetSize(const double bounds[6]) const;
+
+        private:
+            double eye[3];
+            double pixelsPerUnit;    /* at unit distance, or everywhere for parallel views */
+            bool   parallel;
+    };
+
+    /* The level to draw for an object of the given size that was last drawn
+     * at level current, or -1 for none yet */
+    int SelectLevel(int current, int levelCount, double pixels);
+}
+
+#endif
@@ -0,0 +1,329 @@
+/*
+ * Baked static lighting
+ */
+
+#include "LightBake.h"
+
+#include "BVH.h"
+#include "MeshCache.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <future>
+
+const float LightBake::REACH = 0.08f;
+
+namespace
+{
+const char     BAKE_MAGIC[4] = { 'F', 'T', 'L', 'B' };
+const uint32_t BAKE_VERSION  = 1;
+
+/* Vertices per job; enough to outweigh the queueing */
+const size_t CHUNK = 256;
+
+/* On-disk layout: this header, then three float32s a vertex */
+struct BakeHeader
+{
+    char     magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint64_t vertices;
+};
+
+float Dot(const float a[3], const float b[3])
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+/* Van der Corput in base 2: the Hammersley set's second coordinate */
+float RadicalInverse(unsigned int bits)
+{
+    bits = (bits << 16) | (bits >> 16);
+    bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+    bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+    bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+    bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+    return (float)bits * 2.3283064e-10f;
+}
+
+/* Tangents completing an orthonormal basis around a unit normal (Duff et
+ * al., Building an Orthonormal Basis, Revisited) */
+void Basis(const float n[3], float t[3], float b[3])
+{
+    float sign = n[2] >= 0 ? 1.0f : -1.0f;
+    float a    = -1.0f / (sign + n[2]);
+    float c    = n[0] * n[1] * a;
+    t[0] = 1.0f + sign * n[0] * n[0] * a;
+    t[1] = sign * c;
+    t[2] = -sign * n[0];
+    b[0] = c;
+    b[1] = sign + n[1] * n[1] * a;
+    b[2] = -n[1];
+}
+
+/* Occluding triangles under a BVH, for any-hit queries */
+class Occluders
+{
+    public:
+        explicit Occluders(const std::vector<float> &soup)
+            : triangles(soup)
+        {
+            std::vector<double> bounds(triangles.size() / 9 * 6);
+            for (size_t t = 0; t < triangles.size() / 9; t++)
+                for (int c = 0; c < 3; c++)
+                {
+                    const float *v = &triangles[9 * t + c];
+                    bounds[6 * t + 2 * c]     = std::min(v[0], std::min(v[3], v[6]));
+                    bounds[6 * t + 2 * c + 1] = std::max(v[0], std::max(v[3], v[6]));
+                }
+            tree.Build(bounds);
+        }
+
+        /* True when the ray from origin along direction meets a triangle
+         * before reaching distance */
+        bool Hit(const float origin[3], const float direction[3], float distance) const
+        {
+            if (tree.GetRoot() < 0)
+                return false;
+            float inverse[3];
+            for (int c = 0; c < 3; c++)
+                inverse[c] = 1.0f / direction[c];
+
+            int stack[64];
+            int depth = 0;
+            stack[depth++] = tree.GetRoot();
+            while (depth > 0)
+            {
+                const BVH::Node &node = tree.GetNode(stack[--depth]);
+                if (!HitsBox(node.bounds, origin, inverse, distance))
+                    continue;
+                if (node.item >= 0)
+                {
+                    if (HitsTriangle(&triangles[9 * node.item], origin, direction, distance))
+                        return true;
+                    continue;
+                }
+                /* A median split is balanced, so 64 levels are never reached */
+                stack[depth++] = node.left;
+                stack[depth++] = node.right;
+            }
+            return false;
+        }
+
+    private:
+        /* Slab test; infinities from zero direction components compare right */
+        static bool HitsBox(const double bounds[6], const float origin[3], const float inverse[3], float distance)
+        {
+            float near = 0, far = distance;
+            for (int c = 0; c < 3; c++)
+            {
+                float t0 = ((float)bounds[2 * c] - origin[c]) * inverse[c];
+                float t1 = ((float)bounds[2 * c + 1] - origin[c]) * inverse[c];
+                if (t0 > t1)
+                    std::swap(t0, t1);
+                near = std::max(near, t0);
+                far  = std::min(far, t1);
+                if (near > far)
+                    return false;
+            }
+            return true;
+        }
+
+        /* Möller-Trumbore, either face */
+        static bool HitsTriangle(const float *v, const float origin[3], const float direction[3], float distance)
+        {
+            float e1[3], e2[3], s[3];
+            for (int c = 0; c < 3; c++)
+            {
+                e1[c] = v[3 + c] - v[c];
+                e2[c] = v[6 + c] - v[c];
+                s[c]  = origin[c] - v[c];
+            }
+            float p[3] = { direction[1] * e2[2] - direction[2] * e2[1], direction[2] * e2[0] - direction[0] * e2[2],
+                           direction[0] * e2[1] - direction[1] * e2[0] };
+            float determinant = Dot(e1, p);
+            if (std::fabs(determinant) < 1e-12f)
+                return false;
+            float inverse = 1.0f / determinant;
+            float u = Dot(s, p) * inverse;
+            if (u < 0 || u > 1)
+                return false;
+            float q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+            float v2 = Dot(direction, q) * inverse;
+            if (v2 < 0 || u + v2 > 1)
+                return false;
+            float t = Dot(e2, q) * inverse;
+            return t > 0 && t < distance;
+        }
+
+        const std::vector<float> &triangles;
+        BVH                       tree;
+};
+
+struct Job
+{
+    const std::vector<float>             *points;
+    const std::vector<float>             *normals;
+    const std::vector<LightBake::Light>  *lights;
+    const Occluders                      *occluders;
+    int                                   samples;
+    float                                 reach;
+    float                                 offset;    /* ray origins leave the surface by this much */
+    std::vector<float>                   *light;
+};
+
+void BakeVertices(const Job &job, size_t begin, size_t end)
+{
+    ScopedTimer timer("lighting:bake");
+    const float huge = 1e30f;
+    for (size_t i = begin; i < end; i++)
+    {
+        const float *p = &(*job.points)[3 * i];
+        float n[3] = { (*job.normals)[3 * i], (*job.normals)[3 * i + 1], (*job.normals)[3 * i + 2] };
+        float length = std::sqrt(Dot(n, n));
+        float *out = &(*job.light)[3 * i];
+        out[0] = out[1] = out[2] = 0;
+        if (length == 0)
+            continue;
+        for (int c = 0; c < 3; c++)
+            n[c] /= length;
+
+        for (size_t l = 0; l < job.lights->size(); l++)
+        {
+            const LightBake::Light &light = (*job.lights)[l];
+            float toward[3] = { -light.direction[0], -light.direction[1], -light.direction[2] };
+            float facing = Dot(n, toward);
+            if (facing == 0)
+                continue;
+            float side = facing > 0 ? 1.0f : -1.0f;
+            float origin[3];
+            for (int c = 0; c < 3; c++)
+                origin[c] = p[c] + side * job.offset * n[c];
+            if (job.occluders->Hit(origin, toward, huge))
+                continue;
+            for (int c = 0; c < 3; c++)
+                out[c] += light.color[c] * std::fabs(facing);
+        }
+
+        /* Cosine-weighted directions: a disc sample lifted onto the
+         * hemisphere, turned by the vertex's own offset */
+        float t[3], b[3], origin[3];
+        Basis(n, t, b);
+        for (int c = 0; c < 3; c++)
+            origin[c] = p[c] + job.offset * n[c];
+        unsigned int hash = (unsigned int)i * 2654435761u;
+        float shiftU = (float)(hash >> 8) / (float)(1u << 24);
+        float shiftV = (float)((hash * 2654435761u) >> 8) / (float)(1u << 24);
+        int open = 0;
+        for (int s = 0; s < job.samples; s++)
+        {
+            float u = ((float)s + 0.5f) / (float)job.samples + shiftU;
+            float v = RadicalInverse((unsigned int)s) + shiftV;
+            u -= std::floor(u);
+            v -= std::floor(v);
+            float r = std::sqrt(u), phi = 6.2831853f * v;
+            float x = r * std::cos(phi), y = r * std::sin(phi), z = std::sqrt(std::max(0.0f, 1.0f - u));
+            float direction[3];
+            for (int c = 0; c < 3; c++)
+                direction[c] = x * t[c] + y * b[c] + z * n[c];
+            if (!job.occluders->Hit(origin, direction, job.reach))
+                open++;
+        }
+        float sky = job.samples > 0 ? (float)open / (float)job.samples : 1.0f;
+        for (size_t l = 0; l < job.lights->size(); l++)
+            for (int c = 0; c < 3; c++)
+                out[c] += (*job.lights)[l].ambient[c] * sky;
+    }
+}
+}
+
+uint64_t LightBake::ComputeKey(const std::vector<float> &points, const std::vector<float> &normals,
+                               const std::vector<float> &triangles, const std::vector<Light> &lights, int samples)
+{
+    uint64_t hash = MeshCache::HashBytes(&BAKE_VERSION, sizeof(BAKE_VERSION));
+    hash = MeshCache::HashBytes(&samples, sizeof(samples), hash);
+    hash = MeshCache::HashBytes(&REACH, sizeof(REACH), hash);
+    if (!lights.empty())
+        hash = MeshCache::HashBytes(&lights[0], lights.size() * sizeof(Light), hash);
+    if (!points.empty())
+        hash = MeshCache::HashBytes(&points[0], points.size() * sizeof(float), hash);
+    if (!normals.empty())
+        hash = MeshCache::HashBytes(&normals[0], normals.size() * sizeof(float), hash);
+    if (!triangles.empty())
+        hash = MeshCache::HashBytes(&triangles[0], triangles.size() * sizeof(float), hash);
+    return hash;
+}
+
+void LightBake::Build(const std::vector<float> &points, const std::vector<float> &normals,
+                      const std::vector<float> &triangles, const std::vector<Light> &lights, int samples)
+{
+    size_t vertices = points.size() / 3;
+    light.assign(3 * vertices, 0.0f);
+    Occluders occluders(triangles);
+
+    float low[3] = { 1e30f, 1e30f, 1e30f }, high[3] = { -1e30f, -1e30f, -1e30f };
+    for (size_t i = 0; i + 3 <= triangles.size(); i += 3)
+        for (int c = 0; c < 3; c++)
+        {
+            low[c]  = std::min(low[c], triangles[i + c]);
+            high[c] = std::max(high[c], triangles[i + c]);
+        }
+    float diagonal = 0;
+    for (int c = 0; c < 3; c++)
+        diagonal += high[c] > low[c] ? (high[c] - low[c]) * (high[c] - low[c]) : 0;
+    diagonal = std::sqrt(diagonal);
+
+    Job job;
+    job.points    = &points;
+    job.normals   = &normals;
+    job.lights    = &lights;
+    job.occluders = &occluders;
+    job.samples   = samples;
+    job.reach     = REACH * diagonal;
+    job.offset    = 1e-4f * diagonal;
+    job.light     = &light;
+
+    ThreadPool pool;
+    std::vector<std::future<void> > jobs;
+    for (size_t begin = 0; begin < vertices; begin += CHUNK)
+    {
+        size_t end = std::min(vertices, begin + CHUNK);
+        jobs.push_back(pool.Submit([job, begin, end]() { BakeVertices(job, begin, end); }));
+    }
+    for (size_t j = 0; j < jobs.size(); j++)
+        jobs[j].get();
+}
+
+bool LightBake::Read(const std::string &fileName, uint64_t key)
+{
+    std::ifstream in(fileName.c_str(), std::ios::binary);
+    BakeHeader header;
+    if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)))
+        return false;
+    if (memcmp(header.magic, BAKE_MAGIC, sizeof(BAKE_MAGIC)) != 0 || header.version != BAKE_VERSION
+        || header.key != key || header.vertices > (1ULL << 32))
+        return false;
+
+    std::vector<float> values(3 * (size_t)header.vertices);
+    if (!values.empty()
+        && !in.read(reinterpret_cast<char *>(&values[0]), (std::streamsize)(values.size() * sizeof(float))))
+        return false;
+    light.swap(values);
+    return true;
+}
+
+bool LightBake::Write(const std::string &fileName, uint64_t key) const
+{
+    BakeHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BAKE_MAGIC, sizeof(BAKE_MAGIC));
+    header.version  = BAKE_VERSION;
+    header.key      = key;
+    header.vertices = light.size() / 3;
+    return MeshCache::WriteFile(fileName, &header, sizeof(header), light.empty() ? NULL : &light[0],
+                                light.size() * sizeof(float));
+}
@@ -0,0 +1,67 @@
+/*
+ * Baked static lighting
+ *
+ * The light falling on each vertex of the static scenery, ray cast once
+ * instead of shaded every frame, so that it can afford what live shading
+ * can't: shadows from every static object onto every other, and ambient
+ * occlusion darkening the inside of the plant clusters.
+ *
+ * Each light shines along its direction in its colour, two-sided as the
+ * live shaders light, onto the side of a surface facing it unless a shadow
+ * ray finds something in the way. Its ambient colour is taken as light
+ * from all around, which a vertex receives in the fraction of its
+ * cosine-weighted hemisphere that rays of REACH times the scenery's
+ * diagonal leave open. Samples are a Hammersley set turned by a hash of
+ * the vertex, so a bake is the same every time.
+ *
+ * Rays are traced against a BVH over the occluding triangles, on one
+ * thread per core. A bake's key covers the scenery, the lights and the
+ * samples, so a cached bake is only reused while all three are unchanged.
+ */
+
+#ifndef FISHTANK_LIGHTBAKE_H
+#define FISHTANK_LIGHTBAKE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class LightBake
+{
+    public:
+        static const int DEFAULT_SAMPLES = 64;
+
+        /* How far occlusion rays reach, as a fraction of the diagonal of
+         * the occluders' bounds */
+        static const float REACH;
+
+        /* Shining along direction, which is unit length */
+        struct Light
+        {
+            float direction[3];
+            float color[3];
+            float ambient[3];
+        };
+
+        /* Light, three floats per vertex, at points with normals, three
+         * floats each, among triangles of nine floats; all in world space */
+        void Build(const std::vector<float> &points, const std::vector<float> &normals,
+                   const std::vector<float> &triangles, const std::vector<Light> &lights, int samples);
+
+        /* Three floats a vertex, in the order of the points baked */
+        const std::vector<float> &GetLight() const { return light; }
+
+        /* Identifies the bake Build() would make from these arguments */
+        static uint64_t ComputeKey(const std::vector<float> &points, const std::vector<float> &normals,
+                                   const std::vector<float> &triangles, const std::vector<Light> &lights,
+                                   int samples);
+
+        /* A bake written with the same key; false if missing or stale */
+        bool Read(const std::string &fileName, uint64_t key);
+        bool Write(const std::string &fileName, uint64_t key) const;
+
+    private:
+        std::vector<float> light;
+};
+
+#endif
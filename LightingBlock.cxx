@@ -0,0 +1,126 @@
+/*
+ * Scene lights in a uniform buffer
+ */
+
+#include "LightingBlock.h"
+
+#include <vtkCamera.h>
+#include <vtkCommand.h>
+#include <vtkLight.h>
+#include <vtkLightCollection.h>
+#include <vtkMath.h>
+
+#include <cstring>
+#include <map>
+#include <mutex>
+
+const char *const LightingBlock::GLSL =
+    "layout(std140) uniform Lighting\n"
+    "{\n"
+    "    vec4 lightDirection[4];\n"
+    "    vec4 lightColor[4];\n"
+    "    int  lightCount;\n"
+    "};\n";
+
+namespace
+{
+/* Windows may render on threads of their own; each block is only used on
+ * its renderer's */
+std::mutex                               blockLock;
+std::map<vtkRenderer *, LightingBlock *> blocks;
+}
+
+LightingBlock::LightingBlock(vtkRenderer *ren)
+    : renderer(ren), buffer(0), stale(true), users(0)
+{
+    callback = vtkSmartPointer<vtkCallbackCommand>::New();
+    callback->SetCallback(OnStartFrame);
+    callback->SetClientData(this);
+    observer = renderer->AddObserver(vtkCommand::StartEvent, callback);
+    glGenBuffers(1, &buffer);
+}
+
+LightingBlock::~LightingBlock()
+{
+    renderer->RemoveObserver(observer);
+    glDeleteBuffers(1, &buffer);
+}
+
+LightingBlock *LightingBlock::Acquire(vtkRenderer *renderer)
+{
+    std::lock_guard<std::mutex> lock(blockLock);
+    LightingBlock *&block = blocks[renderer];
+    if (!block)
+        block = new LightingBlock(renderer);
+    block->users++;
+    return block;
+}
+
+void LightingBlock::Release()
+{
+    std::lock_guard<std::mutex> lock(blockLock);
+    if (--users > 0)
+        return;
+    blocks.erase(renderer);
+    delete this;
+}
+
+void LightingBlock::Attach(GLuint program)
+{
+    GLuint index = glGetUniformBlockIndex(program, "Lighting");
+    if (index != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, index, BINDING);
+}
+
+void LightingBlock::OnStartFrame(vtkObject *, unsigned long, void *clientData, void *)
+{
+    static_cast<LightingBlock *>(clientData)->stale = true;
+}
+
+/* Scene lights shine from their position to their focal point; headlights
+ * along the view direction */
+void LightingBlock::Bind()
+{
+    if (stale)
+    {
+        Layout layout;
+        memset(&layout, 0, sizeof(layout));
+        vtkLightCollection *lights = renderer->GetLights();
+        lights->InitTraversal();
+        for (vtkLight *light = lights->GetNextItem(); light && layout.count < MAX_LIGHTS;
+             light = lights->GetNextItem())
+        {
+            if (!light->GetSwitch())
+                continue;
+            double direction[3];
+            if (light->LightTypeIsHeadlight())
+            {
+                double *dop = renderer->GetActiveCamera()->GetDirectionOfProjection();
+                for (int c = 0; c < 3; c++)
+                    direction[c] = dop[c];
+            }
+            else
+            {
+                double position[3], focal[3];
+                light->GetTransformedPosition(position);
+                light->GetTransformedFocalPoint(focal);
+                for (int c = 0; c < 3; c++)
+                    direction[c] = focal[c] - position[c];
+                vtkMath::Normalize(direction);
+            }
+            double *diffuse = light->GetDiffuseColor();
+            for (int c = 0; c < 3; c++)
+            {
+                layout.directions[layout.count][c] = (float)direction[c];
+                layout.colors[layout.count][c]     = (float)(diffuse[c] * light->GetIntensity());
+            }
+            layout.count++;
+        }
+
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(layout), &layout, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        stale = false;
+    }
+    glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, buffer);
+}
@@ -0,0 +1,68 @@
+/*
+ * Scene lights in a uniform buffer
+ *
+ * The lights a renderer shines on the tank, packed once per frame into a
+ * std140 uniform block that every program using it reads from the same
+ * binding point. Mappers that draw with their own shaders declare the
+ * block with GLSL and bind it before drawing, instead of each setting the
+ * same light uniforms on every draw.
+ *
+ * One block is shared by every user of a renderer. It is repacked when the
+ * renderer starts a frame and uploaded by the first Bind() of the frame.
+ * Users Acquire() it with a current context and Release() it in their
+ * ReleaseGraphicsResources(); the buffer is freed with the last user.
+ */
+
+#ifndef FISHTANK_LIGHTINGBLOCK_H
+#define FISHTANK_LIGHTINGBLOCK_H
+
+#include <vtk_glew.h>
+
+#include <vtkCallbackCommand.h>
+#include <vtkRenderer.h>
+#include <vtkSmartPointer.h>
+
+class LightingBlock
+{
+    public:
+        static const int    MAX_LIGHTS = 4;
+        static const GLuint BINDING    = 0;
+
+        /* The block's declaration, for pasting into GLSL 1.50 shaders */
+        static const char *const GLSL;
+
+        static LightingBlock *Acquire(vtkRenderer *renderer);
+        void Release();
+
+        /* Point a linked program's block at the binding; once per program */
+        static void Attach(GLuint program);
+
+        /* Upload if this frame's lights are not on the GPU yet, and bind */
+        void Bind();
+
+    private:
+        /* std140: vec4 arrays, then the count padded to a vec4 */
+        struct Layout
+        {
+            float   directions[MAX_LIGHTS][4];
+            float   colors[MAX_LIGHTS][4];
+            GLint   count;
+            GLint   padding[3];
+        };
+
+        explicit LightingBlock(vtkRenderer *renderer);
+        ~LightingBlock();
+        LightingBlock(const LightingBlock &);
+        void operator=(const LightingBlock &);
+
+        static void OnStartFrame(vtkObject *caller, unsigned long event, void *clientData, void *callData);
+
+        vtkRenderer                        *renderer;
+        unsigned long                       observer;
+        vtkSmartPointer<vtkCallbackCommand> callback;
+        GLuint                              buffer;
+        bool                                stale;
+        int                                 users;
+};
+
+#endif
@@ -0,0 +1,205 @@
+/*
+ * Mesh buffers shared between mappers
+ */
+
+#include "MeshBuffers.h"
+
+#include "MeshOptimizer.h"
+
+#include <vtkCellArray.h>
+#include <vtkDataArray.h>
+#include <vtkPointData.h>
+#include <vtkPolyDataNormals.h>
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace
+{
+struct Key
+{
+    vtkRenderWindow *context;
+    vtkPolyData     *mesh;
+    bool             quantized;
+
+    bool operator<(const Key &other) const
+    {
+        if (context != other.context)
+            return context < other.context;
+        if (mesh != other.mesh)
+            return mesh < other.mesh;
+        return quantized < other.quantized;
+    }
+};
+
+std::mutex                   tableLock;
+std::map<Key, MeshBuffers *> table;
+size_t                       totalBytes = 0;
+}
+
+MeshBuffers *MeshBuffers::Acquire(vtkRenderWindow *context, vtkPolyData *mesh, bool quantized)
+{
+    Key key = { context, mesh, quantized };
+    std::lock_guard<std::mutex> lock(tableLock);
+    MeshBuffers *&buffers = table[key];
+    if (!buffers)
+        buffers = new MeshBuffers(context, mesh, quantized);
+    else if (mesh->GetMTime() > buffers->uploadTime)
+        buffers->Upload();
+    buffers->users++;
+    return buffers;
+}
+
+void MeshBuffers::Release()
+{
+    std::lock_guard<std::mutex> lock(tableLock);
+    if (--users > 0)
+        return;
+    Key key = { context, mesh, quantized };
+    table.erase(key);
+    delete this;
+}
+
+MeshBuffers::MeshBuffers(vtkRenderWindow *window, vtkPolyData *polydata, bool quantize)
+    : context(window), mesh(polydata), quantized(quantize), uploadTime(0), indexCount(0),
+      indexType(GL_UNSIGNED_INT), bytes(0), users(0)
+{
+    for (int c = 0; c < 3; c++)
+    {
+        positionScale[c]  = 1;
+        positionOffset[c] = 0;
+    }
+    glGenBuffers(1, &vertexBuffer);
+    glGenBuffers(1, &indexBuffer);
+    Upload();
+}
+
+MeshBuffers::~MeshBuffers()
+{
+    totalBytes -= bytes;
+    glDeleteBuffers(1, &vertexBuffer);
+    glDeleteBuffers(1, &indexBuffer);
+}
+
+/* Interleaved position/normal vertices plus a triangle index buffer;
+ * quantized, 12-byte vertices and 16-bit indices when the points fit.
+ * Called with the table locked. */
+void MeshBuffers::Upload()
+{
+    uploadTime = mesh->GetMTime();
+    vtkSmartPointer<vtkPolyData> source = mesh;
+    if (!source->GetPointData()->GetNormals())
+    {
+        vtkSmartPointer<vtkPolyDataNormals> normals = vtkSmartPointer<vtkPolyDataNormals>::New();
+        normals->SetInputData(source);
+        normals->Update();
+        source = normals->GetOutput();
+    }
+
+    /* Polygons are fanned, in case an uncached mesh slips through untriangulated */
+    std::vector<GLuint> indices;
+    vtkCellArray *polys = source->GetPolys();
+    vtkIdType  npts;
+    vtkIdType *pts;
+    for (polys->InitTraversal(); polys->GetNextCell(npts, pts);)
+    {
+        for (vtkIdType k = 1; k + 1 < npts; k++)
+        {
+            indices.push_back((GLuint)pts[0]);
+            indices.push_back((GLuint)pts[k]);
+            indices.push_back((GLuint)pts[k + 1]);
+        }
+    }
+    indexCount = (GLsizei)indices.size();
+
+    size_t uploaded = 0;
+    vtkIdType nPoints = source->GetNumberOfPoints();
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    if (quantized)
+    {
+        std::vector<MeshOptimizer::QuantizedVertex> vertices;
+        MeshOptimizer::Quantize(source, vertices, positionScale, positionOffset);
+        uploaded += vertices.size() * sizeof(MeshOptimizer::QuantizedVertex);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(MeshOptimizer::QuantizedVertex),
+                     vertices.empty() ? NULL : &vertices[0], GL_STATIC_DRAW);
+    }
+    else
+    {
+        vtkDataArray *normals = source->GetPointData()->GetNormals();
+        std::vector<float> vertices(nPoints * 6);
+        for (vtkIdType i = 0; i < nPoints; i++)
+        {
+            double p[3], n[3];
+            source->GetPoint(i, p);
+            normals->GetTuple(i, n);
+            for (int c = 0; c < 3; c++)
+            {
+                vertices[i * 6 + c]     = (float)p[c];
+                vertices[i * 6 + 3 + c] = (float)n[c];
+            }
+        }
+        uploaded += vertices.size() * sizeof(float);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float),
+                     vertices.empty() ? NULL : &vertices[0], GL_STATIC_DRAW);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    /* The element binding belongs to whichever vertex array is bound */
+    glBindVertexArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    if (quantized && nPoints <= 65536)
+    {
+        std::vector<GLushort> shortIndices(indices.begin(), indices.end());
+        indexType = GL_UNSIGNED_SHORT;
+        uploaded += shortIndices.size() * sizeof(GLushort);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(GLushort),
+                     shortIndices.empty() ? NULL : &shortIndices[0], GL_STATIC_DRAW);
+    }
+    else
+    {
+        indexType = GL_UNSIGNED_INT;
+        uploaded += indices.size() * sizeof(GLuint);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint),
+                     indices.empty() ? NULL : &indices[0], GL_STATIC_DRAW);
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    totalBytes = totalBytes - bytes + uploaded;
+    bytes = uploaded;
+}
+
+void MeshBuffers::Attach(GLuint positionLocation, GLuint normalLocation)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glEnableVertexAttribArray(positionLocation);
+    glEnableVertexAttribArray(normalLocation);
+    if (quantized)
+    {
+        GLsizei stride = sizeof(MeshOptimizer::QuantizedVertex);
+        glVertexAttribPointer(positionLocation, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void *)0);
+        glVertexAttribPointer(normalLocation, 2, GL_SHORT, GL_TRUE, stride,
+                              (void *)offsetof(MeshOptimizer::QuantizedVertex, normal));
+    }
+    else
+    {
+        glVertexAttribPointer(positionLocation, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)0);
+        glVertexAttribPointer(normalLocation, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float),
+                              (void *)(3 * sizeof(float)));
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+}
+
+size_t MeshBuffers::GetNumberOfBufferSets()
+{
+    std::lock_guard<std::mutex> lock(tableLock);
+    return table.size();
+}
+
+size_t MeshBuffers::GetTotalBytes()
+{
+    std::lock_guard<std::mutex> lock(tableLock);
+    return totalBytes;
+}
@@ -0,0 +1,73 @@
+/*
+ * Mesh buffers shared between mappers
+ *
+ * The vertex and index buffers of a mesh, uploaded once per OpenGL
+ * context however many mappers draw it: the instanced groups, swimmers
+ * and schools of every tank in a window all point their vertex arrays at
+ * the same buffers. Vertex arrays can't be shared, so each mapper keeps
+ * its own and Attach()es the buffers to it.
+ *
+ * Buffers are keyed by the window whose context holds them, the mesh and
+ * the vertex format. Users Acquire() them with that context current and
+ * Release() them in their ReleaseGraphicsResources(); the last release
+ * frees them. A mesh modified since its upload is uploaded again, in the
+ * same buffers, by the next Acquire().
+ *
+ * Windows may render on threads of their own; the table is locked, and
+ * a set of buffers is only ever used on its own context's thread.
+ */
+
+#ifndef FISHTANK_MESHBUFFERS_H
+#define FISHTANK_MESHBUFFERS_H
+
+#include <vtk_glew.h>
+
+#include <vtkPolyData.h>
+#include <vtkRenderWindow.h>
+#include <vtkSmartPointer.h>
+
+#include <stddef.h>
+
+class MeshBuffers
+{
+    public:
+        /* Quantized buffers hold MeshOptimizer::Quantize() vertices */
+        static MeshBuffers *Acquire(vtkRenderWindow *context, vtkPolyData *mesh, bool quantized);
+        void Release();
+
+        /* Point the bound vertex array's positions, normals and indices
+         * at these buffers */
+        void Attach(GLuint positionLocation, GLuint normalLocation);
+
+        GLsizei      GetIndexCount() const { return indexCount; }
+        GLenum       GetIndexType() const { return indexType; }
+        const float *GetPositionScale() const { return positionScale; }
+        const float *GetPositionOffset() const { return positionOffset; }
+
+        /* Buffer sets alive in every context, and their bytes */
+        static size_t GetNumberOfBufferSets();
+        static size_t GetTotalBytes();
+
+    private:
+        MeshBuffers(vtkRenderWindow *context, vtkPolyData *mesh, bool quantized);
+        ~MeshBuffers();
+        MeshBuffers(const MeshBuffers &);
+        void operator=(const MeshBuffers &);
+
+        void Upload();
+
+        vtkRenderWindow             *context;
+        vtkSmartPointer<vtkPolyData> mesh;       /* held, so its address stays its key */
+        bool                         quantized;
+        vtkMTimeType                 uploadTime;
+        GLuint                       vertexBuffer;
+        GLuint                       indexBuffer;
+        GLsizei                      indexCount;
+        GLenum                       indexType;
+        float                        positionScale[3];    /* decode quantized positions */
+        float                        positionOffset[3];
+        size_t                       bytes;
+        int                          users;
+};
+
+#endif
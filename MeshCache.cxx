@@ -0,0 +1,339 @@
+/*
+ * Binary mesh cache
+ */
+
+#include "MeshCache.h"
+
+#include <vtkCellArray.h>
+#include <vtkDataArray.h>
+#include <vtkFloatArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace
+{
+const char     ENTRY_MAGIC[4]  = { 'F', 'T', 'M', 'C' };
+const uint32_t ENTRY_VERSION   = 2;   /* 2: welded and in cache order */
+const uint64_t BLOCK_ALIGNMENT = 64;
+
+/* On-disk layout: this header, then the position, normal and cell blocks at
+ * the recorded offsets. Positions and normals are float32 xyz triples; cells
+ * are int64 in VTK's legacy layout (3, a, b, c per triangle). */
+struct EntryHeader
+{
+    char     magic[4];
+    uint32_t version;
+    int64_t  sourceMTime;
+    uint64_t sourceSize;
+    uint64_t sourceHash;
+    uint64_t numberOfPoints;
+    uint64_t numberOfTriangles;
+    uint64_t positionsOffset;
+    uint64_t normalsOffset;
+    uint64_t cellsOffset;
+    uint64_t fileSize;
+};
+
+/* Whether every cell is a triangle, 3 then three ids of points that exist,
+ * so that nothing downstream indexes past the points */
+bool CellsValid(const int64_t *cells, uint64_t triangles, uint64_t points)
+{
+    for (uint64_t t = 0; t < triangles; t++, cells += 4)
+    {
+        if (cells[0] != 3)
+            return false;
+        for (int v = 1; v < 4; v++)
+            if (cells[v] < 0 || (uint64_t)cells[v] >= points)
+                return false;
+    }
+    return true;
+}
+
+uint64_t AlignUp(uint64_t offset)
+{
+    return (offset + BLOCK_ALIGNMENT - 1) & ~(BLOCK_ALIGNMENT - 1);
+}
+
+/* Whether a block of count items of itemSize bytes at offset lies after
+ * the header and within a file of length bytes; divides rather than
+ * multiplies so corrupt counts can't overflow */
+bool BlockFits(uint64_t offset, uint64_t count, uint64_t itemSize, uint64_t length)
+{
+    return offset >= sizeof(EntryHeader) && offset % BLOCK_ALIGNMENT == 0 && offset <= length
+        && count <= (length - offset) / itemSize;
+}
+
+bool StatFile(const std::string &fileName, int64_t &mtime, uint64_t &size)
+{
+    struct stat st;
+    if (stat(fileName.c_str(), &st) != 0)
+        return false;
+    mtime = (int64_t)st.st_mtime;
+    size  = (uint64_t)st.st_size;
+    return true;
+}
+}
+
+const uint64_t MeshCache::HASH_BASIS;
+
+MeshCache::MeshCache(const std::string &dir)
+    : directory(dir)
+{
+}
+
+/* Leading ./ and ../ are dropped from the key, so the converter run from
+ * the source tree and the app run from build/ name the same entry. Levels
+ * of detail add a .lodN suffix. */
+std::string MeshCache::EntryPath(const std::string &sourceFile, int level) const
+{
+    std::string key = sourceFile;
+    for (;;)
+    {
+        if (key.compare(0, 2, "./") == 0)
+            key = key.substr(2);
+        else if (key.compare(0, 3, "../") == 0)
+            key = key.substr(3);
+        else
+            break;
+    }
+
+    std::string base = key;
+    size_t slash = base.find_last_of("/\\");
+    if (slash != std::string::npos)
+        base = base.substr(slash + 1);
+    size_t dot = base.find_last_of('.');
+    if (dot != std::string::npos)
+        base = base.substr(0, dot);
+
+    char hash[17];
+    snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)HashBytes(key.data(), key.size()));
+    std::ostringstream path;
+    path << directory << "/" << base << "-" << hash;
+    if (level > 0)
+        path << ".lod" << level;
+    path << ".ftm";
+    return path.str();
+}
+
+uint64_t MeshCache::HashBytes(const void *data, size_t length, uint64_t hash)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+bool MeshCache::WriteFile(const std::string &fileName, const void *header, size_t headerLength,
+                          const void *payload, size_t payloadLength)
+{
+    size_t slash = fileName.find_last_of('/');
+    if (slash != std::string::npos)
+        mkdir(fileName.substr(0, slash).c_str(), 0755);
+    std::ostringstream tmp;
+    tmp << fileName << ".tmp." << getpid() << "." << std::this_thread::get_id();
+    {
+        std::ofstream out(tmp.str().c_str(), std::ios::binary);
+        out.write(static_cast<const char *>(header), (std::streamsize)headerLength);
+        if (payloadLength > 0)
+            out.write(static_cast<const char *>(payload), (std::streamsize)payloadLength);
+        if (!out)
+        {
+            remove(tmp.str().c_str());
+            return false;
+        }
+    }
+    return rename(tmp.str().c_str(), fileName.c_str()) == 0;
+}
+
+std::string MeshCache::KeyedPath(const std::string &directory, const char *name, uint64_t key,
+                                 const char *extension)
+{
+    char hash[17];
+    snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)key);
+    return directory + "/" + name + "-" + hash + "." + extension;
+}
+
+uint64_t MeshCache::HashFile(const std::string &fileName)
+{
+    std::ifstream in(fileName.c_str(), std::ios::binary);
+    if (!in)
+        return 0;
+    uint64_t hash = HASH_BASIS;
+    char buffer[65536];
+    while (in)
+    {
+        in.read(buffer, sizeof(buffer));
+        hash = HashBytes(buffer, (size_t)in.gcount(), hash);
+    }
+    return hash;
+}
+
+vtkSmartPointer<vtkPolyData> MeshCache::Read(const std::string &sourceFile, int level) const
+{
+    std::string entry = EntryPath(sourceFile, level);
+    int fd = open(entry.c_str(), O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(EntryHeader))
+    {
+        close(fd);
+        return NULL;
+    }
+    size_t length = (size_t)st.st_size;
+
+    /* Private and writable so a filter touching the arrays in place gets
+     * copy-on-write pages rather than a fault */
+    void *base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return NULL;
+
+    const EntryHeader *header = static_cast<const EntryHeader *>(base);
+    bool valid = memcmp(header->magic, ENTRY_MAGIC, sizeof(ENTRY_MAGIC)) == 0
+              && header->version == ENTRY_VERSION
+              && header->fileSize == length
+              && BlockFits(header->positionsOffset, header->numberOfPoints, 3 * sizeof(float), length)
+              && BlockFits(header->normalsOffset, header->numberOfPoints, 3 * sizeof(float), length)
+              && BlockFits(header->cellsOffset, header->numberOfTriangles, 4 * sizeof(int64_t), length);
+
+    int64_t  mtime;
+    uint64_t size;
+    if (valid && StatFile(sourceFile, mtime, size)
+        && (mtime != header->sourceMTime || size != header->sourceSize))
+    {
+        /* Touched but possibly unchanged (checkout, copy): compare contents */
+        valid = HashFile(sourceFile) == header->sourceHash;
+    }
+    /* Checked even when the source is absent and the entry trusted, since
+     * a corrupt file would otherwise be read out of bounds later */
+    const int64_t *cells = reinterpret_cast<const int64_t *>(static_cast<const char *>(base) + header->cellsOffset);
+    valid = valid && CellsValid(cells, header->numberOfTriangles, header->numberOfPoints);
+    if (!valid)
+    {
+        munmap(base, length);
+        return NULL;
+    }
+
+    char *bytes = static_cast<char *>(base);
+    vtkIdType nPoints    = (vtkIdType)header->numberOfPoints;
+    vtkIdType nTriangles = (vtkIdType)header->numberOfTriangles;
+
+    vtkSmartPointer<vtkFloatArray> positions = vtkSmartPointer<vtkFloatArray>::New();
+    positions->SetNumberOfComponents(3);
+    positions->SetArray(reinterpret_cast<float *>(bytes + header->positionsOffset), nPoints * 3, 1);
+    vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+    points->SetData(positions);
+
+    vtkSmartPointer<vtkFloatArray> normals = vtkSmartPointer<vtkFloatArray>::New();
+    normals->SetNumberOfComponents(3);
+    normals->SetName("Normals");
+    normals->SetArray(reinterpret_cast<float *>(bytes + header->normalsOffset), nPoints * 3, 1);
+
+    vtkSmartPointer<vtkIdTypeArray> ids = vtkSmartPointer<vtkIdTypeArray>::New();
+    const int64_t *cellData = reinterpret_cast<const int64_t *>(bytes + header->cellsOffset);
+    if (sizeof(vtkIdType) == sizeof(int64_t))
+    {
+        ids->SetArray(reinterpret_cast<vtkIdType *>(bytes + header->cellsOffset), nTriangles * 4, 1);
+    }
+    else
+    {
+        /* 32-bit vtkIdType builds have to widen-copy the connectivity */
+        vtkIdType *out = ids->WritePointer(0, nTriangles * 4);
+        for (vtkIdType i = 0; i < nTriangles * 4; i++)
+            out[i] = (vtkIdType)cellData[i];
+    }
+    vtkSmartPointer<vtkCellArray> triangles = vtkSmartPointer<vtkCellArray>::New();
+    triangles->SetCells(nTriangles, ids);
+
+    vtkSmartPointer<vtkPolyData> mesh = vtkSmartPointer<vtkPolyData>::New();
+    mesh->SetPoints(points);
+    mesh->SetPolys(triangles);
+    mesh->GetPointData()->SetNormals(normals);
+
+    /* The mapping backs live vtkDataArrays, which have no hook to release
+     * it, so it stays for the life of the process. Its pages are clean and
+     * file-backed, so the OS can drop them under memory pressure. */
+    return mesh;
+}
+
+bool MeshCache::Write(const std::string &sourceFile, vtkPolyData *mesh, int level) const
+{
+    vtkDataArray *normals = mesh->GetPointData()->GetNormals();
+    if (!mesh->GetPoints() || !normals || normals->GetNumberOfComponents() != 3)
+        return false;
+
+    EntryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ENTRY_MAGIC, sizeof(ENTRY_MAGIC));
+    header.version = ENTRY_VERSION;
+    if (!StatFile(sourceFile, header.sourceMTime, header.sourceSize))
+        return false;
+    header.sourceHash = HashFile(sourceFile);
+
+    vtkIdType nPoints = mesh->GetNumberOfPoints();
+    std::vector<float> positions(nPoints * 3);
+    std::vector<float> pointNormals(nPoints * 3);
+    for (vtkIdType i = 0; i < nPoints; i++)
+    {
+        double p[3], n[3];
+        mesh->GetPoints()->GetPoint(i, p);
+        normals->GetTuple(i, n);
+        for (int c = 0; c < 3; c++)
+        {
+            positions[i * 3 + c]    = (float)p[c];
+            pointNormals[i * 3 + c] = (float)n[c];
+        }
+    }
+
+    std::vector<int64_t> cells;
+    cells.reserve(mesh->GetNumberOfPolys() * 4);
+    vtkCellArray *polys = mesh->GetPolys();
+    vtkIdType  npts;
+    vtkIdType *pts;
+    for (polys->InitTraversal(); polys->GetNextCell(npts, pts);)
+    {
+        if (npts != 3)
+            return false;
+        cells.push_back(3);
+        cells.push_back(pts[0]);
+        cells.push_back(pts[1]);
+        cells.push_back(pts[2]);
+    }
+
+    header.numberOfPoints    = (uint64_t)nPoints;
+    header.numberOfTriangles = (uint64_t)(cells.size() / 4);
+    header.positionsOffset   = AlignUp(sizeof(EntryHeader));
+    header.normalsOffset     = AlignUp(header.positionsOffset + positions.size() * sizeof(float));
+    header.cellsOffset       = AlignUp(header.normalsOffset + pointNormals.size() * sizeof(float));
+    header.fileSize          = header.cellsOffset + cells.size() * sizeof(int64_t);
+
+    std::vector<char> image(header.fileSize, 0);
+    memcpy(&image[0], &header, sizeof(header));
+    if (!positions.empty())
+    {
+        memcpy(&image[header.positionsOffset], &positions[0], positions.size() * sizeof(float));
+        memcpy(&image[header.normalsOffset], &pointNormals[0], pointNormals.size() * sizeof(float));
+    }
+    if (!cells.empty())
+        memcpy(&image[header.cellsOffset], &cells[0], cells.size() * sizeof(int64_t));
+    return WriteFile(EntryPath(sourceFile, level), &image[0], image.size(), NULL, 0);
+}
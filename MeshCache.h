@@ -0,0 +1,107 @@
+/*
+ * Binary mesh cache
+ *
+ * Parsing the ASCII .obj files dominates startup, so each parsed model is
+ * stored once in a compact binary form (.ftm) and memory-mapped on later
+ * runs. An entry holds a triangulated mesh as float32 positions, float32
+ * normals and legacy-layout cell connectivity, each block laid out so that
+ * vtkFloatArray/vtkIdTypeArray can point straight into the mapping.
+ *
+ * Entries are named after the source path and validated against the
+ * source's mtime and size; if those changed, a content hash decides whether
+ * the entry is still good. When the source file is absent (production
+ * boxes ship only the cache) the entry is trusted as is.
+ *
+ * A mesh's decimated levels of detail are stored as further entries beside
+ * its own, one per level, validated against the same source file.
+ *
+ * The other caches kept beside the entries, of distance fields, baked
+ * light and caustics, key their files with the same hash and write them
+ * through WriteFile(); ReadOrBuild() reads one back or builds and stores
+ * it.
+ */
+
+#ifndef FISHTANK_MESHCACHE_H
+#define FISHTANK_MESHCACHE_H
+
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+class MeshCache
+{
+    public:
+        explicit MeshCache(const std::string &directory);
+
+        const std::string &GetDirectory() const { return directory; }
+
+        /* Map the entry for a source file, or for one of its levels of
+         * detail; returns null on a miss or a stale entry */
+        vtkSmartPointer<vtkPolyData> Read(const std::string &sourceFile, int level = 0) const;
+
+        /* Store a triangulated mesh with point normals as the entry for sourceFile */
+        bool Write(const std::string &sourceFile, vtkPolyData *mesh, int level = 0) const;
+
+        /* Where the entry for sourceFile lives; level 0 is the mesh itself */
+        std::string EntryPath(const std::string &sourceFile, int level = 0) const;
+
+        /* 64-bit FNV-1a over a file's contents; 0 if it can't be read */
+        static uint64_t HashFile(const std::string &fileName);
+
+        /* 64-bit FNV-1a over bytes, carrying on from hash */
+        static const uint64_t HASH_BASIS = 14695981039346656037ULL;
+        static uint64_t HashBytes(const void *data, size_t length, uint64_t hash = HASH_BASIS);
+
+        /* Write a header and then a payload to fileName, making its directory
+         * if need be. The file is written beside its name and renamed into
+         * place, so concurrent writers and readers never see part of it. */
+        static bool WriteFile(const std::string &fileName, const void *header, size_t headerLength,
+                              const void *payload, size_t payloadLength);
+
+        /* Where a file keyed by key lives in directory: name-<key>.extension */
+        static std::string KeyedPath(const std::string &directory, const char *name, uint64_t key,
+                                     const char *extension);
+
+        /* Read a T back from its keyed file in directory, or build(T &) it
+         * and write it there, logging which it was, what describe(const T &)
+         * says it is and how long it took. T has Read() and Write() taking
+         * a file name and the key. Without a directory it is just built. */
+        template <class T, class Build, class Describe>
+        static std::shared_ptr<const T> ReadOrBuild(const std::string &directory, const char *name,
+                                                    const char *extension, uint64_t key, Build build,
+                                                    Describe describe);
+
+    private:
+        std::string directory;
+};
+
+template <class T, class Build, class Describe>
+std::shared_ptr<const T> MeshCache::ReadOrBuild(const std::string &directory, const char *name,
+                                                const char *extension, uint64_t key, Build build, Describe describe)
+{
+    std::shared_ptr<T> object = std::make_shared<T>();
+    std::string fileName = directory.empty() ? std::string() : KeyedPath(directory, name, key, extension);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool cached = !fileName.empty() && object->Read(fileName, key);
+    if (!cached)
+    {
+        build(*object);
+        if (!fileName.empty())
+            object->Write(fileName, key);
+    }
+    std::ostringstream message;
+    message << "[" << name << "] " << (cached ? "read " : "built ") << describe(*object) << " in "
+            << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+            << " ms" << std::endl;
+    std::cerr << message.str();
+    return object;
+}
+
+#endif
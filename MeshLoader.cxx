@@ -0,0 +1,175 @@
+/*
+ * Asynchronous model loading
+ */
+
+#include "MeshLoader.h"
+
+#include "MeshOptimizer.h"
+#include "Profiler.h"
+
+#include <vtkCleanPolyData.h>
+#include <vtkOBJReader.h>
+#include <vtkPointData.h>
+#include <vtkPolyDataNormals.h>
+#include <vtkQuadricDecimation.h>
+#include <vtkTriangleFilter.h>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+MeshLoader::MeshLoader(const std::string &cacheDirectory, unsigned int threadCount)
+    : pool(threadCount)
+{
+    if (!cacheDirectory.empty())
+        cache.reset(new MeshCache(cacheDirectory));
+}
+
+MeshLoader::MeshFuture MeshLoader::Load(const std::string &fileName)
+{
+    return pool.Submit([this, fileName]() { return Parse(fileName, true); }).share();
+}
+
+MeshLoader::MeshFuture MeshLoader::Reload(const std::string &fileName)
+{
+    return pool.Submit([this, fileName]() { return Parse(fileName, false); }).share();
+}
+
+bool MeshLoader::IsReady(const MeshFuture &mesh)
+{
+    return mesh.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+/* Each call owns its pipeline, so nothing is shared between workers; the
+ * output is copied off the last filter so the pipeline can be released
+ * before the mesh reaches the render thread. */
+vtkSmartPointer<vtkPolyData> MeshLoader::ParseOBJ(const std::string &fileName)
+{
+    vtkSmartPointer<vtkOBJReader> reader = vtkSmartPointer<vtkOBJReader>::New();
+    reader->SetFileName(fileName.c_str());
+
+    vtkSmartPointer<vtkTriangleFilter> triangles = vtkSmartPointer<vtkTriangleFilter>::New();
+    triangles->SetInputConnection(reader->GetOutputPort());
+    triangles->PassVertsOff();
+    triangles->PassLinesOff();
+    triangles->Update();
+
+    vtkSmartPointer<vtkPolyData> mesh = vtkSmartPointer<vtkPolyData>::New();
+    if (triangles->GetOutput()->GetPointData()->GetNormals())
+    {
+        mesh->ShallowCopy(triangles->GetOutput());
+        return mesh;
+    }
+
+    /* Exports without vn lines get faceted normals, matching how they
+     * rendered before the cache existed */
+    vtkSmartPointer<vtkPolyDataNormals> normals = vtkSmartPointer<vtkPolyDataNormals>::New();
+    normals->SetInputConnection(triangles->GetOutputPort());
+    normals->SplittingOn();
+    normals->SetFeatureAngle(30);
+    normals->Update();
+    mesh->ShallowCopy(normals->GetOutput());
+    return mesh;
+}
+
+/* Split normals leave seams of duplicated points, which the decimator
+ * would treat as open boundaries and pull apart; the points are welded
+ * first and the normals rebuilt afterwards with the loader's own crease
+ * angle. */
+vtkSmartPointer<vtkPolyData> MeshLoader::Decimate(vtkPolyData *mesh)
+{
+    vtkSmartPointer<vtkCleanPolyData> weld = vtkSmartPointer<vtkCleanPolyData>::New();
+    weld->SetInputData(mesh);
+    weld->PointMergingOn();
+    weld->SetTolerance(0);
+
+    vtkSmartPointer<vtkQuadricDecimation> decimate = vtkSmartPointer<vtkQuadricDecimation>::New();
+    decimate->SetInputConnection(weld->GetOutputPort());
+    decimate->SetTargetReduction(0.5);
+    decimate->VolumePreservationOn();
+
+    vtkSmartPointer<vtkPolyDataNormals> normals = vtkSmartPointer<vtkPolyDataNormals>::New();
+    normals->SetInputConnection(decimate->GetOutputPort());
+    normals->SplittingOn();
+    normals->SetFeatureAngle(30);
+    normals->Update();
+
+    vtkSmartPointer<vtkPolyData> level = vtkSmartPointer<vtkPolyData>::New();
+    level->ShallowCopy(normals->GetOutput());
+    return level;
+}
+
+/* Runs on a worker thread. Parsed and decimated meshes are optimized
+ * before they are cached, so cached entries are drawn as they are read.
+ * Whether a mesh has a next level depends only
+ * on the level above it, so a cache miss part way down the chain means a
+ * lost entry, not the end of the chain. Reloads skip the cache reads: an
+ * entry validates against the source's mtime in whole seconds, so a file
+ * saved twice within one could still match. */
+MeshLoader::MeshLevels MeshLoader::Parse(const std::string &fileName, bool useCached)
+{
+    ScopedTimer timer("load", fileName);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    const char *source = "cache";
+    vtkSmartPointer<vtkPolyData> mesh;
+    if (cache && useCached)
+        mesh = cache->Read(fileName);
+    if (!mesh)
+    {
+        source = "obj";
+        mesh = ParseOBJ(fileName);
+        {
+            ScopedTimer optimizeTimer("optimize", fileName);
+            mesh = MeshOptimizer::Optimize(mesh);
+        }
+        if (cache && mesh->GetNumberOfPoints() > 0 && !cache->Write(fileName, mesh))
+            std::cerr << "[loader] could not cache " + fileName + "\n" << std::flush;
+    }
+
+    MeshLevels levels(1, mesh);
+    while ((int)levels.size() < MAX_LEVELS && levels.back()->GetNumberOfPolys() >= 2 * MIN_LEVEL_TRIANGLES)
+    {
+        int index = (int)levels.size();
+        vtkSmartPointer<vtkPolyData> level;
+        if (cache && useCached)
+            level = cache->Read(fileName, index);
+        if (!level)
+        {
+            {
+                ScopedTimer decimateTimer("decimate", fileName);
+                level = Decimate(levels.back());
+            }
+            {
+                ScopedTimer optimizeTimer("optimize", fileName);
+                level = MeshOptimizer::Optimize(level);
+            }
+            if (cache && level->GetNumberOfPoints() > 0 && !cache->Write(fileName, level, index))
+                std::cerr << "[loader] could not cache " + fileName + " level " + std::to_string(index) + "\n"
+                          << std::flush;
+        }
+        if (level->GetNumberOfPolys() == 0)
+            break;
+        levels.push_back(level);
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+    /* One write per message so lines from different workers don't interleave */
+    std::ostringstream msg;
+    msg << "[loader] " << source << " " << fileName << " in " << ms << " ms ("
+        << mesh->GetNumberOfPolys() << " faces";
+    for (size_t i = 1; i < levels.size(); i++)
+        msg << (i == 1 ? ", levels " : "/") << levels[i]->GetNumberOfPolys();
+    msg << ")";
+    if (mesh->GetNumberOfPoints() == 0)
+        msg << " - no geometry read";
+    msg << "\n";
+    std::cerr << msg.str() << std::flush;
+
+    /* Bounds are cached on first use; working them out here leaves the
+     * meshes only ever read, by however many render threads draw them */
+    for (size_t i = 0; i < levels.size(); i++)
+        levels[i]->ComputeBounds();
+    return levels;
+}
@@ -0,0 +1,75 @@
+/*
+ * Asynchronous model loading
+ *
+ * Parses .obj files on a pool of worker threads so the render window can
+ * open straight away. Each Load() returns a future for the finished
+ * vtkPolyData; the scene attaches actors as their futures become ready.
+ *
+ * With a cache directory set, meshes come from the binary MeshCache when a
+ * valid entry exists, and freshly parsed meshes are written back to it.
+ *
+ * Every mesh heavy enough to benefit also gets a chain of levels of detail,
+ * each with about half the triangles of the one before, made by quadric
+ * decimation on the worker and cached beside the mesh.
+ *
+ * Every level is welded and reordered by MeshOptimizer before it is cached.
+ */
+
+#ifndef FISHTANK_MESHLOADER_H
+#define FISHTANK_MESHLOADER_H
+
+#include "MeshCache.h"
+#include "ThreadPool.h"
+
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+class MeshLoader
+{
+    public:
+        /* The mesh as loaded, then its coarser levels, finest first */
+        typedef std::vector<vtkSmartPointer<vtkPolyData> > MeshLevels;
+        typedef std::shared_future<MeshLevels>              MeshFuture;
+
+        /* Levels stop once a mesh is this light; at most MAX_LEVELS in all */
+        static const vtkIdType MIN_LEVEL_TRIANGLES = 150;
+        static const int       MAX_LEVELS          = 4;
+
+        /* An empty cacheDirectory disables the binary cache */
+        explicit MeshLoader(const std::string &cacheDirectory = "", unsigned int threadCount = 0);
+
+        /* Empty when the cache is disabled */
+        std::string GetCacheDirectory() const { return cache ? cache->GetDirectory() : std::string(); }
+
+        /* Queue a file for parsing; never blocks */
+        MeshFuture Load(const std::string &fileName);
+
+        /* Queue a fresh parse of a file that changed, ignoring its cached
+         * entries and writing new ones; never blocks */
+        MeshFuture Reload(const std::string &fileName);
+
+        /* True once the future can be read without blocking */
+        static bool IsReady(const MeshFuture &mesh);
+
+        /* Parse an .obj into triangles with point normals, as the reader
+         * leaves them, before optimization. Safe to call from any thread. */
+        static vtkSmartPointer<vtkPolyData> ParseOBJ(const std::string &fileName);
+
+        /* The next level of detail below mesh, in the same form, with about
+         * half its triangles. Safe to call from any thread. */
+        static vtkSmartPointer<vtkPolyData> Decimate(vtkPolyData *mesh);
+
+    private:
+        MeshLevels Parse(const std::string &fileName, bool useCached);
+
+        std::unique_ptr<MeshCache> cache;
+        ThreadPool                 pool;
+};
+
+#endif
@@ -0,0 +1,444 @@
+/*
+ * Mesh optimization
+ */
+
+#include "MeshOptimizer.h"
+
+#include <vtkCellArray.h>
+#include <vtkDataArray.h>
+#include <vtkFloatArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+const double MeshOptimizer::OVERDRAW_THRESHOLD = 1.05;
+
+namespace
+{
+/* Clusters for overdraw sorting are at least this many triangles, so the
+ * cache order inside each survives */
+const size_t MIN_CLUSTER = 64;
+
+/* A vertex as the cache stores it, compared bit for bit */
+struct WeldKey
+{
+    float values[6];
+
+    bool operator==(const WeldKey &other) const
+    {
+        return memcmp(values, other.values, sizeof(values)) == 0;
+    }
+};
+
+struct WeldHash
+{
+    size_t operator()(const WeldKey &key) const
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        const unsigned char *bytes = reinterpret_cast<const unsigned char *>(key.values);
+        for (size_t i = 0; i < sizeof(key.values); i++)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+        return (size_t)hash;
+    }
+};
+
+/* Forsyth's scores: the last triangle's vertices a fixed amount, the rest
+ * of the cache falling off with age, and a bonus for vertices with few
+ * triangles left so lone triangles don't get stranded */
+float VertexScore(int cachePosition, int remaining)
+{
+    if (remaining == 0)
+        return -1;
+    float score = 0;
+    if (cachePosition >= 3)
+        score = std::pow(1.0f - (float)(cachePosition - 3) / (MeshOptimizer::CACHE_SIZE - 3), 1.5f);
+    else if (cachePosition >= 0)
+        score = 0.75f;
+    return score + 2.0f / std::sqrt((float)remaining);
+}
+
+std::vector<unsigned int> OrderForCache(const std::vector<unsigned int> &indices, size_t vertexCount)
+{
+    size_t triangleCount = indices.size() / 3;
+
+    /* Each vertex's triangles; the live ones are the first remaining[v] */
+    std::vector<unsigned int> offsets(vertexCount + 1, 0);
+    for (size_t i = 0; i < indices.size(); i++)
+        offsets[indices[i] + 1]++;
+    for (size_t v = 0; v < vertexCount; v++)
+        offsets[v + 1] += offsets[v];
+    std::vector<unsigned int> adjacency(indices.size());
+    std::vector<int> remaining(vertexCount, 0);
+    for (size_t t = 0; t < triangleCount; t++)
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int v = indices[3 * t + k];
+            adjacency[offsets[v] + remaining[v]++] = (unsigned int)t;
+        }
+
+    std::vector<int>   cachePosition(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        vertexScores[v] = VertexScore(-1, remaining[v]);
+
+    std::vector<bool>         emitted(triangleCount, false);
+    std::vector<unsigned int> cache, nextCache;
+    std::vector<unsigned int> ordered;
+    ordered.reserve(indices.size());
+    size_t cursor = 0;   /* no triangle before it is left */
+    int    best   = -1;
+    for (size_t count = 0; count < triangleCount; count++)
+    {
+        /* Nothing cached scores: start again at the first one left */
+        if (best < 0)
+        {
+            while (emitted[cursor])
+                cursor++;
+            best = (int)cursor;
+        }
+
+        emitted[best] = true;
+        nextCache.clear();
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int v = indices[3 * best + k];
+            ordered.push_back(v);
+            nextCache.push_back(v);
+            unsigned int *live = &adjacency[offsets[v]];
+            for (int j = 0; j < remaining[v]; j++)
+                if (live[j] == (unsigned int)best)
+                {
+                    live[j] = live[--remaining[v]];
+                    break;
+                }
+        }
+        for (size_t c = 0; c < cache.size(); c++)
+        {
+            unsigned int v = cache[c];
+            if (v != nextCache[0] && v != nextCache[1] && v != nextCache[2])
+                nextCache.push_back(v);
+        }
+
+        /* Vertices pushed out of the cache lose their position score */
+        for (size_t c = MeshOptimizer::CACHE_SIZE; c < nextCache.size(); c++)
+        {
+            unsigned int v = nextCache[c];
+            cachePosition[v] = -1;
+            vertexScores[v]  = VertexScore(-1, remaining[v]);
+        }
+        if (nextCache.size() > (size_t)MeshOptimizer::CACHE_SIZE)
+            nextCache.resize(MeshOptimizer::CACHE_SIZE);
+        cache.swap(nextCache);
+        for (size_t c = 0; c < cache.size(); c++)
+        {
+            cachePosition[cache[c]] = (int)c;
+            vertexScores[cache[c]]  = VertexScore((int)c, remaining[cache[c]]);
+        }
+
+        /* Only triangles touching the cache can have changed */
+        best = -1;
+        float bestScore = -1;
+        for (size_t c = 0; c < cache.size(); c++)
+        {
+            unsigned int v = cache[c];
+            for (int j = 0; j < remaining[v]; j++)
+            {
+                unsigned int t = adjacency[offsets[v] + j];
+                float score = vertexScores[indices[3 * t]] + vertexScores[indices[3 * t + 1]]
+                              + vertexScores[indices[3 * t + 2]];
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    best      = (int)t;
+                }
+            }
+        }
+    }
+    return ordered;
+}
+
+/* Splits the cache order where a triangle misses on all three vertices,
+ * which costs it nothing, then draws the clusters facing furthest out
+ * from the mesh centre first: on a roughly convex mesh those are the ones
+ * in front from whichever side it is seen */
+std::vector<unsigned int> OrderForOverdraw(const std::vector<unsigned int> &indices,
+                                           const std::vector<float> &positions)
+{
+    size_t triangleCount = indices.size() / 3;
+    size_t vertexCount   = positions.size() / 3;
+
+    std::vector<size_t> starts(1, 0);
+    std::vector<long long> cacheTime(vertexCount, -MeshOptimizer::CACHE_SIZE - 1);
+    long long misses = 0;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        int missed = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int v = indices[3 * t + k];
+            if (misses - cacheTime[v] >= MeshOptimizer::CACHE_SIZE)
+            {
+                cacheTime[v] = misses++;
+                missed++;
+            }
+        }
+        if (missed == 3 && t - starts.back() >= MIN_CLUSTER)
+            starts.push_back(t);
+    }
+    if (starts.size() < 2)
+        return indices;
+    starts.push_back(triangleCount);
+
+    double center[3] = { 0, 0, 0 };
+    for (size_t v = 0; v < vertexCount; v++)
+        for (int c = 0; c < 3; c++)
+            center[c] += positions[3 * v + c];
+    for (int c = 0; c < 3; c++)
+        center[c] /= std::max<size_t>(vertexCount, 1);
+
+    /* Area-weighted normal and centroid of each cluster */
+    std::vector<std::pair<double, size_t> > clusters;
+    for (size_t i = 0; i + 1 < starts.size(); i++)
+    {
+        double normal[3] = { 0, 0, 0 }, centroid[3] = { 0, 0, 0 }, area = 0;
+        for (size_t t = starts[i]; t < starts[i + 1]; t++)
+        {
+            const float *a = &positions[3 * indices[3 * t]];
+            const float *b = &positions[3 * indices[3 * t + 1]];
+            const float *c = &positions[3 * indices[3 * t + 2]];
+            double e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            double e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+            double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2],
+                            e1[0] * e2[1] - e1[1] * e2[0] };
+            double twice = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (int k = 0; k < 3; k++)
+            {
+                normal[k]   += n[k];
+                centroid[k] += twice * (a[k] + b[k] + c[k]) / 3;
+            }
+            area += twice;
+        }
+        double length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        double facing = 0;
+        if (area > 0 && length > 0)
+            for (int k = 0; k < 3; k++)
+                facing += (centroid[k] / area - center[k]) * normal[k] / length;
+        clusters.push_back(std::make_pair(-facing, i));
+    }
+    std::stable_sort(clusters.begin(), clusters.end());
+
+    std::vector<unsigned int> ordered;
+    ordered.reserve(indices.size());
+    for (size_t i = 0; i < clusters.size(); i++)
+    {
+        size_t cluster = clusters[i].second;
+        ordered.insert(ordered.end(), indices.begin() + 3 * starts[cluster],
+                       indices.begin() + 3 * starts[cluster + 1]);
+    }
+    return ordered;
+}
+
+/* Triangle indices of a mesh, fanning anything that isn't a triangle */
+std::vector<unsigned int> GetIndices(vtkPolyData *mesh)
+{
+    std::vector<unsigned int> indices;
+    indices.reserve(mesh->GetNumberOfPolys() * 3);
+    vtkCellArray *polys = mesh->GetPolys();
+    vtkIdType  npts;
+    vtkIdType *pts;
+    for (polys->InitTraversal(); polys->GetNextCell(npts, pts);)
+        for (vtkIdType k = 1; k + 1 < npts; k++)
+        {
+            indices.push_back((unsigned int)pts[0]);
+            indices.push_back((unsigned int)pts[k]);
+            indices.push_back((unsigned int)pts[k + 1]);
+        }
+    return indices;
+}
+}
+
+/* Welding is exact: vertices on a crease keep their own normals, and
+ * triangles it collapses are dropped */
+vtkSmartPointer<vtkPolyData> MeshOptimizer::Optimize(vtkPolyData *mesh)
+{
+    vtkDataArray *normals = mesh->GetPointData()->GetNormals();
+    if (!normals || normals->GetNumberOfComponents() != 3 || !mesh->GetPoints())
+        return mesh;
+
+    vtkIdType nPoints = mesh->GetNumberOfPoints();
+    std::vector<unsigned int> weldMap(nPoints);
+    std::vector<float>        welded;
+    welded.reserve(nPoints * 6);
+    std::unordered_map<WeldKey, unsigned int, WeldHash> seen;
+    seen.reserve(nPoints);
+    for (vtkIdType i = 0; i < nPoints; i++)
+    {
+        double p[3], n[3];
+        mesh->GetPoint(i, p);
+        normals->GetTuple(i, n);
+        WeldKey key;
+        for (int c = 0; c < 3; c++)
+        {
+            key.values[c]     = (float)p[c];
+            key.values[3 + c] = (float)n[c];
+        }
+        std::pair<std::unordered_map<WeldKey, unsigned int, WeldHash>::iterator, bool> added =
+            seen.insert(std::make_pair(key, (unsigned int)(welded.size() / 6)));
+        if (added.second)
+            welded.insert(welded.end(), key.values, key.values + 6);
+        weldMap[i] = added.first->second;
+    }
+    size_t vertexCount = welded.size() / 6;
+
+    std::vector<unsigned int> source = GetIndices(mesh);
+    std::vector<unsigned int> indices;
+    indices.reserve(source.size());
+    for (size_t t = 0; t + 2 < source.size(); t += 3)
+    {
+        unsigned int a = weldMap[source[t]], b = weldMap[source[t + 1]], c = weldMap[source[t + 2]];
+        if (a == b || b == c || a == c)
+            continue;
+        indices.push_back(a);
+        indices.push_back(b);
+        indices.push_back(c);
+    }
+
+    std::vector<float> positions(vertexCount * 3);
+    for (size_t v = 0; v < vertexCount; v++)
+        for (int c = 0; c < 3; c++)
+            positions[3 * v + c] = welded[6 * v + c];
+    std::vector<unsigned int> cacheOrder = OrderForCache(indices, vertexCount);
+    std::vector<unsigned int> overdrawOrder = OrderForOverdraw(cacheOrder, positions);
+    if (ComputeACMR(overdrawOrder, vertexCount) <= OVERDRAW_THRESHOLD * ComputeACMR(cacheOrder, vertexCount))
+        indices.swap(overdrawOrder);
+    else
+        indices.swap(cacheOrder);
+
+    /* Renumber by first use; welded points no triangle uses are dropped */
+    std::vector<int> remap(vertexCount, -1);
+    vtkIdType used = 0;
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        if (remap[indices[i]] < 0)
+            remap[indices[i]] = (int)used++;
+        indices[i] = (unsigned int)remap[indices[i]];
+    }
+
+    vtkSmartPointer<vtkFloatArray> pointPositions = vtkSmartPointer<vtkFloatArray>::New();
+    pointPositions->SetNumberOfComponents(3);
+    pointPositions->SetNumberOfTuples(used);
+    vtkSmartPointer<vtkFloatArray> pointNormals = vtkSmartPointer<vtkFloatArray>::New();
+    pointNormals->SetNumberOfComponents(3);
+    pointNormals->SetName("Normals");
+    pointNormals->SetNumberOfTuples(used);
+    float *p = pointPositions->GetPointer(0);
+    float *n = pointNormals->GetPointer(0);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        if (remap[v] < 0)
+            continue;
+        memcpy(p + 3 * remap[v], &welded[6 * v], 3 * sizeof(float));
+        memcpy(n + 3 * remap[v], &welded[6 * v + 3], 3 * sizeof(float));
+    }
+    vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+    points->SetData(pointPositions);
+
+    vtkIdType nTriangles = (vtkIdType)indices.size() / 3;
+    vtkSmartPointer<vtkIdTypeArray> ids = vtkSmartPointer<vtkIdTypeArray>::New();
+    vtkIdType *cells = ids->WritePointer(0, nTriangles * 4);
+    for (vtkIdType t = 0; t < nTriangles; t++)
+    {
+        cells[4 * t] = 3;
+        for (int k = 0; k < 3; k++)
+            cells[4 * t + 1 + k] = indices[3 * t + k];
+    }
+    vtkSmartPointer<vtkCellArray> triangles = vtkSmartPointer<vtkCellArray>::New();
+    triangles->SetCells(nTriangles, ids);
+
+    vtkSmartPointer<vtkPolyData> optimized = vtkSmartPointer<vtkPolyData>::New();
+    optimized->SetPoints(points);
+    optimized->SetPolys(triangles);
+    optimized->GetPointData()->SetNormals(pointNormals);
+    return optimized;
+}
+
+/* A zero-area axis keeps a zero scale, and every vertex decodes to the
+ * offset along it */
+void MeshOptimizer::Quantize(vtkPolyData *mesh, std::vector<QuantizedVertex> &vertices, float scale[3],
+                             float offset[3])
+{
+    double bounds[6];
+    mesh->GetBounds(bounds);
+    for (int c = 0; c < 3; c++)
+    {
+        offset[c] = (float)bounds[2 * c];
+        scale[c]  = (float)std::max(bounds[2 * c + 1] - bounds[2 * c], 0.0);
+    }
+
+    vtkDataArray *normals = mesh->GetPointData()->GetNormals();
+    vtkIdType nPoints = mesh->GetNumberOfPoints();
+    vertices.resize(nPoints);
+    for (vtkIdType i = 0; i < nPoints; i++)
+    {
+        QuantizedVertex &vertex = vertices[i];
+        double p[3], n[3] = { 0, 0, 1 };
+        mesh->GetPoint(i, p);
+        if (normals)
+            normals->GetTuple(i, n);
+        for (int c = 0; c < 3; c++)
+        {
+            double fraction = scale[c] > 0 ? (p[c] - offset[c]) / scale[c] : 0;
+            vertex.position[c] = (uint16_t)std::floor(std::min(std::max(fraction, 0.0), 1.0) * 65535 + 0.5);
+        }
+        vertex.position[3] = 0;
+
+        /* Onto the octahedron |x|+|y|+|z| = 1, the lower half folded out
+         * over the corners of the square */
+        double sum = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+        double u = sum > 0 ? n[0] / sum : 0, v = sum > 0 ? n[1] / sum : 0;
+        if (n[2] < 0)
+        {
+            double foldedU = (1 - std::fabs(v)) * (u >= 0 ? 1 : -1);
+            double foldedV = (1 - std::fabs(u)) * (v >= 0 ? 1 : -1);
+            u = foldedU;
+            v = foldedV;
+        }
+        vertex.normal[0] = (int16_t)std::floor(std::min(std::max(u, -1.0), 1.0) * 32767 + 0.5);
+        vertex.normal[1] = (int16_t)std::floor(std::min(std::max(v, -1.0), 1.0) * 32767 + 0.5);
+    }
+}
+
+MeshOptimizer::Statistics MeshOptimizer::Measure(vtkPolyData *mesh)
+{
+    std::vector<unsigned int> indices = GetIndices(mesh);
+    Statistics stats;
+    stats.vertices       = mesh->GetNumberOfPoints();
+    stats.triangles      = (vtkIdType)indices.size() / 3;
+    stats.acmr           = ComputeACMR(indices, stats.vertices);
+    stats.bytes          = stats.vertices * 6 * sizeof(float) + indices.size() * sizeof(uint32_t);
+    stats.quantizedBytes = stats.vertices * sizeof(QuantizedVertex)
+                           + indices.size() * (stats.vertices <= 65536 ? sizeof(uint16_t) : sizeof(uint32_t));
+    return stats;
+}
+
+/* A vertex is still cached while fewer than CACHE_SIZE misses have
+ * happened since its own */
+double MeshOptimizer::ComputeACMR(const std::vector<unsigned int> &indices, vtkIdType vertexCount)
+{
+    if (indices.size() < 3)
+        return 0;
+    std::vector<long long> cacheTime(vertexCount, -CACHE_SIZE - 1);
+    long long misses = 0;
+    for (size_t i = 0; i < indices.size(); i++)
+        if (misses - cacheTime[indices[i]] >= CACHE_SIZE)
+            cacheTime[indices[i]] = misses++;
+    return (double)misses / (indices.size() / 3);
+}
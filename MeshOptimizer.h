@@ -0,0 +1,71 @@
+/*
+ * Mesh optimization
+ *
+ * Prepares loaded triangle meshes for drawing. vtkOBJReader and split
+ * normals leave many copies of the same vertex and triangles in the
+ * order they were modelled, so the GPU transforms most vertices several
+ * times over. Optimize() welds vertices whose position and normal are
+ * identical, orders the triangles for the post-transform vertex cache
+ * (Forsyth's linear-speed method), then moves clusters of them that face
+ * outwards to the front to cut overdraw (after Sander et al.) as long as
+ * that costs the cache little. Points are renumbered in first-use order
+ * so vertex fetches walk memory forwards, and stored as float32.
+ *
+ * Quantize() packs a mesh for the instanced mapper: positions as 16-bit
+ * fractions of the mesh bounds and normals octahedrally encoded in two
+ * 16-bit values, 12 bytes a vertex against 24.
+ *
+ * Measure() reports the average cache miss ratio (ACMR, transformed
+ * vertices per triangle under a FIFO cache of CACHE_SIZE) and the bytes a
+ * mesh takes on the GPU either way.
+ */
+
+#ifndef FISHTANK_MESHOPTIMIZER_H
+#define FISHTANK_MESHOPTIMIZER_H
+
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+#include <stdint.h>
+#include <vector>
+
+class MeshOptimizer
+{
+    public:
+        /* Vertices the ordering and the ACMR figures assume stay cached */
+        static const int CACHE_SIZE = 32;
+
+        /* Overdraw ordering is dropped when it raises ACMR by more than this */
+        static const double OVERDRAW_THRESHOLD;
+
+        struct Statistics
+        {
+            vtkIdType vertices;
+            vtkIdType triangles;
+            double    acmr;
+            size_t    bytes;            /* float vertices, 32-bit indices */
+            size_t    quantizedBytes;   /* Quantize() vertices, 16-bit indices when they fit */
+        };
+
+        /* 16-bit position padded to four for alignment, octahedral normal */
+        struct QuantizedVertex
+        {
+            uint16_t position[4];
+            int16_t  normal[2];
+        };
+
+        /* Triangles with point normals in, the same out; safe to call from
+         * any thread. Meshes without normals are returned as they are. */
+        static vtkSmartPointer<vtkPolyData> Optimize(vtkPolyData *mesh);
+
+        /* Positions decode as offset + scale * fraction */
+        static void Quantize(vtkPolyData *mesh, std::vector<QuantizedVertex> &vertices, float scale[3],
+                             float offset[3]);
+
+        static Statistics Measure(vtkPolyData *mesh);
+
+        /* ACMR of a triangle list under a FIFO cache of CACHE_SIZE */
+        static double ComputeACMR(const std::vector<unsigned int> &indices, vtkIdType vertexCount);
+};
+
+#endif
@@ -0,0 +1,323 @@
+/*
+ * Bubbles and drifting motes
+ */
+
+#include "ParticleSystem.h"
+
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <future>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PARTICLES_X86 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+/* Particles per job when a step is shared out between threads; pools
+ * smaller than two chunks are stepped on the calling thread */
+const int CHUNK = 32768;
+
+/* Vertical velocity decays towards lift / DRAG, per second */
+const float DRAG = 1.5f;
+
+/* Seconds over which a particle grows in and shrinks out */
+const float FADE_IN  = 0.3f;
+const float FADE_OUT = 0.5f;
+
+/* The arrays a step writes, from the first particle of a chunk */
+struct Lanes
+{
+    float *px, *py, *pz;
+    float *vx, *vy, *vz;
+    const float *lift, *spin, *life, *size;
+    float *age, *radius;
+};
+
+/* Sideways velocity is turned by the small angle spin * dt each step,
+ * with the z update seeing the new x so the speed doesn't creep up */
+void IntegrateScalar(const Lanes &l, int count, float dt)
+{
+    for (int i = 0; i < count; i++)
+    {
+        float turn = l.spin[i] * dt;
+        l.vx[i] -= turn * l.vz[i];
+        l.vz[i] += turn * l.vx[i];
+        l.vy[i] += (l.lift[i] - DRAG * l.vy[i]) * dt;
+        l.px[i] += l.vx[i] * dt;
+        l.py[i] += l.vy[i] * dt;
+        l.pz[i] += l.vz[i] * dt;
+        l.age[i] += dt;
+        float grow   = std::min(l.age[i] * (1 / FADE_IN), 1.0f);
+        float shrink = std::min((l.life[i] - l.age[i]) * (1 / FADE_OUT), 1.0f);
+        l.radius[i] = l.size[i] * std::max(std::min(grow, shrink), 0.0f);
+    }
+}
+
+#ifdef PARTICLES_X86
+__attribute__((target("sse2")))
+void IntegrateSSE(const Lanes &l, int count, float dt)
+{
+    const __m128 step   = _mm_set1_ps(dt);
+    const __m128 drag   = _mm_set1_ps(DRAG);
+    const __m128 inRate = _mm_set1_ps(1 / FADE_IN);
+    const __m128 outRate = _mm_set1_ps(1 / FADE_OUT);
+    const __m128 one    = _mm_set1_ps(1.0f);
+    const __m128 zero   = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 turn = _mm_mul_ps(_mm_loadu_ps(l.spin + i), step);
+        __m128 vx   = _mm_sub_ps(_mm_loadu_ps(l.vx + i), _mm_mul_ps(turn, _mm_loadu_ps(l.vz + i)));
+        __m128 vz   = _mm_add_ps(_mm_loadu_ps(l.vz + i), _mm_mul_ps(turn, vx));
+        __m128 vy   = _mm_loadu_ps(l.vy + i);
+        vy = _mm_add_ps(vy, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(l.lift + i), _mm_mul_ps(drag, vy)), step));
+        _mm_storeu_ps(l.vx + i, vx);
+        _mm_storeu_ps(l.vy + i, vy);
+        _mm_storeu_ps(l.vz + i, vz);
+        _mm_storeu_ps(l.px + i, _mm_add_ps(_mm_loadu_ps(l.px + i), _mm_mul_ps(vx, step)));
+        _mm_storeu_ps(l.py + i, _mm_add_ps(_mm_loadu_ps(l.py + i), _mm_mul_ps(vy, step)));
+        _mm_storeu_ps(l.pz + i, _mm_add_ps(_mm_loadu_ps(l.pz + i), _mm_mul_ps(vz, step)));
+
+        __m128 age = _mm_add_ps(_mm_loadu_ps(l.age + i), step);
+        _mm_storeu_ps(l.age + i, age);
+        __m128 grow   = _mm_min_ps(_mm_mul_ps(age, inRate), one);
+        __m128 shrink = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(l.life + i), age), outRate), one);
+        __m128 fade   = _mm_max_ps(_mm_min_ps(grow, shrink), zero);
+        _mm_storeu_ps(l.radius + i, _mm_mul_ps(_mm_loadu_ps(l.size + i), fade));
+    }
+
+    Lanes tail = { l.px + i, l.py + i, l.pz + i, l.vx + i, l.vy + i, l.vz + i,
+                   l.lift + i, l.spin + i, l.life + i, l.size + i, l.age + i, l.radius + i };
+    IntegrateScalar(tail, count - i, dt);
+}
+#endif
+
+typedef void (*Integrator)(const Lanes &l, int count, float dt);
+
+Integrator GetIntegrator()
+{
+#ifdef PARTICLES_X86
+    if (__builtin_cpu_supports("sse2"))
+        return IntegrateSSE;
+#endif
+    return IntegrateScalar;
+}
+}
+
+ParticleSystem::Emitter ParticleSystem::GetDefaultEmitter(Kind kind)
+{
+    Emitter emitter;
+    emitter.kind = kind;
+    emitter.position[0] = emitter.position[1] = emitter.position[2] = 0;
+    if (kind == BUBBLES)
+    {
+        emitter.rate   = 30;
+        emitter.life   = 6;
+        emitter.size   = 0.12f;
+        emitter.spread = 0.3f;
+        emitter.speed  = 1.5f;
+        const unsigned char color[4] = { 170, 220, 255, 255 };
+        memcpy(emitter.color, color, 4);
+    }
+    else
+    {
+        emitter.rate   = 20;
+        emitter.life   = 12;
+        emitter.size   = 0.05f;
+        emitter.spread = 4;
+        emitter.speed  = 0.2f;
+        const unsigned char color[4] = { 200, 200, 150, 0 };
+        memcpy(emitter.color, color, 4);
+    }
+    return emitter;
+}
+
+ParticleSystem::ParticleSystem(int poolSize)
+    : capacity(std::max(poolSize, 0)), alive(0), dropped(0), version(0), seed(DEFAULT_SEED), rateScale(1)
+{
+    for (int c = 0; c < 3; c++)
+    {
+        boundsMin[c] = -10;
+        boundsMax[c] = 10;
+    }
+
+    /* Room for one more so the accessors have an element to point at */
+    size_t room = (size_t)capacity + 1;
+    px.resize(room);
+    py.resize(room);
+    pz.resize(room);
+    vx.resize(room);
+    vy.resize(room);
+    vz.resize(room);
+    lift.resize(room);
+    spin.resize(room);
+    age.resize(room);
+    life.resize(room);
+    size.resize(room);
+    radius.resize(room);
+    colors.resize(room);
+
+    if (capacity >= 2 * CHUNK)
+        workers.reset(new ThreadPool());
+}
+
+void ParticleSystem::SetBounds(const float low[3], const float high[3])
+{
+    for (int c = 0; c < 3; c++)
+    {
+        boundsMin[c] = low[c];
+        boundsMax[c] = high[c];
+    }
+}
+
+int ParticleSystem::AddEmitter(const Emitter &emitter)
+{
+    EmitterState state;
+    state.settings = emitter;
+    state.carry    = 0;
+    emitters.push_back(state);
+    return (int)emitters.size() - 1;
+}
+
+void ParticleSystem::SetEmitterPosition(int index, const float position[3])
+{
+    for (int c = 0; c < 3; c++)
+        emitters[index].settings.position[c] = position[c];
+}
+
+double ParticleSystem::GetSteadyCount() const
+{
+    double count = 0;
+    for (size_t i = 0; i < emitters.size(); i++)
+        count += (double)emitters[i].settings.rate * emitters[i].settings.life;
+    return count * rateScale;
+}
+
+/* xorshift32: spawning only needs cheap, decent noise */
+float ParticleSystem::Random()
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return (float)(seed >> 8) / (float)(1u << 24);
+}
+
+void ParticleSystem::Spawn(const Emitter &emitter, int count)
+{
+    int room = capacity - alive;
+    if (count > room)
+    {
+        dropped += count - room;
+        count = room;
+    }
+
+    unsigned int color;
+    memcpy(&color, emitter.color, 4);
+    bool bubbles = emitter.kind == BUBBLES;
+    for (int n = 0; n < count; n++)
+    {
+        int i = alive++;
+
+        /* Within the spread, denser towards the middle */
+        float offset[3];
+        for (int c = 0; c < 3; c++)
+            offset[c] = (Random() + Random() - 1) * emitter.spread;
+        px[i] = emitter.position[0] + offset[0];
+        py[i] = emitter.position[1] + offset[1];
+        pz[i] = emitter.position[2] + offset[2];
+
+        float speed = emitter.speed * (0.5f + Random());
+        float side  = Random() * 6.2831853f;
+        float turn  = bubbles ? 3 + 3 * Random() : 0.3f + 0.5f * Random();
+        vx[i]   = 0.3f * speed * std::cos(side);
+        vz[i]   = 0.3f * speed * std::sin(side);
+        vy[i]   = bubbles ? speed : (Random() - 0.5f) * speed;
+        lift[i] = bubbles ? DRAG * emitter.speed * (0.8f + 0.4f * Random()) : -0.05f;
+        spin[i] = Random() < 0.5f ? turn : -turn;
+        age[i]  = 0;
+        life[i] = emitter.life * (0.75f + 0.5f * Random());
+        size[i] = emitter.size * (0.6f + 0.8f * Random());
+        radius[i] = 0;
+        colors[i] = color;
+    }
+}
+
+void ParticleSystem::Integrate(int begin, int end, float dt)
+{
+    static const Integrator integrate = GetIntegrator();
+    Lanes lanes = { &px[begin], &py[begin], &pz[begin], &vx[begin], &vy[begin], &vz[begin],
+                    &lift[begin], &spin[begin], &life[begin], &size[begin], &age[begin], &radius[begin] };
+    integrate(lanes, end - begin, dt);
+}
+
+/* Dead particles are replaced by the last live one, which is then checked
+ * in its new place */
+void ParticleSystem::Retire()
+{
+    int i = 0;
+    while (i < alive)
+    {
+        bool dead = age[i] >= life[i]
+                 || px[i] < boundsMin[0] || px[i] > boundsMax[0]
+                 || py[i] < boundsMin[1] || py[i] > boundsMax[1]
+                 || pz[i] < boundsMin[2] || pz[i] > boundsMax[2];
+        if (!dead)
+        {
+            i++;
+            continue;
+        }
+        int last = --alive;
+        px[i] = px[last];
+        py[i] = py[last];
+        pz[i] = pz[last];
+        vx[i] = vx[last];
+        vy[i] = vy[last];
+        vz[i] = vz[last];
+        lift[i]   = lift[last];
+        spin[i]   = spin[last];
+        age[i]    = age[last];
+        life[i]   = life[last];
+        size[i]   = size[last];
+        radius[i] = radius[last];
+        colors[i] = colors[last];
+    }
+}
+
+void ParticleSystem::Step(float dt)
+{
+    ScopedTimer timer("particles:step");
+    if (dt > 0)
+    {
+        for (size_t e = 0; e < emitters.size(); e++)
+        {
+            EmitterState &state = emitters[e];
+            state.carry += (double)state.settings.rate * rateScale * dt;
+            int count = (int)state.carry;
+            state.carry -= count;
+            Spawn(state.settings, count);
+        }
+
+        if (workers && alive >= 2 * CHUNK)
+        {
+            std::vector<std::future<void> > jobs;
+            for (int begin = 0; begin < alive; begin += CHUNK)
+            {
+                int end = std::min(begin + CHUNK, alive);
+                jobs.push_back(workers->Submit([this, begin, end, dt]() { Integrate(begin, end, dt); }));
+            }
+            for (size_t j = 0; j < jobs.size(); j++)
+                jobs[j].get();
+        }
+        else
+            Integrate(0, alive, dt);
+
+        Retire();
+    }
+    version++;
+    Profiler::Get().Count("particles:alive", alive);
+}
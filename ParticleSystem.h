@@ -0,0 +1,129 @@
+/*
+ * Bubbles and drifting motes
+ *
+ * Particles live in a pool of fixed capacity in structure-of-arrays form,
+ * allocated once: nothing is allocated per frame, however many particles
+ * come and go. Live particles are kept packed at the front of the arrays;
+ * one that dies is replaced by the last live one.
+ *
+ * Emitters spawn particles at their position at a steady rate. Each
+ * particle rises or sinks towards a terminal speed set by its lift and a
+ * shared drag, while its sideways velocity turns at its own rate, so
+ * bubbles wobble on their way up and motes wander. Particles die when
+ * their life runs out or they leave the bounds; the top of the bounds is
+ * the water's surface. Particles fade in and out by shrinking.
+ *
+ * A step moves the particles in chunks spread over a pool of worker threads,
+ * each chunk four at a time on SSE2 where the CPU has it.
+ */
+
+#ifndef FISHTANK_PARTICLESYSTEM_H
+#define FISHTANK_PARTICLESYSTEM_H
+
+#include "ThreadPool.h"
+
+#include <memory>
+#include <vector>
+
+class ParticleSystem
+{
+    public:
+        enum Kind { BUBBLES, MOTES };
+
+        struct Emitter
+        {
+            Kind          kind;
+            float         position[3];
+            float         rate;      /* particles per second */
+            float         life;      /* seconds, on average */
+            float         size;      /* radius, on average */
+            float         spread;    /* radius of the region they start in */
+            float         speed;     /* starting speed, on average */
+            unsigned char color[4];  /* RGB, and alpha 255 for a bubble's
+                                        clear middle and bright rim down to
+                                        0 for a soft dot */
+        };
+
+        /* Emitter settings that suit the kind */
+        static Emitter GetDefaultEmitter(Kind kind);
+
+        static const unsigned int DEFAULT_SEED = 2463534242u;
+
+        explicit ParticleSystem(int capacity);
+
+        int GetCapacity() const { return capacity; }
+
+        /* Particles leaving these die */
+        void SetBounds(const float boundsMin[3], const float boundsMax[3]);
+        const float *GetBoundsMin() const { return boundsMin; }
+        const float *GetBoundsMax() const { return boundsMax; }
+
+        /* Returns the emitter's index */
+        int  AddEmitter(const Emitter &emitter);
+        int  GetNumberOfEmitters() const { return (int)emitters.size(); }
+        void SetEmitterPosition(int index, const float position[3]);
+
+        /* Multiplies every emitter's rate */
+        void SetRateScale(float scale) { rateScale = scale; }
+
+        /* Restart spawning's random sequence; zero counts as one */
+        void SetSeed(unsigned int value) { seed = value ? value : 1; }
+
+        /* Particles alive at once with every emitter going steadily, if
+         * none left the bounds early */
+        double GetSteadyCount() const;
+
+        /* Spawn, move and retire particles */
+        void Step(float dt);
+
+        int       GetNumberOfParticles() const { return alive; }
+        long long GetNumberOfDropped() const { return dropped; }
+
+        /* The first GetNumberOfParticles() entries are live: centres, the
+         * radius to draw at, and RGBA colours */
+        const float        *GetPositionX() const { return &px[0]; }
+        const float        *GetPositionY() const { return &py[0]; }
+        const float        *GetPositionZ() const { return &pz[0]; }
+        const float        *GetRadius() const { return &radius[0]; }
+        const unsigned int *GetColors() const { return &colors[0]; }
+
+        /* Bumped by every Step(), for mappers to know when to upload */
+        unsigned long long GetVersion() const { return version; }
+
+    private:
+        ParticleSystem(const ParticleSystem &);
+        ParticleSystem &operator=(const ParticleSystem &);
+
+        struct EmitterState
+        {
+            Emitter settings;
+            double  carry;    /* fractional particles owed */
+        };
+
+        void  Spawn(const Emitter &emitter, int count);
+        void  Integrate(int begin, int end, float dt);
+        void  Retire();
+        float Random();   /* uniform in [0, 1) */
+
+        int                       capacity;
+        int                       alive;
+        long long                 dropped;
+        unsigned long long        version;
+        unsigned int              seed;
+        float                     rateScale;
+        float                     boundsMin[3];
+        float                     boundsMax[3];
+        std::vector<EmitterState> emitters;
+
+        std::vector<float>        px, py, pz;
+        std::vector<float>        vx, vy, vz;
+        std::vector<float>        lift;     /* upward acceleration */
+        std::vector<float>        spin;     /* radians per second the sideways velocity turns */
+        std::vector<float>        age, life, size;
+        std::vector<float>        radius;   /* size, faded */
+        std::vector<unsigned int> colors;
+
+        std::unique_ptr<ThreadPool> workers;   /* null for pools too small to share out */
+};
+
+#endif
@@ -0,0 +1,230 @@
+/*
+ * Frame clock and scoped-timer profiling
+ */
+
+#include "Profiler.h"
+
+#include "JSON.h"
+
+#include <algorithm>
+#include <fstream>
+
+namespace
+{
+/* Weight of the newest frame in the running averages */
+const double SMOOTHING = 0.05;
+
+/* Trace events kept at most, about 50 MB of JSON */
+const size_t MAX_EVENTS = 500000;
+}
+
+const double FrameClock::MAX_DELTA = 0.1;
+
+FrameClock &FrameClock::Get()
+{
+    static FrameClock clock;
+    return clock;
+}
+
+FrameClock::FrameClock()
+    : origin(Clock::now()), frameStart(origin), delta(0), frame(0), pinned(0), isPinned(false)
+{
+}
+
+void FrameClock::BeginFrame()
+{
+    Clock::time_point now = Clock::now();
+    delta      = frame ? std::min(MAX_DELTA, std::chrono::duration<double>(now - frameStart).count()) : 0;
+    frameStart = now;
+    frame++;
+}
+
+double FrameClock::GetTime() const
+{
+    return isPinned ? pinned : GetWallTime();
+}
+
+double FrameClock::GetWallTime() const
+{
+    return std::chrono::duration<double>(Clock::now() - origin).count();
+}
+
+Profiler &Profiler::Get()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+Profiler::Profiler()
+    : tracing(false)
+{
+}
+
+void Profiler::SetTracing(bool enabled)
+{
+    tracing = enabled;
+}
+
+int Profiler::ThreadIndex()
+{
+    std::map<std::thread::id, int>::iterator found = threads.find(std::this_thread::get_id());
+    if (found != threads.end())
+        return found->second;
+    int index = (int)threads.size() + 1;
+    threads[std::this_thread::get_id()] = index;
+    return index;
+}
+
+Profiler::ThreadTotals &Profiler::LocalTotals()
+{
+    static thread_local ThreadTotals *local = NULL;
+    if (!local)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        threadTotals.push_back(std::unique_ptr<ThreadTotals>(new ThreadTotals));
+        local = threadTotals.back().get();
+    }
+    return *local;
+}
+
+void Profiler::SetThreadName(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    threadNames[ThreadIndex()] = name;
+}
+
+void Profiler::Record(const char *name, const std::string &detail,
+                      FrameClock::Clock::time_point start, FrameClock::Clock::time_point end)
+{
+    typedef std::chrono::microseconds us;
+    double ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    ThreadTotals &local = LocalTotals();
+    {
+        std::lock_guard<std::mutex> lock(local.lock);
+        ThreadTotals::Total &total = local.totals[name];
+        total.ms += ms;
+        total.calls++;
+    }
+
+    if (!tracing)
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (events.size() >= MAX_EVENTS)
+        return;
+    FrameClock::Clock::time_point origin = FrameClock::Get().GetOrigin();
+    Event event;
+    event.name       = name;
+    event.detail     = detail;
+    event.thread     = ThreadIndex();
+    event.startUs    = std::chrono::duration_cast<us>(start - origin).count();
+    event.durationUs = std::chrono::duration_cast<us>(end - start).count();
+    event.value      = 0;
+    event.counter    = false;
+    events.push_back(event);
+}
+
+void Profiler::Count(const char *name, double value)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    counters[name] = value;
+
+    if (!tracing || events.size() >= MAX_EVENTS)
+        return;
+    Event event;
+    event.name       = name;
+    event.thread     = ThreadIndex();
+    event.startUs    = std::chrono::duration_cast<std::chrono::microseconds>(
+        FrameClock::Clock::now() - FrameClock::Get().GetOrigin()).count();
+    event.durationUs = 0;
+    event.value      = value;
+    event.counter    = true;
+    events.push_back(event);
+}
+
+void Profiler::EndFrame()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t t = 0; t < threadTotals.size(); t++)
+    {
+        std::lock_guard<std::mutex> threadLock(threadTotals[t]->lock);
+        std::map<const char *, ThreadTotals::Total> &totals = threadTotals[t]->totals;
+        for (std::map<const char *, ThreadTotals::Total>::iterator i = totals.begin(); i != totals.end(); ++i)
+        {
+            if (!i->second.calls)
+                continue;
+            std::map<std::string, StageStats>::iterator stage = stages.find(i->first);
+            if (stage == stages.end())
+            {
+                StageStats empty = { 0, 0, 0, 0, 0 };
+                stage = stages.insert(std::make_pair(std::string(i->first), empty)).first;
+            }
+            stage->second.frameMs    += i->second.ms;
+            stage->second.frameCalls += i->second.calls;
+            i->second.ms    = 0;
+            i->second.calls = 0;
+        }
+    }
+    for (std::map<std::string, StageStats>::iterator i = stages.begin(); i != stages.end(); ++i)
+    {
+        StageStats &stats = i->second;
+        stats.averageMs += SMOOTHING * (stats.frameMs - stats.averageMs);
+        stats.maxMs      = std::max(stats.maxMs, stats.frameMs);
+        stats.calls      = stats.frameCalls;
+        stats.frameMs    = 0;
+        stats.frameCalls = 0;
+    }
+}
+
+void Profiler::ResetMaxima()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (std::map<std::string, StageStats>::iterator i = stages.begin(); i != stages.end(); ++i)
+        i->second.maxMs = 0;
+}
+
+std::map<std::string, Profiler::StageStats> Profiler::GetStages() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stages;
+}
+
+std::map<std::string, double> Profiler::GetCounters() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+}
+
+/* Complete ("X") and counter ("C") events plus thread name metadata */
+bool Profiler::WriteChromeTrace(const std::string &fileName) const
+{
+    std::ofstream out(fileName.c_str());
+    if (!out)
+        return false;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    out << "{\"traceEvents\":[\n";
+    bool first = true;
+    for (std::map<int, std::string>::const_iterator i = threadNames.begin(); i != threadNames.end(); ++i)
+    {
+        out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+            << i->first << ",\"args\":{\"name\":" << JSONValue::Quote(i->second) << "}}";
+        first = false;
+    }
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        const Event &event = events[i];
+        out << (first ? "" : ",\n") << "{\"name\":" << JSONValue::Quote(event.name)
+            << ",\"cat\":\"fishtank\",\"pid\":1,\"tid\":" << event.thread << ",\"ts\":" << event.startUs;
+        if (event.counter)
+            out << ",\"ph\":\"C\",\"args\":{\"value\":" << event.value << "}";
+        else
+            out << ",\"ph\":\"X\",\"dur\":" << event.durationUs;
+        if (!event.detail.empty())
+            out << ",\"args\":{\"detail\":" << JSONValue::Quote(event.detail) << "}";
+        out << "}";
+        first = false;
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return (bool)out;
+}
@@ -0,0 +1,180 @@
+/*
+ * Frame clock and scoped-timer profiling
+ *
+ * FrameClock is the one clock every per-frame update reads: the window
+ * ticks it at the start of each frame, so every actor sees the same delta
+ * within a frame. It runs on std::chrono::steady_clock, unless a replay
+ * or a recording pins its time to a frame's.
+ *
+ * ScopedTimer measures the scope it lives in and hands the interval to the
+ * Profiler, which keeps a per-stage running average and maximum for the
+ * on-screen overlay and, when tracing, every interval for export in the
+ * Chrome trace event format (load it in chrome://tracing or Perfetto).
+ * Timers may run on any thread. Each thread totals its own stages, keyed
+ * by the name's address, and EndFrame() merges them, so a timer takes no
+ * lock another thread wants unless tracing. Times are CPU-side: GL work
+ * submitted inside a scope may finish later.
+ *
+ * Counters are named per-frame values, such as how many objects were
+ * drawn; the overlay shows the latest and traces keep every one.
+ */
+
+#ifndef FISHTANK_PROFILER_H
+#define FISHTANK_PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class FrameClock
+{
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        static FrameClock &Get();
+
+        /* Called once at the start of every frame */
+        void BeginFrame();
+
+        /* Seconds between the last two frame starts, at most MAX_DELTA so
+         * that a frame after an idle spell doesn't lurch */
+        double    GetDelta() const { return delta; }
+        long long GetFrameNumber() const { return frame; }
+
+        /* Seconds since the clock was created, or the pinned time */
+        double GetTime() const;
+
+        /* Seconds since the clock was created, pinned or not */
+        double GetWallTime() const;
+
+        /* Make GetTime() return time until Unpin(), so that everything in a
+         * frame sees the same moment; render thread only */
+        void Pin(double time) { pinned = time; isPinned = true; }
+        void Unpin() { isPinned = false; }
+        bool IsPinned() const { return isPinned; }
+
+        Clock::time_point GetOrigin() const { return origin; }
+
+        static const double MAX_DELTA;
+
+    private:
+        FrameClock();
+
+        Clock::time_point origin;
+        Clock::time_point frameStart;
+        double            delta;
+        long long         frame;
+        double            pinned;
+        bool              isPinned;
+};
+
+class Profiler
+{
+    public:
+        struct StageStats
+        {
+            double averageMs;   /* per frame, smoothed over recent frames */
+            double maxMs;       /* per frame, worst since the last ResetMaxima() */
+            double frameMs;     /* accumulating for the current frame */
+            int    calls;       /* in the last complete frame */
+            int    frameCalls;
+        };
+
+        static Profiler &Get();
+
+        /* Keep every interval for WriteChromeTrace(); off by default */
+        void SetTracing(bool enabled);
+        bool GetTracing() const { return tracing; }
+
+        /* Label the calling thread in traces */
+        void SetThreadName(const std::string &name);
+
+        void Record(const char *name, const std::string &detail,
+                    FrameClock::Clock::time_point start, FrameClock::Clock::time_point end);
+
+        /* Set a counter; the name must be a string literal */
+        void Count(const char *name, double value);
+
+        /* Fold the current frame's per-stage totals into the averages */
+        void EndFrame();
+        void ResetMaxima();
+
+        /* Stage name to its statistics, sorted by name */
+        std::map<std::string, StageStats> GetStages() const;
+
+        /* Counter name to its latest value, sorted by name */
+        std::map<std::string, double> GetCounters() const;
+
+        bool WriteChromeTrace(const std::string &fileName) const;
+
+    private:
+        /* A timed interval, or a counter's value when counter is set */
+        struct Event
+        {
+            const char *name;
+            std::string detail;
+            int         thread;
+            long long   startUs;
+            long long   durationUs;
+            double      value;
+            bool        counter;
+        };
+
+        Profiler();
+
+        /* One thread's stage totals since the last EndFrame(); only that
+         * thread and EndFrame() take its lock */
+        struct ThreadTotals
+        {
+            struct Total
+            {
+                double ms;
+                int    calls;
+            };
+            std::mutex                    lock;
+            std::map<const char *, Total> totals;
+        };
+
+        int ThreadIndex();   /* called with mutex held */
+        ThreadTotals &LocalTotals();
+
+        mutable std::mutex                           mutex;
+        std::atomic<bool>                            tracing;
+        std::vector<std::unique_ptr<ThreadTotals> >  threadTotals;   /* kept after their threads end */
+        std::map<std::string, StageStats>            stages;
+        std::map<std::string, double>      counters;
+        std::vector<Event>                 events;
+        std::map<std::thread::id, int>     threads;
+        std::map<int, std::string>         threadNames;
+};
+
+/* Times its own lifetime as one interval of the named stage. The name must
+ * outlive the program (a string literal); detail is extra trace text. */
+class ScopedTimer
+{
+    public:
+        explicit ScopedTimer(const char *stageName, const std::string &stageDetail = std::string())
+            : name(stageName), detail(stageDetail), start(FrameClock::Clock::now())
+        {
+        }
+
+        ~ScopedTimer()
+        {
+            Profiler::Get().Record(name, detail, start, FrameClock::Clock::now());
+        }
+
+    private:
+        ScopedTimer(const ScopedTimer &);
+        ScopedTimer &operator=(const ScopedTimer &);
+
+        const char                    *name;
+        std::string                    detail;
+        FrameClock::Clock::time_point  start;
+};
+
+#endif
@@ -0,0 +1,135 @@
+/*
+ * Profiling overlay
+ */
+
+#include "ProfilerOverlay.h"
+
+#include "vtkTimedCuller.h"
+
+#include <vtkCommand.h>
+#include <vtkCuller.h>
+#include <vtkCullerCollection.h>
+#include <vtkTextProperty.h>
+
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+/* How often the HUD text, and the window its maxima cover, turns over */
+const std::chrono::milliseconds REFRESH(500);
+}
+
+ProfilerOverlay::ProfilerOverlay(vtkRenderWindow *win, vtkRenderer *ren)
+    : window(win), renderer(ren), visible(false)
+{
+    frameStart = renderStart = renderEnd = lastUpdate = FrameClock::Clock::now();
+
+    callback = vtkSmartPointer<vtkCallbackCommand>::New();
+    callback->SetCallback(OnEvent);
+    callback->SetClientData(this);
+    observers[0] = window->AddObserver(vtkCommand::StartEvent, callback);
+    observers[1] = window->AddObserver(vtkCommand::EndEvent, callback);
+    observers[2] = renderer->AddObserver(vtkCommand::StartEvent, callback);
+    observers[3] = renderer->AddObserver(vtkCommand::EndEvent, callback);
+
+    /* Collected first: the collection can't change while it's traversed */
+    std::vector<vtkSmartPointer<vtkCuller> > cullers;
+    vtkCullerCollection *installed = renderer->GetCullers();
+    installed->InitTraversal();
+    for (vtkCuller *culler = installed->GetNextItem(); culler; culler = installed->GetNextItem())
+        cullers.push_back(culler);
+    for (size_t i = 0; i < cullers.size(); i++)
+    {
+        vtkSmartPointer<vtkTimedCuller> timed = vtkSmartPointer<vtkTimedCuller>::New();
+        timed->SetCuller(cullers[i]);
+        renderer->RemoveCuller(cullers[i]);
+        renderer->AddCuller(timed);
+    }
+
+    text = vtkSmartPointer<vtkTextActor>::New();
+    text->GetTextProperty()->SetFontFamilyToCourier();
+    text->GetTextProperty()->SetFontSize(13);
+    text->GetTextProperty()->SetColor(0.9, 0.9, 0.9);
+    text->GetTextProperty()->SetVerticalJustificationToTop();
+    text->GetPositionCoordinate()->SetCoordinateSystemToNormalizedViewport();
+    text->GetPositionCoordinate()->SetValue(0.01, 0.99);
+    text->SetInput("");
+    text->VisibilityOff();
+    renderer->AddActor2D(text);
+}
+
+ProfilerOverlay::~ProfilerOverlay()
+{
+    window->RemoveObserver(observers[0]);
+    window->RemoveObserver(observers[1]);
+    renderer->RemoveObserver(observers[2]);
+    renderer->RemoveObserver(observers[3]);
+}
+
+void ProfilerOverlay::SetVisible(bool show)
+{
+    visible = show;
+    text->SetVisibility(show ? 1 : 0);
+}
+
+void ProfilerOverlay::OnEvent(vtkObject *caller, unsigned long event, void *clientData, void *)
+{
+    ProfilerOverlay *overlay = static_cast<ProfilerOverlay *>(clientData);
+    FrameClock::Clock::time_point now = FrameClock::Clock::now();
+    Profiler &profiler = Profiler::Get();
+
+    if (caller == overlay->renderer)
+    {
+        if (event == vtkCommand::StartEvent)
+            overlay->renderStart = now;
+        else
+        {
+            overlay->renderEnd = now;
+            profiler.Record("render", std::string(), overlay->renderStart, now);
+        }
+        return;
+    }
+
+    if (event == vtkCommand::StartEvent)
+    {
+        FrameClock::Get().BeginFrame();
+        overlay->frameStart = now;
+        return;
+    }
+
+    profiler.Record("swap", std::string(), overlay->renderEnd, now);
+    profiler.Record("frame", std::string(), overlay->frameStart, now);
+    profiler.EndFrame();
+    if (now - overlay->lastUpdate >= REFRESH)
+    {
+        overlay->lastUpdate = now;
+        if (overlay->visible)
+            overlay->UpdateText();
+        profiler.ResetMaxima();
+    }
+}
+
+void ProfilerOverlay::UpdateText()
+{
+    std::map<std::string, Profiler::StageStats> stages = Profiler::Get().GetStages();
+    double delta = FrameClock::Get().GetDelta();
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2);
+    out << "frame " << FrameClock::Get().GetFrameNumber();
+    if (delta > 0)
+        out << "  " << std::setprecision(1) << 1.0 / delta << " fps" << std::setprecision(2);
+    out << "\n" << std::left << std::setw(16) << "stage" << std::right << std::setw(8) << "avg ms"
+        << std::setw(8) << "max ms" << std::setw(7) << "calls" << "\n";
+    for (std::map<std::string, Profiler::StageStats>::const_iterator i = stages.begin(); i != stages.end(); ++i)
+        out << std::left << std::setw(16) << i->first << std::right << std::setw(8) << i->second.averageMs
+            << std::setw(8) << i->second.maxMs << std::setw(7) << i->second.calls << "\n";
+
+    std::map<std::string, double> counters = Profiler::Get().GetCounters();
+    out << std::setprecision(0);
+    for (std::map<std::string, double>::const_iterator i = counters.begin(); i != counters.end(); ++i)
+        out << std::left << std::setw(16) << i->first << std::right << std::setw(8) << i->second << "\n";
+    text->SetInput(out.str().c_str());
+}
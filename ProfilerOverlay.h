@@ -0,0 +1,51 @@
+/*
+ * Profiling overlay
+ *
+ * Hooks a render window and its renderer so that every frame ticks the
+ * FrameClock and reports the "frame", "render" (the renderer's whole pass,
+ * culling and drawing included) and "swap" stages to the Profiler, and
+ * wraps the renderer's cullers to time "cull". When visible, a text HUD
+ * in the corner lists every stage's smoothed per-frame time and its worst
+ * frame over the last refresh interval, followed by the latest counters.
+ */
+
+#ifndef FISHTANK_PROFILEROVERLAY_H
+#define FISHTANK_PROFILEROVERLAY_H
+
+#include "Profiler.h"
+
+#include <vtkCallbackCommand.h>
+#include <vtkRenderWindow.h>
+#include <vtkRenderer.h>
+#include <vtkSmartPointer.h>
+#include <vtkTextActor.h>
+
+class ProfilerOverlay
+{
+    public:
+        ProfilerOverlay(vtkRenderWindow *window, vtkRenderer *renderer);
+        ~ProfilerOverlay();
+
+        void SetVisible(bool visible);
+
+    private:
+        ProfilerOverlay(const ProfilerOverlay &);
+        ProfilerOverlay &operator=(const ProfilerOverlay &);
+
+        static void OnEvent(vtkObject *caller, unsigned long event, void *clientData, void *callData);
+
+        void UpdateText();
+
+        vtkRenderWindow                     *window;
+        vtkRenderer                         *renderer;
+        vtkSmartPointer<vtkTextActor>        text;
+        vtkSmartPointer<vtkCallbackCommand>  callback;
+        unsigned long                        observers[4];
+        FrameClock::Clock::time_point        frameStart;
+        FrameClock::Clock::time_point        renderStart;
+        FrameClock::Clock::time_point        renderEnd;
+        FrameClock::Clock::time_point        lastUpdate;
+        bool                                 visible;
+};
+
+#endif
@@ -0,0 +1,153 @@
+/*
+ * Render scheduling
+ */
+
+#include "RenderScheduler.h"
+
+#include <vtkActor.h>
+#include <vtkActorCollection.h>
+#include <vtkCamera.h>
+#include <vtkCommand.h>
+#include <vtkLight.h>
+#include <vtkLightCollection.h>
+#include <vtkRenderWindow.h>
+
+#include <algorithm>
+
+RenderScheduler::RenderScheduler(vtkRenderWindowInteractor *iren)
+    : interactor(iren), minInterval(Clock::duration::zero()), timerId(0), frames(0),
+      continuous(false), dirty(true), animating(true), rendering(false)
+{
+    callback = vtkSmartPointer<vtkCallbackCommand>::New();
+    callback->SetCallback(OnEvent);
+    callback->SetClientData(this);
+
+    vtkRenderWindow *window = interactor->GetRenderWindow();
+    observers.push_back(std::make_pair(vtkSmartPointer<vtkObject>(window),
+                                       window->AddObserver(vtkCommand::StartEvent, callback)));
+    observers.push_back(std::make_pair(vtkSmartPointer<vtkObject>(window),
+                                       window->AddObserver(vtkCommand::EndEvent, callback)));
+    observers.push_back(std::make_pair(vtkSmartPointer<vtkObject>(interactor),
+                                       interactor->AddObserver(vtkCommand::TimerEvent, callback)));
+    Schedule();
+}
+
+RenderScheduler::~RenderScheduler()
+{
+    if (timerId)
+        interactor->DestroyTimer(timerId);
+    for (size_t i = 0; i < observers.size(); i++)
+        observers[i].first->RemoveObserver(observers[i].second);
+}
+
+void RenderScheduler::SetMaxFrameRate(double framesPerSecond)
+{
+    minInterval = framesPerSecond > 0
+                ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1 / framesPerSecond))
+                : Clock::duration::zero();
+}
+
+void RenderScheduler::SetContinuous(bool enabled)
+{
+    continuous = enabled;
+    if (continuous)
+        Schedule();
+}
+
+void RenderScheduler::MarkDirty()
+{
+    dirty = true;
+    Schedule();
+}
+
+void RenderScheduler::Watch(vtkObject *object)
+{
+    if (!watched.insert(object).second)
+        return;
+    observers.push_back(std::make_pair(vtkSmartPointer<vtkObject>(object),
+                                       object->AddObserver(vtkCommand::ModifiedEvent, callback)));
+}
+
+void RenderScheduler::WatchScene(vtkRenderer *renderer)
+{
+    Watch(renderer->GetActiveCamera());
+
+    vtkLightCollection *lights = renderer->GetLights();
+    lights->InitTraversal();
+    for (vtkLight *light = lights->GetNextItem(); light; light = lights->GetNextItem())
+        Watch(light);
+
+    vtkActorCollection *actors = renderer->GetActors();
+    actors->InitTraversal();
+    for (vtkActor *actor = actors->GetNextActor(); actor; actor = actors->GetNextActor())
+        Watch(actor);
+}
+
+void RenderScheduler::AddUpdate(const Update &update)
+{
+    updates.push_back(update);
+    animating = true;
+    Schedule();
+}
+
+void RenderScheduler::Schedule()
+{
+    if (timerId)
+        return;
+    /* In whole milliseconds, rounded up so the cap is never beaten */
+    Clock::duration wait = std::max(Clock::duration::zero(), lastFrame + minInterval - Clock::now());
+    unsigned long ms = (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(
+        wait + std::chrono::milliseconds(1) - Clock::duration(1)).count();
+    timerId = interactor->CreateOneShotTimer(ms);
+}
+
+void RenderScheduler::Tick()
+{
+    if (!continuous && !dirty && !animating)
+        return;
+
+    /* Every update runs, even after one has asked for another frame. What
+     * they modify is drawn by this frame, so it marks nothing dirty. */
+    bool again = false;
+    rendering = true;
+    for (size_t i = 0; i < updates.size(); i++)
+        again = updates[i]() || again;
+    rendering = false;
+    animating = again;
+
+    interactor->GetRenderWindow()->Render();
+    frames++;
+
+    if (continuous || animating || dirty)
+        Schedule();
+}
+
+void RenderScheduler::OnEvent(vtkObject *, unsigned long event, void *clientData, void *callData)
+{
+    RenderScheduler *scheduler = static_cast<RenderScheduler *>(clientData);
+    switch (event)
+    {
+        case vtkCommand::TimerEvent:
+            if (!callData || *static_cast<int *>(callData) != scheduler->timerId)
+                return;
+            scheduler->timerId = 0;
+            scheduler->Tick();
+            break;
+
+        case vtkCommand::StartEvent:
+            scheduler->rendering = true;
+            scheduler->lastFrame = Clock::now();
+            break;
+
+        case vtkCommand::EndEvent:
+            scheduler->rendering = false;
+            scheduler->dirty     = false;
+            break;
+
+        case vtkCommand::ModifiedEvent:
+            /* A render adjusts the camera and lights itself */
+            if (!scheduler->rendering)
+                scheduler->MarkDirty();
+            break;
+    }
+}
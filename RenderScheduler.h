@@ -0,0 +1,92 @@
+/*
+ * Render scheduling
+ *
+ * Decides when the window redraws. Anything that changes what is on
+ * screen marks the scene dirty, either by calling MarkDirty() or because
+ * the scheduler watches it for ModifiedEvent; updates registered with
+ * AddUpdate() run before each scheduled frame and say whether they need
+ * another one. A frame is scheduled with a one-shot timer only while the
+ * scene is dirty or an update is still animating, so an unchanging tank
+ * leaves the event loop asleep. Frames never come closer together than
+ * the frame rate cap allows.
+ *
+ * In continuous mode every tick renders, whether or not anything changed.
+ * Renders that happen outside the scheduler, such as those the interactor
+ * style makes while the camera is dragged, count as frames too: they
+ * clear the dirty flag and push the next scheduled frame back.
+ */
+
+#ifndef FISHTANK_RENDERSCHEDULER_H
+#define FISHTANK_RENDERSCHEDULER_H
+
+#include <vtkCallbackCommand.h>
+#include <vtkObject.h>
+#include <vtkRenderWindowInteractor.h>
+#include <vtkRenderer.h>
+#include <vtkSmartPointer.h>
+
+#include <chrono>
+#include <functional>
+#include <set>
+#include <utility>
+#include <vector>
+
+class RenderScheduler
+{
+    public:
+        /* Returns true while it is animating and needs another frame */
+        typedef std::function<bool()> Update;
+
+        /* The interactor must be initialized, since frames come from its timers */
+        explicit RenderScheduler(vtkRenderWindowInteractor *interactor);
+        ~RenderScheduler();
+
+        /* Frames per second at most; zero renders as fast as the window allows */
+        void SetMaxFrameRate(double framesPerSecond);
+
+        /* Render every tick instead of only when something changed */
+        void SetContinuous(bool enabled);
+
+        /* Ask for a frame; cheap to call often */
+        void MarkDirty();
+
+        /* Mark the scene dirty whenever object is modified outside a render */
+        void Watch(vtkObject *object);
+
+        /* Watch the renderer's camera, lights and actors; only objects not
+         * yet watched are added, so call it again as actors are attached */
+        void WatchScene(vtkRenderer *renderer);
+
+        void AddUpdate(const Update &update);
+
+        /* Frames the scheduler itself has rendered */
+        long long GetNumberOfFrames() const { return frames; }
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        RenderScheduler(const RenderScheduler &);
+        RenderScheduler &operator=(const RenderScheduler &);
+
+        static void OnEvent(vtkObject *caller, unsigned long event, void *clientData, void *callData);
+
+        /* Start a one-shot timer for the next frame unless one is pending */
+        void Schedule();
+        void Tick();
+
+        vtkRenderWindowInteractor                          *interactor;
+        vtkSmartPointer<vtkCallbackCommand>                 callback;
+        std::vector<std::pair<vtkObject *, unsigned long> > observers;
+        std::set<vtkObject *>                               watched;
+        std::vector<Update>                                 updates;
+        Clock::duration                                     minInterval;
+        Clock::time_point                                   lastFrame;
+        int                                                 timerId;
+        long long                                           frames;
+        bool                                                continuous;
+        bool                                                dirty;
+        bool                                                animating;
+        bool                                                rendering;
+};
+
+#endif
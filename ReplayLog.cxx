@@ -0,0 +1,225 @@
+/*
+ * Replay log
+ */
+
+#include "ReplayLog.h"
+
+#include <stdint.h>
+#include <cstring>
+
+namespace
+{
+const char     LOG_MAGIC[4] = { 'F', 'T', 'R', 'P' };
+const uint32_t LOG_VERSION  = 1;
+
+/* Scene switches are short; anything longer is a corrupt file */
+const uint32_t MAX_ARGUMENTS       = 1024;
+const uint32_t MAX_ARGUMENT_LENGTH = 4096;
+
+struct LogHeader
+{
+    char     magic[4];
+    uint32_t version;
+    int32_t  width;
+    int32_t  height;
+    uint32_t schoolSeed;
+    uint32_t particleSeed;
+    uint32_t argumentCount;   /* each follows as a length and its bytes */
+};
+
+struct FrameRecord
+{
+    double   time;
+    float    camera[11];
+    uint32_t commandCount;    /* CommandRecords follow */
+};
+
+struct CommandRecord
+{
+    double  time;
+    int32_t actor;
+    uint8_t action;
+    uint8_t pressed;
+    uint8_t padding[2];
+};
+
+template <typename T>
+bool ReadValue(std::istream &in, T &value)
+{
+    return (bool)in.read(reinterpret_cast<char *>(&value), sizeof(value));
+}
+
+template <typename T>
+void WriteValue(std::ostream &out, const T &value)
+{
+    out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+}
+
+ReplayLog::ReplayLog()
+    : frameCount(0)
+{
+}
+
+bool ReplayLog::Create(const std::string &fileName, const Settings &recorded, std::string &error)
+{
+    Close();
+    out.open(fileName.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        error = "cannot write " + fileName;
+        return false;
+    }
+    settings   = recorded;
+    frameCount = 0;
+
+    LogHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LOG_MAGIC, sizeof(LOG_MAGIC));
+    header.version       = LOG_VERSION;
+    header.width         = settings.width;
+    header.height        = settings.height;
+    header.schoolSeed    = settings.schoolSeed;
+    header.particleSeed  = settings.particleSeed;
+    header.argumentCount = (uint32_t)settings.arguments.size();
+    WriteValue(out, header);
+    for (size_t a = 0; a < settings.arguments.size(); a++)
+    {
+        uint32_t length = (uint32_t)settings.arguments[a].size();
+        WriteValue(out, length);
+        out.write(settings.arguments[a].data(), length);
+    }
+    return (bool)out;
+}
+
+void ReplayLog::Append(const Frame &frame)
+{
+    if (!out.is_open())
+        return;
+    FrameRecord record;
+    memset(&record, 0, sizeof(record));
+    record.time = frame.time;
+    memcpy(record.camera, frame.camera, sizeof(record.camera));
+    record.commandCount = (uint32_t)frame.commands.size();
+    WriteValue(out, record);
+    for (size_t c = 0; c < frame.commands.size(); c++)
+    {
+        const ActorControls::Command &command = frame.commands[c];
+        CommandRecord stored;
+        memset(&stored, 0, sizeof(stored));
+        stored.time    = command.time;
+        stored.actor   = command.actor;
+        stored.action  = (uint8_t)command.action;
+        stored.pressed = command.pressed ? 1 : 0;
+        WriteValue(out, stored);
+    }
+    frameCount++;
+}
+
+void ReplayLog::Close()
+{
+    if (out.is_open())
+        out.close();
+}
+
+bool ReplayLog::Load(const std::string &fileName, std::string &error)
+{
+    std::ifstream in(fileName.c_str(), std::ios::binary);
+    if (!in)
+    {
+        error = "cannot read " + fileName;
+        return false;
+    }
+    LogHeader header;
+    if (!ReadValue(in, header) || memcmp(header.magic, LOG_MAGIC, sizeof(LOG_MAGIC)) != 0)
+    {
+        error = fileName + " is not a replay log";
+        return false;
+    }
+    if (header.version != LOG_VERSION)
+    {
+        error = fileName + " is a replay log of another version";
+        return false;
+    }
+    if (header.argumentCount > MAX_ARGUMENTS)
+    {
+        error = fileName + " is corrupt";
+        return false;
+    }
+
+    Settings loaded;
+    loaded.width        = header.width;
+    loaded.height       = header.height;
+    loaded.schoolSeed   = header.schoolSeed;
+    loaded.particleSeed = header.particleSeed;
+    for (uint32_t a = 0; a < header.argumentCount; a++)
+    {
+        uint32_t length;
+        if (!ReadValue(in, length) || length > MAX_ARGUMENT_LENGTH)
+        {
+            error = fileName + " is corrupt";
+            return false;
+        }
+        std::string argument(length, '\0');
+        if (length && !in.read(&argument[0], length))
+        {
+            error = fileName + " is corrupt";
+            return false;
+        }
+        loaded.arguments.push_back(argument);
+    }
+
+    /* Frames until the file runs out; a partly written one is left out */
+    std::vector<Frame> read;
+    FrameRecord record;
+    while (ReadValue(in, record))
+    {
+        Frame frame;
+        frame.time = record.time;
+        memcpy(frame.camera, record.camera, sizeof(frame.camera));
+        bool whole = true;
+        for (uint32_t c = 0; c < record.commandCount && whole; c++)
+        {
+            CommandRecord stored;
+            whole = ReadValue(in, stored);
+            if (!whole)
+                break;
+            ActorControls::Command command;
+            command.time    = stored.time;
+            command.actor   = stored.actor;
+            command.action  = stored.action;
+            command.pressed = stored.pressed != 0;
+            frame.commands.push_back(command);
+        }
+        if (!whole)
+            break;
+        read.push_back(frame);
+    }
+    if (read.empty())
+    {
+        error = fileName + " has no frames";
+        return false;
+    }
+
+    settings = loaded;
+    frames.swap(read);
+    frameCount = (long long)frames.size();
+    return true;
+}
+
+void ReplayLog::StoreCamera(vtkCamera *camera, float stored[11])
+{
+    double *vectors[4] = { camera->GetPosition(), camera->GetFocalPoint(), camera->GetViewUp(),
+                           camera->GetClippingRange() };
+    for (int v = 0; v < 4; v++)
+        for (int c = 0; c < (v < 3 ? 3 : 2); c++)
+            stored[3 * v + c] = (float)vectors[v][c];
+}
+
+void ReplayLog::ApplyCamera(const float stored[11], vtkCamera *camera)
+{
+    camera->SetPosition(stored[0], stored[1], stored[2]);
+    camera->SetFocalPoint(stored[3], stored[4], stored[5]);
+    camera->SetViewUp(stored[6], stored[7], stored[8]);
+    camera->SetClippingRange(stored[9], stored[10]);
+}
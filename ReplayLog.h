@@ -0,0 +1,82 @@
+/*
+ * Replay log
+ *
+ * A compact binary record of a run, for turning a stutter seen live into
+ * a benchmark that shows it again. It starts with what built the scene:
+ * the scene switches given to TankOptions, the school's and the
+ * particles' random seeds, and the window size. Then, for every frame,
+ * the frame clock's time, the camera, and the input commands applied in
+ * that frame.
+ *
+ * A replay pins the frame clock to each frame's time, feeds the frame's
+ * commands to ActorControls and steps the school on the render thread
+ * (TankScene::SetDeterministic), so every replay of a log shows the same
+ * frames however fast it runs. The live run it came from stepped the
+ * school on its own thread, so the fish there may differ by the odd
+ * dropped step.
+ *
+ * Frames are written as they come; a log cut short reads up to its last
+ * whole frame.
+ */
+
+#ifndef FISHTANK_REPLAYLOG_H
+#define FISHTANK_REPLAYLOG_H
+
+#include "ActorControls.h"
+
+#include <vtkCamera.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+class ReplayLog
+{
+    public:
+        struct Settings
+        {
+            Settings() : schoolSeed(1), particleSeed(1), width(0), height(0) {}
+
+            std::vector<std::string> arguments;   /* TankOptions switches, values included */
+            unsigned int             schoolSeed;
+            unsigned int             particleSeed;
+            int                      width;
+            int                      height;
+        };
+
+        struct Frame
+        {
+            double                               time;       /* FrameClock seconds */
+            float                                camera[11]; /* position, focal point, view up, clipping range */
+            std::vector<ActorControls::Command>  commands;   /* in the order applied */
+        };
+
+        ReplayLog();
+
+        /* Start writing a log, replacing any file of that name */
+        bool Create(const std::string &fileName, const Settings &settings, std::string &error);
+        bool IsRecording() const { return out.is_open(); }
+        void Append(const Frame &frame);
+        void Close();
+
+        /* Read a whole log */
+        bool Load(const std::string &fileName, std::string &error);
+
+        const Settings           &GetSettings() const { return settings; }
+        const std::vector<Frame> &GetFrames() const { return frames; }
+        long long                 GetNumberOfFrames() const { return frameCount; }
+
+        static void StoreCamera(vtkCamera *camera, float stored[11]);
+        static void ApplyCamera(const float stored[11], vtkCamera *camera);
+
+    private:
+        ReplayLog(const ReplayLog &);
+        ReplayLog &operator=(const ReplayLog &);
+
+        Settings           settings;
+        std::vector<Frame> frames;       /* loaded */
+        std::ofstream      out;          /* recording */
+        long long          frameCount;   /* written or loaded */
+};
+
+#endif
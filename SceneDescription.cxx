@@ -0,0 +1,406 @@
+/*
+ * Scene files
+ */
+
+#include "SceneDescription.h"
+
+#include "JSON.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+namespace
+{
+bool ReadVector(const JSONValue &value, double out[3])
+{
+    if (value.IsNumber())
+    {
+        out[0] = out[1] = out[2] = value.AsNumber();
+        return true;
+    }
+    if (!value.IsArray() || value.Size() != 3)
+        return false;
+    for (int i = 0; i < 3; i++)
+    {
+        if (!value[i].IsNumber())
+            return false;
+        out[i] = value[i].AsNumber();
+    }
+    return true;
+}
+
+/* Optional vector member: absent keeps the default, malformed is an error */
+bool ReadOptionalVector(const JSONValue &object, const char *key, double out[3], std::string &error)
+{
+    if (!object.Has(key))
+        return true;
+    if (ReadVector(object.Get(key), out))
+        return true;
+    error = std::string("'") + key + "' must be a number or a list of three numbers";
+    return false;
+}
+
+/* Optional "swim" member: absent means rigid */
+bool ReadSwim(const JSONValue &object, SwimDescription &swim, std::string &error)
+{
+    swim.speed     = 0;
+    swim.amplitude = 0;
+    if (!object.Has("swim"))
+        return true;
+    const JSONValue &value = object.Get("swim");
+    swim.speed     = value.Get("speed").AsNumber(1.5);
+    swim.amplitude = value.Get("amplitude").AsNumber(0.08);
+    if (!value.IsObject() || swim.speed < 0 || swim.amplitude < 0 || swim.amplitude > 0.5)
+    {
+        error = "'swim' must be an object with a speed of zero or more and an amplitude from 0 to 0.5";
+        return false;
+    }
+    return true;
+}
+}
+
+std::string SceneDescription::ResolvePath(const std::string &directory, const std::string &path)
+{
+    std::string joined = path;
+    if (!path.empty() && path[0] != '/' && !directory.empty())
+        joined = directory + "/" + path;
+
+    std::vector<std::string> parts;
+    std::istringstream in(joined);
+    std::string part;
+    while (std::getline(in, part, '/'))
+    {
+        if (part.empty() || part == ".")
+            continue;
+        if (part == ".." && !parts.empty() && parts.back() != "..")
+            parts.pop_back();
+        else
+            parts.push_back(part);
+    }
+
+    std::string resolved = joined[0] == '/' ? "/" : "";
+    for (size_t i = 0; i < parts.size(); i++)
+        resolved += (i ? "/" : "") + parts[i];
+    return resolved;
+}
+
+void SceneDescription::Replicate(int copies, const double offset[3])
+{
+    size_t original = instances.size();
+    for (int k = 1; k <= copies; k++)
+        for (size_t i = 0; i < original; i++)
+        {
+            if (!instances[i].isStatic)
+                continue;
+            InstanceDescription copy = instances[i];
+            std::ostringstream name;
+            name << copy.name << "#" << k;
+            copy.name = name.str();
+            for (int c = 0; c < 3; c++)
+                copy.position[c] += k * offset[c];
+            instances.push_back(copy);
+        }
+}
+
+bool SceneDescription::Load(const std::string &fileName, std::string &error)
+{
+    JSONValue root;
+    if (!JSONValue::ParseFile(fileName, root, error))
+        return false;
+    if (!root.IsObject())
+    {
+        error = fileName + ": expected an object at the top level";
+        return false;
+    }
+
+    size_t slash = fileName.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "." : fileName.substr(0, slash);
+
+    meshFiles.clear();
+    materials.clear();
+    instances.clear();
+
+    const JSONValue &meshes = root.Get("meshes");
+    for (size_t i = 0; i < meshes.Members().size(); i++)
+    {
+        const std::string &name  = meshes.Members()[i].first;
+        const JSONValue   &value = meshes.Members()[i].second;
+        if (!value.IsString())
+        {
+            error = fileName + ": mesh '" + name + "' must be a file path";
+            return false;
+        }
+        meshFiles[name] = ResolvePath(directory, value.AsString());
+    }
+
+    const JSONValue &materialList = root.Get("materials");
+    for (size_t i = 0; i < materialList.Members().size(); i++)
+    {
+        MaterialDescription material;
+        material.name = materialList.Members()[i].first;
+        material.diffuse[0] = material.diffuse[1] = material.diffuse[2] = 1;
+        const JSONValue &value = materialList.Members()[i].second;
+        material.emissive = value.Get("emissive").AsNumber(0);
+        if (!ReadOptionalVector(value, "diffuse", material.diffuse, error))
+        {
+            error = fileName + ": material '" + material.name + "': " + error;
+            return false;
+        }
+        if (material.emissive < 0)
+        {
+            error = fileName + ": material '" + material.name + "': 'emissive' must not be negative";
+            return false;
+        }
+        materials[material.name] = material;
+    }
+
+    const JSONValue &instanceList = root.Get("instances");
+    for (size_t i = 0; i < instanceList.Size(); i++)
+    {
+        const JSONValue &value = instanceList[i];
+        InstanceDescription instance;
+        instance.name       = value.Get("name").AsString();
+        instance.mesh       = value.Get("mesh").AsString();
+        instance.material   = value.Get("material").AsString();
+        instance.controlled = value.Get("controlled").AsBoolean();
+        instance.isStatic   = value.Get("static").AsBoolean();
+        instance.caustics   = value.Get("caustics").AsBoolean();
+        for (int c = 0; c < 3; c++)
+        {
+            instance.position[c] = 0;
+            instance.scale[c]    = 1;
+            instance.rotation[c] = 0;
+        }
+
+        std::ostringstream where;
+        where << fileName << ": instance " << i;
+        if (!instance.name.empty())
+            where << " '" << instance.name << "'";
+
+        if (meshFiles.find(instance.mesh) == meshFiles.end())
+        {
+            error = where.str() + ": unknown mesh '" + instance.mesh + "'";
+            return false;
+        }
+        if (instance.controlled && instance.isStatic)
+        {
+            error = where.str() + ": a controlled instance cannot be static";
+            return false;
+        }
+        if (!instance.material.empty() && materials.find(instance.material) == materials.end())
+        {
+            error = where.str() + ": unknown material '" + instance.material + "'";
+            return false;
+        }
+        if (!ReadOptionalVector(value, "position", instance.position, error)
+            || !ReadOptionalVector(value, "scale", instance.scale, error)
+            || !ReadOptionalVector(value, "rotate", instance.rotation, error)
+            || !ReadSwim(value, instance.swim, error))
+        {
+            error = where.str() + ": " + error;
+            return false;
+        }
+        if (instance.isStatic && instance.swim.amplitude > 0)
+        {
+            error = where.str() + ": static instances cannot swim";
+            return false;
+        }
+        instances.push_back(instance);
+    }
+
+    return LoadSchool(root.Get("school"), fileName, error)
+        && LoadParticles(root.Get("particles"), fileName, error)
+        && LoadWater(root.Get("water"), fileName, error);
+}
+
+bool SceneDescription::LoadSchool(const JSONValue &value, const std::string &fileName, std::string &error)
+{
+    school.count = (int)value.Get("count").AsNumber(0);
+    school.scale = value.Get("scale").AsNumber(1);
+    school.seed  = (unsigned int)value.Get("seed").AsNumber(1);
+    school.species.clear();
+    for (int c = 0; c < 3; c++)
+    {
+        school.boundsMin[c] = -10;
+        school.boundsMax[c] = 10;
+    }
+    if (value.IsNull())
+        return true;
+
+    const JSONValue &bounds = value.Get("bounds");
+    if (!ReadOptionalVector(bounds, "min", school.boundsMin, error)
+        || !ReadOptionalVector(bounds, "max", school.boundsMax, error))
+    {
+        error = fileName + ": school bounds: " + error;
+        return false;
+    }
+
+    const JSONValue &speciesList = value.Get("species");
+    for (size_t i = 0; i < speciesList.Size(); i++)
+    {
+        SpeciesDescription species;
+        species.mesh     = speciesList[i].Get("mesh").AsString();
+        species.material = speciesList[i].Get("material").AsString();
+        if (meshFiles.find(species.mesh) == meshFiles.end())
+        {
+            error = fileName + ": school: unknown mesh '" + species.mesh + "'";
+            return false;
+        }
+        if (!species.material.empty() && materials.find(species.material) == materials.end())
+        {
+            error = fileName + ": school: unknown material '" + species.material + "'";
+            return false;
+        }
+        if (!ReadSwim(speciesList[i], species.swim, error))
+        {
+            error = fileName + ": school: " + error;
+            return false;
+        }
+        school.species.push_back(species);
+    }
+    if ((school.count > 0 && school.species.empty()) || school.species.size() > 256)
+    {
+        error = fileName + ": school: needs between 1 and 256 species";
+        return false;
+    }
+    return true;
+}
+
+bool SceneDescription::LoadParticles(const JSONValue &value, const std::string &fileName, std::string &error)
+{
+    particles.capacity = (int)value.Get("capacity").AsNumber(4096);
+    particles.seed     = (unsigned int)value.Get("seed").AsNumber(ParticleSystem::DEFAULT_SEED);
+    particles.emitters.clear();
+    for (int c = 0; c < 3; c++)
+    {
+        particles.boundsMin[c] = school.boundsMin[c];
+        particles.boundsMax[c] = school.boundsMax[c];
+    }
+    if (value.IsNull())
+        return true;
+
+    const JSONValue &bounds = value.Get("bounds");
+    if (!ReadOptionalVector(bounds, "min", particles.boundsMin, error)
+        || !ReadOptionalVector(bounds, "max", particles.boundsMax, error))
+    {
+        error = fileName + ": particle bounds: " + error;
+        return false;
+    }
+    if (particles.capacity < 0)
+    {
+        error = fileName + ": particles: 'capacity' must not be negative";
+        return false;
+    }
+
+    const JSONValue &emitterList = value.Get("emitters");
+    for (size_t i = 0; i < emitterList.Size(); i++)
+    {
+        const JSONValue &entry = emitterList[i];
+        std::ostringstream where;
+        where << fileName << ": particle emitter " << i;
+
+        std::string kind = entry.Get("kind").AsString();
+        if (kind != "bubbles" && kind != "motes")
+        {
+            error = where.str() + ": 'kind' must be \"bubbles\" or \"motes\"";
+            return false;
+        }
+
+        EmitterDescription emitter;
+        emitter.anchor   = entry.Get("anchor").AsString();
+        emitter.settings = ParticleSystem::GetDefaultEmitter(
+            kind == "bubbles" ? ParticleSystem::BUBBLES : ParticleSystem::MOTES);
+        ParticleSystem::Emitter &settings = emitter.settings;
+        settings.rate   = (float)entry.Get("rate").AsNumber(settings.rate);
+        settings.life   = (float)entry.Get("life").AsNumber(settings.life);
+        settings.size   = (float)entry.Get("size").AsNumber(settings.size);
+        settings.spread = (float)entry.Get("spread").AsNumber(settings.spread);
+        settings.speed  = (float)entry.Get("speed").AsNumber(settings.speed);
+        double color[3] = { settings.color[0] / 255.0, settings.color[1] / 255.0, settings.color[2] / 255.0 };
+        for (int c = 0; c < 3; c++)
+            emitter.offset[c] = 0;
+        if (!ReadOptionalVector(entry, "offset", emitter.offset, error)
+            || !ReadOptionalVector(entry, "color", color, error))
+        {
+            error = where.str() + ": " + error;
+            return false;
+        }
+        for (int c = 0; c < 3; c++)
+            settings.color[c] = (unsigned char)(std::min(std::max(color[c], 0.0), 1.0) * 255 + 0.5);
+
+        if (settings.rate < 0 || settings.life <= 0 || settings.size <= 0 || settings.spread < 0
+            || settings.speed < 0)
+        {
+            error = where.str() + ": 'life' and 'size' must be positive, the rest not negative";
+            return false;
+        }
+        bool known = emitter.anchor.empty();
+        for (size_t k = 0; k < instances.size() && !known; k++)
+            known = instances[k].name == emitter.anchor;
+        if (!known)
+        {
+            error = where.str() + ": unknown anchor '" + emitter.anchor + "'";
+            return false;
+        }
+        particles.emitters.push_back(emitter);
+    }
+    return true;
+}
+
+bool SceneDescription::LoadWater(const JSONValue &value, const std::string &fileName, std::string &error)
+{
+    const JSONValue &caustics = value.Get("caustics");
+    water.caustics = !caustics.IsNull();
+    water.atlas    = CausticsAtlas::GetDefaultParameters();
+    water.atlas.size   = (int)caustics.Get("size").AsNumber(water.atlas.size);
+    water.atlas.frames = (int)caustics.Get("frames").AsNumber(water.atlas.frames);
+    water.atlas.waves  = (int)caustics.Get("waves").AsNumber(water.atlas.waves);
+    water.atlas.focus  = (float)caustics.Get("focus").AsNumber(water.atlas.focus);
+    water.atlas.seed   = (unsigned int)caustics.Get("seed").AsNumber(water.atlas.seed);
+    water.tile         = caustics.Get("tile").AsNumber(16);
+    water.period       = caustics.Get("period").AsNumber(5);
+    double direction[3] = { 0, -1, -0.6 };
+    for (int c = 0; c < 3; c++)
+        water.causticsColor[c] = 0.5;
+    if (!ReadOptionalVector(caustics, "direction", direction, error)
+        || !ReadOptionalVector(caustics, "color", water.causticsColor, error))
+    {
+        error = fileName + ": water caustics: " + error;
+        return false;
+    }
+    double length = std::sqrt(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+    if (water.caustics
+        && (water.tile <= 0 || water.period <= 0 || length == 0 || water.atlas.size < 16
+            || water.atlas.size > 1024 || water.atlas.frames < 1 || water.atlas.frames > 256
+            || water.atlas.waves < 1 || water.atlas.waves > 32 || water.atlas.focus < 0))
+    {
+        error = fileName + ": water caustics: 'tile', 'period' and 'direction' must not be zero, 'size' must be "
+                "16 to 1024, 'frames' 1 to 256, 'waves' 1 to 32, and 'focus' not negative";
+        return false;
+    }
+    for (int c = 0; c < 3; c++)
+        water.direction[c] = length > 0 ? direction[c] / length : 0;
+
+    const JSONValue &fog = value.Get("fog");
+    water.fog      = !fog.IsNull();
+    water.fogStart = fog.Get("start").AsNumber(0);
+    for (int c = 0; c < 3; c++)
+    {
+        water.fogColor[c]   = 0;
+        water.extinction[c] = 0.02;
+    }
+    if (!ReadOptionalVector(fog, "color", water.fogColor, error)
+        || !ReadOptionalVector(fog, "extinction", water.extinction, error))
+    {
+        error = fileName + ": water fog: " + error;
+        return false;
+    }
+    if (water.fog && (water.fogStart < 0 || water.extinction[0] < 0 || water.extinction[1] < 0
+                      || water.extinction[2] < 0))
+    {
+        error = fileName + ": water fog: 'start' and 'extinction' must not be negative";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,186 @@
+/*
+ * Scene files
+ *
+ * A scene is a JSON document with three sections:
+ *
+ *   "meshes":    { "<name>": "<path to .obj, relative to the scene file>" }
+ *   "materials": { "<name>": { "diffuse": [r, g, b],
+ *                              "emissive": e } }            (optional)
+ *   "instances": [ { "name": "...", "mesh": "<mesh name>",
+ *                    "material": "<material name>",   (optional)
+ *                    "position": [x, y, z], "scale": s or [sx, sy, sz],
+ *                    "rotate": [degX, degY, degZ],    (applied X, then Y, then Z)
+ *                    "controlled": true,              (optional, keyboard driven)
+ *                    "static": true,                  (optional, never moves)
+ *                    "caustics": true,                (optional, lit by the caustics)
+ *                    "swim": { "speed": hz, "amplitude": a } } ]   (optional)
+ *   "school":    { "count": n, "scale": s, "seed": n,  (optional, see FishSchool)
+ *                  "species": [ { "mesh": "...", "material": "...", "swim": {...} } ],
+ *                  "bounds": { "min": [x, y, z], "max": [x, y, z] } }
+ *   "particles": { "capacity": n, "seed": n,        (optional, see ParticleSystem)
+ *                  "bounds": { "min": [x, y, z], "max": [x, y, z] },
+ *                  "emitters": [ { "kind": "bubbles" or "motes",
+ *                                  "anchor": "<instance name>",   (optional)
+ *                                  "offset": [x, y, z],
+ *                                  "rate": r, "life": s, "size": s,
+ *                                  "spread": s, "speed": s,
+ *                                  "color": [r, g, b] } ] }
+ *   "water":     { "caustics": { "tile": w, "direction": [x, y, z],   (optional)
+ *                                "color": [r, g, b], "period": s,
+ *                                "size": n, "frames": n, "waves": n,
+ *                                "focus": f, "seed": n },
+ *                  "fog": { "color": [r, g, b], "extinction": [r, g, b],
+ *                           "start": d } }
+ *
+ * Instances are rendered in the order listed. Static instances that share
+ * a mesh may be drawn together in one instanced call.
+ *
+ * "swim" bends a fish mesh, nose along +z, from side to side as it is drawn:
+ * speed is tail beats per second (1.5 by default) and amplitude the tail's
+ * sway as a fraction of the body length (0.08 by default). Static
+ * instances cannot swim; controlled ones can, steered while they sway.
+ *
+ * "emissive" makes a material glow in its diffuse colour, e times over,
+ * whatever the lighting; above 1 it is bright enough to bloom.
+ *
+ * An emitter sits at its offset in the anchor instance's frame, following
+ * it if it moves, or at the offset in the world without an anchor. Rate
+ * is particles per second; the settings left out take the kind's defaults.
+ * Particle bounds default to the school's, and capacity to 4096.
+ *
+ * Caustics are projected along their direction onto the instances marked
+ * "caustics", one tile of the CausticsAtlas every tile world units, and
+ * light them in their colour, at average brightness, times the material's
+ * diffuse colour; the pattern loops every period seconds. The rest of the
+ * entry are the atlas's parameters. Fog hides what is further than start
+ * from the eye behind the fog colour, each channel's light falling off by
+ * its extinction per world unit. Either entry may be left out.
+ */
+
+#ifndef FISHTANK_SCENEDESCRIPTION_H
+#define FISHTANK_SCENEDESCRIPTION_H
+
+#include "CausticsAtlas.h"
+#include "ParticleSystem.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+class JSONValue;
+
+struct MaterialDescription
+{
+    std::string name;
+    double      diffuse[3];
+    double      emissive;       /* zero for none */
+};
+
+/* An amplitude of zero means rigid */
+struct SwimDescription
+{
+    double speed;
+    double amplitude;
+};
+
+struct InstanceDescription
+{
+    std::string     name;
+    std::string     mesh;
+    std::string     material;
+    double          position[3];
+    double          scale[3];
+    double          rotation[3];
+    bool            controlled;
+    bool            isStatic;
+    bool            caustics;
+    SwimDescription swim;
+};
+
+struct SpeciesDescription
+{
+    std::string     mesh;
+    std::string     material;
+    SwimDescription swim;
+};
+
+/* A shoal simulated as a whole; a count of zero means no school */
+struct SchoolDescription
+{
+    int                             count;
+    double                          scale;
+    unsigned int                    seed;
+    std::vector<SpeciesDescription> species;
+    double                          boundsMin[3];
+    double                          boundsMax[3];
+};
+
+struct EmitterDescription
+{
+    std::string              anchor;     /* empty for none */
+    double                   offset[3];
+    ParticleSystem::Emitter  settings;   /* position unused */
+};
+
+/* Bubbles and motes; no emitters means no particles */
+struct ParticlesDescription
+{
+    int                             capacity;
+    unsigned int                    seed;
+    double                          boundsMin[3];
+    double                          boundsMax[3];
+    std::vector<EmitterDescription> emitters;
+};
+
+/* Caustics and fog, each off when its entry is absent */
+struct WaterDescription
+{
+    bool                      caustics;
+    CausticsAtlas::Parameters atlas;
+    double                    tile;            /* world units across one tile */
+    double                    direction[3];    /* the light's, unit length */
+    double                    causticsColor[3];
+    double                    period;          /* seconds per loop */
+    bool                      fog;
+    double                    fogColor[3];
+    double                    extinction[3];   /* per world unit */
+    double                    fogStart;
+};
+
+class SceneDescription
+{
+    public:
+        SceneDescription()
+        {
+            school.count       = 0;
+            school.seed        = 1;
+            particles.capacity = 0;
+            particles.seed     = ParticleSystem::DEFAULT_SEED;
+            water.caustics     = false;
+            water.fog          = false;
+        }
+
+        /* Mesh name to resolved file path */
+        std::map<std::string, std::string>         meshFiles;
+        std::map<std::string, MaterialDescription> materials;
+        std::vector<InstanceDescription>           instances;
+        SchoolDescription                          school;
+        ParticlesDescription                       particles;
+        WaterDescription                           water;
+
+        /* Read and validate a scene file; on failure returns false and fills error */
+        bool Load(const std::string &fileName, std::string &error);
+
+        /* Append copies more of every static instance, copy k shifted by k * offset */
+        void Replicate(int copies, const double offset[3]);
+
+        /* Lexically join a path onto a directory and drop "." and "dir/.." parts */
+        static std::string ResolvePath(const std::string &directory, const std::string &path);
+
+    private:
+        bool LoadSchool(const JSONValue &value, const std::string &fileName, std::string &error);
+        bool LoadParticles(const JSONValue &value, const std::string &fileName, std::string &error);
+        bool LoadWater(const JSONValue &value, const std::string &fileName, std::string &error);
+};
+
+#endif
@@ -0,0 +1,162 @@
+/*
+ * Fixed-rate simulation thread
+ */
+
+#include "Simulation.h"
+
+#include "Profiler.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+/* Steps taken at most per wake-up before lost time is dropped */
+const long long MAX_CATCH_UP = 8;
+}
+
+Simulation::Simulation(FishSchool &s, double step)
+    : school(s), stepSeconds(step), clockStart(std::chrono::steady_clock::now()),
+      stopping(false), steps(0), dropped(0), obstaclesChanged(false), started(false), manualTime(-1),
+      manualStep(0)
+{
+    /* The starting positions, so there is something to draw right away */
+    Publish(0, 0);
+}
+
+Simulation::~Simulation()
+{
+    Stop();
+}
+
+void Simulation::Start()
+{
+    if (started)
+        return;
+    started    = true;
+    stopping   = false;
+    clockStart = std::chrono::steady_clock::now();
+    thread     = std::thread(&Simulation::Run, this);
+}
+
+void Simulation::Stop()
+{
+    stopping = true;
+    if (thread.joinable())
+        thread.join();
+}
+
+double Simulation::Now() const
+{
+    if (manualTime >= 0)
+        return manualTime;
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - clockStart).count();
+}
+
+/* Snapshots are indexed by fish id, since the school reorders its arrays */
+void Simulation::Publish(long long step, double time)
+{
+    Snapshot &snapshot = snapshots.GetWriteBuffer();
+    int count = school.GetNumberOfFish();
+    snapshot.step = step;
+    snapshot.time = time;
+    snapshot.positions.resize(3 * count);
+    snapshot.headings.resize(3 * count);
+
+    const int *ids = school.GetIds();
+    const float *p[3] = { school.GetPositionX(), school.GetPositionY(), school.GetPositionZ() };
+    const float *h[3] = { school.GetHeadingX(), school.GetHeadingY(), school.GetHeadingZ() };
+    for (int i = 0; i < count; i++)
+        for (int c = 0; c < 3; c++)
+        {
+            snapshot.positions[3 * ids[i] + c] = p[c][i];
+            snapshot.headings[3 * ids[i] + c]  = h[c][i];
+        }
+    snapshots.Publish();
+}
+
+void Simulation::Run()
+{
+    Profiler::Get().SetThreadName("simulation");
+    long long step = 0;
+    double    lost = 0;   /* dropped time, which the simulation clock no longer counts */
+    while (!stopping)
+    {
+        if (obstaclesChanged.exchange(false))
+        {
+            std::lock_guard<std::mutex> lock(obstacleLock);
+            obstacles = newObstacles;
+            school.SetObstacles(obstacles.get());
+        }
+
+        long long due = (long long)((Now() - lost) / stepSeconds);
+        if (due - step > MAX_CATCH_UP)
+        {
+            long long skipped = due - step - MAX_CATCH_UP;
+            dropped += skipped;
+            lost    += skipped * stepSeconds;
+            due      = step + MAX_CATCH_UP;
+        }
+        if (due > step)
+        {
+            {
+                ScopedTimer timer("simulate");
+                for (; step < due; step++)
+                    school.Step((float)stepSeconds);
+            }
+            steps = step;
+            ScopedTimer timer("publish");
+            Publish(step, lost + step * stepSeconds);
+        }
+
+        std::chrono::duration<double> wake(lost + (step + 1) * stepSeconds);
+        std::this_thread::sleep_until(clockStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(wake));
+    }
+}
+
+void Simulation::StepTo(double seconds)
+{
+    if (started)
+        return;
+    manualTime = std::max(seconds, 0.0);
+    if (obstaclesChanged.exchange(false))
+    {
+        std::lock_guard<std::mutex> lock(obstacleLock);
+        obstacles = newObstacles;
+        school.SetObstacles(obstacles.get());
+    }
+
+    long long due = (long long)(manualTime / stepSeconds);
+    if (due <= manualStep)
+        return;
+    {
+        ScopedTimer timer("simulate");
+        for (; manualStep < due; manualStep++)
+            school.Step((float)stepSeconds);
+    }
+    steps = manualStep;
+    Publish(manualStep, manualStep * stepSeconds);
+}
+
+void Simulation::SetObstacles(const std::shared_ptr<const DistanceField> &field)
+{
+    std::lock_guard<std::mutex> lock(obstacleLock);
+    newObstacles     = field;
+    obstaclesChanged = true;
+}
+
+void Simulation::Sample(const Snapshot *&older, const Snapshot *&newer, float &alpha)
+{
+    /* The front slot goes back to the writer on update, so keep it first */
+    if (snapshots.HasUpdate())
+    {
+        std::swap(previous, snapshots.GetReadBuffer());
+        snapshots.Update();
+    }
+    newer = &snapshots.GetReadBuffer();
+    older = previous.step >= 0 ? &previous : newer;
+
+    double span = newer->time - older->time;
+    double when = Now() - stepSeconds;
+    alpha = span > 0 ? (float)std::min(1.0, std::max(0.0, (when - older->time) / span)) : 1.0f;
+}
@@ -0,0 +1,105 @@
+/*
+ * Fixed-rate simulation thread
+ *
+ * Steps a FishSchool on its own thread at a fixed timestep, paced by the
+ * wall clock rather than by frames, and publishes a snapshot of the fish
+ * after each batch of steps through a triple buffer. The render thread
+ * never waits on the simulation: it blends the two newest snapshots for
+ * the present moment, one step behind the simulation clock.
+ *
+ * If the simulation falls far behind (a debugger stop, a machine under
+ * load) it catches up by at most a few steps and drops the rest of the
+ * lost time, which is counted.
+ *
+ * Replays instead call StepTo() from the render thread each frame and
+ * never Start() the thread: the school then takes exactly the steps its
+ * clock calls for, with nothing dropped, so the same frame times always
+ * give the same fish.
+ *
+ * Obstacles for the school can arrive at any time, for instance once the
+ * scenery has loaded; the simulation thread takes them up between steps.
+ */
+
+#ifndef FISHTANK_SIMULATION_H
+#define FISHTANK_SIMULATION_H
+
+#include "DistanceField.h"
+#include "FishSchool.h"
+#include "TripleBuffer.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class Simulation
+{
+    public:
+        struct Snapshot
+        {
+            Snapshot() : step(-1), time(0) {}
+
+            long long          step;
+            double             time;        /* seconds on the simulation clock */
+            std::vector<float> positions;   /* xyz per fish, indexed by fish id */
+            std::vector<float> headings;
+        };
+
+        /* The school belongs to the simulation thread between Start() and Stop() */
+        Simulation(FishSchool &school, double stepSeconds);
+        ~Simulation();
+
+        void Start();
+        void Stop();
+
+        /* Without Start(): step on the calling thread until the simulation
+         * clock reaches seconds and publish, so that Sample() shows that
+         * moment */
+        void StepTo(double seconds);
+
+        /* Render thread: the two newest snapshots and where the present
+         * moment lies between them, 0 at older and 1 at newer. Pointers
+         * stay valid until the next call. */
+        void Sample(const Snapshot *&older, const Snapshot *&newer, float &alpha);
+
+        /* Any thread: the school avoids this field from its next step on */
+        void SetObstacles(const std::shared_ptr<const DistanceField> &field);
+
+        double    GetStepSeconds() const { return stepSeconds; }
+        long long GetNumberOfSteps() const { return steps.load(); }
+        long long GetNumberOfDroppedSteps() const { return dropped.load(); }
+
+    private:
+        Simulation(const Simulation &);
+        Simulation &operator=(const Simulation &);
+
+        void   Run();
+        void   Publish(long long step, double time);
+        double Now() const;
+
+        FishSchool                           &school;
+        double                                stepSeconds;
+        std::chrono::steady_clock::time_point clockStart;
+        std::thread                           thread;
+        std::atomic<bool>                     stopping;
+        std::atomic<long long>                steps;
+        std::atomic<long long>                dropped;
+        TripleBuffer<Snapshot>                snapshots;
+
+        std::mutex                            obstacleLock;
+        std::shared_ptr<const DistanceField>  newObstacles;   /* under obstacleLock */
+        std::shared_ptr<const DistanceField>  obstacles;      /* simulation thread: the school's */
+        std::atomic<bool>                     obstaclesChanged;
+
+        /* Render thread only: the snapshot the front slot held before the last update */
+        Snapshot previous;
+        bool     started;
+
+        /* StepTo()'s clock and steps; manualTime is negative until the first call */
+        double    manualTime;
+        long long manualStep;
+};
+
+#endif
@@ -0,0 +1,85 @@
+/*
+ * Lock-free single-producer single-consumer queue
+ *
+ * Carries values from one writer thread to one reader thread in order,
+ * each exactly once, without either ever waiting. The ring has a fixed
+ * power-of-two size; values pushed while it is full wait in a spill list
+ * that only the writer touches and go in ahead of anything pushed later,
+ * so nothing is dropped as long as the writer keeps pushing or calls
+ * Flush() now and then.
+ */
+
+#ifndef FISHTANK_SPSCQUEUE_H
+#define FISHTANK_SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+template <typename T>
+class SpscQueue
+{
+    public:
+        /* Room for capacity values before spilling, rounded up to a power of two */
+        explicit SpscQueue(size_t capacity = 256) : head(0), tail(0)
+        {
+            size_t size = 2;
+            while (size < capacity)
+                size *= 2;
+            slots.resize(size);
+        }
+
+        /* Writer: queue a value; never blocks */
+        void Push(const T &value)
+        {
+            Flush();
+            if (!spill.empty() || !TryPush(value))
+                spill.push_back(value);
+        }
+
+        /* Writer: move spilled values into the ring while there is room;
+         * returns whether the spill list is now empty */
+        bool Flush()
+        {
+            while (!spill.empty() && TryPush(spill.front()))
+                spill.pop_front();
+            return spill.empty();
+        }
+
+        /* Reader: the oldest value, or null when empty; stays queued until Pop() */
+        const T *Front() const
+        {
+            size_t at = head.load(std::memory_order_relaxed);
+            if (at == tail.load(std::memory_order_acquire))
+                return NULL;
+            return &slots[at & (slots.size() - 1)];
+        }
+
+        /* Reader: drop the value Front() returned */
+        void Pop()
+        {
+            head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+    private:
+        SpscQueue(const SpscQueue &);
+        SpscQueue &operator=(const SpscQueue &);
+
+        bool TryPush(const T &value)
+        {
+            size_t at = tail.load(std::memory_order_relaxed);
+            if (at - head.load(std::memory_order_acquire) == slots.size())
+                return false;
+            slots[at & (slots.size() - 1)] = value;
+            tail.store(at + 1, std::memory_order_release);
+            return true;
+        }
+
+        std::vector<T>      slots;
+        std::atomic<size_t> head;    /* next to read; advanced by the reader */
+        std::atomic<size_t> tail;    /* next to write; advanced by the writer */
+        std::deque<T>       spill;   /* owned by the writer */
+};
+
+#endif
@@ -0,0 +1,993 @@
+/*
+ * The tank's actors, built from a scene description
+ */
+
+#include "TankScene.h"
+
+#include "MeshCache.h"
+#include "Profiler.h"
+#include "vtkBakedMapper.h"
+
+#include <vtkAppendPolyData.h>
+#include <vtkFloatArray.h>
+#include <vtkLight.h>
+#include <vtkLightCollection.h>
+#include <vtkMath.h>
+#include <vtkPointData.h>
+#include <vtkTransform.h>
+#include <vtkTransformPolyDataFilter.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+
+TankScene::TankScene(AssetRegistry &assets, vtkRenderer *ren)
+    : registry(assets), renderer(ren), instancing(true), bakeStatic(false), bakeLighting(false),
+      lightSamples(LightBake::DEFAULT_SAMPLES), levelOfDetail(true),
+      simulationRate(120), swimmers(0), obstacleAvoidance(true), quantizedMeshes(false),
+      shareMeshBuffers(false), deterministic(false), caustics(true), schoolStart(0), schoolScale(1),
+      obstaclesStale(false), lightingPending(false), lightingStale(false), causticsPending(false),
+      particleBudget(0), particleTime(-1)
+{
+}
+
+/* Spread over a full cycle by a multiplicative hash, so neighbours differ */
+float TankScene::SwimPhase(unsigned int seed)
+{
+    unsigned int hash = seed * 2654435761u;
+    return (float)(hash >> 8) / (float)(1u << 24) * 6.2831853f;
+}
+
+void TankScene::PlaceActor(vtkActor *actor, const InstanceDescription &description)
+{
+    actor->SetOrientation(0, 0, 0);
+    actor->SetScale(description.scale[0], description.scale[1], description.scale[2]);
+    actor->RotateX(description.rotation[0]);
+    actor->RotateY(description.rotation[1]);
+    actor->RotateZ(description.rotation[2]);
+    actor->SetPosition(description.position[0], description.position[1], description.position[2]);
+}
+
+/* Placed through a throwaway actor so the matrix matches vtkProp3D exactly */
+void TankScene::ComputePlacement(const InstanceDescription &description, vtkMatrix4x4 *matrix)
+{
+    vtkSmartPointer<vtkActor> placement = vtkSmartPointer<vtkActor>::New();
+    PlaceActor(placement, description);
+    matrix->DeepCopy(placement->GetMatrix());
+}
+
+size_t TankScene::AddDrawable(vtkPolyDataMapper *mapper, vtkProperty *material, const std::string &name)
+{
+    Drawable drawable;
+    drawable.mapper   = mapper;
+    drawable.actor    = vtkSmartPointer<vtkActor>::New();
+    drawable.name     = name;
+    drawable.copies   = 1;
+    drawable.attached = false;
+    if (vtkInstancedMapper *instanced = dynamic_cast<vtkInstancedMapper *>(mapper))
+        instanced->SetQuantized(quantizedMeshes);
+    drawable.actor->SetMapper(mapper);
+    if (material)
+        drawable.actor->SetProperty(material);
+    pending.push_back(drawables.size());
+    drawables.push_back(drawable);
+    return drawables.size() - 1;
+}
+
+void TankScene::AddMesh(size_t drawable, const SceneDescription &scene, const std::string &mesh)
+{
+    const std::string &fileName = scene.meshFiles.find(mesh)->second;
+    drawables[drawable].meshes.push_back(registry.GetMesh(fileName));
+    drawables[drawable].files.push_back(fileName);
+}
+
+void TankScene::Build(const SceneDescription &scene)
+{
+    built = scene;
+    bool receivers = caustics && scene.water.caustics;
+
+    /* Static instances sharing a mesh are worth one instanced draw */
+    std::map<std::string, int> staticUses;
+    if (instancing && !bakeStatic)
+        for (size_t i = 0; i < scene.instances.size(); i++)
+            if (scene.instances[i].isStatic && !(receivers && scene.instances[i].caustics))
+                staticUses[scene.instances[i].mesh]++;
+
+    /* Mesh name to instanced drawable, material name to baked batch */
+    std::map<std::string, size_t> instancedGroups;
+    std::map<std::string, size_t> batches;
+    for (size_t i = 0; i < scene.instances.size(); i++)
+    {
+        const InstanceDescription &description = scene.instances[i];
+        vtkProperty *material = NULL;
+        if (!description.material.empty())
+            material = registry.GetMaterial(scene.materials.find(description.material)->second);
+
+        Instance instance;
+        instance.description = description;
+        instance.slot        = -1;
+        bool receiver = receivers && description.caustics;
+
+        if (description.isStatic && bakeStatic && !receiver)
+        {
+            std::map<std::string, size_t>::iterator batch = batches.find(description.material);
+            if (batch == batches.end())
+            {
+                vtkSmartPointer<vtkPolyDataMapper> mapper;
+                if (bakeLighting)
+                    mapper = vtkSmartPointer<vtkBakedMapper>::New();
+                else
+                    mapper = vtkSmartPointer<vtkCustomMapperP>::New();
+                size_t index = AddDrawable(mapper, material, "static:" + description.material);
+                batch = batches.insert(std::make_pair(description.material, index)).first;
+                bakedBatches.push_back(index);
+            }
+
+            vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+            ComputePlacement(description, matrix);
+            instance.drawable = batch->second;
+            instance.slot     = (int)drawables[batch->second].placements.size();
+            AddMesh(batch->second, scene, description.mesh);
+            drawables[batch->second].placements.push_back(matrix);
+            instances.push_back(instance);
+            continue;
+        }
+
+        if (description.isStatic && !receiver && staticUses[description.mesh] > 1)
+        {
+            std::map<std::string, size_t>::iterator group = instancedGroups.find(description.mesh);
+            if (group == instancedGroups.end())
+            {
+                size_t index = AddDrawable(vtkSmartPointer<vtkInstancedMapper>::New(), material,
+                                           "instanced:" + description.mesh);
+                AddMesh(index, scene, description.mesh);
+                drawables[index].copies = 0;
+                group = instancedGroups.insert(std::make_pair(description.mesh, index)).first;
+            }
+
+            double white[3] = { 1, 1, 1 };
+            vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+            ComputePlacement(description, matrix);
+            Drawable &drawable = drawables[group->second];
+            static_cast<vtkInstancedMapper *>(drawable.mapper.Get())
+                ->AddInstance(matrix, material ? material->GetDiffuseColor() : white);
+            instance.drawable = group->second;
+            instance.slot     = drawable.copies++;
+            instances.push_back(instance);
+            continue;
+        }
+
+        size_t index;
+        if (description.swim.amplitude > 0 || shareMeshBuffers || receiver)
+        {
+            vtkSmartPointer<vtkInstancedMapper> mapper = vtkSmartPointer<vtkInstancedMapper>::New();
+            double white[3] = { 1, 1, 1 };
+            vtkSmartPointer<vtkMatrix4x4> identity = vtkSmartPointer<vtkMatrix4x4>::New();
+            mapper->AddInstance(identity, material ? material->GetDiffuseColor() : white);
+            if (description.swim.amplitude > 0)
+            {
+                mapper->SetInstanceSwim(0, SwimPhase((unsigned int)i), (float)description.swim.speed,
+                                        (float)description.swim.amplitude);
+                swimmers++;
+            }
+            if (receiver)
+                causticsMappers.push_back(mapper);
+            index = AddDrawable(mapper, material, description.name);
+        }
+        else
+        {
+            instance.mapper = vtkSmartPointer<vtkCustomMapperP>::New();
+            index = AddDrawable(instance.mapper, material, description.name);
+        }
+        AddMesh(index, scene, description.mesh);
+        instance.actor    = drawables[index].actor;
+        instance.drawable = index;
+        PlaceActor(instance.actor, description);
+        if (description.controlled)
+            controls.AddActor(instance.actor);
+        instances.push_back(instance);
+    }
+
+    lightingPending = bakeLighting && !bakedBatches.empty();
+    if (!causticsMappers.empty())
+    {
+        causticsAtlas   = registry.GetCaustics(scene.water.atlas);
+        causticsPending = true;
+    }
+
+    BuildSchool(scene);
+    if (simulation && obstacleAvoidance)
+        CollectObstacles();
+    BuildParticles(scene);
+}
+
+void TankScene::BuildSchool(const SceneDescription &scene)
+{
+    const SchoolDescription &description = scene.school;
+    if (description.count <= 0)
+        return;
+
+    FishSchool::Parameters parameters = school.GetParameters();
+    for (int c = 0; c < 3; c++)
+    {
+        parameters.boundsMin[c] = (float)description.boundsMin[c];
+        parameters.boundsMax[c] = (float)description.boundsMax[c];
+    }
+    school.SetParameters(parameters);
+    school.Reset(description.count, (int)description.species.size(), description.seed);
+    schoolScale = (float)description.scale;
+
+    /* Fish ids are their indices until the first step */
+    speciesById.assign(school.GetSpecies(), school.GetSpecies() + school.GetNumberOfFish());
+    std::vector<int> perSpecies(description.species.size(), 0);
+    for (size_t i = 0; i < speciesById.size(); i++)
+        perSpecies[speciesById[i]]++;
+
+    /* Fish stay within the bounds, give or take a body length */
+    double margin = 5 * description.scale;
+    double bounds[6];
+    for (int c = 0; c < 3; c++)
+    {
+        bounds[2 * c]     = description.boundsMin[c] - margin;
+        bounds[2 * c + 1] = description.boundsMax[c] + margin;
+    }
+
+    for (size_t s = 0; s < description.species.size(); s++)
+    {
+        const SpeciesDescription &species = description.species[s];
+        vtkProperty *material = NULL;
+        if (!species.material.empty())
+            material = registry.GetMaterial(scene.materials.find(species.material)->second);
+
+        vtkSmartPointer<vtkInstancedMapper> mapper = vtkSmartPointer<vtkInstancedMapper>::New();
+        mapper->SetNumberOfInstances(perSpecies[s]);
+        mapper->SetFixedBounds(bounds);
+        double *diffuse = material ? material->GetDiffuseColor() : NULL;
+        for (int i = 0; i < perSpecies[s]; i++)
+        {
+            float *color = mapper->GetInstanceColorPointer(i);
+            for (int c = 0; c < 3; c++)
+                color[c] = diffuse ? (float)diffuse[c] : 1.0f;
+            color[3] = 1;
+        }
+
+        /* Slots are filled in id order every frame, so the k-th slot is
+         * always the same fish; each gets its own phase and a tail beat
+         * within a fifth of the species' speed */
+        if (species.swim.amplitude > 0)
+        {
+            int slot = 0;
+            for (size_t id = 0; id < speciesById.size(); id++)
+            {
+                if (speciesById[id] != s)
+                    continue;
+                float jitter = 0.8f + 0.4f * SwimPhase((unsigned int)id + 7919) / 6.2831853f;
+                mapper->SetInstanceSwim(slot++, SwimPhase((unsigned int)id),
+                                        (float)species.swim.speed * jitter, (float)species.swim.amplitude);
+            }
+        }
+
+        size_t index = AddDrawable(mapper, material, "school:" + species.mesh);
+        AddMesh(index, scene, species.mesh);
+        drawables[index].copies = perSpecies[s];
+        schoolMappers.push_back(mapper);
+    }
+    speciesCursor.resize(schoolMappers.size());
+
+    simulation.reset(new Simulation(school, 1.0 / simulationRate));
+    schoolStart = FrameClock::Get().GetTime();
+    UpdateSchool();
+    if (!deterministic)
+        simulation->Start();
+}
+
+/* Every fish is placed between the two newest snapshots: positions are
+ * blended linearly, headings blended and renormalized */
+void TankScene::UpdateSchool()
+{
+    if (!simulation)
+        return;
+    if (deterministic)
+        simulation->StepTo(FrameClock::Get().GetTime() - schoolStart);
+    ScopedTimer timer("school:pose");
+    const Simulation::Snapshot *older, *newer;
+    float alpha;
+    simulation->Sample(older, newer, alpha);
+
+    std::fill(speciesCursor.begin(), speciesCursor.end(), 0);
+    for (size_t id = 0; id < speciesById.size(); id++)
+    {
+        float position[3], heading[3];
+        for (int c = 0; c < 3; c++)
+        {
+            size_t k = 3 * id + c;
+            position[c] = older->positions[k] + (newer->positions[k] - older->positions[k]) * alpha;
+            heading[c]  = older->headings[k] + (newer->headings[k] - older->headings[k]) * alpha;
+        }
+        float length = std::sqrt(heading[0] * heading[0] + heading[1] * heading[1] + heading[2] * heading[2]);
+        if (length > 0)
+            for (int c = 0; c < 3; c++)
+                heading[c] /= length;
+
+        int s = speciesById[id];
+        FishSchool::ComputeModelMatrix(position, heading, schoolScale,
+                                       schoolMappers[s]->GetInstanceMatrixPointer(speciesCursor[s]++));
+    }
+    for (size_t s = 0; s < schoolMappers.size(); s++)
+        schoolMappers[s]->InstancesModified();
+}
+
+void TankScene::BuildParticles(const SceneDescription &scene)
+{
+    const ParticlesDescription &description = scene.particles;
+    if (description.emitters.empty())
+        return;
+
+    particles.reset(new ParticleSystem(particleBudget > 0 ? particleBudget : description.capacity));
+    float boundsMin[3], boundsMax[3];
+    for (int c = 0; c < 3; c++)
+    {
+        boundsMin[c] = (float)description.boundsMin[c];
+        boundsMax[c] = (float)description.boundsMax[c];
+    }
+    particles->SetBounds(boundsMin, boundsMax);
+    particles->SetSeed(description.seed);
+
+    vtkSmartPointer<vtkMatrix4x4> placement = vtkSmartPointer<vtkMatrix4x4>::New();
+    for (size_t e = 0; e < description.emitters.size(); e++)
+    {
+        const EmitterDescription &emitter = description.emitters[e];
+        ParticleSystem::Emitter settings = emitter.settings;
+        double offset[4] = { emitter.offset[0], emitter.offset[1], emitter.offset[2], 1 };
+        double position[4] = { offset[0], offset[1], offset[2], 1 };
+
+        vtkActor *actor = emitter.anchor.empty() ? NULL : GetActor(emitter.anchor);
+        if (!emitter.anchor.empty())
+        {
+            for (size_t i = 0; i < instances.size(); i++)
+                if (instances[i].description.name == emitter.anchor)
+                {
+                    ComputePlacement(instances[i].description, placement);
+                    placement->MultiplyPoint(offset, position);
+                    break;
+                }
+        }
+        for (int c = 0; c < 3; c++)
+            settings.position[c] = (float)position[c];
+        int index = particles->AddEmitter(settings);
+
+        /* Instances drawn instanced or baked never move */
+        if (actor)
+        {
+            Anchor anchor;
+            anchor.emitter = index;
+            anchor.actor   = actor;
+            for (int c = 0; c < 3; c++)
+                anchor.offset[c] = emitter.offset[c];
+            anchors.push_back(anchor);
+        }
+    }
+    if (particleBudget > 0 && particles->GetSteadyCount() > 0)
+        particles->SetRateScale((float)(particleBudget / particles->GetSteadyCount()));
+
+    particleMapper = vtkSmartPointer<vtkParticleMapper>::New();
+    particleMapper->SetInputData(vtkSmartPointer<vtkPolyData>::New());
+    particleMapper->SetParticles(particles.get());
+    particleActor = vtkSmartPointer<vtkActor>::New();
+    particleActor->SetMapper(particleMapper);
+    renderer->AddActor(particleActor);
+}
+
+void TankScene::UpdateParticles()
+{
+    if (!particles)
+        return;
+    for (size_t a = 0; a < anchors.size(); a++)
+    {
+        const Anchor &anchor = anchors[a];
+        double offset[4] = { anchor.offset[0], anchor.offset[1], anchor.offset[2], 1 };
+        double world[4];
+        anchor.actor->GetMatrix()->MultiplyPoint(offset, world);
+        float position[3] = { (float)world[0], (float)world[1], (float)world[2] };
+        particles->SetEmitterPosition(anchor.emitter, position);
+    }
+
+    double now = FrameClock::Get().GetTime();
+    double dt  = particleTime < 0 ? 0 : std::min(now - particleTime, FrameClock::MAX_DELTA);
+    particleTime = now;
+    particles->Step((float)dt);
+}
+
+bool TankScene::Update()
+{
+    UpdateSchool();
+    UpdateParticles();
+    bool steering = controls.Update(FrameClock::Get().GetTime());
+    return IsAnimated() || steering;
+}
+
+std::shared_ptr<const DistanceField> TankScene::MakeObstacles(const std::vector<float> &triangles,
+                                                             const float boundsMin[3], const float boundsMax[3],
+                                                             const std::string &cacheDirectory)
+{
+    ScopedTimer timer("obstacles:build");
+    const float cellSize = 0.5f;
+    uint64_t key = DistanceField::ComputeKey(triangles, boundsMin, boundsMax, cellSize);
+    return MeshCache::ReadOrBuild<DistanceField>(cacheDirectory, "obstacles", "ftdf", key,
+        [&](DistanceField &field) { field.Build(triangles, boundsMin, boundsMax, cellSize); },
+        [&](const DistanceField &field) {
+            const int *dimensions = field.GetDimensions();
+            std::ostringstream description;
+            description << "a " << dimensions[0] << "x" << dimensions[1] << "x" << dimensions[2] << " field over "
+                        << triangles.size() / 9 << " triangles (" << DistanceField::GetKernelName() << " sampling)";
+            return description.str();
+        });
+}
+
+void TankScene::GatherTriangles(vtkPolyData *mesh, vtkMatrix4x4 *placement, std::vector<float> &points,
+                                std::vector<float> &triangles)
+{
+    size_t first = points.size();
+    vtkIdType nPoints = mesh->GetNumberOfPoints();
+    for (vtkIdType p = 0; p < nPoints; p++)
+    {
+        double point[4] = { 0, 0, 0, 1 };
+        mesh->GetPoint(p, point);
+        if (placement)
+            placement->MultiplyPoint(point, point);
+        for (int c = 0; c < 3; c++)
+            points.push_back((float)point[c]);
+    }
+
+    vtkCellArray *polys = mesh->GetPolys();
+    vtkIdType  npts;
+    vtkIdType *pts;
+    for (polys->InitTraversal(); polys->GetNextCell(npts, pts);)
+    {
+        for (vtkIdType k = 1; k + 1 < npts; k++)
+        {
+            const vtkIdType corners[3] = { pts[0], pts[k], pts[k + 1] };
+            for (int v = 0; v < 3; v++)
+                triangles.insert(triangles.end(), &points[first + 3 * corners[v]],
+                                 &points[first + 3 * corners[v]] + 3);
+        }
+    }
+}
+
+/* Triangles are gathered here on the render thread, since traversing a
+ * cell array isn't safe to share; only the field itself is built aside */
+void TankScene::UpdateObstacles()
+{
+    if (obstacleMeshes.empty())
+        return;
+
+    if (!obstacleField.valid())
+    {
+        for (size_t i = 0; i < obstacleMeshes.size(); i++)
+            if (!MeshLoader::IsReady(obstacleMeshes[i].mesh))
+                return;
+
+        std::vector<float> triangles;
+        std::vector<float> world;
+        for (size_t i = 0; i < obstacleMeshes.size(); i++)
+        {
+            world.clear();
+            GatherTriangles(obstacleMeshes[i].mesh.get().front(), obstacleMeshes[i].placement, world, triangles);
+        }
+
+        /* Room past the bounds for fish that stray out before turning back */
+        const FishSchool::Parameters &parameters = school.GetParameters();
+        float boundsMin[3], boundsMax[3];
+        for (int c = 0; c < 3; c++)
+        {
+            boundsMin[c] = parameters.boundsMin[c] - parameters.obstacleMargin - 1;
+            boundsMax[c] = parameters.boundsMax[c] + parameters.obstacleMargin + 1;
+        }
+        /* Captured by value: the bounds are copied, the triangles shared */
+        std::shared_ptr<std::vector<float> > soup = std::make_shared<std::vector<float> >();
+        soup->swap(triangles);
+        std::string cacheDirectory = registry.GetCacheDirectory();
+        obstacleField = std::async(std::launch::async, [=]() {
+            return MakeObstacles(*soup, boundsMin, boundsMax, cacheDirectory);
+        });
+        return;
+    }
+
+    if (obstacleField.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return;
+    std::shared_ptr<const DistanceField> field = obstacleField.get();
+    if (obstaclesStale)
+    {
+        /* The scenery changed while it was built; the next call starts over */
+        obstaclesStale = false;
+        return;
+    }
+    simulation->SetObstacles(field);
+    obstacleMeshes.clear();
+}
+
+void TankScene::CollectObstacles()
+{
+    obstacleMeshes.clear();
+    for (size_t i = 0; i < instances.size(); i++)
+    {
+        const InstanceDescription &description = instances[i].description;
+        if (!description.isStatic)
+            continue;
+        ObstacleMesh obstacle;
+        obstacle.mesh      = registry.GetMesh(built.meshFiles.find(description.mesh)->second);
+        obstacle.placement = vtkSmartPointer<vtkMatrix4x4>::New();
+        ComputePlacement(description, obstacle.placement);
+        obstacleMeshes.push_back(obstacle);
+    }
+    obstaclesStale = obstacleField.valid();
+}
+
+std::shared_ptr<const LightBake> TankScene::MakeLighting(const std::vector<float> &points,
+                                                        const std::vector<float> &normals,
+                                                        const std::vector<float> &triangles,
+                                                        const std::vector<LightBake::Light> &lights, int samples,
+                                                        const std::string &cacheDirectory)
+{
+    ScopedTimer timer("lighting:build");
+    uint64_t key = LightBake::ComputeKey(points, normals, triangles, lights, samples);
+    return MeshCache::ReadOrBuild<LightBake>(cacheDirectory, "lighting", "ftlb", key,
+        [&](LightBake &bake) { bake.Build(points, normals, triangles, lights, samples); },
+        [&](const LightBake &) {
+            std::ostringstream description;
+            description << "the light on " << points.size() / 3 << " vertices from " << lights.size()
+                        << " lights over " << triangles.size() / 9 << " triangles (" << samples
+                        << " occlusion samples)";
+            return description.str();
+        });
+}
+
+/* As for the obstacles, the batches' geometry is gathered on the render
+ * thread and only the baking is done aside. Their points are in world
+ * space already, and the loader gives every mesh normals. Headlights
+ * follow the camera, so they can't be baked and are left out. */
+int TankScene::UpdateLighting()
+{
+    if (!lightingPending)
+        return 0;
+
+    if (!lightBake.valid())
+    {
+        for (size_t b = 0; b < bakedBatches.size(); b++)
+            if (!drawables[bakedBatches[b]].attached)
+                return 0;
+
+        std::shared_ptr<std::vector<LightBake::Light> > lights = std::make_shared<std::vector<LightBake::Light> >();
+        vtkLightCollection *collection = renderer->GetLights();
+        collection->InitTraversal();
+        for (vtkLight *light = collection->GetNextItem(); light; light = collection->GetNextItem())
+        {
+            if (!light->GetSwitch() || light->LightTypeIsHeadlight())
+                continue;
+            double position[3], focal[3], direction[3];
+            light->GetTransformedPosition(position);
+            light->GetTransformedFocalPoint(focal);
+            for (int c = 0; c < 3; c++)
+                direction[c] = focal[c] - position[c];
+            vtkMath::Normalize(direction);
+            LightBake::Light baked;
+            for (int c = 0; c < 3; c++)
+            {
+                baked.direction[c] = (float)direction[c];
+                baked.color[c]     = (float)(light->GetDiffuseColor()[c] * light->GetIntensity());
+                baked.ambient[c]   = (float)light->GetAmbientColor()[c];
+            }
+            lights->push_back(baked);
+        }
+
+        std::shared_ptr<std::vector<float> > points    = std::make_shared<std::vector<float> >();
+        std::shared_ptr<std::vector<float> > normals   = std::make_shared<std::vector<float> >();
+        std::shared_ptr<std::vector<float> > triangles = std::make_shared<std::vector<float> >();
+        for (size_t b = 0; b < bakedBatches.size(); b++)
+        {
+            vtkPolyData *mesh = drawables[bakedBatches[b]].mapper->GetInput();
+            vtkDataArray *meshNormals = mesh->GetPointData()->GetNormals();
+            GatherTriangles(mesh, NULL, *points, *triangles);
+            vtkIdType nPoints = mesh->GetNumberOfPoints();
+            for (vtkIdType p = 0; p < nPoints; p++)
+            {
+                double normal[3] = { 0, 0, 0 };
+                if (meshNormals)
+                    meshNormals->GetTuple(p, normal);
+                for (int c = 0; c < 3; c++)
+                    normals->push_back((float)normal[c]);
+            }
+        }
+
+        int samples = lightSamples;
+        std::string cacheDirectory = registry.GetCacheDirectory();
+        lightBake = std::async(std::launch::async, [=]() {
+            return MakeLighting(*points, *normals, *triangles, *lights, samples, cacheDirectory);
+        });
+        return 0;
+    }
+
+    if (lightBake.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return 0;
+    std::shared_ptr<const LightBake> bake = lightBake.get();
+    if (lightingStale)
+    {
+        /* A batch was baked afresh meanwhile; the next call starts over */
+        lightingStale = false;
+        return 0;
+    }
+    lightingPending = false;
+
+    const std::vector<float> &light = bake->GetLight();
+    size_t offset = 0;
+    for (size_t b = 0; b < bakedBatches.size(); b++)
+    {
+        vtkPolyData *mesh = drawables[bakedBatches[b]].mapper->GetInput();
+        vtkIdType nPoints = mesh->GetNumberOfPoints();
+        if (offset + 3 * (size_t)nPoints > light.size())
+            break;
+        vtkSmartPointer<vtkFloatArray> array = vtkSmartPointer<vtkFloatArray>::New();
+        array->SetName(vtkBakedMapper::LIGHT_ARRAY);
+        array->SetNumberOfComponents(3);
+        array->SetNumberOfTuples(nPoints);
+        std::copy(light.begin() + offset, light.begin() + offset + 3 * nPoints, array->GetPointer(0));
+        mesh->GetPointData()->AddArray(array);
+        mesh->Modified();
+        offset += 3 * nPoints;
+    }
+    return (int)bakedBatches.size();
+}
+
+vtkSmartPointer<vtkPolyData> TankScene::Bake(const Drawable &drawable)
+{
+    ScopedTimer timer("bake", drawable.name);
+    vtkSmartPointer<vtkAppendPolyData> append = vtkSmartPointer<vtkAppendPolyData>::New();
+    for (size_t i = 0; i < drawable.meshes.size(); i++)
+    {
+        /* Points and normals both follow the placement */
+        vtkSmartPointer<vtkTransform> transform = vtkSmartPointer<vtkTransform>::New();
+        transform->SetMatrix(drawable.placements[i]);
+        vtkSmartPointer<vtkTransformPolyDataFilter> place = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
+        place->SetTransform(transform);
+        place->SetInputData(drawable.meshes[i].get().front());
+        place->Update();
+        append->AddInputData(place->GetOutput());
+    }
+    append->Update();
+
+    vtkSmartPointer<vtkPolyData> merged = vtkSmartPointer<vtkPolyData>::New();
+    merged->ShallowCopy(append->GetOutput());
+    return merged;
+}
+
+/* A single level clears any the mapper had, for meshes reloaded coarser */
+void TankScene::SetMeshes(Drawable &drawable)
+{
+    if (drawable.placements.empty())
+    {
+        const MeshLoader::MeshLevels &levels = drawable.meshes[0].get();
+        drawable.mapper->SetInputData(levels.front());
+        if (levelOfDetail && (levels.size() > 1 || drawable.attached))
+        {
+            if (vtkInstancedMapper *instanced = dynamic_cast<vtkInstancedMapper *>(drawable.mapper.Get()))
+                instanced->SetLevels(levels);
+            else if (vtkCustomMapperP *custom = dynamic_cast<vtkCustomMapperP *>(drawable.mapper.Get()))
+                custom->SetLevels(levels);
+        }
+        return;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    vtkSmartPointer<vtkPolyData> merged = Bake(drawable);
+    drawable.mapper->SetInputData(merged);
+    std::ostringstream message;
+    message << "[scene] baked " << drawable.placements.size() << " instances into '"
+            << drawable.name << "' (" << merged->GetNumberOfPolys() << " triangles) in "
+            << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+            << " ms" << std::endl;
+    std::cerr << message.str();
+
+    /* Lit live again until the new triangles have their light */
+    if (bakeLighting)
+    {
+        lightingStale   = lightBake.valid();
+        lightingPending = true;
+    }
+}
+
+int TankScene::AttachReady()
+{
+    int attached = 0;
+    std::vector<size_t> stillPending;
+    for (size_t i = 0; i < pending.size(); i++)
+    {
+        Drawable &drawable = drawables[pending[i]];
+        bool ready = true;
+        for (size_t m = 0; m < drawable.meshes.size() && ready; m++)
+            ready = MeshLoader::IsReady(drawable.meshes[m]);
+        if (!ready)
+        {
+            stillPending.push_back(pending[i]);
+            continue;
+        }
+
+        SetMeshes(drawable);
+        renderer->AddActor(drawable.actor);
+        drawable.attached = true;
+        attached++;
+    }
+    pending.swap(stillPending);
+    UpdateObstacles();
+    attached += UpdateLighting();
+    attached += UpdateCaustics();
+    return attached;
+}
+
+/* The atlas is shared with every tank that asked for the same one */
+int TankScene::UpdateCaustics()
+{
+    if (!causticsPending || causticsAtlas.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return 0;
+    causticsPending = false;
+    std::shared_ptr<const CausticsAtlas> atlas = causticsAtlas.get();
+    const WaterDescription &water = built.water;
+    for (size_t m = 0; m < causticsMappers.size(); m++)
+        causticsMappers[m]->SetCaustics(atlas, water.direction, water.tile, water.causticsColor, water.period);
+    return (int)causticsMappers.size();
+}
+
+/* Drawables still pending pick the new mesh up when they are attached */
+int TankScene::ReplaceMesh(const std::string &fileName, const MeshLoader::MeshFuture &mesh)
+{
+    int reached = 0;
+    for (size_t d = 0; d < drawables.size(); d++)
+    {
+        Drawable &drawable = drawables[d];
+        bool uses = false;
+        for (size_t m = 0; m < drawable.files.size(); m++)
+            if (drawable.files[m] == fileName)
+            {
+                drawable.meshes[m] = mesh;
+                uses = true;
+            }
+        if (!uses)
+            continue;
+        if (drawable.attached)
+            SetMeshes(drawable);
+        reached++;
+    }
+
+    if (simulation && obstacleAvoidance)
+        for (size_t i = 0; i < instances.size(); i++)
+            if (instances[i].description.isStatic
+                && built.meshFiles.find(instances[i].description.mesh)->second == fileName)
+            {
+                CollectObstacles();
+                break;
+            }
+    return reached;
+}
+
+namespace
+{
+bool SamePlacement(const InstanceDescription &a, const InstanceDescription &b)
+{
+    for (int c = 0; c < 3; c++)
+        if (a.position[c] != b.position[c] || a.scale[c] != b.scale[c] || a.rotation[c] != b.rotation[c])
+            return false;
+    return true;
+}
+
+bool SameKind(const InstanceDescription &a, const InstanceDescription &b)
+{
+    return a.name == b.name && a.mesh == b.mesh && a.material == b.material && a.controlled == b.controlled
+        && a.isStatic == b.isStatic && a.caustics == b.caustics && (a.swim.amplitude > 0) == (b.swim.amplitude > 0);
+}
+
+bool SameAtlas(const WaterDescription &a, const WaterDescription &b)
+{
+    return a.caustics == b.caustics
+        && (!a.caustics
+            || (a.atlas.size == b.atlas.size && a.atlas.frames == b.atlas.frames && a.atlas.waves == b.atlas.waves
+                && a.atlas.focus == b.atlas.focus && a.atlas.seed == b.atlas.seed));
+}
+
+bool SameFog(const WaterDescription &a, const WaterDescription &b)
+{
+    if (a.fog != b.fog)
+        return false;
+    for (int c = 0; a.fog && c < 3; c++)
+        if (a.fogColor[c] != b.fogColor[c] || a.extinction[c] != b.extinction[c])
+            return false;
+    return !a.fog || a.fogStart == b.fogStart;
+}
+
+bool SameMaterial(const MaterialDescription &a, const MaterialDescription &b)
+{
+    return a.diffuse[0] == b.diffuse[0] && a.diffuse[1] == b.diffuse[1] && a.diffuse[2] == b.diffuse[2]
+        && a.emissive == b.emissive;
+}
+}
+
+/* Instanced and baked instances have no actor to move: their slot in the
+ * instance buffer is rewritten, or their batch baked again. Colours held
+ * per instance are rewritten along with their material's property. */
+TankScene::EditStats TankScene::ApplyEdits(const SceneDescription &scene)
+{
+    EditStats stats = { 0, 0, 0 };
+
+    std::set<std::string> recoloured;
+    for (std::map<std::string, MaterialDescription>::const_iterator it = scene.materials.begin();
+         it != scene.materials.end(); ++it)
+    {
+        std::map<std::string, MaterialDescription>::iterator old = built.materials.find(it->first);
+        if (old == built.materials.end() || SameMaterial(old->second, it->second))
+            continue;
+        old->second = it->second;
+        if (registry.UpdateMaterial(it->second))
+        {
+            recoloured.insert(it->first);
+            stats.materials++;
+        }
+    }
+
+    for (std::map<std::string, std::string>::const_iterator it = scene.meshFiles.begin();
+         it != scene.meshFiles.end(); ++it)
+    {
+        std::map<std::string, std::string>::const_iterator old = built.meshFiles.find(it->first);
+        if (old != built.meshFiles.end() && old->second != it->second)
+            stats.ignored++;
+    }
+    if (scene.instances.size() != instances.size())
+        stats.ignored += (int)std::max(scene.instances.size(), instances.size())
+                       - (int)std::min(scene.instances.size(), instances.size());
+
+    std::set<size_t> rebake;
+    bool sceneryMoved = false;
+    double white[3] = { 1, 1, 1 };
+    for (size_t i = 0; i < std::min(scene.instances.size(), instances.size()); i++)
+    {
+        Instance &instance = instances[i];
+        const InstanceDescription &description = scene.instances[i];
+        if (!SameKind(instance.description, description))
+        {
+            stats.ignored++;
+            continue;
+        }
+        bool moved    = !SamePlacement(instance.description, description);
+        bool recolour = recoloured.count(description.material) > 0;
+        bool swim     = instance.description.swim.speed != description.swim.speed
+                     || instance.description.swim.amplitude != description.swim.amplitude;
+        instance.description = description;
+        if (!moved && !recolour && !swim)
+            continue;
+        if (moved || swim)
+            stats.instances++;
+
+        Drawable &drawable = drawables[instance.drawable];
+        vtkInstancedMapper *instanced = dynamic_cast<vtkInstancedMapper *>(drawable.mapper.Get());
+        const double *color = white;
+        if (!description.material.empty())
+            color = registry.GetMaterial(built.materials.find(description.material)->second)->GetDiffuseColor();
+        if (instance.actor)
+        {
+            if (moved)
+                PlaceActor(instance.actor, description);
+            if (instanced && recolour)
+            {
+                float *slot = instanced->GetInstanceColorPointer(0);
+                for (int c = 0; c < 3; c++)
+                    slot[c] = (float)color[c];
+                instanced->InstancesModified();
+            }
+            /* A fish already swimming carries on mid-stroke; one starting
+             * to gets its own phase, as when built */
+            if (instanced && swim && instanced->GetInstanceSwimPointer(0)[2] > 0)
+                instanced->SetInstanceSwimSpeed(0, (float)description.swim.speed,
+                                                (float)description.swim.amplitude);
+            else if (instanced && swim)
+                instanced->SetInstanceSwim(0, SwimPhase((unsigned int)i), (float)description.swim.speed,
+                                           (float)description.swim.amplitude);
+        }
+        else if (!drawable.placements.empty())
+        {
+            if (moved)
+            {
+                ComputePlacement(description, drawable.placements[instance.slot]);
+                rebake.insert(instance.drawable);
+            }
+        }
+        else if (instanced)
+        {
+            vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+            ComputePlacement(description, matrix);
+            instanced->SetInstance(instance.slot, matrix, color);
+        }
+        sceneryMoved = sceneryMoved || (moved && description.isStatic);
+    }
+
+    for (std::set<size_t>::const_iterator it = rebake.begin(); it != rebake.end(); ++it)
+        if (drawables[*it].attached)
+            SetMeshes(drawables[*it]);
+    if (sceneryMoved && simulation && obstacleAvoidance)
+        CollectObstacles();
+
+    /* The fog belongs to the renderer's passes, not the scene */
+    if (!SameAtlas(built.water, scene.water) || !SameFog(built.water, scene.water))
+        stats.ignored++;
+    else if (built.water.caustics)
+    {
+        built.water = scene.water;
+        if (!causticsPending)
+            for (size_t m = 0; m < causticsMappers.size(); m++)
+                causticsMappers[m]->SetCaustics(causticsAtlas.get(), built.water.direction, built.water.tile,
+                                                built.water.causticsColor, built.water.period);
+    }
+
+    /* The school's colours are its species' */
+    const std::vector<SpeciesDescription> &species = scene.school.species;
+    if (scene.school.count != built.school.count || species.size() != schoolMappers.size()
+        || scene.particles.emitters.size() != built.particles.emitters.size())
+        stats.ignored++;
+    for (size_t s = 0; s < std::min(species.size(), schoolMappers.size()); s++)
+    {
+        if (species[s].material != built.school.species[s].material || !recoloured.count(species[s].material))
+            continue;
+        const double *diffuse = registry.GetMaterial(built.materials.find(species[s].material)->second)
+                                    ->GetDiffuseColor();
+        for (int i = 0; i < schoolMappers[s]->GetNumberOfInstances(); i++)
+        {
+            float *color = schoolMappers[s]->GetInstanceColorPointer(i);
+            for (int c = 0; c < 3; c++)
+                color[c] = (float)diffuse[c];
+        }
+        schoolMappers[s]->InstancesModified();
+    }
+    return stats;
+}
+
+TankScene::DrawStats TankScene::GetDrawStats() const
+{
+    DrawStats stats;
+    stats.drawCalls = 0;
+    stats.triangles = 0;
+    for (size_t i = 0; i < drawables.size(); i++)
+    {
+        const Drawable &drawable = drawables[i];
+        if (!drawable.attached || !drawable.actor->GetVisibility())
+            continue;
+        stats.drawCalls++;
+        stats.triangles += drawable.mapper->GetInput()->GetNumberOfPolys() * drawable.copies;
+    }
+    return stats;
+}
+
+vtkIdType TankScene::GetDrawnTriangles() const
+{
+    vtkIdType triangles = 0;
+    for (size_t i = 0; i < drawables.size(); i++)
+    {
+        const Drawable &drawable = drawables[i];
+        if (!drawable.attached || !drawable.actor->GetVisibility())
+            continue;
+        if (vtkInstancedMapper *instanced = dynamic_cast<vtkInstancedMapper *>(drawable.mapper.Get()))
+            triangles += instanced->GetNumberOfDrawnTriangles();
+        else if (vtkCustomMapperP *custom = dynamic_cast<vtkCustomMapperP *>(drawable.mapper.Get()))
+            triangles += custom->GetNumberOfDrawnTriangles();
+        else
+            triangles += drawable.mapper->GetInput()->GetNumberOfPolys();
+    }
+    return triangles;
+}
+
+vtkActor *TankScene::GetActor(const std::string &name) const
+{
+    for (size_t i = 0; i < instances.size(); i++)
+        if (instances[i].description.name == name)
+            return instances[i].actor;
+    return NULL;
+}
@@ -0,0 +1,371 @@
+/*
+ * The tank's actors, built from a scene description
+ *
+ * Build() creates mappers and actors straight away; each actor joins the
+ * renderer once its mesh has finished loading, so the window can show a
+ * partial tank while the rest streams in.
+ *
+ * With instancing on, static instances that share a mesh are collected
+ * into one vtkInstancedMapper and drawn in a single call, with each
+ * instance's material colour as its per-instance colour. Such instances
+ * have no actor of their own.
+ *
+ * Baking goes further: every static instance is transformed into world
+ * space once and merged with the others of its material into a single
+ * polydata, so all the scenery costs one draw call per material. Baking
+ * takes precedence over instancing.
+ *
+ * Baked lighting goes further still: once every batch is attached, the
+ * scene lights' light on the batches' vertices, shadows and ambient
+ * occlusion included, is baked by LightBake on a background thread, or
+ * read back from the mesh cache directory, and drawn by vtkBakedMapper.
+ * Batches are lit live until their light arrives, and again whenever they
+ * are baked afresh until it has been baked again.
+ *
+ * Unless level of detail is turned off, every mesh's coarser levels go to
+ * the mappers that draw it, which pick a level per actor or per instance
+ * each frame. Baked batches are always drawn at full detail.
+ *
+ * Instances marked "caustics", when the scene's water has caustics and
+ * they are on, are drawn the same way as swimmers below, each by a
+ * single-instance vtkInstancedMapper, which lights them with the atlas from
+ * the registry once it is ready. They are never instanced with others or
+ * baked.
+ *
+ * Instances that swim are drawn by a vtkInstancedMapper of their own with a
+ * single instance, whose vertex shader does the swaying; the actor is
+ * placed and moved as any other. Sharing mesh buffers draws every other
+ * instance with an actor the same way, without the swaying.
+ *
+ * A school, when the scene has one, is simulated by FishSchool on the
+ * simulation thread and drawn with one instanced mapper per species,
+ * refilled each frame by blending the two newest simulation snapshots.
+ *
+ * With obstacle avoidance on, once every static instance's mesh is ready
+ * their triangles are placed in the world and turned into a DistanceField
+ * around the school's bounds on a background thread, or read back from the
+ * mesh cache directory, and handed to the simulation.
+ *
+ * Instances marked "controlled" are driven from the keyboard through
+ * ActorControls, whose commands Update() applies.
+ *
+ * Particles, when the scene has emitters, are stepped on the calling
+ * thread by Update() and drawn by one vtkParticleMapper, whose actor goes
+ * to the renderer straight from Build(). Emitters anchored to an instance
+ * with an actor follow it; the rest stay where they start.
+ *
+ * For hot reloading, ReplaceMesh() swaps a mesh parsed afresh into the
+ * mappers that draw it, and ApplyEdits() takes a reloaded description of
+ * the same scene and changes only the materials, placements and swimming
+ * that differ. Both run between frames on the render thread.
+ */
+
+#ifndef FISHTANK_TANKSCENE_H
+#define FISHTANK_TANKSCENE_H
+
+#include "ActorControls.h"
+#include "AssetRegistry.h"
+#include "DistanceField.h"
+#include "FishSchool.h"
+#include "LightBake.h"
+#include "SceneDescription.h"
+#include "ParticleSystem.h"
+#include "Simulation.h"
+#include "vtkCustomMapper.h"
+#include "vtkInstancedMapper.h"
+#include "vtkParticleMapper.h"
+
+#include <vtkActor.h>
+#include <vtkMatrix4x4.h>
+#include <vtkPolyData.h>
+#include <vtkPolyDataMapper.h>
+#include <vtkProperty.h>
+#include <vtkRenderer.h>
+#include <vtkSmartPointer.h>
+
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+class TankScene
+{
+    public:
+        TankScene(AssetRegistry &registry, vtkRenderer *renderer);
+
+        /* Work submitted per frame by the actors attached so far */
+        struct DrawStats
+        {
+            int       drawCalls;
+            vtkIdType triangles;
+
+            bool operator==(const DrawStats &other) const
+            {
+                return drawCalls == other.drawCalls && triangles == other.triangles;
+            }
+        };
+
+        /* Must be set before Build(); instancing is on, baking off by default */
+        void SetInstancing(bool enabled) { instancing = enabled; }
+        void SetBakeStatic(bool enabled) { bakeStatic = enabled; }
+
+        /* Bake the batches' light too; needs baking on, off by default.
+         * The renderer's lights must be in place before AttachReady(). */
+        void SetBakeLighting(bool enabled) { bakeLighting = enabled; }
+        void SetLightSamples(int samples) { lightSamples = samples; }
+        void SetSimulationRate(double stepsPerSecond) { simulationRate = stepsPerSecond; }
+        void SetLevelOfDetail(bool enabled) { levelOfDetail = enabled; }
+        void SetObstacleAvoidance(bool enabled) { obstacleAvoidance = enabled; }
+
+        /* Light the instances marked for it with the water's caustics; on
+         * by default */
+        void SetCaustics(bool enabled) { caustics = enabled; }
+
+        /* Instanced meshes go to the GPU quantized; off by default */
+        void SetQuantizedMeshes(bool enabled) { quantizedMeshes = enabled; }
+
+        /* Draw every instance with an actor of its own through a
+         * single-instance vtkInstancedMapper, as swimmers are, so that its
+         * mesh's GPU buffers are shared with every other mapper drawing it
+         * in the window, other tanks' included; off by default */
+        void SetShareMeshBuffers(bool enabled) { shareMeshBuffers = enabled; }
+
+        /* Step the school from Update(), on the calling thread and by the
+         * frame clock, instead of on its own thread, so that the same frame
+         * times always give the same tank; replays need this */
+        void SetDeterministic(bool enabled) { deterministic = enabled; }
+
+        /* Size the particle pool to this many and scale every emitter's
+         * rate to keep it about full; zero keeps the scene's settings */
+        void SetParticleBudget(int particles) { particleBudget = particles; }
+
+        void Build(const SceneDescription &scene);
+
+        /* Add every actor whose mesh is ready, hand the school its
+         * obstacles, the batches their light and the receivers their
+         * caustics once they are built; returns how many actors were added
+         * or relit */
+        int AttachReady();
+
+        /* Every actor attached, the school's obstacles in place, the
+         * batches' light baked and the caustics atlas built */
+        bool IsComplete() const
+        {
+            return pending.empty() && obstacleMeshes.empty() && !lightingPending && !causticsPending;
+        }
+
+        vtkRenderer *GetRenderer() const { return renderer; }
+
+        size_t GetNumberOfInstances() const { return instances.size(); }
+
+        /* Actors handed to the renderer, one per draw call */
+        size_t GetNumberOfActors() const { return drawables.size(); }
+
+        /* Triangles at full detail */
+        DrawStats GetDrawStats() const;
+
+        /* Triangles at the levels of detail chosen last frame, whether or
+         * not culling then dropped them */
+        vtkIdType GetDrawnTriangles() const;
+
+        bool HasSchool() const { return !schoolMappers.empty(); }
+
+        /* True when something moves on its own every frame: the school,
+         * a swimming fish, particles or caustics */
+        bool IsAnimated() const { return HasSchool() || swimmers > 0 || particles || !causticsMappers.empty(); }
+        int  GetNumberOfFish() const { return (int)speciesById.size(); }
+        int  GetNumberOfParticles() const { return particles ? particles->GetNumberOfParticles() : 0; }
+
+        /* Null without a school; it runs from Build() until the scene goes */
+        Simulation *GetSimulation() const { return simulation.get(); }
+
+        /* Move the school's instances to where the simulation has them now */
+        void UpdateSchool();
+
+        /* Move the emitters with their anchors and step the particles by
+         * the time since the last call */
+        void UpdateParticles();
+
+        /* Everything that animates, and the controlled actors, once per
+         * frame before rendering; returns true while anything still moves */
+        bool Update();
+
+        /* Swap a reloaded mesh, which must be ready, into every mapper that
+         * draws it: batches holding it are baked again and, if it is
+         * scenery, the obstacle field rebuilt. Returns the actors reached. */
+        int ReplaceMesh(const std::string &fileName, const MeshLoader::MeshFuture &mesh);
+
+        /* What ApplyEdits() changed, and how many edits it can't apply:
+         * instances added, removed or changed in kind, mesh files moved,
+         * and any change to the school's size, the emitters, the caustics
+         * atlas's parameters or the fog. The caustics' direction, tile,
+         * colour and period are applied. */
+        struct EditStats
+        {
+            int materials;
+            int instances;
+            int ignored;
+        };
+
+        /* Apply the edits between the scene as built and a reloaded
+         * description of it, matching instances by their order */
+        EditStats ApplyEdits(const SceneDescription &scene);
+
+        /* Null when no instance has that name or it is drawn instanced or baked */
+        vtkActor *GetActor(const std::string &name) const;
+
+        /* Drives every instance marked "controlled", in scene order */
+        ActorControls &GetControls() { return controls; }
+
+        /* The matrix an actor placed as described would have */
+        static void ComputePlacement(const InstanceDescription &description, vtkMatrix4x4 *matrix);
+
+    private:
+        /* One actor and the meshes it waits on. A baked batch has one
+         * placement per mesh; anything else draws a single mesh as is,
+         * once per instance of its mapper. */
+        struct Drawable
+        {
+            std::vector<MeshLoader::MeshFuture>         meshes;
+            std::vector<std::string>                    files;   /* one per mesh */
+            std::vector<vtkSmartPointer<vtkMatrix4x4> > placements;
+            vtkSmartPointer<vtkPolyDataMapper>          mapper;
+            vtkSmartPointer<vtkActor>                   actor;
+            std::string                                 name;
+            int                                         copies;
+            bool                                        attached;
+        };
+
+        /* Drawn by drawables[drawable], as its instance or placement slot,
+         * or by an actor of its own when slot is negative */
+        struct Instance
+        {
+            InstanceDescription               description;
+            vtkSmartPointer<vtkCustomMapperP> mapper;
+            vtkSmartPointer<vtkActor>         actor;
+            size_t                            drawable;
+            int                               slot;
+        };
+
+        static void PlaceActor(vtkActor *actor, const InstanceDescription &description);
+
+        /* A phase in [0, 2 pi) that differs from one seed to the next */
+        static float SwimPhase(unsigned int seed);
+
+        /* Append a pending drawable with no meshes yet, returning its index */
+        size_t AddDrawable(vtkPolyDataMapper *mapper, vtkProperty *material, const std::string &name);
+        void   AddMesh(size_t drawable, const SceneDescription &scene, const std::string &mesh);
+
+        /* Hand a ready drawable's mesh and its levels, or its baked batch, to its mapper */
+        void SetMeshes(Drawable &drawable);
+
+        /* Gather the static instances' meshes and placements afresh for
+         * UpdateObstacles() */
+        void CollectObstacles();
+
+        void BuildSchool(const SceneDescription &scene);
+        void BuildParticles(const SceneDescription &scene);
+
+        /* Append a mesh's points, moved by placement if given, and its
+         * polygons split into triangles of nine floats each */
+        static void GatherTriangles(vtkPolyData *mesh, vtkMatrix4x4 *placement, std::vector<float> &points,
+                                    std::vector<float> &triangles);
+
+        /* Start building the obstacle field once its meshes are ready, and
+         * pass it on once built */
+        void UpdateObstacles();
+
+        /* Runs on its own thread; reads the field from the cache or builds
+         * and caches it */
+        static std::shared_ptr<const DistanceField> MakeObstacles(const std::vector<float> &triangles,
+                                                                  const float boundsMin[3], const float boundsMax[3],
+                                                                  const std::string &cacheDirectory);
+
+        /* Start baking the batches' light once they are all attached, and
+         * hand it to their mappers once baked; returns the batches relit */
+        int UpdateLighting();
+
+        /* Runs on its own thread; reads the light from the cache or bakes
+         * and caches it */
+        static std::shared_ptr<const LightBake> MakeLighting(const std::vector<float> &points,
+                                                             const std::vector<float> &normals,
+                                                             const std::vector<float> &triangles,
+                                                             const std::vector<LightBake::Light> &lights,
+                                                             int samples, const std::string &cacheDirectory);
+
+        /* Hand the receivers the caustics atlas once it is ready; returns
+         * the receivers lit */
+        int UpdateCaustics();
+
+        /* Merge a batch's meshes, each under its placement */
+        static vtkSmartPointer<vtkPolyData> Bake(const Drawable &drawable);
+
+        AssetRegistry        &registry;
+        vtkRenderer          *renderer;
+        SceneDescription      built;   /* with the edits applied since */
+        bool                  instancing;
+        bool                  bakeStatic;
+        bool                  bakeLighting;
+        int                   lightSamples;
+        bool                  levelOfDetail;
+        double                simulationRate;
+        std::vector<Instance> instances;
+        std::vector<Drawable> drawables;
+        ActorControls         controls;
+        std::vector<size_t>   pending;
+        int                   swimmers;
+        bool                  obstacleAvoidance;
+        bool                  quantizedMeshes;
+        bool                  shareMeshBuffers;
+        bool                  deterministic;
+        bool                  caustics;
+        double                schoolStart;   /* frame clock time the simulation clock counts from */
+
+        FishSchool                                        school;
+        std::unique_ptr<Simulation>                       simulation;
+        float                                             schoolScale;
+        std::vector<vtkSmartPointer<vtkInstancedMapper> > schoolMappers;   /* one per species */
+        std::vector<unsigned char>                        speciesById;
+        std::vector<int>                                  speciesCursor;
+
+        /* Static scenery for the school to avoid; emptied once the field
+         * is with the simulation */
+        struct ObstacleMesh
+        {
+            MeshLoader::MeshFuture        mesh;
+            vtkSmartPointer<vtkMatrix4x4> placement;
+        };
+        std::vector<ObstacleMesh>                          obstacleMeshes;
+        std::future<std::shared_ptr<const DistanceField> > obstacleField;
+        bool                                               obstaclesStale;   /* the field in progress is out of date */
+
+        /* Baked batches, and the light being baked for them from the
+         * meshes they were given last; pending until it is in place */
+        std::vector<size_t>                            bakedBatches;
+        std::future<std::shared_ptr<const LightBake> > lightBake;
+        bool                                           lightingPending;
+        bool                                           lightingStale;   /* the light in progress is out of date */
+
+        /* Instances lit by the caustics, and the atlas being built for
+         * them; pending until they have it */
+        std::vector<vtkSmartPointer<vtkInstancedMapper> > causticsMappers;
+        AssetRegistry::CausticsFuture                     causticsAtlas;
+        bool                                              causticsPending;
+
+        /* An emitter that follows an actor, at an offset in its frame */
+        struct Anchor
+        {
+            int                       emitter;
+            vtkSmartPointer<vtkActor> actor;
+            double                    offset[3];
+        };
+
+        int                                particleBudget;
+        std::unique_ptr<ParticleSystem>    particles;
+        vtkSmartPointer<vtkParticleMapper> particleMapper;
+        vtkSmartPointer<vtkActor>          particleActor;
+        std::vector<Anchor>                anchors;
+        double                             particleTime;   /* of the last step, negative before the first */
+};
+
+#endif
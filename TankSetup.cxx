@@ -0,0 +1,219 @@
+/*
+ * Setup shared by the executables that show the tank
+ */
+
+#include "TankSetup.h"
+
+#include <vtkCamera.h>
+#include <vtkCuller.h>
+#include <vtkCullerCollection.h>
+#include <vtkLight.h>
+#include <vtkRenderStepsPass.h>
+#include <vtkSmartPointer.h>
+
+#include <cstdlib>
+#include <vector>
+
+TankOptions::TankOptions()
+    : sceneFile("../Scenes/tank.json"), instancing(true), bakeStatic(false), bakeLighting(false),
+      lightSamples(LightBake::DEFAULT_SAMPLES), replicate(0),
+      fishCount(-1), simulationRate(120), culling(true), occlusion(false),
+      levelOfDetail(true), bloom(true), bloomResolution(0.5), bloomLevels(5), particles(0),
+      obstacles(true), quantize(false), caustics(true), fog(true)
+{
+}
+
+bool TankOptions::ParseArgument(int &i, int argc, char *argv[])
+{
+    int first = i;
+    std::string arg = argv[i];
+    if (arg == "--no-instancing")
+        instancing = false;
+    else if (arg == "--bake-static")
+        bakeStatic = true;
+    else if (arg == "--bake-lighting")
+        bakeStatic = bakeLighting = true;
+    else if (arg == "--bake-samples" && i + 1 < argc && atoi(argv[i + 1]) > 0)
+        lightSamples = atoi(argv[++i]);
+    else if (arg == "--replicate" && i + 1 < argc)
+        replicate = atoi(argv[++i]);
+    else if (arg == "--fish" && i + 1 < argc)
+        fishCount = atoi(argv[++i]);
+    else if (arg == "--sim-rate" && i + 1 < argc && atof(argv[i + 1]) > 0)
+        simulationRate = atof(argv[++i]);
+    else if (arg == "--no-culling")
+        culling = false;
+    else if (arg == "--occlusion")
+        occlusion = true;
+    else if (arg == "--no-lod")
+        levelOfDetail = false;
+    else if (arg == "--no-bloom")
+        bloom = false;
+    else if (arg == "--bloom-resolution" && i + 1 < argc && atof(argv[i + 1]) > 0)
+        bloomResolution = atof(argv[++i]);
+    else if (arg == "--bloom-levels" && i + 1 < argc && atoi(argv[i + 1]) > 0)
+        bloomLevels = atoi(argv[++i]);
+    else if (arg == "--particles" && i + 1 < argc && atoi(argv[i + 1]) >= 0)
+        particles = atoi(argv[++i]);
+    else if (arg == "--no-obstacles")
+        obstacles = false;
+    else if (arg == "--quantize")
+        quantize = true;
+    else if (arg == "--no-caustics")
+        caustics = false;
+    else if (arg == "--no-fog")
+        fog = false;
+    else if (arg.compare(0, 2, "--") != 0)
+        sceneFile = arg;
+    else
+        return false;
+    for (; first <= i; first++)
+        arguments.push_back(argv[first]);
+    return true;
+}
+
+bool TankOptions::ParseArguments(const std::vector<std::string> &list, std::string &error)
+{
+    std::vector<char *> argv;
+    for (size_t a = 0; a < list.size(); a++)
+        argv.push_back(const_cast<char *>(list[a].c_str()));
+    for (int i = 0; i < (int)argv.size(); i++)
+        if (!ParseArgument(i, (int)argv.size(), &argv[0]))
+        {
+            error = "unknown scene switch " + list[i];
+            return false;
+        }
+    return true;
+}
+
+const char *TankOptions::Usage()
+{
+    return "[--no-instancing] [--bake-static] [--bake-lighting] [--bake-samples N] [--replicate N]"
+           " [--fish N] [--sim-rate HZ] [--no-culling] [--occlusion] [--no-lod] [--no-bloom] [--bloom-resolution F]"
+           " [--bloom-levels N] [--particles N] [--no-obstacles] [--quantize] [--no-caustics]"
+           " [--no-fog] [scene.json]";
+}
+
+bool TankOptions::LoadDescription(SceneDescription &description, std::string &error) const
+{
+    if (!description.Load(sceneFile, error))
+        return false;
+
+    if (fishCount >= 0)
+    {
+        if (fishCount > 0 && description.school.species.empty())
+        {
+            error = sceneFile + " has no school to resize";
+            return false;
+        }
+        description.school.count = fishCount;
+    }
+    if (particles > 0 && description.particles.emitters.empty())
+    {
+        error = sceneFile + " has no particle emitters to resize";
+        return false;
+    }
+
+    /* Scaled-up scenes for measuring: more copies of the scenery, stacked
+     * back from the camera behind the original tank */
+    double behind[3] = { 0, 0, -40 };
+    description.Replicate(replicate, behind);
+    return true;
+}
+
+void TankOptions::Configure(TankScene &scene) const
+{
+    scene.SetInstancing(instancing);
+    scene.SetBakeStatic(bakeStatic);
+    scene.SetBakeLighting(bakeLighting);
+    scene.SetLightSamples(lightSamples);
+    scene.SetSimulationRate(simulationRate);
+    scene.SetLevelOfDetail(levelOfDetail);
+    scene.SetParticleBudget(particles);
+    scene.SetObstacleAvoidance(obstacles);
+    scene.SetQuantizedMeshes(quantize);
+    scene.SetCaustics(caustics);
+}
+
+vtkBVHCuller *TankOptions::InstallCuller(vtkRenderer *renderer) const
+{
+    if (!culling)
+        return NULL;
+
+    /* Collected first: the collection can't change while it's traversed */
+    std::vector<vtkCuller *> installed;
+    vtkCullerCollection *cullers = renderer->GetCullers();
+    cullers->InitTraversal();
+    for (vtkCuller *culler = cullers->GetNextItem(); culler; culler = cullers->GetNextItem())
+        installed.push_back(culler);
+    for (size_t i = 0; i < installed.size(); i++)
+        renderer->RemoveCuller(installed[i]);
+
+    vtkSmartPointer<vtkBVHCuller> culler = vtkSmartPointer<vtkBVHCuller>::New();
+    culler->SetOcclusionCulling(occlusion);
+    renderer->AddCuller(culler);
+    return culler;
+}
+
+vtkBloomPass *TankOptions::InstallPasses(vtkRenderer *renderer) const
+{
+    if (!bloom)
+        return NULL;
+
+    vtkSmartPointer<vtkRenderStepsPass> steps = vtkSmartPointer<vtkRenderStepsPass>::New();
+    vtkSmartPointer<vtkBloomPass> pass = vtkSmartPointer<vtkBloomPass>::New();
+    pass->SetDelegatePass(steps);
+    pass->SetResolution(bloomResolution);
+    pass->SetLevels(bloomLevels);
+    renderer->SetPass(pass);
+    return pass;
+}
+
+/* Beneath bloom, so that what the fog hides doesn't glow */
+vtkFogPass *TankOptions::InstallFog(vtkRenderer *renderer, const WaterDescription &water) const
+{
+    if (!fog || !water.fog)
+        return NULL;
+
+    vtkSmartPointer<vtkFogPass> pass = vtkSmartPointer<vtkFogPass>::New();
+    pass->SetColor(water.fogColor);
+    pass->SetExtinction(water.extinction);
+    pass->SetStart(water.fogStart);
+    if (vtkBloomPass *bloom = dynamic_cast<vtkBloomPass *>(renderer->GetPass()))
+    {
+        pass->SetDelegatePass(bloom->GetDelegatePass());
+        bloom->SetDelegatePass(pass);
+    }
+    else
+    {
+        vtkSmartPointer<vtkRenderStepsPass> steps = vtkSmartPointer<vtkRenderStepsPass>::New();
+        pass->SetDelegatePass(steps);
+        renderer->SetPass(pass);
+    }
+    return pass;
+}
+
+void SetupTankView(vtkRenderer *renderer)
+{
+    renderer->SetBackground(0, 0, 0);
+    renderer->SetViewport(0, 0, 1, 1);
+
+    vtkCamera *camera = renderer->GetActiveCamera();
+    camera->SetFocalPoint(0, 0, 0);
+    camera->SetPosition(0, 0, 70);
+    camera->SetViewUp(0, 1, 0);
+    camera->SetClippingRange(20, 120);
+    camera->SetDistance(170);
+
+    renderer->RemoveAllLights();
+    vtkSmartPointer<vtkLight> key = vtkSmartPointer<vtkLight>::New();
+    key->SetAmbientColor(0.15, 0.15, 0.15);
+    key->SetPosition(0.0, 1.5, 1.0);
+    key->SetFocalPoint(0, 0, 0);
+    vtkSmartPointer<vtkLight> fill = vtkSmartPointer<vtkLight>::New();
+    fill->SetAmbientColor(0.0, 0.0, 0.5);
+    fill->SetPosition(0.0, 0.0, 9.9);
+    fill->SetFocalPoint(0, 0, 0);
+    renderer->AddLight(key);
+    renderer->AddLight(fill);
+}
@@ -0,0 +1,88 @@
+/*
+ * Setup shared by the executables that show the tank
+ *
+ * TankOptions holds the command-line switches that shape the scene and
+ * turns them into a scene description and a configured TankScene, so the
+ * interactive app and the benchmark render the same tank from the same
+ * flags. SetupTankView() gives a renderer the tank's camera and lights.
+ * InstallPasses() sets up the renderer's passes, with or without bloom,
+ * and InstallFog() adds the scene's fog beneath them.
+ */
+
+#ifndef FISHTANK_TANKSETUP_H
+#define FISHTANK_TANKSETUP_H
+
+#include "SceneDescription.h"
+#include "TankScene.h"
+#include "vtkBVHCuller.h"
+#include "vtkBloomPass.h"
+#include "vtkFogPass.h"
+
+#include <vtkRenderer.h>
+
+#include <string>
+#include <vector>
+
+struct TankOptions
+{
+    TankOptions();
+
+    std::string sceneFile;
+    bool        instancing;
+    bool        bakeStatic;
+    bool        bakeLighting;     /* bakes the static scenery too */
+    int         lightSamples;     /* occlusion rays per vertex when baking light */
+    int         replicate;
+    int         fishCount;        /* negative keeps the scene's own count */
+    double      simulationRate;
+    bool        culling;
+    bool        occlusion;
+    bool        levelOfDetail;
+    bool        bloom;
+    double      bloomResolution;  /* first blur level, as a fraction of the window */
+    int         bloomLevels;
+    int         particles;        /* pool size; zero keeps the scene's */
+    bool        obstacles;        /* school steers around the static scenery */
+    bool        quantize;         /* instanced meshes as 16-bit positions and normals */
+    bool        caustics;         /* when the scene's water has them */
+    bool        fog;              /* likewise */
+
+    /* Every argument parsed so far, values included, in order */
+    std::vector<std::string> arguments;
+
+    /* Consume argv[i], and its value if it takes one, when it is one of the
+     * scene switches or a scene file; returns false for anything else */
+    bool ParseArgument(int &i, int argc, char *argv[]);
+
+    /* The same for a whole list, such as one saved in a replay log;
+     * returns false, naming it in error, at the first it doesn't take */
+    bool ParseArguments(const std::vector<std::string> &list, std::string &error);
+
+    /* The scene switches, for usage messages */
+    static const char *Usage();
+
+    /* Load the scene file and apply the fish count and replication */
+    bool LoadDescription(SceneDescription &description, std::string &error) const;
+
+    /* Must be called before the scene's Build() */
+    void Configure(TankScene &scene) const;
+
+    /* Swap the renderer's cullers for a BVH culler, unless culling is
+     * off; returns the culler or null */
+    vtkBVHCuller *InstallCuller(vtkRenderer *renderer) const;
+
+    /* Render through a bloom pass, unless bloom is off; returns the pass
+     * or null. Its graphics resources must be released before exit. */
+    vtkBloomPass *InstallPasses(vtkRenderer *renderer) const;
+
+    /* Render the scene through a fog pass, beneath the bloom pass if
+     * InstallPasses() set one, unless fog is off or the water has none;
+     * returns the pass or null. When it is the renderer's own pass its
+     * graphics resources must be released before exit. */
+    vtkFogPass *InstallFog(vtkRenderer *renderer, const WaterDescription &water) const;
+};
+
+/* Background, camera and the tank's two lights */
+void SetupTankView(vtkRenderer *renderer);
+
+#endif
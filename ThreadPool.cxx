@@ -0,0 +1,49 @@
+/*
+ * Fixed-size worker pool used for loading and other background work.
+ */
+
+#include "ThreadPool.h"
+
+#include "Profiler.h"
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+{
+    stopping = false;
+    if (threadCount == 0)
+        threadCount = std::thread::hardware_concurrency();
+    if (threadCount == 0)
+        threadCount = 2;
+    for (unsigned int i = 0; i < threadCount; i++)
+        workers.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+}
+
+/* Drains the queue before joining, so every future handed out is satisfied */
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+}
+
+void ThreadPool::WorkerLoop()
+{
+    Profiler::Get().SetThreadName("worker");
+    for (;;)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!stopping && jobs.empty())
+                wake.wait(lock);
+            if (jobs.empty())
+                return;
+            job = jobs.front();
+            jobs.pop_front();
+        }
+        job();
+    }
+}
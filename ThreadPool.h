@@ -0,0 +1,57 @@
+/*
+ * Fixed-size worker pool used for loading and other background work.
+ *
+ * Jobs are queued FIFO and picked up by whichever worker is free;
+ * Submit() hands back a std::future for the job's result.
+ */
+
+#ifndef FISHTANK_THREADPOOL_H
+#define FISHTANK_THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+    public:
+        /* A thread count of 0 picks one worker per hardware thread */
+        explicit ThreadPool(unsigned int threadCount = 0);
+        ~ThreadPool();
+
+        unsigned int GetNumberOfThreads() const { return (unsigned int)workers.size(); }
+
+        template <typename F>
+        std::future<typename std::result_of<F()>::type> Submit(F job)
+        {
+            typedef typename std::result_of<F()>::type Result;
+            std::shared_ptr<std::packaged_task<Result()> > task =
+                std::make_shared<std::packaged_task<Result()> >(job);
+            std::future<Result> result = task->get_future();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                jobs.push_back([task]() { (*task)(); });
+            }
+            wake.notify_one();
+            return result;
+        }
+
+    private:
+        ThreadPool(const ThreadPool &);
+        ThreadPool &operator=(const ThreadPool &);
+
+        void WorkerLoop();
+
+        std::vector<std::thread>           workers;
+        std::deque<std::function<void()> > jobs;
+        std::mutex                         mutex;
+        std::condition_variable            wake;
+        bool                               stopping;
+};
+
+#endif
@@ -0,0 +1,60 @@
+/*
+ * Lock-free triple buffer
+ *
+ * Hands the newest value from one writer thread to one reader thread
+ * without either ever waiting. The writer fills its back slot and
+ * publishes it by swapping it with the spare; the reader swaps the spare
+ * for its front slot whenever a fresher one is waiting. Values the reader
+ * was too slow to see are simply overwritten.
+ */
+
+#ifndef FISHTANK_TRIPLEBUFFER_H
+#define FISHTANK_TRIPLEBUFFER_H
+
+#include <atomic>
+
+template <typename T>
+class TripleBuffer
+{
+    public:
+        TripleBuffer() : spare(1), back(0), front(2) {}
+
+        /* Writer: the slot to fill next, then Publish() it */
+        T &GetWriteBuffer() { return slots[back]; }
+
+        void Publish()
+        {
+            back = spare.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+        }
+
+        /* Reader: whether a value newer than the front slot is waiting; if
+         * so the next Update() will take it */
+        bool HasUpdate() const { return (spare.load(std::memory_order_relaxed) & FRESH) != 0; }
+
+        /* Reader: take the newest published value, if there is one since
+         * the last call; returns whether the front slot changed */
+        bool Update()
+        {
+            if (!HasUpdate())
+                return false;
+            front = spare.exchange(front, std::memory_order_acq_rel) & INDEX;
+            return true;
+        }
+
+        /* Reader: the value taken by the last successful Update(), which
+         * the reader may modify until its next Update() */
+        T &GetReadBuffer() { return slots[front]; }
+
+    private:
+        enum { INDEX = 3, FRESH = 4 };
+
+        TripleBuffer(const TripleBuffer &);
+        TripleBuffer &operator=(const TripleBuffer &);
+
+        T                slots[3];
+        std::atomic<int> spare;   /* slot index, plus FRESH once published */
+        int              back;    /* owned by the writer */
+        int              front;   /* owned by the reader */
+};
+
+#endif
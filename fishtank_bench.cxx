@@ -0,0 +1,407 @@
+/*
+ * Frame time benchmark
+ *
+ * Loads the tank as the app does, renders it offscreen while a scripted
+ * camera path plays over a fixed number of frames, and reports the
+ * min/avg/p50/p99/max frame times at each requested resolution as JSON on
+ * stdout. Frame n of N always shows the path at the same point, however
+ * fast the machine, so runs are comparable.
+ *
+ * Usage: fishtank_bench [scene switches] [--frames N] [--warmup N]
+ *                       [--size W H]... [--path camera.json] [--max-p99 MS]
+ *                       [--replay log [--realtime]]
+ *
+ * With bloom on, each resolution also reports the GPU time of each bloom
+ * stage, averaged over the frames whose timer queries had come back, and
+ * with fog on the fog pass's GPU time likewise. Comparing runs with
+ * --replicate N and with --no-caustics or --no-fog shows what the water
+ * costs and that it doesn't grow with the scene.
+ *
+ * With --replay a log recorded by fishtank --record drives the frames
+ * instead of the camera path: the scene is built from the log's switches
+ * and seeds (switches given here come after, so they can change it), and
+ * each frame shows the recorded moment, camera and key input, as fast as
+ * it renders or, with --realtime, at the pace it was recorded. Replays
+ * render at one size, the log's unless --size is given, and also report
+ * the slowest frames by index, so that a stutter can be found again.
+ *
+ * With --max-p99 the exit status is non-zero when any resolution's p99
+ * frame time goes over the budget. On CPU-only machines run it under Mesa
+ * llvmpipe (LIBGL_ALWAYS_SOFTWARE=1); without a display, VTK must be built
+ * with OSMesa or EGL offscreen support.
+ */
+
+#include "AssetRegistry.h"
+#include "CameraPath.h"
+#include "JSON.h"
+#include "MeshLoader.h"
+#include "Profiler.h"
+#include "ProfilerOverlay.h"
+#include "ReplayLog.h"
+#include "TankScene.h"
+#include "TankSetup.h"
+
+#include <vtkCamera.h>
+#include <vtkRenderWindow.h>
+#include <vtkRenderer.h>
+#include <vtkSmartPointer.h>
+#include <vtk_glew.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace
+{
+/* GPU times kept per frame: each bloom stage's, then the fog's */
+const int FOG_SLOT   = vtkBloomPass::STAGE_COUNT;
+const int PASS_SLOTS = FOG_SLOT + 1;
+
+struct Result
+{
+    int    width;
+    int    height;
+    double minMs;
+    double avgMs;
+    double p50Ms;
+    double p99Ms;
+    double maxMs;
+    double drawn;           /* props per frame, on average, with culling on */
+    double frustumCulled;
+    double occluded;
+    double triangles;       /* per frame, on average, after level of detail */
+    double particles;       /* alive per frame, on average */
+    double passMs[PASS_SLOTS];   /* GPU time, negative when unknown */
+    std::vector<std::pair<int, double> > slowest;   /* replays: frame index and time, slowest first */
+};
+
+/* Replays report this many of their slowest frames */
+const size_t SLOWEST_FRAMES = 5;
+
+/* Nearest-rank percentile of sorted times */
+double Percentile(const std::vector<double> &sorted, double percent)
+{
+    size_t rank = (size_t)std::ceil(percent / 100 * sorted.size());
+    return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+/* One frame as the app draws it: school posed and particles stepped, then
+ * a full render. The finish makes the time include the GPU's work, not
+ * just its submission. */
+double RenderFrame(vtkRenderWindow *window, TankScene &scene)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    scene.Update();
+    window->Render();
+    glFinish();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/* Counters for the frame just drawn, averaged over frames */
+void Accumulate(Result &result, TankScene &scene, vtkBVHCuller *culler, vtkBloomPass *bloom, vtkFogPass *fog,
+                int frames, double passTotals[], int passFrames[])
+{
+    result.triangles += (double)scene.GetDrawnTriangles() / frames;
+    result.particles += (double)scene.GetNumberOfParticles() / frames;
+    if (culler)
+    {
+        vtkBVHCuller::Stats stats = culler->GetLastStats();
+        result.drawn         += (double)stats.drawn / frames;
+        result.frustumCulled += (double)stats.frustumCulled / frames;
+        result.occluded      += (double)stats.occluded / frames;
+    }
+    for (int stage = 0; bloom && stage < vtkBloomPass::STAGE_COUNT; stage++)
+        if (bloom->GetStageTime(stage) >= 0)
+        {
+            passTotals[stage] += bloom->GetStageTime(stage);
+            passFrames[stage]++;
+        }
+    if (fog && fog->GetTime() >= 0)
+    {
+        passTotals[FOG_SLOT] += fog->GetTime();
+        passFrames[FOG_SLOT]++;
+    }
+}
+
+void Summarize(Result &result, vtkRenderWindow *window, std::vector<double> times, const double passTotals[],
+               const int passFrames[])
+{
+    for (int slot = 0; slot < PASS_SLOTS; slot++)
+        result.passMs[slot] = passFrames[slot] ? passTotals[slot] / passFrames[slot] : -1;
+    std::sort(times.begin(), times.end());
+
+    int *size = window->GetSize();
+    result.width  = size[0];
+    result.height = size[1];
+    double total = 0;
+    for (size_t i = 0; i < times.size(); i++)
+        total += times[i];
+    result.minMs = times.front();
+    result.avgMs = total / times.size();
+    result.p50Ms = Percentile(times, 50);
+    result.p99Ms = Percentile(times, 99);
+    result.maxMs = times.back();
+}
+
+Result Measure(vtkRenderWindow *window, vtkRenderer *renderer, TankScene &scene, vtkBVHCuller *culler,
+               vtkBloomPass *bloom, vtkFogPass *fog, const CameraPath &path, int frames, int warmup)
+{
+    Result result;
+    result.drawn = result.frustumCulled = result.occluded = result.triangles = result.particles = 0;
+    double passTotals[PASS_SLOTS] = { 0 };
+    int    passFrames[PASS_SLOTS] = { 0 };
+    vtkCamera *camera = renderer->GetActiveCamera();
+    path.Apply(0, camera);
+    for (int i = 0; i < warmup; i++)
+        RenderFrame(window, scene);
+
+    std::vector<double> times;
+    times.reserve(frames);
+    for (int i = 0; i < frames; i++)
+    {
+        path.Apply(path.GetDuration() * i / std::max(frames - 1, 1), camera);
+        times.push_back(RenderFrame(window, scene));
+        Accumulate(result, scene, culler, bloom, fog, frames, passTotals, passFrames);
+    }
+    Summarize(result, window, times, passTotals, passFrames);
+    return result;
+}
+
+/* Each frame at its recorded moment, the frame clock pinned there; the
+ * warm-up frames redraw the first moment, which moves nothing */
+Result MeasureReplay(vtkRenderWindow *window, vtkRenderer *renderer, TankScene &scene, vtkBVHCuller *culler,
+                     vtkBloomPass *bloom, vtkFogPass *fog, const ReplayLog &log, int warmup, bool realtime)
+{
+    Result result;
+    result.drawn = result.frustumCulled = result.occluded = result.triangles = result.particles = 0;
+    double passTotals[PASS_SLOTS] = { 0 };
+    int    passFrames[PASS_SLOTS] = { 0 };
+    vtkCamera *camera = renderer->GetActiveCamera();
+    const std::vector<ReplayLog::Frame> &recorded = log.GetFrames();
+    int frames = (int)recorded.size();
+    FrameClock::Get().Pin(recorded[0].time);
+    ReplayLog::ApplyCamera(recorded[0].camera, camera);
+    for (int i = 0; i < warmup; i++)
+        RenderFrame(window, scene);
+
+    std::vector<double> times;
+    times.reserve(frames);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; i++)
+    {
+        const ReplayLog::Frame &frame = recorded[i];
+        if (realtime)
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(frame.time - recorded[0].time)));
+        FrameClock::Get().Pin(frame.time);
+        for (size_t c = 0; c < frame.commands.size(); c++)
+            scene.GetControls().Submit(frame.commands[c]);
+        ReplayLog::ApplyCamera(frame.camera, camera);
+        times.push_back(RenderFrame(window, scene));
+        Accumulate(result, scene, culler, bloom, fog, frames, passTotals, passFrames);
+    }
+
+    for (int i = 0; i < frames; i++)
+        result.slowest.push_back(std::make_pair(i, times[i]));
+    size_t kept = std::min(SLOWEST_FRAMES, result.slowest.size());
+    std::partial_sort(result.slowest.begin(), result.slowest.begin() + kept, result.slowest.end(),
+                      [](const std::pair<int, double> &a, const std::pair<int, double> &b) {
+                          return a.second > b.second;
+                      });
+    result.slowest.resize(kept);
+    Summarize(result, window, times, passTotals, passFrames);
+    return result;
+}
+
+const char *GLString(GLenum name)
+{
+    const char *text = (const char *)glGetString(name);
+    return text ? text : "unknown";
+}
+}
+
+int main(int argc, char *argv[])
+{
+    TankOptions options;
+    int frames = 600;
+    int warmup = 30;
+    double maxP99 = 0;
+    std::string pathFile = "../Scenes/bench_path.json";
+    std::string replayFile;
+    bool realtime = false;
+    std::vector<std::pair<int, int> > sizes;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--frames" && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            frames = atoi(argv[++i]);
+        else if (arg == "--warmup" && i + 1 < argc)
+            warmup = atoi(argv[++i]);
+        else if (arg == "--size" && i + 2 < argc && atoi(argv[i + 1]) > 0 && atoi(argv[i + 2]) > 0)
+        {
+            sizes.push_back(std::make_pair(atoi(argv[i + 1]), atoi(argv[i + 2])));
+            i += 2;
+        }
+        else if (arg == "--path" && i + 1 < argc)
+            pathFile = argv[++i];
+        else if (arg == "--max-p99" && i + 1 < argc)
+            maxP99 = atof(argv[++i]);
+        else if (arg == "--replay" && i + 1 < argc)
+            replayFile = argv[++i];
+        else if (arg == "--realtime")
+            realtime = true;
+        else if (!options.ParseArgument(i, argc, argv))
+        {
+            std::cerr << "usage: " << argv[0] << " " << TankOptions::Usage()
+                      << " [--frames N] [--warmup N] [--size W H]... [--path camera.json] [--max-p99 MS]"
+                      << " [--replay log [--realtime]]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* A replay's scene is the log's, then whatever was switched here */
+    ReplayLog   log;
+    std::string error;
+    bool        replaying = !replayFile.empty();
+    if (replaying)
+    {
+        TankOptions recorded;
+        if (!log.Load(replayFile, error) || !recorded.ParseArguments(log.GetSettings().arguments, error)
+            || !recorded.ParseArguments(options.arguments, error))
+        {
+            std::cerr << "fishtank_bench: " << error << std::endl;
+            return EXIT_FAILURE;
+        }
+        options = recorded;
+        frames  = (int)log.GetFrames().size();
+        if (sizes.size() > 1)
+            std::cerr << "[bench] a replay renders at one size; using the first" << std::endl;
+        if (sizes.empty() && log.GetSettings().width > 0 && log.GetSettings().height > 0)
+            sizes.push_back(std::make_pair(log.GetSettings().width, log.GetSettings().height));
+        sizes.resize(std::min<size_t>(sizes.size(), 1));
+    }
+    if (sizes.empty())
+        sizes.push_back(std::make_pair(1280, 720));
+
+    SceneDescription description;
+    CameraPath path;
+    if (!options.LoadDescription(description, error) || (!replaying && !path.Load(pathFile, error)))
+    {
+        std::cerr << "fishtank_bench: " << error << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (replaying)
+    {
+        description.school.seed    = log.GetSettings().schoolSeed;
+        description.particles.seed = log.GetSettings().particleSeed;
+    }
+
+    MeshLoader    loader("meshcache");
+    AssetRegistry registry(loader);
+
+    /* Lit before loading, since baked lighting is baked from the lights */
+    vtkSmartPointer<vtkRenderer> renderer = vtkSmartPointer<vtkRenderer>::New();
+    SetupTankView(renderer);
+    TankScene scene(registry, renderer);
+    options.Configure(scene);
+    if (replaying)
+    {
+        /* The school's clock starts at the first recorded moment */
+        scene.SetDeterministic(true);
+        FrameClock::Get().Pin(log.GetFrames()[0].time);
+    }
+    scene.Build(description);
+
+    /* Everything is measured fully loaded */
+    while (!scene.IsComplete())
+    {
+        scene.AttachReady();
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+
+    vtkSmartPointer<vtkRenderWindow> window = vtkSmartPointer<vtkRenderWindow>::New();
+    window->SetOffScreenRendering(1);
+    window->AddRenderer(renderer);
+    vtkBVHCuller *culler = options.InstallCuller(renderer);
+    vtkBloomPass *bloom  = options.InstallPasses(renderer);
+    vtkFogPass   *fog    = options.InstallFog(renderer, description.water);
+
+    /* Hidden, but it ticks the frame clock the mappers animate by */
+    ProfilerOverlay overlay(window, renderer);
+
+    std::vector<Result> results;
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        window->SetSize(sizes[i].first, sizes[i].second);
+        if (replaying)
+            results.push_back(MeasureReplay(window, renderer, scene, culler, bloom, fog, log, warmup, realtime));
+        else
+            results.push_back(Measure(window, renderer, scene, culler, bloom, fog, path, frames, warmup));
+    }
+
+    TankScene::DrawStats stats = scene.GetDrawStats();
+    std::cout << "{" << std::endl;
+    std::cout << "  \"scene\": " << JSONValue::Quote(options.sceneFile)
+              << (replaying ? ", \"replay\": " : ", \"path\": ") << JSONValue::Quote(replaying ? replayFile : pathFile)
+              << ", \"frames\": " << frames << ", \"warmup\": " << warmup << "," << std::endl;
+    std::cout << "  \"renderer\": " << JSONValue::Quote(GLString(GL_RENDERER))
+              << ", \"gl_version\": " << JSONValue::Quote(GLString(GL_VERSION)) << "," << std::endl;
+    std::cout << "  \"instances\": " << scene.GetNumberOfInstances() << ", \"fish\": " << scene.GetNumberOfFish()
+              << ", \"draw_calls\": " << stats.drawCalls << ", \"triangles\": " << stats.triangles << ","
+              << std::endl;
+    std::cout << "  \"results\": [" << std::endl;
+    bool overBudget = false;
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Result &r = results[i];
+        std::cout << "    { \"width\": " << r.width << ", \"height\": " << r.height
+                  << ", \"min_ms\": " << r.minMs << ", \"avg_ms\": " << r.avgMs
+                  << ", \"p50_ms\": " << r.p50Ms << ", \"p99_ms\": " << r.p99Ms
+                  << ", \"max_ms\": " << r.maxMs << ", \"fps\": " << (r.avgMs > 0 ? 1000 / r.avgMs : 0)
+                  << ", \"triangles_drawn\": " << r.triangles << ", \"particles\": " << r.particles;
+        if (culler)
+            std::cout << ", \"drawn\": " << r.drawn << ", \"frustum_culled\": " << r.frustumCulled
+                      << ", \"occluded\": " << r.occluded;
+        if (bloom && r.passMs[0] >= 0)
+        {
+            std::cout << ", \"passes\": {";
+            for (int stage = 0; stage < vtkBloomPass::STAGE_COUNT; stage++)
+                std::cout << (stage ? ", " : " ") << JSONValue::Quote(vtkBloomPass::GetStageName(stage))
+                          << ": " << r.passMs[stage];
+            std::cout << " }";
+        }
+        if (fog && r.passMs[FOG_SLOT] >= 0)
+            std::cout << ", \"fog_ms\": " << r.passMs[FOG_SLOT];
+        if (!r.slowest.empty())
+        {
+            std::cout << ", \"slowest\": [";
+            for (size_t f = 0; f < r.slowest.size(); f++)
+                std::cout << (f ? ", " : " ") << "{ \"frame\": " << r.slowest[f].first
+                          << ", \"ms\": " << r.slowest[f].second << " }";
+            std::cout << " ]";
+        }
+        std::cout << " }" << (i + 1 < results.size() ? "," : "") << std::endl;
+        if (maxP99 > 0 && r.p99Ms > maxP99)
+        {
+            std::cerr << "[bench] " << r.width << "x" << r.height << ": p99 " << r.p99Ms
+                      << " ms is over the " << maxP99 << " ms budget" << std::endl;
+            overBudget = true;
+        }
+    }
+    std::cout << "  ]" << std::endl;
+    std::cout << "}" << std::endl;
+
+    if (culler)
+        culler->ReleaseGraphicsResources(window);
+    if (bloom)
+        bloom->ReleaseGraphicsResources(window);
+    else if (fog)
+        fog->ReleaseGraphicsResources(window);
+    return overBudget ? EXIT_FAILURE : EXIT_SUCCESS;
+}
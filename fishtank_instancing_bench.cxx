@@ -0,0 +1,196 @@
+/*
+ * Instancing benchmark
+ *
+ * Renders a field of leaves offscreen twice, once with an actor and
+ * vtkCustomMapperP per leaf and once through a single vtkInstancedMapper,
+ * and reports the mean frame time of each path as JSON on stdout.
+ *
+ * Usage: fishtank_instancing_bench [--count N] [--frames F] [--mesh file.obj]
+ *                                  [--size W H]
+ *
+ * On CPU-only machines run it under Mesa llvmpipe (LIBGL_ALWAYS_SOFTWARE=1).
+ */
+
+#include "JSON.h"
+#include "MeshLoader.h"
+#include "TankScene.h"
+#include "vtkCustomMapper.h"
+#include "vtkInstancedMapper.h"
+
+#include <vtkCamera.h>
+#include <vtkMatrix4x4.h>
+#include <vtkProperty.h>
+#include <vtkRenderWindow.h>
+#include <vtkRenderer.h>
+#include <vtkSmartPointer.h>
+#include <vtk_glew.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+struct Result
+{
+    double firstFrameMs;
+    double meanMs;
+    double minMs;
+};
+
+/* Leaves on a square grid, each turned and tinted a little differently */
+InstanceDescription LeafPlacement(int index, int count, double color[3])
+{
+    int side = (int)std::ceil(std::sqrt((double)count));
+    InstanceDescription leaf;
+    leaf.position[0] = (index % side - side * 0.5) * 2.5;
+    leaf.position[1] = 0;
+    leaf.position[2] = (index / side - side * 0.5) * 2.5;
+    leaf.scale[0] = leaf.scale[1] = leaf.scale[2] = 1.0 + (index % 7) * 0.1;
+    leaf.rotation[0] = leaf.rotation[2] = 0;
+    leaf.rotation[1] = (index * 37) % 360;
+    color[0] = 0.0;
+    color[1] = 0.5 + (index % 5) * 0.1;
+    color[2] = (index % 3) * 0.1;
+    return leaf;
+}
+
+Result TimeFrames(vtkRenderWindow *window, int frames)
+{
+    Result result;
+    std::vector<double> times;
+    for (int i = 0; i <= frames; i++)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        window->Render();
+        glFinish();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (i == 0)
+            result.firstFrameMs = ms;   /* includes buffer uploads */
+        else
+            times.push_back(ms);
+    }
+    double total = 0;
+    for (size_t i = 0; i < times.size(); i++)
+        total += times[i];
+    result.meanMs = times.empty() ? 0 : total / times.size();
+    result.minMs  = times.empty() ? 0 : *std::min_element(times.begin(), times.end());
+    return result;
+}
+
+vtkSmartPointer<vtkRenderWindow> MakeWindow(vtkRenderer *renderer, int width, int height)
+{
+    vtkSmartPointer<vtkRenderWindow> window = vtkSmartPointer<vtkRenderWindow>::New();
+    window->SetOffScreenRendering(1);
+    window->SetSize(width, height);
+    window->AddRenderer(renderer);
+    renderer->SetBackground(0, 0, 0);
+    renderer->GetActiveCamera()->SetPosition(0, 60, 120);
+    renderer->GetActiveCamera()->SetFocalPoint(0, 0, 0);
+    return window;
+}
+
+void PrintResult(const char *name, const Result &result, bool last)
+{
+    std::cout << "  \"" << name << "\": { \"first_frame_ms\": " << result.firstFrameMs
+              << ", \"mean_ms\": " << result.meanMs << ", \"min_ms\": " << result.minMs
+              << " }" << (last ? "" : ",") << std::endl;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    int count  = 10000;
+    int frames = 100;
+    int width  = 1280;
+    int height = 720;
+    std::string meshFile = "../Models/obj/leaf1.obj";
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--count" && i + 1 < argc)
+            count = atoi(argv[++i]);
+        else if (arg == "--frames" && i + 1 < argc)
+            frames = atoi(argv[++i]);
+        else if (arg == "--mesh" && i + 1 < argc)
+            meshFile = argv[++i];
+        else if (arg == "--size" && i + 2 < argc)
+        {
+            width  = atoi(argv[++i]);
+            height = atoi(argv[++i]);
+        }
+        else
+        {
+            std::cerr << "usage: " << argv[0]
+                      << " [--count N] [--frames F] [--mesh file.obj] [--size W H]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    MeshLoader loader("meshcache", 1);
+    vtkSmartPointer<vtkPolyData> mesh = loader.Load(meshFile).get().front();
+    if (mesh->GetNumberOfPoints() == 0)
+        return EXIT_FAILURE;
+
+    vtkSmartPointer<vtkProperty> leafProp = vtkSmartPointer<vtkProperty>::New();
+
+    /* Per-actor path: one mapper, actor and property per leaf */
+    Result perActor;
+    {
+        vtkSmartPointer<vtkRenderer> renderer = vtkSmartPointer<vtkRenderer>::New();
+        vtkSmartPointer<vtkRenderWindow> window = MakeWindow(renderer, width, height);
+        for (int i = 0; i < count; i++)
+        {
+            double color[3];
+            InstanceDescription leaf = LeafPlacement(i, count, color);
+            vtkSmartPointer<vtkCustomMapperP> mapper = vtkSmartPointer<vtkCustomMapperP>::New();
+            mapper->SetInputData(mesh);
+            vtkSmartPointer<vtkActor> actor = vtkSmartPointer<vtkActor>::New();
+            actor->SetMapper(mapper);
+            actor->GetProperty()->SetDiffuseColor(color);
+            vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+            TankScene::ComputePlacement(leaf, matrix);
+            actor->SetUserMatrix(matrix);
+            renderer->AddActor(actor);
+        }
+        renderer->ResetCameraClippingRange();
+        perActor = TimeFrames(window, frames);
+    }
+
+    /* Instanced path: the same leaves in one draw call */
+    Result instanced;
+    {
+        vtkSmartPointer<vtkRenderer> renderer = vtkSmartPointer<vtkRenderer>::New();
+        vtkSmartPointer<vtkRenderWindow> window = MakeWindow(renderer, width, height);
+        vtkSmartPointer<vtkInstancedMapper> mapper = vtkSmartPointer<vtkInstancedMapper>::New();
+        mapper->SetInputData(mesh);
+        for (int i = 0; i < count; i++)
+        {
+            double color[3];
+            InstanceDescription leaf = LeafPlacement(i, count, color);
+            vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+            TankScene::ComputePlacement(leaf, matrix);
+            mapper->AddInstance(matrix, color);
+        }
+        vtkSmartPointer<vtkActor> actor = vtkSmartPointer<vtkActor>::New();
+        actor->SetMapper(mapper);
+        actor->SetProperty(leafProp);
+        renderer->AddActor(actor);
+        renderer->ResetCameraClippingRange();
+        instanced = TimeFrames(window, frames);
+    }
+
+    std::cout << "{" << std::endl;
+    std::cout << "  \"mesh\": " << JSONValue::Quote(meshFile) << ", \"instances\": " << count
+              << ", \"frames\": " << frames << ", \"width\": " << width
+              << ", \"height\": " << height << "," << std::endl;
+    PrintResult("per_actor", perActor, false);
+    PrintResult("instanced", instanced, false);
+    std::cout << "  \"speedup\": " << (instanced.meanMs > 0 ? perActor.meanMs / instanced.meanMs : 0) << std::endl;
+    std::cout << "}" << std::endl;
+    return EXIT_SUCCESS;
+}
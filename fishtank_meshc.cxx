@@ -0,0 +1,108 @@
+/*
+ * Mesh cache converter
+ *
+ * Build-time tool that parses .obj models and writes their binary cache
+ * entries, levels of detail included, so deployed installs never parse the
+ * ASCII files or decimate.
+ *
+ * For each model it prints vertices, ACMR and GPU bytes as the reader
+ * leaves the mesh and after MeshOptimizer, with the bytes it would take
+ * quantized.
+ *
+ * Scene files given as well have their caustics atlases built into the
+ * same directory, so the app reads them back rather than building them at
+ * startup.
+ *
+ * Usage: fishtank_meshc <cache-dir> <model.obj | scene.json>...
+ * Entries are keyed by path minus any leading ./ and ../, so converting
+ * Models/obj/fish1.obj from the source tree serves the app's
+ * ../Models/obj/fish1.obj when it runs from build/.
+ */
+
+#include "AssetRegistry.h"
+#include "MeshLoader.h"
+#include "MeshOptimizer.h"
+#include "SceneDescription.h"
+#include "ThreadPool.h"
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        std::cerr << "usage: " << argv[0] << " <cache-dir> <model.obj | scene.json>..." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::string> models, scenes;
+    for (int i = 2; i < argc; i++)
+    {
+        std::string fileName = argv[i];
+        bool scene = fileName.size() > 5 && fileName.compare(fileName.size() - 5, 5, ".json") == 0;
+        (scene ? scenes : models).push_back(fileName);
+    }
+
+    /* The loader parses in parallel and writes each miss back to the cache */
+    MeshLoader loader(argv[1]);
+    std::vector<MeshLoader::MeshFuture> meshes;
+    for (size_t i = 0; i < models.size(); i++)
+        meshes.push_back(loader.Load(models[i]));
+
+    /* The registry builds each atlas on its own thread and caches it */
+    AssetRegistry registry(loader);
+    std::vector<AssetRegistry::CausticsFuture> atlases;
+    int failures = 0;
+    for (size_t i = 0; i < scenes.size(); i++)
+    {
+        SceneDescription description;
+        std::string error;
+        if (!description.Load(scenes[i], error))
+        {
+            std::cerr << "fishtank_meshc: " << error << std::endl;
+            failures++;
+        }
+        else if (description.water.caustics)
+            atlases.push_back(registry.GetCaustics(description.water.atlas));
+    }
+
+    /* The unoptimized meshes, for the report, parsed again alongside */
+    ThreadPool pool;
+    std::vector<std::future<MeshOptimizer::Statistics> > before;
+    for (size_t i = 0; i < models.size(); i++)
+    {
+        std::string fileName = models[i];
+        before.push_back(pool.Submit([fileName]() {
+            return MeshOptimizer::Measure(MeshLoader::ParseOBJ(fileName));
+        }));
+    }
+
+    printf("%-40s %15s %13s %19s %9s\n", "mesh", "vertices", "acmr", "bytes", "quantized");
+    MeshCache cache(argv[1]);
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        MeshOptimizer::Statistics was = before[i].get();
+        MeshOptimizer::Statistics now = MeshOptimizer::Measure(meshes[i].get().front());
+        printf("%-40s %7lld > %5lld %5.3f > %5.3f %8zu > %8zu %9zu\n", models[i].c_str(), (long long)was.vertices,
+               (long long)now.vertices, was.acmr, now.acmr, was.bytes, now.bytes, now.quantizedBytes);
+
+        size_t levels = meshes[i].get().size();
+        for (size_t level = 0; level < levels; level++)
+        {
+            if (!cache.Read(models[i], (int)level))
+            {
+                std::cerr << "fishtank_meshc: no cache entry for " << models[i];
+                if (level > 0)
+                    std::cerr << " level " << level;
+                std::cerr << std::endl;
+                failures++;
+            }
+        }
+    }
+    for (size_t i = 0; i < atlases.size(); i++)
+        atlases[i].wait();
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,182 @@
+/*
+ * Schooling benchmark
+ *
+ * Steps FishSchool headlessly at 1k, 10k and 100k fish with each kernel
+ * the CPU supports and prints the cost in nanoseconds per fish per step as
+ * JSON on stdout. The tank grows with the fish count so that the density,
+ * and with it the work per fish, stays the same.
+ *
+ * With --obstacles the tank also gets a row of pillars, floor to ceiling,
+ * as a DistanceField that every fish samples twice a step.
+ *
+ * Usage: fishtank_school_bench [--steps S] [--density D] [--kernel scalar|sse|avx2]
+ *                              [--count N]... [--obstacles]
+ */
+
+#include "DistanceField.h"
+#include "FishSchool.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+/* Twelve triangles, wound outwards */
+void AddBox(std::vector<float> &triangles, const float low[3], const float high[3])
+{
+    static const int faces[6][4] = { { 0, 4, 6, 2 }, { 1, 3, 7, 5 }, { 0, 1, 5, 4 },
+                                     { 2, 6, 7, 3 }, { 0, 2, 3, 1 }, { 4, 5, 7, 6 } };
+    static const int fan[6] = { 0, 1, 2, 0, 2, 3 };
+    for (int f = 0; f < 6; f++)
+        for (int v = 0; v < 6; v++)
+        {
+            int corner = faces[f][fan[v]];
+            triangles.push_back(corner & 1 ? high[0] : low[0]);
+            triangles.push_back(corner & 2 ? high[1] : low[1]);
+            triangles.push_back(corner & 4 ? high[2] : low[2]);
+        }
+}
+
+/* Pillars a fifth of the tank apart across its width, down its middle */
+void BuildPillars(const FishSchool::Parameters &parameters, DistanceField &field)
+{
+    std::vector<float> triangles;
+    float width = parameters.boundsMax[0] - parameters.boundsMin[0];
+    for (int p = 1; p < 5; p++)
+    {
+        float x = parameters.boundsMin[0] + width * p / 5;
+        float low[3]  = { x - 1, parameters.boundsMin[1] - 1, -1 };
+        float high[3] = { x + 1, parameters.boundsMax[1] + 1, 1 };
+        AddBox(triangles, low, high);
+    }
+    float boundsMin[3], boundsMax[3];
+    for (int c = 0; c < 3; c++)
+    {
+        boundsMin[c] = parameters.boundsMin[c] - parameters.obstacleMargin - 1;
+        boundsMax[c] = parameters.boundsMax[c] + parameters.obstacleMargin + 1;
+    }
+    field.Build(triangles, boundsMin, boundsMax, 0.5f);
+}
+
+double NanosecondsPerFishStep(FishSchool::Kernel kernel, int count, int steps, double density, bool obstacles)
+{
+    /* Same proportions as the default tank, sized for the density */
+    FishSchool::Parameters parameters = FishSchool::GetDefaultParameters();
+    double extent[3], volume = 1;
+    for (int c = 0; c < 3; c++)
+    {
+        extent[c] = parameters.boundsMax[c] - parameters.boundsMin[c];
+        volume *= extent[c];
+    }
+    double grow = std::cbrt(count / density / volume);
+    for (int c = 0; c < 3; c++)
+    {
+        parameters.boundsMin[c] = (float)(-0.5 * extent[c] * grow);
+        parameters.boundsMax[c] = (float)(0.5 * extent[c] * grow);
+    }
+
+    DistanceField field;
+    if (obstacles)
+        BuildPillars(parameters, field);
+
+    FishSchool school;
+    school.SetParameters(parameters);
+    if (obstacles)
+        school.SetObstacles(&field);
+    school.SetKernel(kernel);
+    school.Reset(count, 3, 1);
+    const float dt = 1.0f / 60;
+    for (int i = 0; i < 10; i++)
+        school.Step(dt);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < steps; i++)
+        school.Step(dt);
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    return ns / ((double)count * steps);
+}
+}
+
+int main(int argc, char *argv[])
+{
+    int    steps   = 50;
+    double density = 0.25;
+    bool   obstacles = false;
+    std::vector<int>                counts;
+    std::vector<FishSchool::Kernel> kernels;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--steps" && i + 1 < argc)
+            steps = atoi(argv[++i]);
+        else if (arg == "--density" && i + 1 < argc)
+            density = atof(argv[++i]);
+        else if (arg == "--count" && i + 1 < argc)
+            counts.push_back(atoi(argv[++i]));
+        else if (arg == "--obstacles")
+            obstacles = true;
+        else if (arg == "--kernel" && i + 1 < argc)
+        {
+            std::string name = argv[++i];
+            if (name == "scalar")
+                kernels.push_back(FishSchool::SCALAR);
+            else if (name == "sse")
+                kernels.push_back(FishSchool::SSE);
+            else if (name == "avx2")
+                kernels.push_back(FishSchool::AVX2);
+            else
+            {
+                std::cerr << "unknown kernel " << name << std::endl;
+                return EXIT_FAILURE;
+            }
+            if (!FishSchool::IsKernelSupported(kernels.back()))
+            {
+                std::cerr << name << " is not supported on this CPU" << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else
+        {
+            std::cerr << "usage: " << argv[0]
+                      << " [--steps S] [--density D] [--kernel scalar|sse|avx2] [--count N]..."
+                      << " [--obstacles]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (counts.empty())
+    {
+        counts.push_back(1000);
+        counts.push_back(10000);
+        counts.push_back(100000);
+    }
+    if (kernels.empty())
+    {
+        kernels.push_back(FishSchool::SCALAR);
+        if (FishSchool::IsKernelSupported(FishSchool::SSE))
+            kernels.push_back(FishSchool::SSE);
+        if (FishSchool::IsKernelSupported(FishSchool::AVX2))
+            kernels.push_back(FishSchool::AVX2);
+    }
+
+    std::cout << "{" << std::endl;
+    std::cout << "  \"steps\": " << steps << ", \"density\": " << density << "," << std::endl;
+    if (obstacles)
+        std::cout << "  \"obstacles\": \"" << DistanceField::GetKernelName() << "\"," << std::endl;
+    std::cout << "  \"results\": [" << std::endl;
+    for (size_t k = 0; k < kernels.size(); k++)
+        for (size_t c = 0; c < counts.size(); c++)
+        {
+            double ns = NanosecondsPerFishStep(kernels[k], counts[c], steps, density, obstacles);
+            bool last = k + 1 == kernels.size() && c + 1 == counts.size();
+            std::cout << "    { \"kernel\": \"" << FishSchool::GetKernelName(kernels[k])
+                      << "\", \"fish\": " << counts[c] << ", \"ns_per_fish_step\": " << ns
+                      << " }" << (last ? "" : ",") << std::endl;
+        }
+    std::cout << "  ]" << std::endl;
+    std::cout << "}" << std::endl;
+    return EXIT_SUCCESS;
+}
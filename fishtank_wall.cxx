@@ -0,0 +1,444 @@
+/*
+ * Video wall
+ *
+ * Many tanks from one process. Meshes and materials are loaded once into
+ * one AssetRegistry that every tank draws from; each tank is a TankScene
+ * of its own, with its own renderer, camera, school, particles and
+ * simulation thread, built from its own scene file or all from the same.
+ * Tanks draw their meshes through MeshBuffers, so each mesh is on the GPU
+ * once per window however many tanks in it show it.
+ *
+ * In a window the tanks tile it in a grid of viewports. The mouse moves
+ * the camera of the tank under it, and keys steer that tank's controlled
+ * fish. With --offscreen the tanks are split across --windows N offscreen
+ * windows, each drawn on a render thread of its own for --frames N frames,
+ * and each window's frame times are printed as JSON.
+ *
+ * Usage: fishtank_wall [scene switches] [--tanks N] [--tank scene.json]...
+ *                      [--columns N] [--size W H] [--max-fps N]
+ *                      [--offscreen [--windows N] [--frames N]]
+ *
+ * --tank may be repeated, one tank each; otherwise --tanks N (4 by
+ * default) copies of the scene are shown, each school and particle
+ * system seeded differently. --size is each tank's. Render threads need
+ * a VTK built for offscreen contexts (OSMesa or EGL) or a driver that
+ * takes GLX contexts from several threads.
+ */
+
+#include "AssetRegistry.h"
+#include "MeshBuffers.h"
+#include "MeshLoader.h"
+#include "Profiler.h"
+#include "RenderScheduler.h"
+#include "TankScene.h"
+#include "TankSetup.h"
+
+#include <vtkCallbackCommand.h>
+#include <vtkCommand.h>
+#include <vtkInteractorStyleJoystickCamera.h>
+#include <vtkRenderWindow.h>
+#include <vtkRenderWindowInteractor.h>
+#include <vtkRenderer.h>
+#include <vtkSmartPointer.h>
+#include <vtk_glew.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+/* One tank and the passes installed on its renderer */
+struct Tank
+{
+    vtkSmartPointer<vtkRenderer> renderer;
+    std::unique_ptr<TankScene>   scene;
+    vtkBVHCuller                *culler;
+    vtkBloomPass                *bloom;
+    vtkFogPass                  *fog;
+    WaterDescription             water;   /* the fog's, for its pass */
+};
+
+/* An offscreen window, its tanks and the frame times its thread measured */
+struct WallWindow
+{
+    vtkSmartPointer<vtkRenderWindow> window;
+    std::vector<Tank *>              tanks;
+    std::vector<double>              times;
+};
+
+/* Lets the render threads keep their contexts until the main thread has
+ * counted the GPU buffers they share */
+struct Rendezvous
+{
+    std::mutex              mutex;
+    std::condition_variable changed;
+    int                     finished;
+    bool                    release;
+};
+
+/* Interactive callbacks find the tank under the mouse from here */
+struct WallState
+{
+    std::vector<Tank *>             tanks;
+    std::map<vtkRenderer *, Tank *> byRenderer;
+    RenderScheduler                *scheduler;
+    int                             timerId;
+    std::chrono::steady_clock::time_point start;
+};
+
+double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/* Nearest-rank percentile of sorted times */
+double Percentile(const std::vector<double> &sorted, double percent)
+{
+    size_t rank = (size_t)std::ceil(percent / 100 * sorted.size());
+    return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+/* Cell t of a grid of columns, filled from the top left */
+void PlaceViewport(vtkRenderer *renderer, int t, int count, int columns)
+{
+    int rows   = (count + columns - 1) / columns;
+    int column = t % columns;
+    int row    = t / columns;
+    renderer->SetViewport((double)column / columns, 1 - (double)(row + 1) / rows,
+                          (double)(column + 1) / columns, 1 - (double)row / rows);
+}
+
+bool AttachAll(std::vector<Tank *> &tanks)
+{
+    bool complete = true;
+    for (size_t t = 0; t < tanks.size(); t++)
+    {
+        tanks[t]->scene->AttachReady();
+        complete = tanks[t]->scene->IsComplete() && complete;
+    }
+    return complete;
+}
+
+/* Timer callback: attach every tank's actors whose meshes are ready */
+void AttachReadyActors(vtkObject *caller, unsigned long, void *clientData, void *callData)
+{
+    vtkRenderWindowInteractor *iren = static_cast<vtkRenderWindowInteractor *>(caller);
+    WallState *state = static_cast<WallState *>(clientData);
+    if (callData && *static_cast<int *>(callData) != state->timerId)
+        return;
+
+    bool complete = true;
+    for (size_t t = 0; t < state->tanks.size(); t++)
+    {
+        TankScene &scene = *state->tanks[t]->scene;
+        if (scene.AttachReady() > 0)
+        {
+            state->scheduler->WatchScene(scene.GetRenderer());
+            state->scheduler->MarkDirty();
+        }
+        complete = scene.IsComplete() && complete;
+    }
+    if (complete)
+    {
+        iren->DestroyTimer(state->timerId);
+        std::cerr << "[wall] " << state->tanks.size() << " tanks complete after "
+                  << MillisecondsSince(state->start) << " ms" << std::endl;
+    }
+}
+
+/* Interactor key callback: keys steer the tank under the mouse */
+void SteerControlledActors(vtkObject *caller, unsigned long event, void *clientData, void *)
+{
+    vtkRenderWindowInteractor *iren = static_cast<vtkRenderWindowInteractor *>(caller);
+    WallState *state = static_cast<WallState *>(clientData);
+    const char *keySym = iren->GetKeySym();
+    int *position = iren->GetEventPosition();
+    std::map<vtkRenderer *, Tank *>::iterator tank =
+        state->byRenderer.find(iren->FindPokedRenderer(position[0], position[1]));
+    if (!keySym || tank == state->byRenderer.end())
+        return;
+    if (tank->second->scene->GetControls().HandleKey(keySym, event == vtkCommand::KeyPressEvent,
+                                                     FrameClock::Get().GetWallTime()))
+        state->scheduler->MarkDirty();
+}
+
+/* A render thread: the window's context is made on its first render, here,
+ * and released here once the main thread has counted the buffers */
+void RenderWindowFrames(WallWindow *wall, long long frames, Rendezvous *rendezvous)
+{
+    Profiler::Get().SetThreadName("render");
+    wall->times.reserve(frames);
+    for (long long i = 0; i < frames; i++)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t t = 0; t < wall->tanks.size(); t++)
+            wall->tanks[t]->scene->Update();
+        wall->window->Render();
+        glFinish();
+        wall->times.push_back(MillisecondsSince(start));
+    }
+
+    std::unique_lock<std::mutex> lock(rendezvous->mutex);
+    rendezvous->finished++;
+    rendezvous->changed.notify_all();
+    rendezvous->changed.wait(lock, [rendezvous]() { return rendezvous->release; });
+    lock.unlock();
+
+    for (size_t t = 0; t < wall->tanks.size(); t++)
+    {
+        if (wall->tanks[t]->culler)
+            wall->tanks[t]->culler->ReleaseGraphicsResources(wall->window);
+        if (wall->tanks[t]->bloom)
+            wall->tanks[t]->bloom->ReleaseGraphicsResources(wall->window);
+        else if (wall->tanks[t]->fog)
+            wall->tanks[t]->fog->ReleaseGraphicsResources(wall->window);
+    }
+    wall->window->Finalize();
+}
+}
+
+int main(int argc, char *argv[])
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    TankOptions options;
+    std::vector<std::string> sceneFiles;
+    int       tankCount    = 4;
+    int       columns      = 0;
+    int       width        = 400;
+    int       height       = 400;
+    double    maxFrameRate = 60;
+    bool      offscreen    = false;
+    int       windowCount  = 1;
+    long long frames       = 600;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--tanks" && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            tankCount = atoi(argv[++i]);
+        else if (arg == "--tank" && i + 1 < argc)
+            sceneFiles.push_back(argv[++i]);
+        else if (arg == "--columns" && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            columns = atoi(argv[++i]);
+        else if (arg == "--size" && i + 2 < argc)
+        {
+            width  = atoi(argv[++i]);
+            height = atoi(argv[++i]);
+        }
+        else if (arg == "--max-fps" && i + 1 < argc)
+            maxFrameRate = atof(argv[++i]);
+        else if (arg == "--offscreen")
+            offscreen = true;
+        else if (arg == "--windows" && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            windowCount = atoi(argv[++i]);
+        else if (arg == "--frames" && i + 1 < argc && atoll(argv[i + 1]) > 0)
+            frames = atoll(argv[++i]);
+        else if (!options.ParseArgument(i, argc, argv))
+        {
+            std::cerr << "usage: fishtank_wall " << TankOptions::Usage()
+                      << " [--tanks N] [--tank scene.json]... [--columns N] [--size W H] [--max-fps N]"
+                      << " [--offscreen [--windows N] [--frames N]]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (sceneFiles.empty())
+        sceneFiles.assign(tankCount, options.sceneFile);
+    tankCount   = (int)sceneFiles.size();
+    windowCount = offscreen ? std::min(windowCount, tankCount) : 1;
+
+    Profiler::Get().SetThreadName("main");
+
+    /* One loader and registry for every tank, so each mesh file is read and
+     * each material made once */
+    MeshLoader    loader("meshcache");
+    AssetRegistry registry(loader);
+
+    std::vector<std::unique_ptr<Tank> > tanks;
+    for (int t = 0; t < tankCount; t++)
+    {
+        TankOptions tankOptions = options;
+        tankOptions.sceneFile = sceneFiles[t];
+        SceneDescription description;
+        std::string error;
+        if (!tankOptions.LoadDescription(description, error))
+        {
+            std::cerr << "fishtank_wall: " << error << std::endl;
+            return EXIT_FAILURE;
+        }
+        /* Copies of one scene would otherwise swim in lockstep */
+        description.school.seed    += 7919u * t;
+        description.particles.seed += 7919u * t;
+
+        std::unique_ptr<Tank> tank(new Tank);
+        tank->culler   = NULL;
+        tank->bloom    = NULL;
+        tank->fog      = NULL;
+        tank->water    = description.water;
+        tank->renderer = vtkSmartPointer<vtkRenderer>::New();
+        tank->scene.reset(new TankScene(registry, tank->renderer));
+        tankOptions.Configure(*tank->scene);
+        tank->scene->SetShareMeshBuffers(true);
+        tank->scene->Build(description);
+        tanks.push_back(std::move(tank));
+    }
+    std::cerr << "[wall] " << tankCount << " tanks share " << registry.GetNumberOfMeshes() << " meshes and "
+              << registry.GetNumberOfMaterials() << " materials" << std::endl;
+
+    /* Tanks go to windows in runs, each run tiling its window */
+    std::vector<WallWindow> walls(windowCount);
+    for (int w = 0; w < windowCount; w++)
+    {
+        int first = tankCount * w / windowCount;
+        int last  = tankCount * (w + 1) / windowCount;
+        int count = last - first;
+        int across = columns > 0 ? std::min(columns, count) : (int)std::ceil(std::sqrt((double)count));
+        int down   = (count + across - 1) / across;
+
+        WallWindow &wall = walls[w];
+        wall.window = vtkSmartPointer<vtkRenderWindow>::New();
+        wall.window->SetSize(across * width, down * height);
+        wall.window->SetOffScreenRendering(offscreen ? 1 : 0);
+        for (int t = first; t < last; t++)
+        {
+            Tank &tank = *tanks[t];
+            wall.window->AddRenderer(tank.renderer);
+            SetupTankView(tank.renderer);
+            PlaceViewport(tank.renderer, t - first, count, across);
+            tank.culler = options.InstallCuller(tank.renderer);
+            tank.bloom  = options.InstallPasses(tank.renderer);
+            tank.fog    = options.InstallFog(tank.renderer, tank.water);
+            wall.tanks.push_back(&tank);
+        }
+    }
+
+    if (offscreen)
+    {
+        std::vector<Tank *> all;
+        for (int t = 0; t < tankCount; t++)
+            all.push_back(tanks[t].get());
+        while (!AttachAll(all))
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        double loadMs = MillisecondsSince(start);
+
+        Rendezvous rendezvous;
+        rendezvous.finished = 0;
+        rendezvous.release  = false;
+        std::vector<std::thread> threads;
+        for (int w = 0; w < windowCount; w++)
+            threads.push_back(std::thread(RenderWindowFrames, &walls[w], frames, &rendezvous));
+
+        size_t bufferSets, bufferBytes;
+        {
+            std::unique_lock<std::mutex> lock(rendezvous.mutex);
+            rendezvous.changed.wait(lock, [&rendezvous, windowCount]() {
+                return rendezvous.finished == windowCount;
+            });
+            bufferSets  = MeshBuffers::GetNumberOfBufferSets();
+            bufferBytes = MeshBuffers::GetTotalBytes();
+            rendezvous.release = true;
+            rendezvous.changed.notify_all();
+        }
+        for (size_t i = 0; i < threads.size(); i++)
+            threads[i].join();
+
+        printf("{\n  \"tanks\": %d,\n  \"meshes\": %zu,\n  \"loadMs\": %.1f,\n", tankCount,
+               registry.GetNumberOfMeshes(), loadMs);
+        printf("  \"meshBuffers\": %zu,\n  \"meshBufferBytes\": %zu,\n  \"windows\": [\n", bufferSets,
+               bufferBytes);
+        for (int w = 0; w < windowCount; w++)
+        {
+            std::vector<double> times = walls[w].times;
+            std::sort(times.begin(), times.end());
+            double total = 0;
+            for (size_t i = 0; i < times.size(); i++)
+                total += times[i];
+            int *size = walls[w].window->GetSize();
+            printf("    { \"tanks\": %zu, \"width\": %d, \"height\": %d, \"frames\": %zu, \"avgMs\": %.3f,"
+                   " \"p50Ms\": %.3f, \"p99Ms\": %.3f, \"maxMs\": %.3f }%s\n",
+                   walls[w].tanks.size(), size[0], size[1], times.size(), total / times.size(),
+                   Percentile(times, 50), Percentile(times, 99), times.back(), w + 1 < windowCount ? "," : "");
+        }
+        printf("  ]\n}\n");
+    }
+    else
+    {
+        WallState state;
+        state.scheduler = NULL;
+        state.timerId   = 0;
+        state.start     = start;
+        for (int t = 0; t < tankCount; t++)
+        {
+            state.tanks.push_back(tanks[t].get());
+            state.byRenderer[tanks[t]->renderer] = tanks[t].get();
+        }
+
+        vtkRenderWindow *window = walls[0].window;
+        vtkSmartPointer<vtkRenderWindowInteractor> iren = vtkSmartPointer<vtkRenderWindowInteractor>::New();
+        iren->SetRenderWindow(window);
+        vtkSmartPointer<vtkInteractorStyleJoystickCamera> style =
+            vtkSmartPointer<vtkInteractorStyleJoystickCamera>::New();
+        iren->SetInteractorStyle(style);
+        iren->Initialize();
+
+        RenderScheduler scheduler(iren);
+        scheduler.SetMaxFrameRate(maxFrameRate);
+        scheduler.SetContinuous(true);
+        state.scheduler = &scheduler;
+        for (int t = 0; t < tankCount; t++)
+            scheduler.WatchScene(tanks[t]->renderer);
+        scheduler.AddUpdate([&state]() {
+            bool animating = false;
+            for (size_t t = 0; t < state.tanks.size(); t++)
+            {
+                state.tanks[t]->scene->GetControls().Flush();
+                animating = state.tanks[t]->scene->Update() || animating;
+            }
+            return animating;
+        });
+
+        vtkSmartPointer<vtkCallbackCommand> keyCallback = vtkSmartPointer<vtkCallbackCommand>::New();
+        keyCallback->SetCallback(SteerControlledActors);
+        keyCallback->SetClientData(&state);
+        iren->AddObserver(vtkCommand::KeyPressEvent, keyCallback);
+        iren->AddObserver(vtkCommand::KeyReleaseEvent, keyCallback);
+
+        vtkSmartPointer<vtkCallbackCommand> attachCallback = vtkSmartPointer<vtkCallbackCommand>::New();
+        attachCallback->SetCallback(AttachReadyActors);
+        attachCallback->SetClientData(&state);
+        iren->AddObserver(vtkCommand::TimerEvent, attachCallback);
+        state.timerId = iren->CreateRepeatingTimer(10);
+
+        iren->Start();
+        std::cerr << "[wall] " << scheduler.GetNumberOfFrames() << " frames, "
+                  << MeshBuffers::GetNumberOfBufferSets() << " mesh buffer sets in "
+                  << MeshBuffers::GetTotalBytes() / 1024 << " KB" << std::endl;
+        state.scheduler = NULL;
+
+        window->MakeCurrent();
+        for (int t = 0; t < tankCount; t++)
+        {
+            if (tanks[t]->culler)
+                tanks[t]->culler->ReleaseGraphicsResources(window);
+            if (tanks[t]->bloom)
+                tanks[t]->bloom->ReleaseGraphicsResources(window);
+            else if (tanks[t]->fog)
+                tanks[t]->fog->ReleaseGraphicsResources(window);
+        }
+    }
+
+    for (int t = 0; t < tankCount; t++)
+        if (Simulation *simulation = tanks[t]->scene->GetSimulation())
+            simulation->Stop();
+    return EXIT_SUCCESS;
+}
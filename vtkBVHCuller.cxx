@@ -0,0 +1,458 @@
+/*
+ * BVH culler
+ */
+
+#include "vtkBVHCuller.h"
+
+#include "GLUtilities.h"
+#include "Profiler.h"
+
+#include <vtkCamera.h>
+#include <vtkCommand.h>
+#include <vtkMath.h>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+vtkStandardNewMacro(vtkBVHCuller);
+
+namespace
+{
+/* Drawn leaves are re-tested every this many frames, staggered by node */
+const int VISIBLE_QUERY_INTERVAL = 4;
+
+/* Query boxes are grown by this fraction of their size, plus a little,
+ * so that faces lying on the box don't hide it */
+const double BOX_GROWTH = 0.01;
+
+const char *VERTEX_SHADER =
+    "#version 150\n"
+    "in vec3 corner;\n"
+    "uniform mat4 worldToClip;\n"
+    "uniform vec3 boxMin;\n"
+    "uniform vec3 boxMax;\n"
+    "void main()\n"
+    "{\n"
+    "    gl_Position = worldToClip * vec4(mix(boxMin, boxMax, corner), 1.0);\n"
+    "}\n";
+
+const char *FRAGMENT_SHADER =
+    "#version 150\n"
+    "out vec4 fragOutput0;\n"
+    "void main()\n"
+    "{\n"
+    "    fragOutput0 = vec4(1.0);\n"
+    "}\n";
+
+/* The unit cube as 12 triangles */
+const float CUBE[36 * 3] =
+{
+    0,0,0, 1,0,0, 1,1,0,  0,0,0, 1,1,0, 0,1,0,
+    0,0,1, 1,1,1, 1,0,1,  0,0,1, 0,1,1, 1,1,1,
+    0,0,0, 0,1,0, 0,1,1,  0,0,0, 0,1,1, 0,0,1,
+    1,0,0, 1,1,1, 1,1,0,  1,0,0, 1,0,1, 1,1,1,
+    0,0,0, 1,0,1, 1,0,0,  0,0,0, 0,0,1, 1,0,1,
+    0,1,0, 1,1,0, 1,1,1,  0,1,0, 1,1,1, 0,1,1
+};
+
+bool HasBounds(vtkProp *prop, double bounds[6])
+{
+    double *b = prop->GetBounds();
+    if (!b || !vtkMath::AreBoundsInitialized(b))
+        return false;
+    std::copy(b, b + 6, bounds);
+    return true;
+}
+}
+
+vtkBVHCuller::vtkBVHCuller()
+{
+    occlusion     = false;
+    frame         = 0;
+    stats.drawn   = stats.frustumCulled = stats.occluded = 0;
+    eye[0] = eye[1] = eye[2] = 0;
+    eyeMargin     = 0;
+    program       = 0;
+    vertexArray   = 0;
+    boxBuffer     = 0;
+    programFailed = false;
+    observed      = NULL;
+    observer      = 0;
+    callback      = vtkSmartPointer<vtkCallbackCommand>::New();
+    callback->SetCallback(OnRendered);
+    callback->SetClientData(this);
+}
+
+vtkBVHCuller::~vtkBVHCuller()
+{
+    /* GL objects must already be gone via ReleaseGraphicsResources; the
+     * context may not be current here */
+    if (observed)
+        observed->RemoveObserver(observer);
+}
+
+double vtkBVHCuller::Cull(vtkRenderer *ren, vtkProp **propList, int &listLength, int &initialized)
+{
+    frame++;
+    if (occlusion)
+    {
+        if (observed != ren)
+        {
+            if (observed)
+                observed->RemoveObserver(observer);
+            observed = ren;
+            observer = ren->AddObserver(vtkCommand::EndEvent, callback);
+        }
+        ReadQueries();
+    }
+
+    Update(propList, listLength);
+    Traverse(ren);
+
+    /* Kept props first, culled ones after them with no render time */
+    std::vector<vtkProp *> culled;
+    int kept = 0;
+    double total = 0;
+    for (int i = 0; i < listLength; i++)
+    {
+        vtkProp *prop = propList[i];
+        int item = entries[prop].item;
+        if (item >= 0 && !visible[item])
+        {
+            culled.push_back(prop);
+            continue;
+        }
+        if (!initialized)
+            prop->SetRenderTimeMultiplier(1.0);
+        total += prop->GetRenderTimeMultiplier();
+        propList[kept++] = prop;
+    }
+    for (size_t i = 0; i < culled.size(); i++)
+    {
+        culled[i]->SetRenderTimeMultiplier(0.0);
+        propList[kept + i] = culled[i];
+    }
+    listLength  = kept;
+    initialized = 1;
+
+    Profiler &profiler = Profiler::Get();
+    profiler.Count("cull:drawn", stats.drawn);
+    profiler.Count("cull:frustum", stats.frustumCulled);
+    if (occlusion)
+        profiler.Count("cull:occluded", stats.occluded);
+    return total;
+}
+
+void vtkBVHCuller::Update(vtkProp **propList, int listLength)
+{
+    bool rebuild = false;
+    int bounded = 0;
+    for (int i = 0; i < listLength && !rebuild; i++)
+    {
+        std::unordered_map<vtkProp *, Entry>::iterator found = entries.find(propList[i]);
+        if (found == entries.end() || (found->second.item < 0 && found->second.redrawTime != propList[i]->GetRedrawMTime()))
+            rebuild = true;   /* new, or without bounds until now */
+        else if (found->second.item >= 0)
+            bounded++;
+    }
+    if (rebuild || bounded != (int)items.size())
+    {
+        Rebuild(propList, listLength);
+        return;
+    }
+
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        Entry &entry = entries[items[i]];
+        vtkMTimeType redrawTime = items[i]->GetRedrawMTime();
+        if (redrawTime == entry.redrawTime)
+            continue;
+        entry.redrawTime = redrawTime;
+        double bounds[6];
+        if (HasBounds(items[i], bounds))
+            bvh.Refit((int)i, bounds);
+    }
+}
+
+void vtkBVHCuller::Rebuild(vtkProp **propList, int listLength)
+{
+    DeleteQueries();
+    items.clear();
+    entries.clear();
+
+    std::vector<double> itemBounds;
+    for (int i = 0; i < listLength; i++)
+    {
+        Entry entry;
+        entry.redrawTime = propList[i]->GetRedrawMTime();
+        entry.item       = -1;
+        double bounds[6];
+        if (HasBounds(propList[i], bounds))
+        {
+            entry.item = (int)items.size();
+            items.push_back(propList[i]);
+            itemBounds.insert(itemBounds.end(), bounds, bounds + 6);
+        }
+        entries[propList[i]] = entry;
+    }
+    bvh.Build(itemBounds);
+
+    NodeState fresh = { 0, false, false };
+    nodeStates.assign(bvh.GetNumberOfNodes(), fresh);
+}
+
+void vtkBVHCuller::Traverse(vtkRenderer *ren)
+{
+    stats.drawn = stats.frustumCulled = stats.occluded = 0;
+    visible.assign(items.size(), 0);
+    toQuery.clear();
+    if (bvh.GetRoot() < 0)
+        return;
+
+    vtkCamera *camera = ren->GetActiveCamera();
+    double planes[24];
+    camera->GetFrustumPlanes(ren->GetTiledAspectRatio(), planes);
+    camera->GetPosition(eye);
+    eyeMargin = 2 * camera->GetClippingRange()[0];
+
+    std::vector<std::pair<int, int> > stack;
+    stack.push_back(std::make_pair(bvh.GetRoot(), 0x3f));
+    while (!stack.empty())
+    {
+        int index = stack.back().first;
+        int mask  = stack.back().second;
+        stack.pop_back();
+        const BVH::Node &node = bvh.GetNode(index);
+
+        BVH::Containment containment = BVH::TestFrustum(node.bounds, planes, mask);
+        if (containment == BVH::OUTSIDE)
+        {
+            stats.frustumCulled += node.count;
+            continue;
+        }
+        if (occlusion && nodeStates[index].occluded && !ContainsEye(index))
+        {
+            stats.occluded += node.count;
+            toQuery.push_back(index);
+            continue;
+        }
+        if (node.item >= 0)
+        {
+            visible[node.item] = 1;
+            stats.drawn++;
+            if (occlusion && (frame + index) % VISIBLE_QUERY_INTERVAL == 0 && !ContainsEye(index))
+                toQuery.push_back(index);
+            continue;
+        }
+        if (containment == BVH::INSIDE && !occlusion)
+        {
+            MarkVisible(index);
+            continue;
+        }
+        stack.push_back(std::make_pair(node.right, mask));
+        stack.push_back(std::make_pair(node.left, mask));
+    }
+}
+
+void vtkBVHCuller::MarkVisible(int index)
+{
+    const BVH::Node &node = bvh.GetNode(index);
+    stats.drawn += node.count;
+    std::vector<int> stack(1, index);
+    while (!stack.empty())
+    {
+        const BVH::Node &n = bvh.GetNode(stack.back());
+        stack.pop_back();
+        if (n.item >= 0)
+            visible[n.item] = 1;
+        else
+        {
+            stack.push_back(n.left);
+            stack.push_back(n.right);
+        }
+    }
+}
+
+/* A box the camera is in, or nearly, is clipped by the near plane and
+ * would look hidden, so it is never tested */
+bool vtkBVHCuller::ContainsEye(int index) const
+{
+    const double *bounds = bvh.GetNode(index).bounds;
+    for (int c = 0; c < 3; c++)
+        if (eye[c] < bounds[2 * c] - eyeMargin || eye[c] > bounds[2 * c + 1] + eyeMargin)
+            return false;
+    return true;
+}
+
+void vtkBVHCuller::SetOccluded(int index)
+{
+    nodeStates[index].occluded = true;
+
+    /* Hidden siblings make a hidden parent, tested as one from now on */
+    for (int parent = bvh.GetNode(index).parent; parent >= 0; parent = bvh.GetNode(parent).parent)
+    {
+        const BVH::Node &node = bvh.GetNode(parent);
+        if (!nodeStates[node.left].occluded || !nodeStates[node.right].occluded)
+            break;
+        nodeStates[parent].occluded = true;
+    }
+}
+
+/* Everything under a node that shows again is drawn until tested on its
+ * own, so nothing behind it pops in late */
+void vtkBVHCuller::SetVisible(int index)
+{
+    std::vector<int> stack(1, index);
+    while (!stack.empty())
+    {
+        const BVH::Node &node = bvh.GetNode(stack.back());
+        nodeStates[stack.back()].occluded = false;
+        stack.pop_back();
+        if (node.item < 0)
+        {
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+        }
+    }
+}
+
+void vtkBVHCuller::ReadQueries()
+{
+    for (size_t i = 0; i < nodeStates.size(); i++)
+    {
+        NodeState &state = nodeStates[i];
+        if (!state.pending)
+            continue;
+        GLuint available = 0;
+        glGetQueryObjectuiv(state.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            continue;
+        GLuint samples = 0;
+        glGetQueryObjectuiv(state.query, GL_QUERY_RESULT, &samples);
+        state.pending = false;
+        if (samples == 0)
+            SetOccluded((int)i);
+        else
+            SetVisible((int)i);
+    }
+}
+
+void vtkBVHCuller::OnRendered(vtkObject *caller, unsigned long, void *clientData, void *)
+{
+    vtkBVHCuller *culler = static_cast<vtkBVHCuller *>(clientData);
+    if (culler->occlusion)
+        culler->IssueQueries(static_cast<vtkRenderer *>(caller));
+}
+
+/* Runs after the renderer has drawn, while its depth buffer is complete */
+void vtkBVHCuller::IssueQueries(vtkRenderer *ren)
+{
+    if (toQuery.empty() || programFailed)
+        return;
+    ScopedTimer timer("cull:queries");
+
+    if (!program)
+    {
+        GLUtilities::AttributeBindings attributes;
+        attributes.push_back(std::make_pair((GLuint)0, "corner"));
+        std::string log;
+        program = GLUtilities::BuildProgram(VERTEX_SHADER, FRAGMENT_SHADER, attributes, log);
+        if (!program)
+        {
+            std::cerr << "vtkBVHCuller: " << log << std::endl;
+            programFailed = true;
+            return;
+        }
+        glGenVertexArrays(1, &vertexArray);
+        glGenBuffers(1, &boxBuffer);
+        glBindVertexArray(vertexArray);
+        glBindBuffer(GL_ARRAY_BUFFER, boxBuffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(CUBE), CUBE, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void *)0);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    /* Depth-tested, but writing nothing */
+    GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+    GLboolean cullFace  = glIsEnabled(GL_CULL_FACE);
+    GLint depthFunc;
+    glGetIntegerv(GL_DEPTH_FUNC, &depthFunc);
+    glEnable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+    glDepthFunc(GL_LEQUAL);
+    glDepthMask(GL_FALSE);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+    float worldToClip[16];
+    GLUtilities::GetWorldToClip(ren, worldToClip);
+    glUseProgram(program);
+    glUniformMatrix4fv(glGetUniformLocation(program, "worldToClip"), 1, GL_FALSE, worldToClip);
+    GLint boxMin = glGetUniformLocation(program, "boxMin");
+    GLint boxMax = glGetUniformLocation(program, "boxMax");
+    glBindVertexArray(vertexArray);
+
+    for (size_t i = 0; i < toQuery.size(); i++)
+    {
+        NodeState &state = nodeStates[toQuery[i]];
+        if (state.pending)
+            continue;
+        if (!state.query)
+            glGenQueries(1, &state.query);
+
+        const double *bounds = bvh.GetNode(toQuery[i]).bounds;
+        float low[3], high[3];
+        for (int c = 0; c < 3; c++)
+        {
+            double grow = BOX_GROWTH * (bounds[2 * c + 1] - bounds[2 * c]) + 1e-3;
+            low[c]  = (float)(bounds[2 * c] - grow);
+            high[c] = (float)(bounds[2 * c + 1] + grow);
+        }
+        glUniform3fv(boxMin, 1, low);
+        glUniform3fv(boxMax, 1, high);
+        glBeginQuery(GL_SAMPLES_PASSED, state.query);
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+        glEndQuery(GL_SAMPLES_PASSED);
+        state.pending = true;
+    }
+    toQuery.clear();
+
+    glBindVertexArray(0);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthMask(GL_TRUE);
+    glDepthFunc(depthFunc);
+    if (!depthTest)
+        glDisable(GL_DEPTH_TEST);
+    if (cullFace)
+        glEnable(GL_CULL_FACE);
+    GLUtilities::ReleaseVTKShader(ren);
+}
+
+void vtkBVHCuller::DeleteQueries()
+{
+    for (size_t i = 0; i < nodeStates.size(); i++)
+        if (nodeStates[i].query)
+            glDeleteQueries(1, &nodeStates[i].query);
+    nodeStates.clear();
+    toQuery.clear();
+}
+
+void vtkBVHCuller::ReleaseGraphicsResources(vtkWindow *)
+{
+    DeleteQueries();
+    if (program)
+    {
+        glDeleteProgram(program);
+        glDeleteVertexArrays(1, &vertexArray);
+        glDeleteBuffers(1, &boxBuffer);
+    }
+    program     = 0;
+    vertexArray = 0;
+    boxBuffer   = 0;
+
+    /* The tree is rebuilt with fresh query state on the next frame */
+    entries.clear();
+    items.clear();
+}
@@ -0,0 +1,126 @@
+/*
+ * BVH culler
+ *
+ * Replaces VTK's frustum coverage culler, which tests every prop every
+ * frame, with a bounding volume hierarchy over the props' world bounds:
+ * whole subtrees outside the view frustum are dropped with one test. The
+ * tree is built from the props the renderer hands over, refit when a
+ * prop's bounds change, and rebuilt only when props come or go.
+ *
+ * Occlusion culling, when on, also drops props hidden behind others. At
+ * the end of each frame the boxes of nodes that were hidden, and now and
+ * then of leaves that were drawn, are drawn invisibly inside hardware
+ * occlusion queries against that frame's depth buffer. The answers are
+ * collected a frame later so nothing waits on the GPU; a node found
+ * hidden is skipped with everything under it until its box shows again,
+ * and when both children of a node are hidden the node is tested as one.
+ * Something coming out from behind cover may therefore appear a frame
+ * late. Props without bounds, such as the 2D overlay, are always kept.
+ */
+
+#ifndef FISHTANK_VTKBVHCULLER_H
+#define FISHTANK_VTKBVHCULLER_H
+
+#include "BVH.h"
+
+#include <vtk_glew.h>
+
+#include <vtkCallbackCommand.h>
+#include <vtkCuller.h>
+#include <vtkObjectFactory.h>
+#include <vtkProp.h>
+#include <vtkRenderer.h>
+#include <vtkSmartPointer.h>
+#include <vtkWindow.h>
+
+#include <unordered_map>
+#include <vector>
+
+class vtkBVHCuller : public vtkCuller
+{
+    private:
+        typedef vtkCuller super;
+
+    public:
+        static vtkBVHCuller *New();
+
+        /* What the last frame kept and dropped, counting props */
+        struct Stats
+        {
+            int drawn;
+            int frustumCulled;
+            int occluded;
+        };
+
+        /* Off by default */
+        void SetOcclusionCulling(bool enabled) { occlusion = enabled; }
+        bool GetOcclusionCulling() const { return occlusion; }
+
+        Stats GetLastStats() const { return stats; }
+
+        virtual double Cull(vtkRenderer *ren, vtkProp **propList, int &listLength, int &initialized);
+
+        /* Free the GL objects of the occlusion queries; the window's
+         * context must be current */
+        void ReleaseGraphicsResources(vtkWindow *window);
+
+    protected:
+        vtkBVHCuller();
+        ~vtkBVHCuller();
+
+    private:
+        vtkBVHCuller(const vtkBVHCuller &);
+        void operator=(const vtkBVHCuller &);
+
+        /* Every prop seen, with its leaf's item or -1 when it has no bounds */
+        struct Entry
+        {
+            int          item;
+            vtkMTimeType redrawTime;
+        };
+
+        struct NodeState
+        {
+            GLuint query;
+            bool   pending;    /* query issued, answer not read yet */
+            bool   occluded;
+        };
+
+        /* Bring the tree up to date with this frame's props */
+        void Update(vtkProp **propList, int listLength);
+        void Rebuild(vtkProp **propList, int listLength);
+        void Traverse(vtkRenderer *ren);
+        void MarkVisible(int node);
+
+        void ReadQueries();
+        void IssueQueries(vtkRenderer *ren);
+        void SetOccluded(int node);
+        void SetVisible(int node);
+        void DeleteQueries();
+        bool ContainsEye(int node) const;
+
+        static void OnRendered(vtkObject *caller, unsigned long event, void *clientData, void *callData);
+
+        BVH                                     bvh;
+        std::vector<vtkSmartPointer<vtkProp> >  items;
+        std::unordered_map<vtkProp *, Entry>    entries;
+        std::vector<char>                       visible;      /* per item, this frame */
+        std::vector<NodeState>                  nodeStates;
+        std::vector<int>                        toQuery;
+        bool                                    occlusion;
+        long long                               frame;
+        Stats                                   stats;
+        double                                  eye[3];
+        double                                  eyeMargin;
+
+        GLuint                                  program;
+        GLuint                                  vertexArray;
+        GLuint                                  boxBuffer;
+        bool                                    programFailed;
+
+        vtkRenderer                            *observed;
+        unsigned long                           observer;
+        vtkSmartPointer<vtkCallbackCommand>     callback;
+};
+
+#endif
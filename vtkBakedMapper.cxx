@@ -0,0 +1,209 @@
+/*
+ * Baked lighting mapper
+ */
+
+#include "vtkBakedMapper.h"
+
+#include "Profiler.h"
+
+#include <vtkCellArray.h>
+#include <vtkDataArray.h>
+#include <vtkPointData.h>
+#include <vtkProperty.h>
+
+#include <iostream>
+#include <vector>
+
+vtkStandardNewMacro(vtkBakedMapper);
+
+const char *vtkBakedMapper::LIGHT_ARRAY = "BakedLight";
+
+namespace
+{
+enum
+{
+    VERTEX_LOCATION = 0,
+    LIGHT_LOCATION  = 1
+};
+
+const char *VERTEX_SHADER =
+    "#version 150\n"
+    "in vec3 vertexMC;\n"
+    "in vec3 bakedLight;\n"
+    "uniform mat4 worldToClip;\n"
+    "uniform mat4 actorMatrix;\n"
+    "out vec3 light;\n"
+    "void main()\n"
+    "{\n"
+    "    gl_Position = worldToClip * actorMatrix * vec4(vertexMC, 1.0);\n"
+    "    light = bakedLight;\n"
+    "}\n";
+
+/* The live shaders' terms, with the light sum read from the bake */
+const char *FRAGMENT_SHADER =
+    "#version 150\n"
+    "in vec3 light;\n"
+    "uniform vec3  diffuseColor;\n"
+    "uniform float diffuseIntensity;\n"
+    "uniform vec3  ambientColor;\n"
+    "uniform float ambientIntensity;\n"
+    "out vec4 fragOutput0;\n"
+    "void main()\n"
+    "{\n"
+    "    vec3 color = ambientIntensity * ambientColor + diffuseIntensity * diffuseColor * light;\n"
+    "    fragOutput0 = vec4(color, 1.0);\n"
+    "}\n";
+}
+
+vtkBakedMapper::vtkBakedMapper()
+{
+    uploadTime    = 0;
+    indexCount    = 0;
+    program       = 0;
+    vertexArray   = 0;
+    vertexBuffer  = 0;
+    indexBuffer   = 0;
+    programFailed = false;
+}
+
+vtkBakedMapper::~vtkBakedMapper()
+{
+    /* GL objects must already be gone via ReleaseGraphicsResources; the
+     * context may not be current here */
+}
+
+bool vtkBakedMapper::Upload(vtkPolyData *input)
+{
+    vtkDataArray *light = input->GetPointData()->GetArray(LIGHT_ARRAY);
+    vtkIdType nPoints = input->GetNumberOfPoints();
+    if (!light || light->GetNumberOfComponents() != 3 || light->GetNumberOfTuples() != nPoints)
+        return false;
+
+    std::vector<float> vertices(6 * (size_t)nPoints);
+    for (vtkIdType p = 0; p < nPoints; p++)
+    {
+        double point[3], color[3];
+        input->GetPoint(p, point);
+        light->GetTuple(p, color);
+        for (int c = 0; c < 3; c++)
+        {
+            vertices[6 * p + c]     = (float)point[c];
+            vertices[6 * p + 3 + c] = (float)color[c];
+        }
+    }
+
+    std::vector<GLuint> indices;
+    vtkCellArray *polys = input->GetPolys();
+    vtkIdType  npts;
+    vtkIdType *pts;
+    for (polys->InitTraversal(); polys->GetNextCell(npts, pts);)
+        for (vtkIdType k = 1; k + 1 < npts; k++)
+        {
+            indices.push_back((GLuint)pts[0]);
+            indices.push_back((GLuint)pts[k]);
+            indices.push_back((GLuint)pts[k + 1]);
+        }
+
+    glBindVertexArray(vertexArray);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.empty() ? NULL : &vertices[0],
+                 GL_STATIC_DRAW);
+    glEnableVertexAttribArray(VERTEX_LOCATION);
+    glVertexAttribPointer(VERTEX_LOCATION, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)0);
+    glEnableVertexAttribArray(LIGHT_LOCATION);
+    glVertexAttribPointer(LIGHT_LOCATION, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)(3 * sizeof(float)));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.empty() ? NULL : &indices[0],
+                 GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    indexCount = (GLsizei)indices.size();
+    return true;
+}
+
+void vtkBakedMapper::RenderPiece(vtkRenderer *ren, vtkActor *act)
+{
+    vtkPolyData *input = this->GetInput();
+    if (!input)
+        return;
+    if (programFailed || !input->GetPointData()->GetArray(LIGHT_ARRAY))
+    {
+        super::RenderPiece(ren, act);
+        return;
+    }
+    ScopedTimer timer("draw:baked");
+
+    if (!program)
+    {
+        GLUtilities::AttributeBindings attributes;
+        attributes.push_back(std::make_pair((GLuint)VERTEX_LOCATION, "vertexMC"));
+        attributes.push_back(std::make_pair((GLuint)LIGHT_LOCATION, "bakedLight"));
+        std::string log;
+        program = GLUtilities::BuildProgram(VERTEX_SHADER, FRAGMENT_SHADER, attributes, log);
+        if (!program)
+        {
+            std::cerr << "vtkBakedMapper: " << log << std::endl;
+            programFailed = true;
+            super::RenderPiece(ren, act);
+            return;
+        }
+        worldToClipLocation      = glGetUniformLocation(program, "worldToClip");
+        actorMatrixLocation      = glGetUniformLocation(program, "actorMatrix");
+        diffuseColorLocation     = glGetUniformLocation(program, "diffuseColor");
+        diffuseIntensityLocation = glGetUniformLocation(program, "diffuseIntensity");
+        ambientColorLocation     = glGetUniformLocation(program, "ambientColor");
+        ambientIntensityLocation = glGetUniformLocation(program, "ambientIntensity");
+        glGenVertexArrays(1, &vertexArray);
+        glGenBuffers(1, &vertexBuffer);
+        glGenBuffers(1, &indexBuffer);
+        uploadTime = 0;
+    }
+    if (input->GetMTime() > uploadTime)
+    {
+        if (!Upload(input))
+        {
+            super::RenderPiece(ren, act);
+            return;
+        }
+        uploadTime = input->GetMTime();
+    }
+    if (indexCount == 0)
+        return;
+
+    float worldToClip[16], actorMatrix[16];
+    GLUtilities::GetWorldToClip(ren, worldToClip);
+    GLUtilities::ToColumnMajor(act->GetMatrix(), actorMatrix);
+    vtkProperty *prop = act->GetProperty();
+    double *diffuseColor = prop->GetDiffuseColor();
+    double *ambientColor = prop->GetAmbientColor();
+
+    glUseProgram(program);
+    glUniformMatrix4fv(worldToClipLocation, 1, GL_FALSE, worldToClip);
+    glUniformMatrix4fv(actorMatrixLocation, 1, GL_FALSE, actorMatrix);
+    glUniform3f(diffuseColorLocation, (float)diffuseColor[0], (float)diffuseColor[1], (float)diffuseColor[2]);
+    glUniform1f(diffuseIntensityLocation, (float)prop->GetDiffuse());
+    glUniform3f(ambientColorLocation, (float)ambientColor[0], (float)ambientColor[1], (float)ambientColor[2]);
+    glUniform1f(ambientIntensityLocation, (float)prop->GetAmbient());
+    glBindVertexArray(vertexArray);
+    glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (void *)0);
+    glBindVertexArray(0);
+
+    GLUtilities::ReleaseVTKShader(ren);
+}
+
+void vtkBakedMapper::ReleaseGraphicsResources(vtkWindow *win)
+{
+    if (program)
+    {
+        glDeleteProgram(program);
+        glDeleteVertexArrays(1, &vertexArray);
+        glDeleteBuffers(1, &vertexBuffer);
+        glDeleteBuffers(1, &indexBuffer);
+    }
+    program      = 0;
+    vertexArray  = 0;
+    vertexBuffer = 0;
+    indexBuffer  = 0;
+    uploadTime   = 0;
+    indexCount   = 0;
+    super::ReleaseGraphicsResources(win);
+}
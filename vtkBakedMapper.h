@@ -0,0 +1,69 @@
+/*
+ * Baked lighting mapper
+ *
+ * Draws a mesh whose light was baked into a "BakedLight" point array, RGB
+ * floats per vertex, by LightBake: the fragment colour is the material's
+ * diffuse colour and intensity times the baked light, plus its glow. No
+ * light is evaluated per frame, so shadows and occlusion cost nothing to
+ * draw. Material edits still show at once, as they only change uniforms.
+ *
+ * Positions and light go up interleaved in one buffer, polygons fanned
+ * into triangles in an index buffer, whenever the input is modified.
+ * Until the input has its light, the mesh is drawn by VTK's own lit
+ * path, as a plain vtkOpenGLPolyDataMapper would.
+ */
+
+#ifndef FISHTANK_VTKBAKEDMAPPER_H
+#define FISHTANK_VTKBAKEDMAPPER_H
+
+#include "GLUtilities.h"
+
+#include <vtkActor.h>
+#include <vtkObjectFactory.h>
+#include <vtkOpenGLPolyDataMapper.h>
+#include <vtkPolyData.h>
+#include <vtkRenderer.h>
+#include <vtkWindow.h>
+
+class vtkBakedMapper : public vtkOpenGLPolyDataMapper
+{
+    private:
+        typedef vtkOpenGLPolyDataMapper super;
+
+    public:
+        static vtkBakedMapper *New();
+
+        vtkBakedMapper();
+        ~vtkBakedMapper();
+
+        /* Name of the point array holding the light */
+        static const char *LIGHT_ARRAY;
+
+        virtual void RenderPiece(vtkRenderer *ren, vtkActor *act);
+        virtual void ReleaseGraphicsResources(vtkWindow *win);
+
+    protected:
+        /* False when the input has no baked light to draw */
+        bool Upload(vtkPolyData *input);
+
+        unsigned long uploadTime;
+        GLsizei       indexCount;
+
+        GLuint program;
+        GLint  worldToClipLocation;
+        GLint  actorMatrixLocation;
+        GLint  diffuseColorLocation;
+        GLint  diffuseIntensityLocation;
+        GLint  ambientColorLocation;
+        GLint  ambientIntensityLocation;
+        GLuint vertexArray;
+        GLuint vertexBuffer;
+        GLuint indexBuffer;
+        bool   programFailed;
+
+    private:
+        vtkBakedMapper(const vtkBakedMapper &);
+        void operator=(const vtkBakedMapper &);
+};
+
+#endif
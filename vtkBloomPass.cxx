@@ -0,0 +1,506 @@
+/*
+ * Bloom pass
+ */
+
+#include "vtkBloomPass.h"
+
+#include "GLUtilities.h"
+#include "Profiler.h"
+
+#include <vtkRenderer.h>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+vtkStandardNewMacro(vtkBloomPass);
+
+namespace
+{
+/* Profiler counter names; they must be literals */
+const char *STAGE_NAMES[vtkBloomPass::STAGE_COUNT]    = { "scene", "extract", "blur", "composite" };
+const char *STAGE_COUNTERS[vtkBloomPass::STAGE_COUNT] =
+{
+    "gpu:bloom.scene", "gpu:bloom.extract", "gpu:bloom.blur", "gpu:bloom.composite"
+};
+
+/* One triangle that covers the viewport, made from the vertex index, so
+ * no vertex buffer is needed */
+const char *VERTEX_SHADER =
+    "#version 150\n"
+    "out vec2 texCoord;\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);\n"
+    "    texCoord = corner;\n"
+    "    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);\n"
+    "}\n";
+
+/* Averages 4x4 source texels with four bilinear taps, then keeps what is
+ * over the threshold, easing in over the knee below it so the glow fades
+ * rather than switching on. A threshold of zero keeps everything, which
+ * makes it the blur chain's downsample too. Region maps the target onto
+ * the part of the source to read. */
+const char *EXTRACT_SHADER =
+    "#version 150\n"
+    "uniform sampler2D source;\n"
+    "uniform vec2  texelSize;\n"
+    "uniform vec4  region;\n"
+    "uniform float threshold;\n"
+    "in vec2 texCoord;\n"
+    "out vec4 fragOutput0;\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 uv = region.xy + texCoord * region.zw;\n"
+    "    vec3 color = 0.25 * (texture(source, uv + texelSize * vec2(-1.0, -1.0)).rgb\n"
+    "                       + texture(source, uv + texelSize * vec2( 1.0, -1.0)).rgb\n"
+    "                       + texture(source, uv + texelSize * vec2(-1.0,  1.0)).rgb\n"
+    "                       + texture(source, uv + texelSize * vec2( 1.0,  1.0)).rgb);\n"
+    "    float brightness = max(color.r, max(color.g, color.b));\n"
+    "    float knee = 0.5 * threshold;\n"
+    "    float soft = clamp(brightness - threshold + knee, 0.0, 2.0 * knee);\n"
+    "    soft = soft * soft / (4.0 * knee + 1e-5);\n"
+    "    color *= max(soft, brightness - threshold) / max(brightness, 1e-5);\n"
+    "    fragOutput0 = vec4(color, 1.0);\n"
+    "}\n";
+
+/* Nine-tap Gaussian along one direction in five fetches, using bilinear
+ * filtering to read two texels per fetch. With a zero direction the
+ * weights sum to one, so it also copies, for adding levels back up. */
+const char *BLUR_SHADER =
+    "#version 150\n"
+    "uniform sampler2D source;\n"
+    "uniform vec2 direction;\n"
+    "in vec2 texCoord;\n"
+    "out vec4 fragOutput0;\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 near = direction * 1.3846153846;\n"
+    "    vec2 far  = direction * 3.2307692308;\n"
+    "    vec3 color = 0.2270270270 * texture(source, texCoord).rgb\n"
+    "               + 0.3162162162 * (texture(source, texCoord + near).rgb + texture(source, texCoord - near).rgb)\n"
+    "               + 0.0702702703 * (texture(source, texCoord + far).rgb + texture(source, texCoord - far).rgb);\n"
+    "    fragOutput0 = vec4(color, 1.0);\n"
+    "}\n";
+
+/* Scene plus glow, with the scene's depth, so whatever is drawn or
+ * depth-tested afterwards still sees the tank */
+const char *COMPOSITE_SHADER =
+    "#version 150\n"
+    "uniform sampler2D scene;\n"
+    "uniform sampler2D sceneDepth;\n"
+    "uniform sampler2D bloom;\n"
+    "uniform vec4  region;\n"
+    "uniform float intensity;\n"
+    "in vec2 texCoord;\n"
+    "out vec4 fragOutput0;\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 uv = region.xy + texCoord * region.zw;\n"
+    "    vec3 color = texture(scene, uv).rgb + intensity * texture(bloom, texCoord).rgb;\n"
+    "    fragOutput0 = vec4(color, 1.0);\n"
+    "    gl_FragDepth = texture(sceneDepth, uv).r;\n"
+    "}\n";
+
+void SetTextureParameters(GLenum filter)
+{
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+void BindTexture(GLenum unit, GLuint texture)
+{
+    glActiveTexture(unit);
+    glBindTexture(GL_TEXTURE_2D, texture);
+}
+}
+
+vtkBloomPass::vtkBloomPass()
+{
+    threshold        = 1.0;
+    intensity        = 1.0;
+    resolution       = 0.5;
+    levelCount       = 5;
+    std::fill(stageTimes, stageTimes + STAGE_COUNT, -1.0);
+    extractProgram   = 0;
+    blurProgram      = 0;
+    compositeProgram = 0;
+    emptyVertexArray = 0;
+    programFailed    = false;
+    scene.framebuffer = scene.texture = 0;
+    scene.width = scene.height = 0;
+    sceneDepth       = 0;
+    width = height   = 0;
+    builtLevels      = 0;
+    builtResolution  = 0;
+    timing           = false;
+    for (int f = 0; f < QUERY_FRAMES; f++)
+    {
+        std::fill(queries[f], queries[f] + STAGE_COUNT, 0);
+        issued[f] = false;
+    }
+    querySlot = 0;
+}
+
+vtkBloomPass::~vtkBloomPass()
+{
+    /* GL objects must already be gone via ReleaseGraphicsResources; the
+     * context may not be current here */
+}
+
+const char *vtkBloomPass::GetStageName(int stage)
+{
+    return stage >= 0 && stage < STAGE_COUNT ? STAGE_NAMES[stage] : "";
+}
+
+void vtkBloomPass::SetResolution(double fraction)
+{
+    resolution = std::min(std::max(fraction, 0.05), 1.0);
+}
+
+void vtkBloomPass::SetLevels(int count)
+{
+    levelCount = std::min(std::max(count, 1), (int)MAX_LEVELS);
+}
+
+bool vtkBloomPass::Initialize()
+{
+    if (extractProgram)
+        return true;
+    if (programFailed)
+        return false;
+
+    GLUtilities::AttributeBindings none;
+    std::string log;
+    extractProgram   = GLUtilities::BuildProgram(VERTEX_SHADER, EXTRACT_SHADER, none, log);
+    blurProgram      = extractProgram ? GLUtilities::BuildProgram(VERTEX_SHADER, BLUR_SHADER, none, log) : 0;
+    compositeProgram = blurProgram ? GLUtilities::BuildProgram(VERTEX_SHADER, COMPOSITE_SHADER, none, log) : 0;
+    if (!compositeProgram)
+    {
+        std::cerr << "vtkBloomPass: " << log << std::endl;
+        if (extractProgram)
+            glDeleteProgram(extractProgram);
+        if (blurProgram)
+            glDeleteProgram(blurProgram);
+        extractProgram = blurProgram = 0;
+        programFailed  = true;
+        return false;
+    }
+
+    glUseProgram(extractProgram);
+    glUniform1i(glGetUniformLocation(extractProgram, "source"), 0);
+    glUseProgram(blurProgram);
+    glUniform1i(glGetUniformLocation(blurProgram, "source"), 0);
+    glUseProgram(compositeProgram);
+    glUniform1i(glGetUniformLocation(compositeProgram, "scene"), 0);
+    glUniform1i(glGetUniformLocation(compositeProgram, "sceneDepth"), 1);
+    glUniform1i(glGetUniformLocation(compositeProgram, "bloom"), 2);
+
+    /* Core profiles draw nothing without a vertex array bound */
+    glGenVertexArrays(1, &emptyVertexArray);
+
+    timing = GLUtilities::IsSupported(3, 3, "GL_ARB_timer_query");
+    if (timing)
+        for (int f = 0; f < QUERY_FRAMES; f++)
+            glGenQueries(STAGE_COUNT, queries[f]);
+    return true;
+}
+
+void vtkBloomPass::CreateTarget(Target &target, int targetWidth, int targetHeight)
+{
+    target.width  = targetWidth;
+    target.height = targetHeight;
+    glGenTextures(1, &target.texture);
+    glBindTexture(GL_TEXTURE_2D, target.texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, targetWidth, targetHeight, 0, GL_RGBA, GL_FLOAT, NULL);
+    SetTextureParameters(GL_LINEAR);
+    glGenFramebuffers(1, &target.framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.texture, 0);
+}
+
+void vtkBloomPass::DeleteTarget(Target &target)
+{
+    if (target.framebuffer)
+        glDeleteFramebuffers(1, &target.framebuffer);
+    if (target.texture)
+        glDeleteTextures(1, &target.texture);
+    target.framebuffer = target.texture = 0;
+    target.width = target.height = 0;
+}
+
+void vtkBloomPass::DeleteTargets()
+{
+    DeleteTarget(scene);
+    if (sceneDepth)
+        glDeleteTextures(1, &sceneDepth);
+    sceneDepth = 0;
+    for (size_t i = 0; i < levels.size(); i++)
+    {
+        DeleteTarget(levels[i].blurred);
+        DeleteTarget(levels[i].across);
+    }
+    levels.clear();
+    width = height = 0;
+}
+
+/* The scene target spans the renderer's origin as well as its size: VTK's
+ * camera pass draws at the tiled origin when it isn't given one of its own
+ * framebuffers */
+void vtkBloomPass::Resize(int sceneWidth, int sceneHeight)
+{
+    if (sceneWidth == width && sceneHeight == height && builtLevels == levelCount
+        && builtResolution == resolution)
+        return;
+    DeleteTargets();
+    width           = sceneWidth;
+    height          = sceneHeight;
+    builtLevels     = levelCount;
+    builtResolution = resolution;
+
+    CreateTarget(scene, width, height);
+    glGenTextures(1, &sceneDepth);
+    glBindTexture(GL_TEXTURE_2D, sceneDepth);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    SetTextureParameters(GL_NEAREST);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, sceneDepth, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cerr << "vtkBloomPass: the scene framebuffer is incomplete" << std::endl;
+
+    int levelWidth  = std::max((int)(width * resolution), 1);
+    int levelHeight = std::max((int)(height * resolution), 1);
+    levels.resize(levelCount);
+    for (int i = 0; i < levelCount; i++)
+    {
+        CreateTarget(levels[i].blurred, levelWidth, levelHeight);
+        CreateTarget(levels[i].across, levelWidth, levelHeight);
+        levelWidth  = std::max(levelWidth / 2, 1);
+        levelHeight = std::max(levelHeight / 2, 1);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void vtkBloomPass::DrawInto(const Target &target)
+{
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target.framebuffer);
+    glViewport(0, 0, target.width, target.height);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+void vtkBloomPass::BeginStage(int stage)
+{
+    if (timing)
+        glBeginQuery(GL_TIME_ELAPSED, queries[querySlot][stage]);
+}
+
+void vtkBloomPass::EndStage()
+{
+    if (timing)
+        glEndQuery(GL_TIME_ELAPSED);
+}
+
+/* Reads the oldest frame's queries, which have had QUERY_FRAMES - 1
+ * frames to finish; if they haven't, the old times stand */
+void vtkBloomPass::ReadStageTimes()
+{
+    if (!timing || !issued[querySlot])
+        return;
+    GLuint available = 0;
+    glGetQueryObjectuiv(queries[querySlot][STAGE_COUNT - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+        return;
+
+    Profiler &profiler = Profiler::Get();
+    for (int stage = 0; stage < STAGE_COUNT; stage++)
+    {
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(queries[querySlot][stage], GL_QUERY_RESULT, &elapsed);
+        stageTimes[stage] = elapsed / 1.0e6;
+        profiler.Count(STAGE_COUNTERS[stage], stageTimes[stage]);
+    }
+}
+
+void vtkBloomPass::Render(const vtkRenderState *s)
+{
+    NumberOfRenderedProps = 0;
+    vtkRenderer *ren = s->GetRenderer();
+    if (!DelegatePass)
+    {
+        std::cerr << "vtkBloomPass: no delegate pass to render the scene" << std::endl;
+        return;
+    }
+
+    int viewWidth, viewHeight, originX, originY;
+    ren->GetTiledSizeAndOrigin(&viewWidth, &viewHeight, &originX, &originY);
+    if (viewWidth < 1 || viewHeight < 1 || !Initialize())
+    {
+        /* Plain rendering rather than nothing */
+        DelegatePass->Render(s);
+        NumberOfRenderedProps = DelegatePass->GetNumberOfRenderedProps();
+        return;
+    }
+
+    ReadStageTimes();
+
+    GLint drawFramebuffer, readFramebuffer, viewport[4], depthFunc, blendFunc[4];
+    GLboolean depthMask;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer);
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glGetIntegerv(GL_DEPTH_FUNC, &depthFunc);
+    glGetBooleanv(GL_DEPTH_WRITEMASK, &depthMask);
+    GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+    GLboolean blend     = glIsEnabled(GL_BLEND);
+    GLboolean scissor   = glIsEnabled(GL_SCISSOR_TEST);
+    glGetIntegerv(GL_BLEND_SRC_RGB, &blendFunc[0]);
+    glGetIntegerv(GL_BLEND_DST_RGB, &blendFunc[1]);
+    glGetIntegerv(GL_BLEND_SRC_ALPHA, &blendFunc[2]);
+    glGetIntegerv(GL_BLEND_DST_ALPHA, &blendFunc[3]);
+
+    Resize(originX + viewWidth, originY + viewHeight);
+
+    /* The scene, unchanged but for where it lands */
+    {
+        ScopedTimer timer("bloom:scene");
+        BeginStage(SCENE);
+        glBindFramebuffer(GL_FRAMEBUFFER, scene.framebuffer);
+        double *background = ren->GetBackground();
+        glClearColor((GLfloat)background[0], (GLfloat)background[1], (GLfloat)background[2], 0.0f);
+        glClearDepth(1.0);
+        glDepthMask(GL_TRUE);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        DelegatePass->Render(s);
+        NumberOfRenderedProps = DelegatePass->GetNumberOfRenderedProps();
+        EndStage();
+    }
+
+    /* The camera pass leaves a scissor box sized for the window, which
+     * would clip the smaller blur levels */
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+    glDisable(GL_SCISSOR_TEST);
+    glDepthMask(GL_FALSE);
+    glBindVertexArray(emptyVertexArray);
+
+    float sceneRegion[4] = { (float)originX / width, (float)originY / height,
+                             (float)viewWidth / width, (float)viewHeight / height };
+    {
+        ScopedTimer timer("bloom:extract");
+        BeginStage(EXTRACT);
+        glUseProgram(extractProgram);
+        glUniform2f(glGetUniformLocation(extractProgram, "texelSize"), 1.0f / width, 1.0f / height);
+        glUniform4fv(glGetUniformLocation(extractProgram, "region"), 1, sceneRegion);
+        glUniform1f(glGetUniformLocation(extractProgram, "threshold"), (GLfloat)threshold);
+        BindTexture(GL_TEXTURE0, scene.texture);
+        DrawInto(levels[0].blurred);
+        EndStage();
+    }
+
+    {
+        ScopedTimer timer("bloom:blur");
+        BeginStage(BLUR);
+        GLint texelSize = glGetUniformLocation(extractProgram, "texelSize");
+        GLint direction = glGetUniformLocation(blurProgram, "direction");
+        float whole[4]  = { 0, 0, 1, 1 };
+        for (size_t i = 0; i < levels.size(); i++)
+        {
+            Level &level = levels[i];
+            if (i > 0)
+            {
+                const Target &above = levels[i - 1].blurred;
+                glUseProgram(extractProgram);
+                glUniform2f(texelSize, 1.0f / above.width, 1.0f / above.height);
+                glUniform4fv(glGetUniformLocation(extractProgram, "region"), 1, whole);
+                glUniform1f(glGetUniformLocation(extractProgram, "threshold"), 0.0f);
+                BindTexture(GL_TEXTURE0, above.texture);
+                DrawInto(level.blurred);
+            }
+            glUseProgram(blurProgram);
+            glUniform2f(direction, 1.0f / level.blurred.width, 0.0f);
+            BindTexture(GL_TEXTURE0, level.blurred.texture);
+            DrawInto(level.across);
+            glUniform2f(direction, 0.0f, 1.0f / level.across.height);
+            BindTexture(GL_TEXTURE0, level.across.texture);
+            DrawInto(level.blurred);
+        }
+
+        /* Each level added into the one above it, smallest first */
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        glUniform2f(direction, 0.0f, 0.0f);
+        for (size_t i = levels.size() - 1; i > 0; i--)
+        {
+            BindTexture(GL_TEXTURE0, levels[i].blurred.texture);
+            DrawInto(levels[i - 1].blurred);
+        }
+        glDisable(GL_BLEND);
+        EndStage();
+    }
+
+    {
+        ScopedTimer timer("bloom:composite");
+        BeginStage(COMPOSITE);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+        glViewport(originX, originY, viewWidth, viewHeight);
+        glEnable(GL_DEPTH_TEST);
+        glDepthFunc(GL_ALWAYS);
+        glDepthMask(GL_TRUE);
+        glUseProgram(compositeProgram);
+        glUniform4fv(glGetUniformLocation(compositeProgram, "region"), 1, sceneRegion);
+        glUniform1f(glGetUniformLocation(compositeProgram, "intensity"), (GLfloat)intensity);
+        BindTexture(GL_TEXTURE0, scene.texture);
+        BindTexture(GL_TEXTURE1, sceneDepth);
+        BindTexture(GL_TEXTURE2, levels[0].blurred.texture);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        EndStage();
+    }
+
+    if (timing)
+    {
+        issued[querySlot] = true;
+        querySlot = (querySlot + 1) % QUERY_FRAMES;
+    }
+
+    BindTexture(GL_TEXTURE2, 0);
+    BindTexture(GL_TEXTURE1, 0);
+    BindTexture(GL_TEXTURE0, 0);
+    glBindVertexArray(0);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    glDepthFunc(depthFunc);
+    glDepthMask(depthMask);
+    if (!depthTest)
+        glDisable(GL_DEPTH_TEST);
+    glBlendFuncSeparate(blendFunc[0], blendFunc[1], blendFunc[2], blendFunc[3]);
+    if (blend)
+        glEnable(GL_BLEND);
+    if (scissor)
+        glEnable(GL_SCISSOR_TEST);
+    GLUtilities::ReleaseVTKShader(ren);
+}
+
+void vtkBloomPass::ReleaseGraphicsResources(vtkWindow *window)
+{
+    super::ReleaseGraphicsResources(window);
+    DeleteTargets();
+    if (extractProgram)
+    {
+        glDeleteProgram(extractProgram);
+        glDeleteProgram(blurProgram);
+        glDeleteProgram(compositeProgram);
+        glDeleteVertexArrays(1, &emptyVertexArray);
+    }
+    if (timing)
+        for (int f = 0; f < QUERY_FRAMES; f++)
+        {
+            glDeleteQueries(STAGE_COUNT, queries[f]);
+            std::fill(queries[f], queries[f] + STAGE_COUNT, 0);
+            issued[f] = false;
+        }
+    extractProgram = blurProgram = compositeProgram = 0;
+    emptyVertexArray = 0;
+    timing           = false;
+    querySlot        = 0;
+}
@@ -0,0 +1,134 @@
+/*
+ * Bloom pass
+ *
+ * Gives the glow tank its glow. The delegate pass renders the scene into
+ * a half-float colour target, so lit and emissive surfaces can be brighter
+ * than white. Whatever is brighter than the threshold is extracted into a
+ * reduced-size target and blurred through a chain of levels, each half the
+ * size of the one before, with a separable Gaussian on every level. The
+ * levels are then added back up the chain and the result is added to the
+ * scene as it is copied to the window, along with the scene's depth.
+ *
+ * The first blur level's size, as a fraction of the window, and the
+ * number of levels set the cost: a small first level with many levels
+ * gives a wide, cheap glow. Each stage is timed on the GPU with timer
+ * queries, read a few frames late so nothing waits.
+ */
+
+#ifndef FISHTANK_VTKBLOOMPASS_H
+#define FISHTANK_VTKBLOOMPASS_H
+
+#include <vtk_glew.h>
+
+#include <vtkImageProcessingPass.h>
+#include <vtkObjectFactory.h>
+#include <vtkRenderState.h>
+#include <vtkWindow.h>
+
+#include <vector>
+
+class vtkBloomPass : public vtkImageProcessingPass
+{
+    private:
+        typedef vtkImageProcessingPass super;
+
+    public:
+        static vtkBloomPass *New();
+
+        enum Stage { SCENE, EXTRACT, BLUR, COMPOSITE, STAGE_COUNT };
+
+        static const int MAX_LEVELS = 6;
+
+        static const char *GetStageName(int stage);
+
+        /* Brightness, the largest of r, g and b, above which a pixel
+         * glows; 1 by default */
+        void   SetThreshold(double value) { threshold = value; }
+        double GetThreshold() const { return threshold; }
+
+        /* How strongly the glow is added to the scene; 1 by default */
+        void   SetIntensity(double value) { intensity = value; }
+        double GetIntensity() const { return intensity; }
+
+        /* Size of the first blur level as a fraction of the window, from
+         * 0.05 to 1; 0.5 by default */
+        void   SetResolution(double fraction);
+        double GetResolution() const { return resolution; }
+
+        /* Blur levels, 1 to MAX_LEVELS; 5 by default */
+        void SetLevels(int count);
+        int  GetLevels() const { return levelCount; }
+
+        /* GPU milliseconds a stage took, as of a few frames ago; negative
+         * until known, and always without timer query support */
+        double GetStageTime(int stage) const { return stageTimes[stage]; }
+
+        virtual void Render(const vtkRenderState *s);
+        virtual void ReleaseGraphicsResources(vtkWindow *window);
+
+    protected:
+        vtkBloomPass();
+        ~vtkBloomPass();
+
+    private:
+        vtkBloomPass(const vtkBloomPass &);
+        void operator=(const vtkBloomPass &);
+
+        /* A texture and the framebuffer that draws into it */
+        struct Target
+        {
+            GLuint framebuffer;
+            GLuint texture;
+            int    width;
+            int    height;
+        };
+
+        /* Blur results and the intermediate of the separable blur */
+        struct Level
+        {
+            Target blurred;
+            Target across;
+        };
+
+        static const int QUERY_FRAMES = 3;
+
+        bool Initialize();
+        void Resize(int width, int height);
+        void DeleteTargets();
+        static void CreateTarget(Target &target, int width, int height);
+        static void DeleteTarget(Target &target);
+
+        /* Draw one full-screen triangle into a target */
+        void DrawInto(const Target &target);
+
+        void BeginStage(int stage);
+        void EndStage();
+        void ReadStageTimes();
+
+        double threshold;
+        double intensity;
+        double resolution;
+        int    levelCount;
+        double stageTimes[STAGE_COUNT];
+
+        GLuint extractProgram;
+        GLuint blurProgram;
+        GLuint compositeProgram;
+        GLuint emptyVertexArray;
+        bool   programFailed;
+
+        Target             scene;
+        GLuint             sceneDepth;
+        std::vector<Level> levels;
+        int                width;
+        int                height;
+        int                builtLevels;
+        double             builtResolution;
+
+        bool   timing;
+        GLuint queries[QUERY_FRAMES][STAGE_COUNT];
+        bool   issued[QUERY_FRAMES];
+        int    querySlot;
+};
+
+#endif
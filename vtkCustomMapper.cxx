@@ -0,0 +1,75 @@
+/*
+ * VTK OpenGL mapper extensions used for every model in the tank
+ */
+
+#include "vtkCustomMapper.h"
+
+#include "LevelOfDetail.h"
+
+#include <vtkMath.h>
+
+vtkStandardNewMacro(vtkCustomMapperP);
+
+void vtkCustomMapperP::SetLevels(const std::vector<vtkSmartPointer<vtkPolyData> > &levels)
+{
+    /* Their buffers can only go with the context current */
+    retiredMappers.insert(retiredMappers.end(), levelMappers.begin(), levelMappers.end());
+    levelMappers.clear();
+    for (size_t i = 1; i < levels.size(); i++)
+    {
+        vtkSmartPointer<vtkOpenGLPolyDataMapper> mapper = vtkSmartPointer<vtkOpenGLPolyDataMapper>::New();
+        mapper->SetInputData(levels[i]);
+        levelMappers.push_back(mapper);
+    }
+    currentLevel = 0;
+}
+
+void vtkCustomMapperP::ReleaseRetiredLevels(vtkWindow *win)
+{
+    for (size_t i = 0; i < retiredMappers.size(); i++)
+        retiredMappers[i]->ReleaseGraphicsResources(win);
+    retiredMappers.clear();
+}
+
+/* Sized by the actor's world bounds, which follow its moves and scaling */
+vtkOpenGLPolyDataMapper *vtkCustomMapperP::SelectLevel(vtkRenderer *ren, vtkActor *act)
+{
+    if (levelMappers.empty())
+        return NULL;
+    double *bounds = act->GetBounds();
+    if (!bounds || !vtkMath::AreBoundsInitialized(bounds))
+        return NULL;
+
+    LevelOfDetail::ScreenProjection projection(ren);
+    currentLevel = LevelOfDetail::SelectLevel(currentLevel, (int)levelMappers.size() + 1,
+                                              projection.GetSize(bounds));
+    return currentLevel > 0 ? levelMappers[currentLevel - 1].Get() : NULL;
+}
+
+vtkIdType vtkCustomMapperP::GetNumberOfDrawnTriangles()
+{
+    vtkPolyData *mesh = currentLevel > 0 ? levelMappers[currentLevel - 1]->GetInput() : this->GetInput();
+    return mesh ? mesh->GetNumberOfPolys() : 0;
+}
+
+void vtkCustomMapperP::DrawAxes(vtkRenderer *ren, vtkActor *act)
+{
+    if (axes.IsEmpty())
+    {
+        const float         origin[3]    = { 0, 0, 0 };
+        const float         ends[3][3]   = { { 10, 0, 0 }, { 0, 10, 0 }, { 0, 0, 10 } };
+        const unsigned char colors[3][3] = { { 255, 0, 0 }, { 0, 255, 0 }, { 0, 0, 255 } };
+        for (int axis = 0; axis < 3; axis++)
+            axes.AddLine(origin, ends[axis], colors[axis]);
+    }
+    axes.Draw(ren, act->GetMatrix());
+}
+
+void vtkCustomMapperP::ReleaseGraphicsResources(vtkWindow *win)
+{
+    axes.ReleaseGraphicsResources();
+    for (size_t i = 0; i < levelMappers.size(); i++)
+        levelMappers[i]->ReleaseGraphicsResources(win);
+    ReleaseRetiredLevels(win);
+    super::ReleaseGraphicsResources(win);
+}
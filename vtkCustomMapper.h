@@ -0,0 +1,90 @@
+/*
+ * VTK OpenGL mapper extensions used for every model in the tank
+ */
+
+#ifndef FISHTANK_VTKCUSTOMMAPPER_H
+#define FISHTANK_VTKCUSTOMMAPPER_H
+
+#include "DebugLines.h"
+#include "Profiler.h"
+
+#include <vtkActor.h>
+#include <vtkObjectFactory.h>
+#include <vtkOpenGLPolyDataMapper.h>
+#include <vtkPolyData.h>
+#include <vtkRenderer.h>
+#include <vtkSmartPointer.h>
+#include <vtkWindow.h>
+
+#include <vector>
+
+/*************
+ *
+ * VTK OpenGL classes
+ *
+ * ***********/
+
+/* Class to extend VTK's OpenGL mapper. Lighting is VTK's own shader
+ * path; the mapper adds levels of detail and an axes overlay. */
+class vtkCustomMapperP : public vtkOpenGLPolyDataMapper
+{
+    private:
+        typedef vtkOpenGLPolyDataMapper super;
+
+    public:
+        bool displayAxes;
+
+        static vtkCustomMapperP *New();
+
+        /* Coarser meshes to draw in place of the input while the actor is
+         * small on screen, finest first; levels[0] is the input itself.
+         * Levels replaced after a render are freed at the next one. */
+        void SetLevels(const std::vector<vtkSmartPointer<vtkPolyData> > &levels);
+
+        /* Level drawn last frame, 0 being the input */
+        int GetCurrentLevel() const { return currentLevel; }
+
+        /* Triangles in the mesh of the current level */
+        vtkIdType GetNumberOfDrawnTriangles();
+
+        vtkCustomMapperP() 
+        {
+            displayAxes  = false;
+            currentLevel = 0;
+        }
+
+        // RenderPiece is called whenever geometry to be rendered. If not overwritten, defaults to
+        // superclass implementation
+        virtual void RenderPiece(vtkRenderer *ren, vtkActor *act)
+        {
+            ScopedTimer timer("draw:custom");
+            ReleaseRetiredLevels(ren->GetRenderWindow());
+            vtkOpenGLPolyDataMapper *level = SelectLevel(ren, act);
+            if (level)
+                level->RenderPiece(ren, act);
+            else
+                super::RenderPiece(ren, act);
+
+            if (displayAxes)
+                DrawAxes(ren, act);
+        }
+
+        virtual void ReleaseGraphicsResources(vtkWindow *win);
+
+    private:
+        /* The mapper for this frame's level, or null for the input */
+        vtkOpenGLPolyDataMapper *SelectLevel(vtkRenderer *ren, vtkActor *act);
+
+        void ReleaseRetiredLevels(vtkWindow *win);
+
+        /* Red, green and blue lines along the model's x, y and z */
+        void DrawAxes(vtkRenderer *ren, vtkActor *act);
+
+        /* One per level below the input, each with its own buffers */
+        std::vector<vtkSmartPointer<vtkOpenGLPolyDataMapper> > levelMappers;
+        std::vector<vtkSmartPointer<vtkOpenGLPolyDataMapper> > retiredMappers;
+        int                                                    currentLevel;
+        DebugLines                                             axes;
+};
+
+#endif
@@ -0,0 +1,333 @@
+/*
+ * Fog pass
+ */
+
+#include "vtkFogPass.h"
+
+#include "GLUtilities.h"
+#include "Profiler.h"
+
+#include <vtkCamera.h>
+#include <vtkMatrix4x4.h>
+#include <vtkRenderer.h>
+#include <vtkSmartPointer.h>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+vtkStandardNewMacro(vtkFogPass);
+
+namespace
+{
+/* One triangle that covers the viewport, as the bloom pass draws */
+const char *VERTEX_SHADER =
+    "#version 150\n"
+    "out vec2 texCoord;\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);\n"
+    "    texCoord = corner;\n"
+    "    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);\n"
+    "}\n";
+
+/* The depth and the viewport position make the pixel's clip space point,
+ * which the inverse projection takes back to the eye's frame. Region maps
+ * the viewport onto the part of the scene target drawn. */
+const char *FOG_FRAGMENT_SHADER =
+    "#version 150\n"
+    "uniform sampler2D scene;\n"
+    "uniform sampler2D sceneDepth;\n"
+    "uniform vec4  region;\n"
+    "uniform mat4  clipToView;\n"
+    "uniform vec3  fogColor;\n"
+    "uniform vec3  extinction;\n"
+    "uniform float start;\n"
+    "in vec2 texCoord;\n"
+    "out vec4 fragOutput0;\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 uv = region.xy + texCoord * region.zw;\n"
+    "    float depth = texture(sceneDepth, uv).r;\n"
+    "    vec4 view = clipToView * vec4(texCoord * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);\n"
+    "    float range = length(view.xyz / view.w);\n"
+    "    vec3 transmittance = exp(-extinction * max(range - start, 0.0));\n"
+    "    fragOutput0 = vec4(mix(fogColor, texture(scene, uv).rgb, transmittance), 1.0);\n"
+    "    gl_FragDepth = depth;\n"
+    "}\n";
+
+void SetTextureParameters()
+{
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+void BindTexture(GLenum unit, GLuint texture)
+{
+    glActiveTexture(unit);
+    glBindTexture(GL_TEXTURE_2D, texture);
+}
+}
+
+vtkFogPass::vtkFogPass()
+{
+    for (int c = 0; c < 3; c++)
+    {
+        color[c]      = 0;
+        extinction[c] = 0.02;
+    }
+    start              = 0;
+    time               = -1;
+    program            = 0;
+    regionLocation     = -1;
+    clipToViewLocation = -1;
+    fogColorLocation   = -1;
+    extinctionLocation = -1;
+    startLocation      = -1;
+    emptyVertexArray   = 0;
+    programFailed      = false;
+    framebuffer        = 0;
+    sceneColor         = 0;
+    sceneDepth         = 0;
+    width = height     = 0;
+    timing             = false;
+    for (int f = 0; f < QUERY_FRAMES; f++)
+        queries[f][0] = queries[f][1] = 0;
+    std::fill(issued, issued + QUERY_FRAMES, false);
+    querySlot          = 0;
+}
+
+vtkFogPass::~vtkFogPass()
+{
+    /* GL objects must already be gone via ReleaseGraphicsResources; the
+     * context may not be current here */
+}
+
+void vtkFogPass::SetColor(const double fogColor[3])
+{
+    for (int c = 0; c < 3; c++)
+        color[c] = fogColor[c];
+}
+
+void vtkFogPass::SetExtinction(const double perUnit[3])
+{
+    for (int c = 0; c < 3; c++)
+        extinction[c] = std::max(perUnit[c], 0.0);
+}
+
+bool vtkFogPass::Initialize()
+{
+    if (program)
+        return true;
+    if (programFailed)
+        return false;
+
+    GLUtilities::AttributeBindings none;
+    std::string log;
+    program = GLUtilities::BuildProgram(VERTEX_SHADER, FOG_FRAGMENT_SHADER, none, log);
+    if (!program)
+    {
+        std::cerr << "vtkFogPass: " << log << std::endl;
+        programFailed = true;
+        return false;
+    }
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "scene"), 0);
+    glUniform1i(glGetUniformLocation(program, "sceneDepth"), 1);
+    regionLocation     = glGetUniformLocation(program, "region");
+    clipToViewLocation = glGetUniformLocation(program, "clipToView");
+    fogColorLocation   = glGetUniformLocation(program, "fogColor");
+    extinctionLocation = glGetUniformLocation(program, "extinction");
+    startLocation      = glGetUniformLocation(program, "start");
+
+    /* Core profiles draw nothing without a vertex array bound */
+    glGenVertexArrays(1, &emptyVertexArray);
+
+    timing = GLUtilities::IsSupported(3, 3, "GL_ARB_timer_query");
+    if (timing)
+        for (int f = 0; f < QUERY_FRAMES; f++)
+            glGenQueries(2, queries[f]);
+    return true;
+}
+
+void vtkFogPass::DeleteTargets()
+{
+    if (framebuffer)
+        glDeleteFramebuffers(1, &framebuffer);
+    if (sceneColor)
+        glDeleteTextures(1, &sceneColor);
+    if (sceneDepth)
+        glDeleteTextures(1, &sceneDepth);
+    framebuffer = sceneColor = sceneDepth = 0;
+    width = height = 0;
+}
+
+/* Spanning the renderer's origin as well as its size, as the bloom
+ * pass's scene target does */
+void vtkFogPass::Resize(int sceneWidth, int sceneHeight)
+{
+    if (sceneWidth == width && sceneHeight == height)
+        return;
+    DeleteTargets();
+    width  = sceneWidth;
+    height = sceneHeight;
+
+    glGenTextures(1, &sceneColor);
+    glBindTexture(GL_TEXTURE_2D, sceneColor);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+    SetTextureParameters();
+    glGenTextures(1, &sceneDepth);
+    glBindTexture(GL_TEXTURE_2D, sceneDepth);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    SetTextureParameters();
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, sceneColor, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, sceneDepth, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cerr << "vtkFogPass: the scene framebuffer is incomplete" << std::endl;
+}
+
+/* Reads the oldest frame's query, which has had QUERY_FRAMES - 1 frames
+ * to finish; if it hasn't, the old time stands */
+void vtkFogPass::ReadTime()
+{
+    if (!timing || !issued[querySlot])
+        return;
+    GLuint available = 0;
+    glGetQueryObjectuiv(queries[querySlot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+        return;
+    GLuint64 before = 0, after = 0;
+    glGetQueryObjectui64v(queries[querySlot][0], GL_QUERY_RESULT, &before);
+    glGetQueryObjectui64v(queries[querySlot][1], GL_QUERY_RESULT, &after);
+    time = (after - before) / 1.0e6;
+    Profiler::Get().Count("gpu:fog", time);
+}
+
+void vtkFogPass::Render(const vtkRenderState *s)
+{
+    NumberOfRenderedProps = 0;
+    vtkRenderer *ren = s->GetRenderer();
+    if (!DelegatePass)
+    {
+        std::cerr << "vtkFogPass: no delegate pass to render the scene" << std::endl;
+        return;
+    }
+
+    int viewWidth, viewHeight, originX, originY;
+    ren->GetTiledSizeAndOrigin(&viewWidth, &viewHeight, &originX, &originY);
+    if (viewWidth < 1 || viewHeight < 1 || !Initialize())
+    {
+        /* Clear water rather than nothing */
+        DelegatePass->Render(s);
+        NumberOfRenderedProps = DelegatePass->GetNumberOfRenderedProps();
+        return;
+    }
+
+    ReadTime();
+
+    GLint drawFramebuffer, readFramebuffer, viewport[4], depthFunc;
+    GLboolean depthMask;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer);
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glGetIntegerv(GL_DEPTH_FUNC, &depthFunc);
+    glGetBooleanv(GL_DEPTH_WRITEMASK, &depthMask);
+    GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+    GLboolean blend     = glIsEnabled(GL_BLEND);
+
+    Resize(originX + viewWidth, originY + viewHeight);
+
+    {
+        ScopedTimer timer("fog:scene");
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        double *background = ren->GetBackground();
+        glClearColor((GLfloat)background[0], (GLfloat)background[1], (GLfloat)background[2], 0.0f);
+        glClearDepth(1.0);
+        glDepthMask(GL_TRUE);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        DelegatePass->Render(s);
+        NumberOfRenderedProps = DelegatePass->GetNumberOfRenderedProps();
+    }
+
+    {
+        ScopedTimer timer("fog");
+        if (timing)
+            glQueryCounter(queries[querySlot][0], GL_TIMESTAMP);
+
+        /* The projection VTK's OpenGL camera draws with */
+        vtkSmartPointer<vtkMatrix4x4> clipToView = vtkSmartPointer<vtkMatrix4x4>::New();
+        clipToView->DeepCopy(ren->GetActiveCamera()->GetProjectionTransformMatrix(ren->GetTiledAspectRatio(), -1, 1));
+        clipToView->Invert();
+        float inverse[16];
+        GLUtilities::ToColumnMajor(clipToView, inverse);
+        float region[4] = { (float)originX / width, (float)originY / height,
+                            (float)viewWidth / width, (float)viewHeight / height };
+
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+        glViewport(originX, originY, viewWidth, viewHeight);
+        glDisable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+        glDepthFunc(GL_ALWAYS);
+        glDepthMask(GL_TRUE);
+        glUseProgram(program);
+        glUniform4fv(regionLocation, 1, region);
+        glUniformMatrix4fv(clipToViewLocation, 1, GL_FALSE, inverse);
+        glUniform3f(fogColorLocation, (GLfloat)color[0], (GLfloat)color[1], (GLfloat)color[2]);
+        glUniform3f(extinctionLocation, (GLfloat)extinction[0], (GLfloat)extinction[1], (GLfloat)extinction[2]);
+        glUniform1f(startLocation, (GLfloat)start);
+        BindTexture(GL_TEXTURE0, sceneColor);
+        BindTexture(GL_TEXTURE1, sceneDepth);
+        glBindVertexArray(emptyVertexArray);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        if (timing)
+        {
+            glQueryCounter(queries[querySlot][1], GL_TIMESTAMP);
+            issued[querySlot] = true;
+            querySlot = (querySlot + 1) % QUERY_FRAMES;
+        }
+    }
+
+    BindTexture(GL_TEXTURE1, 0);
+    BindTexture(GL_TEXTURE0, 0);
+    glBindVertexArray(0);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    glDepthFunc(depthFunc);
+    glDepthMask(depthMask);
+    if (!depthTest)
+        glDisable(GL_DEPTH_TEST);
+    if (blend)
+        glEnable(GL_BLEND);
+    GLUtilities::ReleaseVTKShader(ren);
+}
+
+void vtkFogPass::ReleaseGraphicsResources(vtkWindow *window)
+{
+    super::ReleaseGraphicsResources(window);
+    DeleteTargets();
+    if (program)
+    {
+        glDeleteProgram(program);
+        glDeleteVertexArrays(1, &emptyVertexArray);
+    }
+    if (timing)
+    {
+        for (int f = 0; f < QUERY_FRAMES; f++)
+        {
+            glDeleteQueries(2, queries[f]);
+            queries[f][0] = queries[f][1] = 0;
+        }
+        std::fill(issued, issued + QUERY_FRAMES, false);
+    }
+    program          = 0;
+    emptyVertexArray = 0;
+    timing           = false;
+    querySlot        = 0;
+}
@@ -0,0 +1,95 @@
+/*
+ * Fog pass
+ *
+ * Murks the water with distance. The delegate pass renders the scene into
+ * a half-float colour target with a depth texture; one full-screen pass
+ * then turns each pixel's depth back into its distance from the eye and
+ * fades the scene towards the fog colour by Beer-Lambert transmittance,
+ * exp(-extinction * distance), per channel, from the start distance on.
+ * The result goes to the window along with the scene's depth.
+ *
+ * The fog is worked out analytically per pixel, with no marching and no
+ * geometry, so it costs the same whatever is in the tank. Its pass is
+ * timed on the GPU between two timestamps, read a few frames late. A
+ * bloom pass drawing around the fog keeps its own elapsed-time query open
+ * over it, which timestamps, unlike a second elapsed-time query, may be
+ * taken inside; bloom's scene time includes the fog's.
+ */
+
+#ifndef FISHTANK_VTKFOGPASS_H
+#define FISHTANK_VTKFOGPASS_H
+
+#include <vtk_glew.h>
+
+#include <vtkImageProcessingPass.h>
+#include <vtkObjectFactory.h>
+#include <vtkRenderState.h>
+#include <vtkWindow.h>
+
+class vtkFogPass : public vtkImageProcessingPass
+{
+    private:
+        typedef vtkImageProcessingPass super;
+
+    public:
+        static vtkFogPass *New();
+
+        /* What distant things fade to; black by default */
+        void SetColor(const double color[3]);
+
+        /* Light lost per world unit, per channel; 0.02 by default */
+        void SetExtinction(const double extinction[3]);
+
+        /* Distance from the eye at which the fog begins; 0 by default */
+        void   SetStart(double distance) { start = distance; }
+        double GetStart() const { return start; }
+
+        /* GPU milliseconds the fog took, as of a few frames ago; negative
+         * until known, and always without timer query support */
+        double GetTime() const { return time; }
+
+        virtual void Render(const vtkRenderState *s);
+        virtual void ReleaseGraphicsResources(vtkWindow *window);
+
+    protected:
+        vtkFogPass();
+        ~vtkFogPass();
+
+    private:
+        vtkFogPass(const vtkFogPass &);
+        void operator=(const vtkFogPass &);
+
+        static const int QUERY_FRAMES = 3;
+
+        bool Initialize();
+        void Resize(int width, int height);
+        void DeleteTargets();
+        void ReadTime();
+
+        double color[3];
+        double extinction[3];
+        double start;
+        double time;
+
+        GLuint program;
+        GLint  regionLocation;
+        GLint  clipToViewLocation;
+        GLint  fogColorLocation;
+        GLint  extinctionLocation;
+        GLint  startLocation;
+        GLuint emptyVertexArray;
+        bool   programFailed;
+
+        GLuint framebuffer;
+        GLuint sceneColor;
+        GLuint sceneDepth;
+        int    width;
+        int    height;
+
+        bool   timing;
+        GLuint queries[QUERY_FRAMES][2];   /* timestamps before and after */
+        bool   issued[QUERY_FRAMES];
+        int    querySlot;
+};
+
+#endif
@@ -0,0 +1,656 @@
+/*
+ * Instanced mapper
+ */
+
+#include "vtkInstancedMapper.h"
+
+#include "LevelOfDetail.h"
+#include "Profiler.h"
+
+#include <vtkMath.h>
+#include <vtkPolyData.h>
+#include <vtkProperty.h>
+#include <vtkSmartPointer.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+vtkStandardNewMacro(vtkInstancedMapper);
+
+namespace
+{
+enum
+{
+    VERTEX_LOCATION   = 0,
+    NORMAL_LOCATION   = 1,
+    MATRIX_LOCATION   = 2,   /* a mat4 takes locations 2..5 */
+    COLOR_LOCATION    = 6,
+    SWIM_LOCATION     = 7
+};
+
+/* Swim time restarts this often, so that as a float it stays exact to
+ * well under a frame however long the tank has been up */
+const double SWIM_EPOCH = 60.0;
+
+/* Swimming bends the body sideways along x by a wave running from nose to
+ * tail, half a wavelength long, whose sway grows with the square of the
+ * distance from the nose. x' = x + f(z) has normals (nx, ny, nz - f'(z) nx).
+ * Quantized meshes decode their positions from fractions of the bounds and
+ * unfold their octahedral normals first; float meshes pass through with a
+ * unit scale. Normals go to world space by the cofactors of the model
+ * matrix, its inverse transpose up to scale, so that non-uniform scales
+ * leave them perpendicular to the surface; the determinant's sign keeps
+ * mirrored instances' normals pointing out. */
+const char *VERTEX_SHADER =
+    "#version 150\n"
+    "in vec3 vertexMC;\n"
+    "in vec3 normalMC;\n"
+    "in mat4 instanceMatrix;\n"
+    "in vec4 instanceColor;\n"
+    "in vec4 instanceSwim;\n"
+    "uniform mat4 worldToClip;\n"
+    "uniform mat4 actorMatrix;\n"
+    "uniform float swimTime;\n"
+    "uniform vec2 spine;\n"
+    "uniform vec3 positionScale;\n"
+    "uniform vec3 positionOffset;\n"
+    "uniform bool octahedralNormals;\n"
+    "out vec3 normalWC;\n"
+    "out vec3 positionWC;\n"
+    "out vec4 diffuseColor;\n"
+    "void main()\n"
+    "{\n"
+    "    vec3 position = positionOffset + positionScale * vertexMC;\n"
+    "    vec3 normal   = normalMC;\n"
+    "    if (octahedralNormals)\n"
+    "    {\n"
+    "        normal = vec3(normalMC.xy, 1.0 - abs(normalMC.x) - abs(normalMC.y));\n"
+    "        float fold = max(-normal.z, 0.0);\n"
+    "        normal.x += normal.x >= 0.0 ? -fold : fold;\n"
+    "        normal.y += normal.y >= 0.0 ? -fold : fold;\n"
+    "        normal = normalize(normal);\n"
+    "    }\n"
+    "    if (instanceSwim.z > 0.0)\n"
+    "    {\n"
+    "        float t     = clamp((spine.x - position.z) / spine.y, 0.0, 1.0);\n"
+    "        float wave  = 6.2831853 * instanceSwim.y * swimTime + instanceSwim.x - 3.1415927 * t;\n"
+    "        float reach = instanceSwim.z * spine.y;\n"
+    "        position.x += reach * t * t * sin(wave);\n"
+    "        float slope = -reach * (2.0 * t * sin(wave) - 3.1415927 * t * t * cos(wave)) / spine.y;\n"
+    "        normal.z   -= slope * normal.x;\n"
+    "    }\n"
+    "    mat4 modelMatrix = actorMatrix * instanceMatrix;\n"
+    "    vec4 world   = modelMatrix * vec4(position, 1.0);\n"
+    "    gl_Position  = worldToClip * world;\n"
+    "    positionWC   = world.xyz;\n"
+    "    mat3 linear  = mat3(modelMatrix);\n"
+    "    mat3 cofactors = mat3(cross(linear[1], linear[2]), cross(linear[2], linear[0]),\n"
+    "                          cross(linear[0], linear[1]));\n"
+    "    normalWC     = sign(dot(linear[0], cofactors[0])) * (cofactors * normal);\n"
+    "    diffuseColor = instanceColor;\n"
+    "}\n";
+
+/* Same terms as VTK's default lighting: ambient plus per-light Lambert.
+ * The lights come from the shared LightingBlock. Caustics are one more
+ * Lambert term, its light read from the atlas at the fragment's world
+ * position projected onto the axes across the caustics' direction; the
+ * frames uniform holds the two layers to blend and the blend. */
+const char *FRAGMENT_SHADER_BODY =
+    "in vec3 normalWC;\n"
+    "in vec3 positionWC;\n"
+    "in vec4 diffuseColor;\n"
+    "uniform vec3  ambientColor;\n"
+    "uniform float ambientIntensity;\n"
+    "uniform float diffuseIntensity;\n"
+    "uniform bool  causticsOn;\n"
+    "uniform sampler2DArray causticsAtlas;\n"
+    "uniform vec3  causticsDirection;\n"
+    "uniform vec3  causticsAxisU;\n"
+    "uniform vec3  causticsAxisV;\n"
+    "uniform vec3  causticsColor;\n"
+    "uniform vec3  causticsFrames;\n"
+    "out vec4 fragOutput0;\n"
+    "void main()\n"
+    "{\n"
+    "    vec3 n = normalize(gl_FrontFacing ? normalWC : -normalWC);\n"
+    "    vec3 lit = vec3(0.0);\n"
+    "    for (int i = 0; i < lightCount; i++)\n"
+    "        lit += lightColor[i].rgb * max(dot(n, -lightDirection[i].xyz), 0.0);\n"
+    "    if (causticsOn)\n"
+    "    {\n"
+    "        vec2 uv = vec2(dot(positionWC, causticsAxisU), dot(positionWC, causticsAxisV));\n"
+    "        float light = mix(texture(causticsAtlas, vec3(uv, causticsFrames.x)).r,\n"
+    "                          texture(causticsAtlas, vec3(uv, causticsFrames.y)).r, causticsFrames.z);\n"
+    "        lit += causticsColor * light * max(dot(n, -causticsDirection), 0.0);\n"
+    "    }\n"
+    "    vec3 color = ambientIntensity * ambientColor + diffuseIntensity * diffuseColor.rgb * lit;\n"
+    "    fragOutput0 = vec4(color, diffuseColor.a);\n"
+    "}\n";
+}
+
+vtkInstancedMapper::vtkInstancedMapper()
+{
+    instancesModified = false;
+    useFixedBounds    = false;
+    meshUploadTime    = 0;
+    program           = 0;
+    instanceBuffer    = 0;
+    lighting          = NULL;
+    programFailed     = false;
+    quantized         = false;
+    causticsTexture   = NULL;
+    causticsPeriod    = 1;
+    swimEpoch         = 0;
+    SetLevels(std::vector<vtkSmartPointer<vtkPolyData> >());
+}
+
+vtkInstancedMapper::~vtkInstancedMapper()
+{
+    /* GL objects must already be gone via ReleaseGraphicsResources; the
+     * context may not be current here */
+}
+
+void vtkInstancedMapper::AddInstance(const vtkMatrix4x4 *matrix, const double color[3])
+{
+    instanceMatrices.resize(instanceMatrices.size() + 16);
+    instanceColors.resize(instanceColors.size() + 4);
+    instanceSwim.resize(instanceSwim.size() + 4, 0.0f);
+    SetInstance(GetNumberOfInstances() - 1, matrix, color);
+}
+
+void vtkInstancedMapper::SetInstance(int index, const vtkMatrix4x4 *matrix, const double color[3])
+{
+    GLUtilities::ToColumnMajor(matrix, &instanceMatrices[index * 16]);
+    for (int c = 0; c < 3; c++)
+        instanceColors[index * 4 + c] = (float)color[c];
+    instanceColors[index * 4 + 3] = 1.0f;
+    instancesModified = true;
+    this->Modified();
+}
+
+void vtkInstancedMapper::RemoveAllInstances()
+{
+    instanceMatrices.clear();
+    instanceColors.clear();
+    instanceSwim.clear();
+    instanceLevels.clear();
+    instancesModified = true;
+    this->Modified();
+}
+
+void vtkInstancedMapper::SetNumberOfInstances(int count)
+{
+    instanceMatrices.resize(count * 16);
+    instanceColors.resize(count * 4);
+    instanceSwim.resize(count * 4, 0.0f);
+    InstancesModified();
+}
+
+void vtkInstancedMapper::InstancesModified()
+{
+    instancesModified = true;
+    this->Modified();
+}
+
+void vtkInstancedMapper::SetFixedBounds(const double bounds[6])
+{
+    for (int i = 0; i < 6; i++)
+        fixedBounds[i] = bounds[i];
+    useFixedBounds = true;
+    this->Modified();
+}
+
+void vtkInstancedMapper::SetLevels(const std::vector<vtkSmartPointer<vtkPolyData> > &levels)
+{
+    /* GL objects can only go with the context current */
+    for (size_t i = 0; i < meshLevels.size(); i++)
+        if (meshLevels[i].vertexArray || meshLevels[i].buffers)
+            retiredLevels.push_back(meshLevels[i]);
+    meshUploadTime = 0;
+    meshLevels.assign(std::max<size_t>(levels.size(), 1), MeshLevel());
+    for (size_t i = 0; i < meshLevels.size(); i++)
+    {
+        MeshLevel &level = meshLevels[i];
+        if (i > 0)
+            level.mesh = levels[i];
+        level.vertexArray = 0;
+        level.buffers     = NULL;
+        level.first       = 0;
+        level.count       = 0;
+    }
+    instanceLevels.clear();
+    instancesModified = true;
+    this->Modified();
+}
+
+vtkIdType vtkInstancedMapper::GetNumberOfDrawnTriangles() const
+{
+    vtkIdType triangles = 0;
+    for (size_t l = 0; l < meshLevels.size(); l++)
+        if (meshLevels[l].buffers)
+            triangles += (vtkIdType)meshLevels[l].buffers->GetIndexCount() / 3 * meshLevels[l].count;
+    return triangles;
+}
+
+void vtkInstancedMapper::SetInstanceSwim(int index, float phase, float speed, float amplitude)
+{
+    float *swim = GetInstanceSwimPointer(index);
+    swim[0] = phase;
+    swim[1] = speed;
+    swim[2] = amplitude;
+    swim[3] = 0;
+    InstancesModified();
+}
+
+/* The phase now is phase + 2 pi speed (time - swimEpoch), worked out in
+ * double as the epoch's rebasing is */
+void vtkInstancedMapper::SetInstanceSwimSpeed(int index, float speed, float amplitude)
+{
+    float *swim = GetInstanceSwimPointer(index);
+    double elapsed = FrameClock::Get().GetTime() - swimEpoch;
+    swim[0] = (float)std::fmod(swim[0] + 2 * vtkMath::Pi() * (swim[1] - speed) * elapsed, 2 * vtkMath::Pi());
+    swim[1] = speed;
+    swim[2] = amplitude;
+    InstancesModified();
+}
+
+/* The atlas is laid across the two axes perpendicular to the direction,
+ * the first of them also perpendicular to whichever world axis the
+ * direction is least along */
+void vtkInstancedMapper::SetCaustics(const std::shared_ptr<const CausticsAtlas> &atlas, const double direction[3],
+                                     double tile, const double color[3], double period)
+{
+    causticsAtlas = atlas;
+    if (!atlas)
+    {
+        this->Modified();
+        return;
+    }
+
+    double d[3] = { direction[0], direction[1], direction[2] };
+    vtkMath::Normalize(d);
+    double least[3] = { 0, 0, 0 };
+    int axis = 0;
+    for (int c = 1; c < 3; c++)
+        if (std::fabs(d[c]) < std::fabs(d[axis]))
+            axis = c;
+    least[axis] = 1;
+    double u[3], v[3];
+    vtkMath::Cross(d, least, u);
+    vtkMath::Normalize(u);
+    vtkMath::Cross(d, u, v);
+    for (int c = 0; c < 3; c++)
+    {
+        causticsDirection[c] = (float)d[c];
+        causticsAxes[c]      = (float)(u[c] / tile);
+        causticsAxes[3 + c]  = (float)(v[c] / tile);
+        causticsColor[c]     = (float)color[c] * CausticsAtlas::INTENSITY_SCALE;
+    }
+    causticsPeriod = period;
+    this->Modified();
+}
+
+double *vtkInstancedMapper::GetBounds()
+{
+    if (useFixedBounds)
+    {
+        for (int i = 0; i < 6; i++)
+            this->Bounds[i] = fixedBounds[i];
+        return this->Bounds;
+    }
+
+    this->Bounds[0] = this->Bounds[2] = this->Bounds[4] = 1;
+    this->Bounds[1] = this->Bounds[3] = this->Bounds[5] = -1;
+    vtkPolyData *input = this->GetInput();
+    if (!input || input->GetNumberOfPoints() == 0 || GetNumberOfInstances() == 0)
+        return this->Bounds;
+
+    double mesh[6];
+    input->GetBounds(mesh);
+    bool first = true;
+    for (int i = 0; i < GetNumberOfInstances(); i++)
+    {
+        const float *m = &instanceMatrices[i * 16];
+        for (int corner = 0; corner < 8; corner++)
+        {
+            double p[3] = { mesh[corner & 1], mesh[2 + ((corner >> 1) & 1)], mesh[4 + ((corner >> 2) & 1)] };
+            for (int r = 0; r < 3; r++)
+            {
+                double v = m[r] * p[0] + m[4 + r] * p[1] + m[8 + r] * p[2] + m[12 + r];
+                if (first || v < this->Bounds[2 * r])
+                    this->Bounds[2 * r] = v;
+                if (first || v > this->Bounds[2 * r + 1])
+                    this->Bounds[2 * r + 1] = v;
+            }
+            first = false;
+        }
+    }
+    return this->Bounds;
+}
+
+void vtkInstancedMapper::ReleaseLevel(MeshLevel &level)
+{
+    if (level.vertexArray)
+        glDeleteVertexArrays(1, &level.vertexArray);
+    if (level.buffers)
+        level.buffers->Release();
+    level.vertexArray = 0;
+    level.buffers     = NULL;
+}
+
+/* The new buffers are acquired before the old are released, so a mesh
+ * uploaded again keeps its buffers */
+void vtkInstancedMapper::UploadMesh(MeshLevel &level, vtkPolyData *mesh, vtkRenderWindow *window)
+{
+    MeshBuffers *buffers = MeshBuffers::Acquire(window, mesh, quantized);
+    if (level.buffers)
+        level.buffers->Release();
+    level.buffers = buffers;
+    glBindVertexArray(level.vertexArray);
+    buffers->Attach(VERTEX_LOCATION, NORMAL_LOCATION);
+    glBindVertexArray(0);
+}
+
+/* Each instance is sized by the mesh's bounding sphere under its matrix
+ * and the actor's, scaled by the largest axis scale of either */
+bool vtkInstancedMapper::AssignLevels(vtkRenderer *ren, vtkActor *act)
+{
+    double bounds[6];
+    this->GetInput()->GetBounds(bounds);
+    double center[4] = { 0, 0, 0, 1 }, radius2 = 0;
+    for (int c = 0; c < 3; c++)
+    {
+        center[c] = (bounds[2 * c] + bounds[2 * c + 1]) / 2;
+        double half = (bounds[2 * c + 1] - bounds[2 * c]) / 2;
+        radius2 += half * half;
+    }
+    double radius = std::sqrt(radius2);
+
+    vtkMatrix4x4 *actorMatrix = act->GetMatrix();
+    double actorScale2 = 0;
+    for (int column = 0; column < 3; column++)
+    {
+        double length2 = 0;
+        for (int r = 0; r < 3; r++)
+            length2 += actorMatrix->GetElement(r, column) * actorMatrix->GetElement(r, column);
+        actorScale2 = std::max(actorScale2, length2);
+    }
+
+    LevelOfDetail::ScreenProjection projection(ren);
+    int  levelCount = (int)meshLevels.size();
+    bool changed    = false;
+    instanceLevels.resize(GetNumberOfInstances(), -1);
+    for (int i = 0; i < GetNumberOfInstances(); i++)
+    {
+        const float *m = &instanceMatrices[i * 16];
+        double local[4], world[4], scale2 = 0;
+        for (int r = 0; r < 4; r++)
+            local[r] = m[r] * center[0] + m[4 + r] * center[1] + m[8 + r] * center[2] + m[12 + r];
+        actorMatrix->MultiplyPoint(local, world);
+        for (int column = 0; column < 3; column++)
+        {
+            const float *axis = m + 4 * column;
+            scale2 = std::max(scale2, (double)(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]));
+        }
+
+        double pixels = projection.GetSize(world, radius * std::sqrt(scale2 * actorScale2));
+        int level = LevelOfDetail::SelectLevel(instanceLevels[i], levelCount, pixels);
+        changed = changed || level != instanceLevels[i];
+        instanceLevels[i] = (signed char)level;
+    }
+    return changed;
+}
+
+/* Matrices, colours and swim parameters, one block each, with a divisor of
+ * one. With more than one level the instances are regrouped by level
+ * first, and each level's vertex array starts at its own run. */
+void vtkInstancedMapper::UploadInstances()
+{
+    int count = GetNumberOfInstances();
+    const float *matrices = instanceMatrices.empty() ? NULL : &instanceMatrices[0];
+    const float *colors   = instanceColors.empty() ? NULL : &instanceColors[0];
+    const float *swims    = instanceSwim.empty() ? NULL : &instanceSwim[0];
+    if (meshLevels.size() == 1)
+    {
+        meshLevels[0].first = 0;
+        meshLevels[0].count = count;
+    }
+    else
+    {
+        for (size_t l = 0; l < meshLevels.size(); l++)
+            meshLevels[l].count = 0;
+        for (int i = 0; i < count; i++)
+            meshLevels[instanceLevels[i]].count++;
+        int first = 0;
+        for (size_t l = 0; l < meshLevels.size(); l++)
+        {
+            meshLevels[l].first = first;
+            first += meshLevels[l].count;
+        }
+
+        groupedMatrices.resize(instanceMatrices.size());
+        groupedColors.resize(instanceColors.size());
+        groupedSwim.resize(instanceSwim.size());
+        std::vector<int> cursor(meshLevels.size());
+        for (size_t l = 0; l < meshLevels.size(); l++)
+            cursor[l] = meshLevels[l].first;
+        for (int i = 0; i < count; i++)
+        {
+            int slot = cursor[instanceLevels[i]]++;
+            std::copy(matrices + i * 16, matrices + i * 16 + 16, &groupedMatrices[slot * 16]);
+            std::copy(colors + i * 4, colors + i * 4 + 4, &groupedColors[slot * 4]);
+            std::copy(swims + i * 4, swims + i * 4 + 4, &groupedSwim[slot * 4]);
+        }
+        if (count)
+        {
+            matrices = &groupedMatrices[0];
+            colors   = &groupedColors[0];
+            swims    = &groupedSwim[0];
+        }
+    }
+
+    size_t matrixBytes = instanceMatrices.size() * sizeof(float);
+    size_t colorBytes  = instanceColors.size() * sizeof(float);
+    size_t swimBytes   = instanceSwim.size() * sizeof(float);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, matrixBytes + colorBytes + swimBytes, NULL, GL_DYNAMIC_DRAW);
+    if (matrixBytes)
+    {
+        glBufferSubData(GL_ARRAY_BUFFER, 0, matrixBytes, matrices);
+        glBufferSubData(GL_ARRAY_BUFFER, matrixBytes, colorBytes, colors);
+        glBufferSubData(GL_ARRAY_BUFFER, matrixBytes + colorBytes, swimBytes, swims);
+    }
+    for (size_t l = 0; l < meshLevels.size(); l++)
+    {
+        size_t first = meshLevels[l].first;
+        glBindVertexArray(meshLevels[l].vertexArray);
+        for (int column = 0; column < 4; column++)
+        {
+            glEnableVertexAttribArray(MATRIX_LOCATION + column);
+            glVertexAttribPointer(MATRIX_LOCATION + column, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(float),
+                                  (void *)((first * 16 + column * 4) * sizeof(float)));
+            glVertexAttribDivisor(MATRIX_LOCATION + column, 1);
+        }
+        glEnableVertexAttribArray(COLOR_LOCATION);
+        glVertexAttribPointer(COLOR_LOCATION, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float),
+                              (void *)(matrixBytes + first * 4 * sizeof(float)));
+        glVertexAttribDivisor(COLOR_LOCATION, 1);
+        glEnableVertexAttribArray(SWIM_LOCATION);
+        glVertexAttribPointer(SWIM_LOCATION, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float),
+                              (void *)(matrixBytes + colorBytes + first * 4 * sizeof(float)));
+        glVertexAttribDivisor(SWIM_LOCATION, 1);
+    }
+    glBindVertexArray(0);
+
+    instancesModified = false;
+}
+
+void vtkInstancedMapper::RenderPiece(vtkRenderer *ren, vtkActor *act)
+{
+    vtkPolyData *input = this->GetInput();
+    if (!input || GetNumberOfInstances() == 0 || programFailed)
+        return;
+    ScopedTimer timer("draw:instanced");
+
+    if (!program)
+    {
+        GLUtilities::AttributeBindings attributes;
+        attributes.push_back(std::make_pair((GLuint)VERTEX_LOCATION, "vertexMC"));
+        attributes.push_back(std::make_pair((GLuint)NORMAL_LOCATION, "normalMC"));
+        attributes.push_back(std::make_pair((GLuint)MATRIX_LOCATION, "instanceMatrix"));
+        attributes.push_back(std::make_pair((GLuint)COLOR_LOCATION, "instanceColor"));
+        attributes.push_back(std::make_pair((GLuint)SWIM_LOCATION, "instanceSwim"));
+        std::string log;
+        std::string fragmentShader = std::string("#version 150\n") + LightingBlock::GLSL + FRAGMENT_SHADER_BODY;
+        program = GLUtilities::BuildProgram(VERTEX_SHADER, fragmentShader.c_str(), attributes, log);
+        if (!program)
+        {
+            std::cerr << "vtkInstancedMapper: " << log << std::endl;
+            programFailed = true;
+            return;
+        }
+        LightingBlock::Attach(program);
+        worldToClipLocation       = glGetUniformLocation(program, "worldToClip");
+        actorMatrixLocation       = glGetUniformLocation(program, "actorMatrix");
+        ambientColorLocation      = glGetUniformLocation(program, "ambientColor");
+        ambientIntensityLocation  = glGetUniformLocation(program, "ambientIntensity");
+        diffuseIntensityLocation  = glGetUniformLocation(program, "diffuseIntensity");
+        swimTimeLocation          = glGetUniformLocation(program, "swimTime");
+        spineLocation             = glGetUniformLocation(program, "spine");
+        positionScaleLocation     = glGetUniformLocation(program, "positionScale");
+        positionOffsetLocation    = glGetUniformLocation(program, "positionOffset");
+        octahedralLocation        = glGetUniformLocation(program, "octahedralNormals");
+        causticsOnLocation        = glGetUniformLocation(program, "causticsOn");
+        causticsDirectionLocation = glGetUniformLocation(program, "causticsDirection");
+        causticsAxisULocation     = glGetUniformLocation(program, "causticsAxisU");
+        causticsAxisVLocation     = glGetUniformLocation(program, "causticsAxisV");
+        causticsColorLocation     = glGetUniformLocation(program, "causticsColor");
+        causticsFramesLocation    = glGetUniformLocation(program, "causticsFrames");
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "causticsAtlas"), 0);
+        lighting = LightingBlock::Acquire(ren);
+        glGenBuffers(1, &instanceBuffer);
+        instancesModified = true;
+    }
+    for (size_t l = 0; l < meshLevels.size(); l++)
+    {
+        MeshLevel &level = meshLevels[l];
+        if (level.vertexArray)
+            continue;
+        glGenVertexArrays(1, &level.vertexArray);
+        if (level.mesh)
+            UploadMesh(level, level.mesh, ren->GetRenderWindow());
+        instancesModified = true;
+    }
+    if (input->GetMTime() > meshUploadTime)
+    {
+        UploadMesh(meshLevels[0], input, ren->GetRenderWindow());
+        meshUploadTime = input->GetMTime();
+    }
+    /* Only now, so that meshes kept across SetLevels() keep their buffers */
+    for (size_t l = 0; l < retiredLevels.size(); l++)
+        ReleaseLevel(retiredLevels[l]);
+    retiredLevels.clear();
+    /* A new atlas is acquired before the old is let go, as meshes are */
+    if (causticsAtlas && (!causticsTexture || causticsTexture->GetAtlas() != causticsAtlas.get()))
+    {
+        CausticsTexture *texture = CausticsTexture::Acquire(ren->GetRenderWindow(), causticsAtlas);
+        if (causticsTexture)
+            causticsTexture->Release();
+        causticsTexture = texture;
+    }
+    /* Restarting the swim time turns each phase on by the time skipped,
+     * worked out in double, so the sway carries on without a jump */
+    double time    = FrameClock::Get().GetTime();
+    double skipped = std::floor((time - swimEpoch) / SWIM_EPOCH) * SWIM_EPOCH;
+    if (skipped != 0)
+    {
+        for (size_t i = 0; i < instanceSwim.size(); i += 4)
+            instanceSwim[i] = (float)std::fmod(instanceSwim[i] + 2 * vtkMath::Pi() * instanceSwim[i + 1] * skipped,
+                                               2 * vtkMath::Pi());
+        swimEpoch += skipped;
+        instancesModified = true;
+    }
+    bool regrouped = meshLevels.size() > 1 && AssignLevels(ren, act);
+    if (instancesModified || regrouped)
+        UploadInstances();
+
+    float worldToClip[16], actorMatrix[16];
+    GLUtilities::GetWorldToClip(ren, worldToClip);
+    GLUtilities::ToColumnMajor(act->GetMatrix(), actorMatrix);
+
+    vtkProperty *prop = act->GetProperty();
+    double *ambientColor = prop->GetAmbientColor();
+
+    /* The nose is the mesh's far end along +z */
+    double bounds[6];
+    input->GetBounds(bounds);
+    float spine[2] = { (float)bounds[5], (float)std::max(bounds[5] - bounds[4], 1e-6) };
+
+    glUseProgram(program);
+    glUniformMatrix4fv(worldToClipLocation, 1, GL_FALSE, worldToClip);
+    glUniformMatrix4fv(actorMatrixLocation, 1, GL_FALSE, actorMatrix);
+    glUniform3f(ambientColorLocation, (float)ambientColor[0], (float)ambientColor[1], (float)ambientColor[2]);
+    glUniform1f(ambientIntensityLocation, (float)prop->GetAmbient());
+    glUniform1f(diffuseIntensityLocation, (float)prop->GetDiffuse());
+    glUniform1f(swimTimeLocation, (float)(time - swimEpoch));
+    glUniform2fv(spineLocation, 1, spine);
+    glUniform1i(octahedralLocation, quantized ? 1 : 0);
+    glUniform1i(causticsOnLocation, causticsAtlas ? 1 : 0);
+    if (causticsAtlas)
+    {
+        /* Frames blend linearly, the last into the first */
+        int    frames   = causticsTexture->GetNumberOfFrames();
+        double loop     = time / causticsPeriod;
+        double position = (loop - std::floor(loop)) * frames;
+        int    frame    = std::min((int)position, frames - 1);
+        glUniform3fv(causticsDirectionLocation, 1, causticsDirection);
+        glUniform3fv(causticsAxisULocation, 1, causticsAxes);
+        glUniform3fv(causticsAxisVLocation, 1, causticsAxes + 3);
+        glUniform3fv(causticsColorLocation, 1, causticsColor);
+        glUniform3f(causticsFramesLocation, (float)frame, (float)((frame + 1) % frames), (float)(position - frame));
+        causticsTexture->Bind(GL_TEXTURE0);
+    }
+    lighting->Bind();
+
+    for (size_t l = 0; l < meshLevels.size(); l++)
+    {
+        const MeshLevel &level = meshLevels[l];
+        if (level.count == 0)
+            continue;
+        glUniform3fv(positionScaleLocation, 1, level.buffers->GetPositionScale());
+        glUniform3fv(positionOffsetLocation, 1, level.buffers->GetPositionOffset());
+        glBindVertexArray(level.vertexArray);
+        glDrawElementsInstanced(GL_TRIANGLES, level.buffers->GetIndexCount(), level.buffers->GetIndexType(),
+                                (void *)0, level.count);
+    }
+    glBindVertexArray(0);
+    if (causticsAtlas)
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    GLUtilities::ReleaseVTKShader(ren);
+}
+
+void vtkInstancedMapper::ReleaseGraphicsResources(vtkWindow *win)
+{
+    if (program)
+    {
+        glDeleteProgram(program);
+        glDeleteBuffers(1, &instanceBuffer);
+        lighting->Release();
+    }
+    for (size_t l = 0; l < meshLevels.size(); l++)
+        ReleaseLevel(meshLevels[l]);
+    for (size_t l = 0; l < retiredLevels.size(); l++)
+        ReleaseLevel(retiredLevels[l]);
+    retiredLevels.clear();
+    if (causticsTexture)
+        causticsTexture->Release();
+    program         = 0;
+    instanceBuffer  = 0;
+    lighting        = NULL;
+    causticsTexture = NULL;
+    meshUploadTime  = 0;
+    super::ReleaseGraphicsResources(win);
+}
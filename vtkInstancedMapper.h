@@ -0,0 +1,196 @@
+/*
+ * Instanced mapper
+ *
+ * Draws one mesh many times in a single glDrawElementsInstanced call, in
+ * the spirit of VTK's glyph mapper. Each instance has its own model matrix
+ * and diffuse colour, stored in a per-instance vertex buffer; the actor's
+ * own matrix is applied on top of every instance. Uses GLSL 1.50 and
+ * instanced arrays only, so it runs on core profiles and on Mesa llvmpipe.
+ * The scene lights come from the renderer's shared LightingBlock.
+ *
+ * Normals are transformed by the inverse transpose of the model matrix,
+ * so instances may be scaled unevenly.
+ *
+ * Instances of fish meshes can also swim: the vertex shader sways the
+ * body from side to side by a per-instance phase, speed and amplitude, so
+ * animating any number of fish costs no CPU vertex work and no uploads.
+ *
+ * Given levels of detail, each instance picks its own level by its size on
+ * screen. Instances are grouped by level in the instance buffer and each
+ * level is one instanced draw of its own mesh, its vertex array pointing
+ * at the level's run of instances.
+ *
+ * Quantized, meshes go to the GPU as MeshOptimizer::Quantize() packs
+ * them, at half the vertex memory, decoded in the vertex shader.
+ *
+ * Mesh buffers come from MeshBuffers, so every instanced mapper drawing a
+ * mesh in a window shares one copy of it on the GPU.
+ *
+ * Given a CausticsAtlas, the surfaces drawn are lit by caustics too: each
+ * fragment's world position is projected along the caustics' direction
+ * onto the atlas, which repeats every tile world units, and the two
+ * frames either side of the moment are blended. Surfaces facing away from
+ * the light get none. The atlas texture comes from CausticsTexture.
+ */
+
+#ifndef FISHTANK_VTKINSTANCEDMAPPER_H
+#define FISHTANK_VTKINSTANCEDMAPPER_H
+
+#include "CausticsAtlas.h"
+#include "CausticsTexture.h"
+#include "GLUtilities.h"
+#include "LightingBlock.h"
+#include "MeshBuffers.h"
+
+#include <vtkActor.h>
+#include <vtkMatrix4x4.h>
+#include <vtkObjectFactory.h>
+#include <vtkOpenGLPolyDataMapper.h>
+#include <vtkPolyData.h>
+#include <vtkRenderer.h>
+#include <vtkSmartPointer.h>
+#include <vtkWindow.h>
+
+#include <memory>
+#include <vector>
+
+class vtkInstancedMapper : public vtkOpenGLPolyDataMapper
+{
+    private:
+        typedef vtkOpenGLPolyDataMapper super;
+
+    public:
+        static vtkInstancedMapper *New();
+
+        vtkInstancedMapper();
+        ~vtkInstancedMapper();
+
+        /* Instances are appended in draw order; matrices are VTK row-major */
+        void AddInstance(const vtkMatrix4x4 *matrix, const double color[3]);
+        void SetInstance(int index, const vtkMatrix4x4 *matrix, const double color[3]);
+        void RemoveAllInstances();
+        int  GetNumberOfInstances() const { return (int)instanceColors.size() / 4; }
+
+        /* Bulk access for callers that rewrite every instance each frame:
+         * size the arrays, write column-major matrices and RGBA colours
+         * through the pointers, then call InstancesModified() */
+        void   SetNumberOfInstances(int count);
+        float *GetInstanceMatrixPointer(int index) { return &instanceMatrices[index * 16]; }
+        float *GetInstanceColorPointer(int index) { return &instanceColors[index * 4]; }
+        float *GetInstanceSwimPointer(int index) { return &instanceSwim[index * 4]; }
+        void   InstancesModified();
+
+        /* Sway a mesh whose nose points along +z: phase in radians, speed
+         * in tail beats per second, amplitude as a fraction of the body
+         * length. Instances start with zero amplitude, which is rigid. */
+        void SetInstanceSwim(int index, float phase, float speed, float amplitude);
+
+        /* Change a swimming instance's speed and amplitude mid-stroke: its
+         * phase is turned so that it carries on from where it is now */
+        void SetInstanceSwimSpeed(int index, float speed, float amplitude);
+
+        /* Report these bounds instead of scanning every instance, for
+         * instances that move each frame within a known region */
+        void SetFixedBounds(const double bounds[6]);
+
+        /* Coarser meshes for instances small on screen, finest first;
+         * levels[0] is the input itself. Setting them again after a render
+         * frees the old levels' buffers at the next one. */
+        void SetLevels(const std::vector<vtkSmartPointer<vtkPolyData> > &levels);
+
+        /* Upload 16-bit positions and octahedral normals instead of floats.
+         * Set before the first render. */
+        void SetQuantized(bool enabled) { quantized = enabled; }
+        bool GetQuantized() const { return quantized; }
+
+        /* Light with caustics from the atlas, falling along direction, in
+         * colour times the atlas's light, one loop every period seconds;
+         * a null atlas turns them off, as they start */
+        void SetCaustics(const std::shared_ptr<const CausticsAtlas> &atlas, const double direction[3], double tile,
+                         const double color[3], double period);
+        bool HasCaustics() const { return causticsAtlas != NULL; }
+
+        /* Instances drawn at a level last frame */
+        int GetNumberOfInstancesAtLevel(int level) const { return meshLevels[level].count; }
+        int GetNumberOfLevels() const { return (int)meshLevels.size(); }
+
+        /* Triangles of every instance at the level it was last drawn at */
+        vtkIdType GetNumberOfDrawnTriangles() const;
+
+        virtual void RenderPiece(vtkRenderer *ren, vtkActor *act);
+        virtual void ReleaseGraphicsResources(vtkWindow *win);
+
+        /* Union of the mesh bounds under every instance matrix */
+        virtual double *GetBounds();
+        virtual void GetBounds(double bounds[6]) { super::GetBounds(bounds); }
+
+    protected:
+        /* A mesh, its buffers and the vertex array that draws it, with the
+         * run of the instance buffer drawn at this level */
+        struct MeshLevel
+        {
+            vtkSmartPointer<vtkPolyData> mesh;     /* null for the input */
+            GLuint                       vertexArray;
+            MeshBuffers                 *buffers;   /* null until uploaded */
+            int                          first;
+            int                          count;
+        };
+
+        void UploadMesh(MeshLevel &level, vtkPolyData *mesh, vtkRenderWindow *window);
+        static void ReleaseLevel(MeshLevel &level);
+        void UploadInstances();
+
+        /* Choose every instance's level; true when any changed */
+        bool AssignLevels(vtkRenderer *ren, vtkActor *act);
+
+        std::vector<float> instanceMatrices;   /* 16 floats, column-major */
+        std::vector<float> instanceColors;     /* 4 floats per instance */
+        std::vector<float> instanceSwim;       /* phase at swimEpoch, speed, amplitude, unused */
+        double             swimEpoch;          /* when the shader's swim time is zero */
+        bool               instancesModified;
+        bool               useFixedBounds;
+        double             fixedBounds[6];
+        vtkMTimeType       meshUploadTime;
+
+        std::vector<MeshLevel>   meshLevels;       /* never empty */
+        std::vector<MeshLevel>   retiredLevels;    /* replaced since the last render */
+        std::vector<signed char> instanceLevels;   /* -1 until first drawn */
+        std::vector<float>       groupedMatrices;  /* upload order when levels differ */
+        std::vector<float>       groupedColors;
+        std::vector<float>       groupedSwim;
+
+        GLuint         program;
+        GLint          worldToClipLocation;
+        GLint          actorMatrixLocation;
+        GLint          ambientColorLocation;
+        GLint          ambientIntensityLocation;
+        GLint          diffuseIntensityLocation;
+        GLint          swimTimeLocation;
+        GLint          spineLocation;
+        GLint          positionScaleLocation;
+        GLint          positionOffsetLocation;
+        GLint          octahedralLocation;
+        GLint          causticsOnLocation;
+        GLint          causticsDirectionLocation;
+        GLint          causticsAxisULocation;
+        GLint          causticsAxisVLocation;
+        GLint          causticsColorLocation;
+        GLint          causticsFramesLocation;
+        GLuint         instanceBuffer;
+        LightingBlock *lighting;
+        bool           programFailed;
+        bool           quantized;
+
+        std::shared_ptr<const CausticsAtlas> causticsAtlas;
+        CausticsTexture                     *causticsTexture;   /* null until first drawn */
+        float                                causticsDirection[3];
+        float                                causticsAxes[6];    /* u then v, over the tile */
+        float                                causticsColor[3];   /* times the atlas's intensity scale */
+        double                               causticsPeriod;
+
+    private:
+        vtkInstancedMapper(const vtkInstancedMapper &);
+        void operator=(const vtkInstancedMapper &);
+};
+
+#endif
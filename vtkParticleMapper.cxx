@@ -0,0 +1,232 @@
+/*
+ * Particle mapper
+ */
+
+#include "vtkParticleMapper.h"
+
+#include "Profiler.h"
+
+#include <vtkCamera.h>
+#include <vtkMatrix4x4.h>
+
+#include <iostream>
+
+vtkStandardNewMacro(vtkParticleMapper);
+
+namespace
+{
+enum
+{
+    X_LOCATION      = 0,
+    Y_LOCATION      = 1,
+    Z_LOCATION      = 2,
+    RADIUS_LOCATION = 3,
+    COLOR_LOCATION  = 4
+};
+
+/* A sphere of radius r at clip depth w covers r * P11 * height / w pixels
+ * across, P11 being the projection's vertical scale; pointScale holds
+ * P11 * height. Orthographic projections have w = 1, which also fits. */
+const char *VERTEX_SHADER =
+    "#version 150\n"
+    "in float particleX;\n"
+    "in float particleY;\n"
+    "in float particleZ;\n"
+    "in float particleRadius;\n"
+    "in vec4 particleColor;\n"
+    "uniform mat4 worldToClip;\n"
+    "uniform float pointScale;\n"
+    "out vec4 color;\n"
+    "void main()\n"
+    "{\n"
+    "    gl_Position  = worldToClip * vec4(particleX, particleY, particleZ, 1.0);\n"
+    "    gl_PointSize = particleRadius * pointScale / max(gl_Position.w, 1e-6);\n"
+    "    color = particleColor;\n"
+    "}\n";
+
+/* Added onto the scene, so black is transparent; the highlight sits up and
+ * to the left, gl_PointCoord running top to bottom */
+const char *FRAGMENT_SHADER =
+    "#version 150\n"
+    "in vec4 color;\n"
+    "out vec4 fragOutput0;\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 p = gl_PointCoord * 2.0 - 1.0;\n"
+    "    float d2 = dot(p, p);\n"
+    "    if (d2 > 1.0)\n"
+    "        discard;\n"
+    "    float rim   = 0.15 + 0.85 * d2 * d2;\n"
+    "    float soft  = 1.0 - d2;\n"
+    "    float spot  = color.a * smoothstep(0.3, 0.0, length(p - vec2(-0.35, -0.35)));\n"
+    "    fragOutput0 = vec4(0.6 * color.rgb * mix(soft, rim, color.a) + vec3(0.8 * spot), 0.0);\n"
+    "}\n";
+}
+
+vtkParticleMapper::vtkParticleMapper()
+{
+    particles       = NULL;
+    uploadedVersion = 0;
+    bufferCapacity  = 0;
+    program         = 0;
+    vertexArray     = 0;
+    particleBuffer  = 0;
+    programFailed   = false;
+}
+
+vtkParticleMapper::~vtkParticleMapper()
+{
+    /* GL objects must already be gone via ReleaseGraphicsResources; the
+     * context may not be current here */
+}
+
+void vtkParticleMapper::SetParticles(const ParticleSystem *system)
+{
+    particles       = system;
+    uploadedVersion = 0;
+    this->Modified();
+}
+
+double *vtkParticleMapper::GetBounds()
+{
+    if (!particles)
+    {
+        this->Bounds[0] = this->Bounds[2] = this->Bounds[4] = 1;
+        this->Bounds[1] = this->Bounds[3] = this->Bounds[5] = -1;
+        return this->Bounds;
+    }
+    for (int c = 0; c < 3; c++)
+    {
+        this->Bounds[2 * c]     = particles->GetBoundsMin()[c];
+        this->Bounds[2 * c + 1] = particles->GetBoundsMax()[c];
+    }
+    return this->Bounds;
+}
+
+/* One block per attribute, each the system's capacity long, so the live
+ * particles are a prefix of every block and a frame's upload is a copy of
+ * five prefixes into storage allocated once */
+void vtkParticleMapper::Upload()
+{
+    int capacity = particles->GetCapacity();
+    size_t block = (size_t)capacity * sizeof(float);
+    if (capacity != bufferCapacity)
+    {
+        glBindVertexArray(vertexArray);
+        glBindBuffer(GL_ARRAY_BUFFER, particleBuffer);
+        glBufferData(GL_ARRAY_BUFFER, 5 * block, NULL, GL_STREAM_DRAW);
+        const GLuint floats[4] = { X_LOCATION, Y_LOCATION, Z_LOCATION, RADIUS_LOCATION };
+        for (int a = 0; a < 4; a++)
+        {
+            glEnableVertexAttribArray(floats[a]);
+            glVertexAttribPointer(floats[a], 1, GL_FLOAT, GL_FALSE, sizeof(float), (void *)(a * block));
+        }
+        glEnableVertexAttribArray(COLOR_LOCATION);
+        glVertexAttribPointer(COLOR_LOCATION, 4, GL_UNSIGNED_BYTE, GL_TRUE, 4, (void *)(4 * block));
+        glBindVertexArray(0);
+        bufferCapacity = capacity;
+    }
+
+    size_t live = (size_t)particles->GetNumberOfParticles() * sizeof(float);
+    glBindBuffer(GL_ARRAY_BUFFER, particleBuffer);
+    if (live)
+    {
+        glBufferSubData(GL_ARRAY_BUFFER, 0, live, particles->GetPositionX());
+        glBufferSubData(GL_ARRAY_BUFFER, block, live, particles->GetPositionY());
+        glBufferSubData(GL_ARRAY_BUFFER, 2 * block, live, particles->GetPositionZ());
+        glBufferSubData(GL_ARRAY_BUFFER, 3 * block, live, particles->GetRadius());
+        glBufferSubData(GL_ARRAY_BUFFER, 4 * block, live, particles->GetColors());
+    }
+    uploadedVersion = particles->GetVersion();
+}
+
+void vtkParticleMapper::RenderPiece(vtkRenderer *ren, vtkActor *)
+{
+    if (!particles || particles->GetCapacity() == 0 || programFailed)
+        return;
+    ScopedTimer timer("draw:particles");
+
+    if (!program)
+    {
+        GLUtilities::AttributeBindings attributes;
+        attributes.push_back(std::make_pair((GLuint)X_LOCATION, "particleX"));
+        attributes.push_back(std::make_pair((GLuint)Y_LOCATION, "particleY"));
+        attributes.push_back(std::make_pair((GLuint)Z_LOCATION, "particleZ"));
+        attributes.push_back(std::make_pair((GLuint)RADIUS_LOCATION, "particleRadius"));
+        attributes.push_back(std::make_pair((GLuint)COLOR_LOCATION, "particleColor"));
+        std::string log;
+        program = GLUtilities::BuildProgram(VERTEX_SHADER, FRAGMENT_SHADER, attributes, log);
+        if (!program)
+        {
+            std::cerr << "vtkParticleMapper: " << log << std::endl;
+            programFailed = true;
+            return;
+        }
+        worldToClipLocation = glGetUniformLocation(program, "worldToClip");
+        pointScaleLocation  = glGetUniformLocation(program, "pointScale");
+        glGenVertexArrays(1, &vertexArray);
+        glGenBuffers(1, &particleBuffer);
+        bufferCapacity  = 0;
+        uploadedVersion = 0;
+    }
+    if (bufferCapacity != particles->GetCapacity() || uploadedVersion != particles->GetVersion())
+        Upload();
+    int count = particles->GetNumberOfParticles();
+    if (count == 0)
+        return;
+
+    float worldToClip[16];
+    GLUtilities::GetWorldToClip(ren, worldToClip);
+    int width, height, x, y;
+    ren->GetTiledSizeAndOrigin(&width, &height, &x, &y);
+    vtkMatrix4x4 *projection = ren->GetActiveCamera()->GetProjectionTransformMatrix(
+        ren->GetTiledAspectRatio(), -1, 1);
+    float pointScale = (float)(projection->GetElement(1, 1) * height);
+
+    GLboolean blend = glIsEnabled(GL_BLEND);
+    GLboolean pointSize = glIsEnabled(GL_PROGRAM_POINT_SIZE);
+    GLboolean depthMask;
+    GLint blendFunc[4];
+    glGetBooleanv(GL_DEPTH_WRITEMASK, &depthMask);
+    glGetIntegerv(GL_BLEND_SRC_RGB, &blendFunc[0]);
+    glGetIntegerv(GL_BLEND_DST_RGB, &blendFunc[1]);
+    glGetIntegerv(GL_BLEND_SRC_ALPHA, &blendFunc[2]);
+    glGetIntegerv(GL_BLEND_DST_ALPHA, &blendFunc[3]);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glDepthMask(GL_FALSE);
+    glEnable(GL_PROGRAM_POINT_SIZE);
+
+    glUseProgram(program);
+    glUniformMatrix4fv(worldToClipLocation, 1, GL_FALSE, worldToClip);
+    glUniform1f(pointScaleLocation, pointScale);
+    glBindVertexArray(vertexArray);
+    glDrawArrays(GL_POINTS, 0, count);
+    glBindVertexArray(0);
+
+    if (!pointSize)
+        glDisable(GL_PROGRAM_POINT_SIZE);
+    glDepthMask(depthMask);
+    glBlendFuncSeparate(blendFunc[0], blendFunc[1], blendFunc[2], blendFunc[3]);
+    if (!blend)
+        glDisable(GL_BLEND);
+
+    GLUtilities::ReleaseVTKShader(ren);
+}
+
+void vtkParticleMapper::ReleaseGraphicsResources(vtkWindow *win)
+{
+    if (program)
+    {
+        glDeleteProgram(program);
+        glDeleteVertexArrays(1, &vertexArray);
+        glDeleteBuffers(1, &particleBuffer);
+    }
+    program         = 0;
+    vertexArray     = 0;
+    particleBuffer  = 0;
+    bufferCapacity  = 0;
+    uploadedVersion = 0;
+    super::ReleaseGraphicsResources(win);
+}
@@ -0,0 +1,74 @@
+/*
+ * Particle mapper
+ *
+ * Draws every live particle of a ParticleSystem as a point sprite, in one
+ * glDrawArrays(GL_POINTS) call. Positions, radii and colours are uploaded
+ * each frame into one buffer sized for the system's capacity, so the
+ * buffer is allocated once; only the live particles are copied. The vertex
+ * shader sizes each point by its radius and distance, and the fragment
+ * shader cuts it into a disc. A colour's alpha picks the look: a bubble,
+ * clear in the middle and bright at the rim with a highlight, at 255,
+ * fading to a soft dot at 0.
+ *
+ * Particles are added onto the colour behind them and leave depth alone,
+ * so they need no sorting and any order of drawing gives the same picture,
+ * while solid objects in front still hide them.
+ *
+ * Particles are in world coordinates; the actor's matrix is not applied.
+ * The mapper's input is only a placeholder: set an empty polydata.
+ */
+
+#ifndef FISHTANK_VTKPARTICLEMAPPER_H
+#define FISHTANK_VTKPARTICLEMAPPER_H
+
+#include "GLUtilities.h"
+#include "ParticleSystem.h"
+
+#include <vtkActor.h>
+#include <vtkObjectFactory.h>
+#include <vtkOpenGLPolyDataMapper.h>
+#include <vtkRenderer.h>
+#include <vtkWindow.h>
+
+class vtkParticleMapper : public vtkOpenGLPolyDataMapper
+{
+    private:
+        typedef vtkOpenGLPolyDataMapper super;
+
+    public:
+        static vtkParticleMapper *New();
+
+        vtkParticleMapper();
+        ~vtkParticleMapper();
+
+        /* Not owned; must outlive the mapper's rendering */
+        void                  SetParticles(const ParticleSystem *particles);
+        const ParticleSystem *GetParticles() const { return particles; }
+
+        virtual void RenderPiece(vtkRenderer *ren, vtkActor *act);
+        virtual void ReleaseGraphicsResources(vtkWindow *win);
+
+        /* The particle system's bounds */
+        virtual double *GetBounds();
+        virtual void GetBounds(double bounds[6]) { super::GetBounds(bounds); }
+
+    protected:
+        void Upload();
+
+        const ParticleSystem *particles;
+        unsigned long long    uploadedVersion;
+        int                   bufferCapacity;
+
+        GLuint program;
+        GLint  worldToClipLocation;
+        GLint  pointScaleLocation;
+        GLuint vertexArray;
+        GLuint particleBuffer;
+        bool   programFailed;
+
+    private:
+        vtkParticleMapper(const vtkParticleMapper &);
+        void operator=(const vtkParticleMapper &);
+};
+
+#endif
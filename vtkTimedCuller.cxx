@@ -0,0 +1,17 @@
+/*
+ * Timed culler
+ */
+
+#include "vtkTimedCuller.h"
+
+#include "Profiler.h"
+
+vtkStandardNewMacro(vtkTimedCuller);
+
+double vtkTimedCuller::Cull(vtkRenderer *ren, vtkProp **propList, int &listLength, int &initialized)
+{
+    if (!culler)
+        return 0;
+    ScopedTimer timer("cull");
+    return culler->Cull(ren, propList, listLength, initialized);
+}
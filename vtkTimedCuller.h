@@ -0,0 +1,40 @@
+/*
+ * Timed culler
+ *
+ * Wraps another culler and reports the time it spends to the Profiler as
+ * the "cull" stage, so culling shows up separately from drawing.
+ */
+
+#ifndef FISHTANK_VTKTIMEDCULLER_H
+#define FISHTANK_VTKTIMEDCULLER_H
+
+#include <vtkCuller.h>
+#include <vtkObjectFactory.h>
+#include <vtkProp.h>
+#include <vtkRenderer.h>
+#include <vtkSmartPointer.h>
+
+class vtkTimedCuller : public vtkCuller
+{
+    private:
+        typedef vtkCuller super;
+
+    public:
+        static vtkTimedCuller *New();
+
+        void       SetCuller(vtkCuller *wrapped) { culler = wrapped; }
+        vtkCuller *GetCuller() const { return culler; }
+
+        virtual double Cull(vtkRenderer *ren, vtkProp **propList, int &listLength, int &initialized);
+
+    protected:
+        vtkTimedCuller() {}
+
+        vtkSmartPointer<vtkCuller> culler;
+
+    private:
+        vtkTimedCuller(const vtkTimedCuller &);
+        void operator=(const vtkTimedCuller &);
+};
+
+#endif